@@ -0,0 +1,232 @@
+
+#include "options.h"
+
+#include <nebase/evdp/base.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#if defined(OS_LINUX)
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+#endif
+
+static neb_evdp_timer_t bench_queue_timer = NULL;
+static neb_evdp_source_t bench_queue_dst = NULL;
+
+static const char *syscalls_source = NULL;
+#if defined(OS_LINUX)
+static int perf_fd = -1;
+#endif
+
+int64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#if defined(OS_LINUX)
+static int open_tracepoint(void)
+{
+	static const char *paths[] = {
+		"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+		"/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+	};
+	long long id = -1;
+	for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]) && id < 0; i++) {
+		FILE *f = fopen(paths[i], "r");
+		if (!f)
+			continue;
+		if (fscanf(f, "%lld", &id) != 1)
+			id = -1;
+		fclose(f);
+	}
+	if (id < 0)
+		return -1;
+
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.size = sizeof(attr);
+	attr.config = id;
+	attr.inherit = 1; // count the threads created later
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+#endif
+
+const char *bench_syscalls_open(void)
+{
+#if defined(OS_LINUX)
+	perf_fd = open_tracepoint();
+	if (perf_fd >= 0)
+		syscalls_source = "tracepoint";
+#endif
+	return syscalls_source;
+}
+
+void bench_syscalls_close(void)
+{
+#if defined(OS_LINUX)
+	if (perf_fd >= 0) {
+		close(perf_fd);
+		perf_fd = -1;
+	}
+#endif
+	syscalls_source = NULL;
+}
+
+static int64_t syscalls_read(void)
+{
+#if defined(OS_LINUX)
+	if (perf_fd >= 0) {
+		uint64_t count;
+		if (read(perf_fd, &count, sizeof(count)) != sizeof(count))
+			return -1;
+		return count;
+	}
+#endif
+	return -1;
+}
+
+void bench_stats_start(struct bench_stats *st)
+{
+	st->events = 0;
+	st->lat_count = 0;
+	st->syscalls_start = syscalls_read();
+	st->start_ns = bench_now_ns();
+	st->end_ns = st->start_ns;
+}
+
+void bench_stats_stop(struct bench_stats *st)
+{
+	st->end_ns = bench_now_ns();
+	st->syscalls_end = syscalls_read();
+}
+
+void bench_stats_add_lat(struct bench_stats *st, int64_t ns)
+{
+	if (st->lat_count == st->lat_size) {
+		size_t size = st->lat_size ? st->lat_size * 2 : 65536;
+		uint32_t *p = realloc(st->lat_ns, size * sizeof(uint32_t));
+		if (!p)
+			return; // drop the sample
+		st->lat_ns = p;
+		st->lat_size = size;
+	}
+	if (ns < 0)
+		ns = 0;
+	st->lat_ns[st->lat_count++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+void bench_stats_report(const char *scenario, const struct bench_stats *st, const char *extra)
+{
+	double seconds = (double)(st->end_ns - st->start_ns) / 1e9;
+	double rate = seconds > 0 ? (double)st->events / seconds : 0;
+
+	char p50[32] = "null", p99[32] = "null";
+	if (st->lat_count) {
+		qsort(st->lat_ns, st->lat_count, sizeof(uint32_t), cmp_u32);
+		snprintf(p50, sizeof(p50), "%.3f", st->lat_ns[(st->lat_count - 1) / 2] / 1e3);
+		snprintf(p99, sizeof(p99), "%.3f", st->lat_ns[(st->lat_count - 1) * 99 / 100] / 1e3);
+	}
+
+	char syscalls[32] = "null";
+	if (st->syscalls_start >= 0 && st->syscalls_end >= st->syscalls_start && st->events)
+		snprintf(syscalls, sizeof(syscalls), "%.3f", (double)(st->syscalls_end - st->syscalls_start) / st->events);
+
+	const char *driver = neb_evdp_driver_name();
+	fprintf(stdout, "{\"driver\":\"%s\",\"scenario\":\"%s\",\"events\":%llu,\"seconds\":%.3f,"
+	        "\"events_per_sec\":%.0f,\"p50_us\":%s,\"p99_us\":%s,"
+	        "\"syscalls_per_event\":%s,\"syscalls_source\":%s%s%s%s%s}\n",
+	        driver ? driver : "none", scenario, (unsigned long long)st->events, seconds,
+	        rate, p50, p99, syscalls,
+	        syscalls_source ? "\"" : "", syscalls_source ? syscalls_source : "null", syscalls_source ? "\"" : "",
+	        extra ? "," : "", extra ? extra : "");
+	fflush(stdout);
+}
+
+void bench_stats_free(struct bench_stats *st)
+{
+	free(st->lat_ns);
+	st->lat_ns = NULL;
+	st->lat_count = 0;
+	st->lat_size = 0;
+}
+
+static neb_evdp_cb_ret_t on_duration(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+neb_evdp_queue_t bench_queue_create(const struct bench_opts *o)
+{
+	neb_evdp_queue_t q = neb_evdp_queue_create(o->batch_size);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return NULL;
+	}
+	bench_queue_timer = neb_evdp_timer_create(1024, 65536);
+	if (!bench_queue_timer) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		goto exit_fail;
+	}
+	neb_evdp_queue_set_timer(q, bench_queue_timer);
+
+	bench_queue_dst = neb_evdp_source_new_itimer_ms(1, o->duration_ms, on_duration);
+	if (!bench_queue_dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		goto exit_fail;
+	}
+	if (neb_evdp_queue_attach(q, bench_queue_dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		goto exit_fail;
+	}
+	return q;
+
+exit_fail:
+	bench_queue_destroy(q);
+	return NULL;
+}
+
+void bench_queue_destroy(neb_evdp_queue_t q)
+{
+	if (bench_queue_dst) {
+		if (neb_evdp_source_get_queue(bench_queue_dst) && neb_evdp_queue_detach(q, bench_queue_dst, 0) != 0)
+			fprintf(stderr, "failed to detach itimer_ms source\n");
+		neb_evdp_source_del(bench_queue_dst);
+		bench_queue_dst = NULL;
+	}
+	neb_evdp_queue_destroy(q);
+	if (bench_queue_timer) {
+		neb_evdp_timer_destroy(bench_queue_timer);
+		bench_queue_timer = NULL;
+	}
+}
+
+int bench_raise_nofile(int want)
+{
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == -1)
+		return 1024;
+	if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < (rlim_t)want) {
+		rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= (rlim_t)want) ? (rlim_t)want : rl.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &rl) == -1 && getrlimit(RLIMIT_NOFILE, &rl) == -1)
+			return 1024;
+	}
+	if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > (rlim_t)want)
+		return want;
+	return (int)rl.rlim_cur;
+}
@@ -0,0 +1,80 @@
+#ifndef NEB_BENCH_EVDP_BENCH_H
+#define NEB_BENCH_EVDP_BENCH_H 1
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/types.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct bench_opts {
+	int batch_size;   // queue batch size, 0 for the default one
+	int duration_ms;  // run time of each scenario
+	int conns;        // fan-in connections
+	int idle_fds;     // watched fds in the idle scenario, 1% of them are active
+	int timer_points; // points in the timer churn scenario
+	int churn_fds;    // fds in the attach/detach churn scenario
+};
+
+struct bench_stats {
+	uint64_t events;
+	int64_t start_ns;
+	int64_t end_ns;
+	int64_t syscalls_start;
+	int64_t syscalls_end;
+	uint32_t *lat_ns; // latency samples, saturated at UINT32_MAX
+	size_t lat_count;
+	size_t lat_size;
+};
+
+extern int64_t bench_now_ns(void);
+
+/**
+ * \brief open the syscall counter, which is the raw_syscalls:sys_enter
+ *        tracepoint on Linux, so tracefs and perf_event permission is required
+ * \return the name of the counter source, or NULL if not available
+ */
+extern const char *bench_syscalls_open(void);
+extern void bench_syscalls_close(void);
+
+extern void bench_stats_start(struct bench_stats *st)
+	_nattr_nonnull((1));
+extern void bench_stats_stop(struct bench_stats *st)
+	_nattr_nonnull((1));
+extern void bench_stats_add_lat(struct bench_stats *st, int64_t ns)
+	_nattr_nonnull((1));
+/**
+ * \brief print the result as one json line
+ * \param[in] extra extra json members without the leading comma, or NULL
+ */
+extern void bench_stats_report(const char *scenario, const struct bench_stats *st, const char *extra)
+	_nattr_nonnull((1, 2));
+extern void bench_stats_free(struct bench_stats *st)
+	_nattr_nonnull((1));
+
+/**
+ * \brief create a queue with timer, which breaks after duration_ms
+ */
+extern neb_evdp_queue_t bench_queue_create(const struct bench_opts *o)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern void bench_queue_destroy(neb_evdp_queue_t q)
+	_nattr_nonnull((1));
+
+/**
+ * \brief raise RLIMIT_NOFILE up to want
+ * \return the number of fds that can be opened
+ */
+extern int bench_raise_nofile(int want);
+
+extern int bench_pingpong(const struct bench_opts *o)
+	_nattr_nonnull((1));
+extern int bench_fanin(const struct bench_opts *o)
+	_nattr_nonnull((1));
+extern int bench_idle(const struct bench_opts *o)
+	_nattr_nonnull((1));
+extern int bench_timer(const struct bench_opts *o)
+	_nattr_nonnull((1));
+extern int bench_churn(const struct bench_opts *o)
+	_nattr_nonnull((1));
+
+#endif
@@ -0,0 +1,159 @@
+
+/*
+ * sources on always readable pipes are removed in the read handler, and
+ * attached again in the batch handler, the latency is from attach to read
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+struct churn_pipe {
+	int fds[2];
+	neb_evdp_source_t s;
+	int64_t attach_ns;
+};
+
+static struct {
+	neb_evdp_queue_t q;
+	struct churn_pipe *pipes;
+	int count;
+	struct churn_pipe **detached;
+	int ndetached;
+	struct bench_stats st;
+} ch;
+
+static neb_evdp_cb_ret_t on_hup(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t on_read(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	struct churn_pipe *p = udata;
+	bench_stats_add_lat(&ch.st, bench_now_ns() - p->attach_ns);
+	ch.st.events++;
+	return NEB_EVDP_CB_REMOVE;
+}
+
+static int on_remove(neb_evdp_source_t s)
+{
+	ch.detached[ch.ndetached++] = neb_evdp_source_get_udata(s);
+	return 0;
+}
+
+static int pipe_attach(struct churn_pipe *p)
+{
+	if (neb_evdp_source_os_fd_next_read(p->s, on_read) != 0)
+		return -1;
+	p->attach_ns = bench_now_ns();
+	return neb_evdp_queue_attach(ch.q, p->s);
+}
+
+static neb_evdp_cb_ret_t on_batch(void *udata _nattr_unused)
+{
+	for (int i = 0; i < ch.ndetached; i++) {
+		if (pipe_attach(ch.detached[i]) != 0) {
+			fprintf(stderr, "failed to attach os_fd source\n");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+	}
+	ch.ndetached = 0;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int bench_churn(const struct bench_opts *o)
+{
+	int ret = 0;
+
+	ch.count = 0;
+	ch.ndetached = 0;
+	int max = (bench_raise_nofile(o->churn_fds * 2 + 64) - 64) / 2;
+	int count = o->churn_fds < max ? o->churn_fds : max;
+	if (count <= 0) {
+		fprintf(stderr, "no enough fds for churn pipes\n");
+		return -1;
+	}
+	ch.pipes = calloc(count, sizeof(struct churn_pipe));
+	ch.detached = calloc(count, sizeof(struct churn_pipe *));
+	if (!ch.pipes || !ch.detached) {
+		perror("calloc");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	ch.q = bench_queue_create(o);
+	if (!ch.q) {
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_batch_handler(ch.q, on_batch);
+	for (; ch.count < count; ch.count++) {
+		struct churn_pipe *p = ch.pipes + ch.count;
+		if (pipe(p->fds) == -1) {
+			perror("pipe");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (fcntl(p->fds[0], F_SETFL, O_NONBLOCK) == -1 || write(p->fds[1], "x", 1) != 1) {
+			perror("pipe setup");
+			ch.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+		p->s = neb_evdp_source_new_os_fd(p->fds[0], on_hup);
+		if (!p->s) {
+			fprintf(stderr, "failed to create os_fd source\n");
+			ch.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(p->s, p);
+		neb_evdp_source_set_on_remove(p->s, on_remove);
+		if (pipe_attach(p) != 0) {
+			fprintf(stderr, "failed to attach os_fd source\n");
+			ch.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	bench_stats_start(&ch.st);
+	if (neb_evdp_queue_run(ch.q) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	bench_stats_stop(&ch.st);
+
+	char extra[32];
+	snprintf(extra, sizeof(extra), "\"fds\":%d", ch.count);
+	bench_stats_report("churn", &ch.st, extra);
+
+exit_clean:
+	for (int i = 0; i < ch.count; i++) {
+		struct churn_pipe *p = ch.pipes + i;
+		if (p->s) {
+			if (neb_evdp_source_get_queue(p->s) && neb_evdp_queue_detach(ch.q, p->s, 0) != 0)
+				fprintf(stderr, "failed to detach os_fd source\n");
+			neb_evdp_source_del(p->s);
+		}
+		close(p->fds[0]);
+		close(p->fds[1]);
+	}
+	free(ch.pipes);
+	ch.pipes = NULL;
+	free(ch.detached);
+	ch.detached = NULL;
+	if (ch.q)
+		bench_queue_destroy(ch.q);
+	ch.q = NULL;
+	bench_stats_free(&ch.st);
+	return ret;
+}
@@ -0,0 +1,199 @@
+
+/*
+ * a writer thread sends timestamped messages over many connections, and the
+ * queue reads all of them, the latency is from send to read
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define FANIN_MSG_SIZE 64
+#define FANIN_READ_MAX 32
+
+struct fanin_conn {
+	int fds[2]; // 0 for the queue, 1 for the writer
+	neb_evdp_source_t s;
+};
+
+static struct {
+	struct fanin_conn *conns;
+	int count;
+	atomic_int stop;
+	struct bench_stats st;
+	uint64_t calls;
+} fi;
+
+static void *writer_main(void *arg _nattr_unused)
+{
+	char msg[FANIN_MSG_SIZE];
+	memset(msg, 0, sizeof(msg));
+	struct pollfd *pfds = calloc(fi.count, sizeof(struct pollfd));
+	if (!pfds)
+		return NULL;
+	for (int i = 0; i < fi.count; i++) {
+		pfds[i].fd = fi.conns[i].fds[1];
+		pfds[i].events = POLLOUT;
+	}
+
+	while (!atomic_load(&fi.stop)) {
+		int sent = 0;
+		for (int i = 0; i < fi.count; i++) {
+			int64_t now = bench_now_ns();
+			memcpy(msg, &now, sizeof(now));
+			if (send(fi.conns[i].fds[1], msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(msg))
+				sent++;
+			else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				goto exit_thread;
+		}
+		if (!sent && poll(pfds, fi.count, 10) == -1 && errno != EINTR)
+			break;
+	}
+
+exit_thread:
+	free(pfds);
+	return NULL;
+}
+
+static neb_evdp_cb_ret_t on_hup(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t on_read(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_source_t s = udata;
+	char msg[FANIN_MSG_SIZE];
+	fi.calls++;
+	for (int i = 0; i < FANIN_READ_MAX; i++) {
+		ssize_t nr = recv(fd, msg, sizeof(msg), 0);
+		if (nr == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				break;
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		if (nr != sizeof(msg))
+			return NEB_EVDP_CB_BREAK_ERR;
+		int64_t sent;
+		memcpy(&sent, msg, sizeof(sent));
+		bench_stats_add_lat(&fi.st, bench_now_ns() - sent);
+		fi.st.events++;
+	}
+	if (neb_evdp_source_os_fd_next_read(s, on_read) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int bench_fanin(const struct bench_opts *o)
+{
+	int ret = 0;
+	neb_evdp_queue_t q = NULL;
+	pthread_t writer;
+	int writer_started = 0;
+
+	fi.count = 0;
+	fi.calls = 0;
+	atomic_store(&fi.stop, 0);
+	int max = (bench_raise_nofile(o->conns * 2 + 64) - 64) / 2;
+	int count = o->conns < max ? o->conns : max;
+	if (count <= 0) {
+		fprintf(stderr, "no enough fds for fan-in connections\n");
+		return -1;
+	}
+	fi.conns = calloc(count, sizeof(struct fanin_conn));
+	if (!fi.conns) {
+		perror("calloc");
+		return -1;
+	}
+
+	q = bench_queue_create(o);
+	if (!q) {
+		ret = -1;
+		goto exit_clean;
+	}
+	for (; fi.count < count; fi.count++) {
+		struct fanin_conn *c = fi.conns + fi.count;
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, c->fds) == -1) {
+			perror("socketpair");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (fcntl(c->fds[0], F_SETFL, O_NONBLOCK) == -1) {
+			perror("fcntl");
+			fi.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+		c->s = neb_evdp_source_new_os_fd(c->fds[0], on_hup);
+		if (!c->s) {
+			fprintf(stderr, "failed to create os_fd source\n");
+			fi.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(c->s, c->s);
+		if (neb_evdp_source_os_fd_next_read(c->s, on_read) != 0 || neb_evdp_queue_attach(q, c->s) != 0) {
+			fprintf(stderr, "failed to attach os_fd source\n");
+			fi.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	bench_stats_start(&fi.st);
+	if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+		fprintf(stderr, "failed to create writer thread\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	writer_started = 1;
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	atomic_store(&fi.stop, 1);
+	pthread_join(writer, NULL);
+	writer_started = 0;
+	bench_stats_stop(&fi.st);
+
+	char extra[64];
+	snprintf(extra, sizeof(extra), "\"conns\":%d,\"events_per_wakeup\":%.2f",
+	         fi.count, fi.calls ? (double)fi.st.events / fi.calls : 0.0);
+	bench_stats_report("fanin", &fi.st, extra);
+
+exit_clean:
+	if (writer_started) {
+		atomic_store(&fi.stop, 1);
+		pthread_join(writer, NULL);
+	}
+	for (int i = 0; i < fi.count; i++) {
+		struct fanin_conn *c = fi.conns + i;
+		if (c->s) {
+			if (neb_evdp_source_get_queue(c->s) && neb_evdp_queue_detach(q, c->s, 0) != 0)
+				fprintf(stderr, "failed to detach os_fd source\n");
+			neb_evdp_source_del(c->s);
+		}
+		close(c->fds[0]);
+		close(c->fds[1]);
+	}
+	free(fi.conns);
+	fi.conns = NULL;
+	if (q)
+		bench_queue_destroy(q);
+	bench_stats_free(&fi.st);
+	return ret;
+}
@@ -0,0 +1,152 @@
+
+/*
+ * lots of watched idle fds with 1% of them active, each active pipe writes a
+ * timestamp to itself after read, the latency is from write to read
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define IDLE_ACTIVE_STEP 100
+
+struct idle_pipe {
+	int fds[2];
+	neb_evdp_source_t s;
+};
+
+static struct {
+	struct idle_pipe *pipes;
+	int count;
+	int started;
+	struct bench_stats st;
+} ip;
+
+static int write_ts(int fd)
+{
+	int64_t now = bench_now_ns();
+	return write(fd, &now, sizeof(now)) == sizeof(now) ? 0 : -1;
+}
+
+static neb_evdp_cb_ret_t on_hup(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t on_read(int fd, void *udata, const void *context _nattr_unused)
+{
+	struct idle_pipe *p = udata;
+	int64_t sent;
+	if (read(fd, &sent, sizeof(sent)) != sizeof(sent))
+		return NEB_EVDP_CB_BREAK_ERR;
+	if (!ip.started) { // all fds are added to the driver now
+		ip.started = 1;
+		bench_stats_start(&ip.st);
+	} else {
+		bench_stats_add_lat(&ip.st, bench_now_ns() - sent);
+		ip.st.events++;
+	}
+	if (write_ts(p->fds[1]) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	if (neb_evdp_source_os_fd_next_read(p->s, on_read) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int bench_idle(const struct bench_opts *o)
+{
+	int ret = 0;
+	neb_evdp_queue_t q = NULL;
+
+	ip.count = 0;
+	ip.started = 0;
+	int max = (bench_raise_nofile(o->idle_fds * 2 + 64) - 64) / 2;
+	int count = o->idle_fds < max ? o->idle_fds : max;
+	if (count <= 0) {
+		fprintf(stderr, "no enough fds for idle pipes\n");
+		return -1;
+	}
+	ip.pipes = calloc(count, sizeof(struct idle_pipe));
+	if (!ip.pipes) {
+		perror("calloc");
+		return -1;
+	}
+
+	q = bench_queue_create(o);
+	if (!q) {
+		ret = -1;
+		goto exit_clean;
+	}
+	for (; ip.count < count; ip.count++) {
+		struct idle_pipe *p = ip.pipes + ip.count;
+		if (pipe(p->fds) == -1) {
+			perror("pipe");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (fcntl(p->fds[0], F_SETFL, O_NONBLOCK) == -1) {
+			perror("fcntl");
+			ip.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+		p->s = neb_evdp_source_new_os_fd(p->fds[0], on_hup);
+		if (!p->s) {
+			fprintf(stderr, "failed to create os_fd source\n");
+			ip.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(p->s, p);
+		if (neb_evdp_source_os_fd_next_read(p->s, on_read) != 0 || neb_evdp_queue_attach(q, p->s) != 0) {
+			fprintf(stderr, "failed to attach os_fd source\n");
+			ip.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+		if (ip.count % IDLE_ACTIVE_STEP == 0 && write_ts(p->fds[1]) != 0) {
+			perror("write");
+			ip.count++;
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	bench_stats_start(&ip.st); // restarted by the first event
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	bench_stats_stop(&ip.st);
+
+	char extra[64];
+	snprintf(extra, sizeof(extra), "\"fds\":%d,\"active\":%d",
+	         ip.count, (ip.count + IDLE_ACTIVE_STEP - 1) / IDLE_ACTIVE_STEP);
+	bench_stats_report("idle", &ip.st, extra);
+
+exit_clean:
+	for (int i = 0; i < ip.count; i++) {
+		struct idle_pipe *p = ip.pipes + i;
+		if (p->s) {
+			if (neb_evdp_source_get_queue(p->s) && neb_evdp_queue_detach(q, p->s, 0) != 0)
+				fprintf(stderr, "failed to detach os_fd source\n");
+			neb_evdp_source_del(p->s);
+		}
+		close(p->fds[0]);
+		close(p->fds[1]);
+	}
+	free(ip.pipes);
+	ip.pipes = NULL;
+	if (q)
+		bench_queue_destroy(q);
+	bench_stats_free(&ip.st);
+	return ret;
+}
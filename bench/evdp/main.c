@@ -0,0 +1,136 @@
+
+/*
+ * evdp benchmark, run the scenarios with the selected driver, and print one
+ * json line for each of them
+ */
+
+#include <nebase/evdp/base.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+static const struct {
+	const char *name;
+	int (*run)(const struct bench_opts *o);
+} scenarios[] = {
+	{"pingpong", bench_pingpong},
+	{"fanin", bench_fanin},
+	{"idle", bench_idle},
+	{"timer", bench_timer},
+	{"churn", bench_churn},
+};
+#define SCENARIO_NUM (int)(sizeof(scenarios) / sizeof(scenarios[0]))
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options]\n", prog);
+	fprintf(stderr, "  -d driver    evdp driver to use, default to the one selected by env\n");
+	fprintf(stderr, "  -s scenario  run only this scenario, can be used multiple times\n");
+	fprintf(stderr, "               pingpong, fanin, idle, timer, churn\n");
+	fprintf(stderr, "  -b num       queue batch size, the aio_poll driver needs at least 1/8 of\n");
+	fprintf(stderr, "               the watched fds, i.e. for the idle and churn scenarios\n");
+	fprintf(stderr, "  -t msec      run time of each scenario, default 1000\n");
+	fprintf(stderr, "  -c num       fan-in connections, default 64\n");
+	fprintf(stderr, "  -i num       watched fds of the idle scenario, default 100000\n");
+	fprintf(stderr, "  -p num       timer points of the timer scenario, default 10000\n");
+	fprintf(stderr, "  -f num       fds of the churn scenario, default 1000\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_opts o = {
+		.batch_size = 0,
+		.duration_ms = 1000,
+		.conns = 64,
+		.idle_fds = 100000,
+		.timer_points = 10000,
+		.churn_fds = 1000,
+	};
+	int selected[SCENARIO_NUM] = {0};
+	int any_selected = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:s:b:t:c:i:p:f:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			if (neb_evdp_driver_select(optarg) != 0) {
+				fprintf(stderr, "failed to select driver %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 's':
+		{
+			int found = 0;
+			for (int i = 0; i < SCENARIO_NUM; i++) {
+				if (strcmp(optarg, scenarios[i].name) == 0) {
+					selected[i] = 1;
+					found = 1;
+				}
+			}
+			if (!found) {
+				fprintf(stderr, "unknown scenario %s\n", optarg);
+				return -1;
+			}
+			any_selected = 1;
+		}
+			break;
+		case 'b':
+			o.batch_size = atoi(optarg);
+			break;
+		case 't':
+			o.duration_ms = atoi(optarg);
+			break;
+		case 'c':
+			o.conns = atoi(optarg);
+			break;
+		case 'i':
+			o.idle_fds = atoi(optarg);
+			break;
+		case 'p':
+			o.timer_points = atoi(optarg);
+			break;
+		case 'f':
+			o.churn_fds = atoi(optarg);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+			break;
+		}
+	}
+	if (o.batch_size < 0 || o.duration_ms <= 0 || o.conns <= 0 || o.idle_fds <= 0 || o.timer_points <= 0 || o.churn_fds <= 0) {
+		fprintf(stderr, "invalid options\n");
+		return -1;
+	}
+	if (!neb_evdp_driver_name()) {
+		fprintf(stderr, "no evdp driver is available\n");
+		return -1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	if (!bench_syscalls_open())
+		fprintf(stderr, "syscall counter is not available\n");
+
+	int ret = 0;
+	for (int i = 0; i < SCENARIO_NUM; i++) {
+		if (any_selected && !selected[i])
+			continue;
+		if (scenarios[i].run(&o) != 0) {
+			fprintf(stdout, "{\"driver\":\"%s\",\"scenario\":\"%s\",\"error\":\"failed\"}\n",
+			        neb_evdp_driver_name(), scenarios[i].name);
+			ret = -1;
+		}
+	}
+
+	bench_syscalls_close();
+	return ret;
+}
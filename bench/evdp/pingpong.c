@@ -0,0 +1,129 @@
+
+/*
+ * one byte ping-pong over a socketpair, the latency is the round trip time
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+static struct {
+	int fds[2];
+	neb_evdp_source_t s[2];
+	struct bench_stats st;
+	int64_t sent_ns;
+} pp;
+
+static neb_evdp_cb_ret_t on_hup(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t on_ping(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_source_t s = udata;
+	char c;
+	if (read(fd, &c, 1) != 1 || write(fd, &c, 1) != 1)
+		return NEB_EVDP_CB_BREAK_ERR;
+	pp.st.events++;
+	if (neb_evdp_source_os_fd_next_read(s, on_ping) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t on_pong(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_source_t s = udata;
+	char c;
+	if (read(fd, &c, 1) != 1)
+		return NEB_EVDP_CB_BREAK_ERR;
+	int64_t now = bench_now_ns();
+	bench_stats_add_lat(&pp.st, now - pp.sent_ns);
+	pp.st.events++;
+	pp.sent_ns = now;
+	if (write(fd, &c, 1) != 1)
+		return NEB_EVDP_CB_BREAK_ERR;
+	if (neb_evdp_source_os_fd_next_read(s, on_pong) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int bench_pingpong(const struct bench_opts *o)
+{
+	int ret = 0;
+	neb_evdp_queue_t q = NULL;
+	pp.fds[0] = pp.fds[1] = -1;
+	pp.s[0] = pp.s[1] = NULL;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pp.fds) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		if (fcntl(pp.fds[i], F_SETFL, O_NONBLOCK) == -1) {
+			perror("fcntl");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	q = bench_queue_create(o);
+	if (!q) {
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < 2; i++) {
+		pp.s[i] = neb_evdp_source_new_os_fd(pp.fds[i], on_hup);
+		if (!pp.s[i]) {
+			fprintf(stderr, "failed to create os_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(pp.s[i], pp.s[i]);
+		if (neb_evdp_source_os_fd_next_read(pp.s[i], i ? on_ping : on_pong) != 0 ||
+		    neb_evdp_queue_attach(q, pp.s[i]) != 0) {
+			fprintf(stderr, "failed to attach os_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	bench_stats_start(&pp.st);
+	pp.sent_ns = bench_now_ns();
+	if (write(pp.fds[0], "p", 1) != 1) {
+		perror("write");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	bench_stats_stop(&pp.st);
+	bench_stats_report("pingpong", &pp.st, NULL);
+
+exit_clean:
+	for (int i = 0; i < 2; i++) {
+		if (pp.s[i]) {
+			if (neb_evdp_source_get_queue(pp.s[i]) && neb_evdp_queue_detach(q, pp.s[i], 0) != 0)
+				fprintf(stderr, "failed to detach os_fd source\n");
+			neb_evdp_source_del(pp.s[i]);
+		}
+	}
+	if (q)
+		bench_queue_destroy(q);
+	for (int i = 0; i < 2; i++) {
+		if (pp.fds[i] >= 0)
+			close(pp.fds[i]);
+	}
+	bench_stats_free(&pp.st);
+	return ret;
+}
@@ -0,0 +1,136 @@
+
+/*
+ * timer points are reset after fired, and also reset or replaced before fired
+ * by others, the latency is how late a point is fired in msec resolution
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TIMER_MAX_DELAY 10
+#define TIMER_REPLACE_STEP 16
+
+struct timer_point {
+	neb_evdp_timer_point tp;
+	int64_t due;
+};
+
+static struct {
+	neb_evdp_queue_t q;
+	neb_evdp_timer_t t;
+	struct timer_point *points;
+	int count;
+	struct bench_stats st;
+	uint64_t resets;
+	uint64_t replaces;
+	int failed;
+} tm;
+
+static neb_evdp_timeout_ret_t on_timeout(void *udata);
+
+static int64_t next_due(void)
+{
+	return neb_evdp_queue_get_abs_timeout(tm.q, 1 + rand() % TIMER_MAX_DELAY);
+}
+
+static int point_add(struct timer_point *p)
+{
+	p->due = next_due();
+	p->tp = neb_evdp_timer_new_point(tm.t, p->due, on_timeout, p);
+	return p->tp ? 0 : -1;
+}
+
+static neb_evdp_timeout_ret_t on_timeout(void *udata)
+{
+	struct timer_point *p = udata;
+	int64_t now = neb_evdp_queue_get_abs_timeout(tm.q, 0);
+	bench_stats_add_lat(&tm.st, (now - p->due) * 1000000);
+	tm.st.events++;
+
+	p->due = next_due();
+	if (neb_evdp_timer_point_reset(tm.t, p->tp, p->due) != 0)
+		tm.failed = 1;
+
+	// reset another one before it's fired
+	struct timer_point *o = tm.points + rand() % tm.count;
+	if (o != p) {
+		o->due = next_due();
+		if (neb_evdp_timer_point_reset(tm.t, o->tp, o->due) != 0)
+			tm.failed = 1;
+		tm.resets++;
+	}
+
+	// and replace another one by a new point
+	if (tm.st.events % TIMER_REPLACE_STEP == 0) {
+		o = tm.points + rand() % tm.count;
+		if (o != p) {
+			neb_evdp_timer_del_point(tm.t, o->tp);
+			if (point_add(o) != 0)
+				tm.failed = 1;
+			tm.replaces++;
+		}
+	}
+	return NEB_EVDP_TIMEOUT_KEEP;
+}
+
+int bench_timer(const struct bench_opts *o)
+{
+	int ret = 0;
+
+	tm.count = 0;
+	tm.resets = 0;
+	tm.replaces = 0;
+	tm.failed = 0;
+	tm.points = calloc(o->timer_points, sizeof(struct timer_point));
+	if (!tm.points) {
+		perror("calloc");
+		return -1;
+	}
+	tm.q = bench_queue_create(o);
+	if (!tm.q) {
+		ret = -1;
+		goto exit_clean;
+	}
+	tm.t = neb_evdp_queue_get_timer(tm.q);
+
+	srand(1);
+	for (; tm.count < o->timer_points; tm.count++) {
+		if (point_add(tm.points + tm.count) != 0) {
+			fprintf(stderr, "failed to add timer point\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	bench_stats_start(&tm.st);
+	if (neb_evdp_queue_run(tm.q) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	bench_stats_stop(&tm.st);
+	if (tm.failed) {
+		fprintf(stderr, "failed to reset timer points\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	char extra[96];
+	snprintf(extra, sizeof(extra), "\"points\":%d,\"resets\":%llu,\"replaces\":%llu",
+	         tm.count, (unsigned long long)tm.resets, (unsigned long long)tm.replaces);
+	bench_stats_report("timer", &tm.st, extra);
+
+exit_clean:
+	if (tm.q) // all points are freed with the timer
+		bench_queue_destroy(tm.q);
+	tm.q = NULL;
+	free(tm.points);
+	tm.points = NULL;
+	bench_stats_free(&tm.st);
+	return ret;
+}
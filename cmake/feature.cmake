@@ -32,3 +32,26 @@ if(OS_LINUX)
 else()
   set(USE_IO_URING OFF)
 endif()
+
+set(WITH_EVDP_RUNTIME_DRIVER_DESC "Build all enabled evdp drivers and select one at runtime")
+option(WITH_EVDP_RUNTIME_DRIVER ${WITH_EVDP_RUNTIME_DRIVER_DESC} ON)
+if(OS_LINUX AND (USE_AIO_POLL OR USE_IO_URING))
+  add_feature_info(WITH_EVDP_RUNTIME_DRIVER WITH_EVDP_RUNTIME_DRIVER ${WITH_EVDP_RUNTIME_DRIVER_DESC})
+else()
+  set(WITH_EVDP_RUNTIME_DRIVER OFF)
+endif()
+
+set(WITH_BENCH_DESC "Build the benchmarks")
+option(WITH_BENCH ${WITH_BENCH_DESC} OFF)
+add_feature_info(WITH_BENCH WITH_BENCH ${WITH_BENCH_DESC})
+
+set(WITH_USDT_DESC "Build with USDT probes on evdp hot paths")
+option(WITH_USDT ${WITH_USDT_DESC} ON)
+if(WITH_USDT)
+  include(CheckIncludeFile)
+  CHECK_INCLUDE_FILE("sys/sdt.h" HAVE_SYS_SDT_H)
+  if(NOT HAVE_SYS_SDT_H)
+    set(WITH_USDT OFF)
+  endif()
+endif()
+add_feature_info(WITH_USDT WITH_USDT ${WITH_USDT_DESC})
@@ -4,11 +4,33 @@
 
 #include <nebase/cdefs.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include "types.h"
 
 #define NEB_EVDP_DEFAULT_BATCH_SIZE 10
 
+/*
+ * Driver Functions
+ */
+
+#define NEB_EVDP_DRIVER_ENV "NEB_EVDP_DRIVER"
+
+/**
+ * \brief select the driver by name, i.e. io_uring, aio_poll or epoll on Linux
+ * \return 0 if ok, -1 if the driver is not compiled in, not available in the
+ *         running system, or another driver is already in use
+ * \note all queues and sources share the same driver, so it should be called
+ *       before creating any of them. If not called, the driver in env
+ *       NEB_EVDP_DRIVER_ENV will be tried, and then the first available one.
+ */
+extern int neb_evdp_driver_select(const char *name)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \return the name of the driver in use, NULL if no one is available
+ */
+extern const char *neb_evdp_driver_name(void);
+
 /*
  * Queue Functions
  */
@@ -62,6 +84,14 @@ extern int neb_evdp_queue_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to
 extern int neb_evdp_queue_run(neb_evdp_queue_t q)
 	_nattr_nonnull((1));
 
+/**
+ * \brief find the attached os_fd or ro_fd source by fd
+ * \return NULL if not found
+ * \note a fd should be attached only once to the same queue
+ */
+extern neb_evdp_source_t neb_evdp_queue_find_fd(neb_evdp_queue_t q, int fd)
+	_nattr_nonnull((1));
+
 /**
  * \return NEB_EVDP_CB_CONTINUE or NEB_EVDP_CB_REMOVE or NEB_EVDP_CB_END_FOREACH
  * \note for NEB_EVDP_CB_REMOVE, there may be a later batch remove after all sources checked
@@ -140,6 +170,11 @@ extern void *neb_evdp_source_get_udata(neb_evdp_source_t s)
 	_nattr_nonnull((1));
 extern neb_evdp_queue_t neb_evdp_source_get_queue(neb_evdp_source_t s)
 	_nattr_nonnull((1));
+/**
+ * \return the fd of ro_fd and os_fd sources, or -1 for others
+ */
+extern int neb_evdp_source_get_fd(neb_evdp_source_t s)
+	_nattr_nonnull((1));
 /**
  * \brief set cb that is called when source is removed from queue
  * \note the source is not auto deleted after on_remove, but you can always call
@@ -201,6 +236,14 @@ extern int neb_evdp_source_fd_get_nread(const void *context, int *nbytes)
  */
 extern neb_evdp_source_t neb_evdp_source_new_ro_fd(int fd, neb_evdp_io_handler_t rf, neb_evdp_io_handler_t hf)
 	_nattr_warn_unused_result _nattr_nonnull((2, 3));
+/**
+ * \brief wake up only one of the queues waiting on the same fd, such as a
+ *        listening socket shared by worker threads
+ * \note should be set before attached, and only the epoll driver supports
+ *       it (EPOLLEXCLUSIVE), others still wake up all queues
+ */
+extern int neb_evdp_source_ro_fd_set_exclusive(neb_evdp_source_t s, int on)
+	_nattr_warn_unused_result _nattr_nonnull((1));
 
 extern neb_evdp_source_t neb_evdp_source_new_os_fd(int fd, neb_evdp_io_handler_t hf)
 	_nattr_warn_unused_result _nattr_nonnull((2));
@@ -218,5 +261,45 @@ extern int neb_evdp_source_os_fd_next_read(neb_evdp_source_t s, neb_evdp_io_hand
  */
 extern int neb_evdp_source_os_fd_next_write(neb_evdp_source_t s, neb_evdp_io_handler_t wf)
 	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief set the handler for error events, i.e. messages in the socket error
+ *        queue on Linux, which is called before the read handler
+ * \param[in] ef set to null to ignore error events, which is the default
+ * \note error events are only reported while read or write is armed, and not
+ *       by the kevent driver
+ */
+extern void neb_evdp_source_os_fd_set_error(neb_evdp_source_t s, neb_evdp_io_handler_t ef)
+	_nattr_nonnull((1));
+/**
+ * \brief set a deadline for read and write waits that armed later
+ * \param[in] msec timeout in msec from the time the wait is armed, <= 0 to disable
+ * \param[in] tf called if no event occurs before the deadline, with read and
+ *               write disabled. The return value is the same as other handlers,
+ *               except that BREAK is not supported
+ * \note the io_uring driver links a timeout to the poll request, so it's all
+ *       done in kernel, others use the queue timer, which is required then
+ */
+extern int neb_evdp_source_os_fd_set_deadline(neb_evdp_source_t s, int msec, neb_evdp_io_handler_t tf)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+
+/*
+ * child process source
+ */
+
+/**
+ * \param[in] wstatus the status returned by waitpid, -1 if the child is reaped elsewhere
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_proc_handler_t)(pid_t pid, int wstatus, void *udata);
+
+/**
+ * \brief return a oneshot source which will call pf after the child exited
+ * \param[in] pidfd the pidfd of the child, required on Linux, ignored on others
+ * \note the child will be reaped before calling pf, and the source will be
+ *       removed after that. The pidfd is not closed by this source, so close
+ *       it in pf and return NEB_EVDP_CB_CLOSE, or close it after removed.
+ */
+extern neb_evdp_source_t neb_evdp_source_new_proc(pid_t pid, int pidfd, neb_evdp_proc_handler_t pf)
+	_nattr_warn_unused_result _nattr_nonnull((3));
 
 #endif
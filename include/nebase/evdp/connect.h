@@ -0,0 +1,59 @@
+
+#ifndef NEB_EVDP_CONNECT_H
+#define NEB_EVDP_CONNECT_H 1
+
+#include <nebase/cdefs.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "types.h"
+
+/*
+ * Async Connect Functions
+ *  the connect is started at once, and the handler will be called in the queue
+ */
+
+struct neb_evdp_connect;
+typedef struct neb_evdp_connect* neb_evdp_connect_t;
+
+/**
+ * \param[in] fd the connected fd, nonblock and cloexec, which should be closed
+ *               by the caller, or -1 if failed
+ * \param[in] err 0 if connected, or the SO_ERROR, ETIMEDOUT if timeout
+ * \note the connect object is freed after this handler
+ */
+typedef void (*neb_evdp_connect_handler_t)(int fd, int err, void *udata);
+
+/**
+ * \param[in] type SOCK_STREAM or SOCK_SEQPACKET
+ * \param[in] timeout in milliseconds, the queue timer is required if > 0
+ * \return NULL if failed, and errno will be set if connect failed at once
+ */
+extern neb_evdp_connect_t neb_evdp_connect_unix(neb_evdp_queue_t q, int type, const char *addr, int timeout,
+                                                neb_evdp_connect_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3, 5));
+/**
+ * \param[in] addr AF_INET or AF_INET6 address
+ * \param[in] timeout the same as neb_evdp_connect_unix
+ * \return the same as neb_evdp_connect_unix
+ */
+extern neb_evdp_connect_t neb_evdp_connect_inet(neb_evdp_queue_t q, int type, const struct sockaddr *addr, socklen_t addrlen,
+                                                int timeout, neb_evdp_connect_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3, 6));
+/**
+ * \brief connect with the socket created by the caller, e.g. by neb_sock_tcp_new_connector
+ * \param[in] fd nonblock socket, which will be closed if failed
+ * \param[in] timeout the same as neb_evdp_connect_unix
+ * \return the same as neb_evdp_connect_unix
+ */
+extern neb_evdp_connect_t neb_evdp_connect_fd(neb_evdp_queue_t q, int fd, const struct sockaddr *addr, socklen_t addrlen,
+                                              int timeout, neb_evdp_connect_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3, 6));
+/**
+ * \brief cancel the connect, the fd will be closed and the handler will not be called
+ * \note it should not be called after the handler is called
+ */
+extern void neb_evdp_connect_cancel(neb_evdp_connect_t c)
+	_nattr_nonnull((1));
+
+#endif
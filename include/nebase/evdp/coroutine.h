@@ -0,0 +1,76 @@
+
+#ifndef NEB_EVDP_COROUTINE_H
+#define NEB_EVDP_COROUTINE_H 1
+
+#include <nebase/cdefs.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "types.h"
+
+/*
+ * Coroutine Functions
+ *  stackful coroutines that suspend on sources and the timer of the evdp
+ *  queue they are spawned on, so all of them run in the queue thread
+ *
+ *  the I/O functions should be called inside coroutines, and the fds should be
+ *  nonblocking. Each coroutine owns an os_fd source which is kept attached to
+ *  the fd it waits on, so use neb_co_close to close such fds.
+ */
+
+struct neb_co;
+typedef struct neb_co* neb_co_t;
+
+typedef void (*neb_co_func_t)(void *arg);
+
+#define NEB_CO_DEFAULT_STACK_SIZE (64 * 1024)
+
+/**
+ * \brief create a coroutine and run it until the first suspension or return
+ * \param[in] stack_size 0 to use the default one, stacks of the default size
+ *                       are pooled per thread
+ * \note the coroutine is freed after fn returns, and all coroutines should
+ *       have returned before the queue and its timer are destroyed
+ */
+extern int neb_co_spawn(neb_evdp_queue_t q, neb_co_func_t fn, void *arg, size_t stack_size)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \return the running coroutine, or NULL if not in any coroutine
+ */
+extern neb_co_t neb_co_self(void);
+extern neb_evdp_queue_t neb_co_get_queue(neb_co_t co)
+	_nattr_nonnull((1));
+
+/**
+ * \return the same as read, except that it waits if no data available
+ */
+extern ssize_t neb_co_read(int fd, void *buf, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+/**
+ * \return len if all data written, or -1 if failed, in which case part of the
+ *         data may have been written
+ * \note SIGPIPE should be ignored if fd is a socket or pipe
+ */
+extern ssize_t neb_co_write(int fd, const void *buf, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+/**
+ * \return 0 if connected, or -1 with errno set
+ */
+extern int neb_co_connect(int fd, const struct sockaddr *addr, socklen_t addrlen)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+/**
+ * \note the queue timer is required
+ */
+extern int neb_co_sleep(int msec);
+/**
+ * \brief close the fd, and remove it from the queue if it is waited before
+ */
+extern int neb_co_close(int fd);
+
+/**
+ * \brief free all cached stacks of the current thread
+ */
+extern void neb_co_stack_pool_clear(void);
+
+#endif
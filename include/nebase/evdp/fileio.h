@@ -0,0 +1,81 @@
+
+#ifndef NEB_EVDP_FILEIO_H
+#define NEB_EVDP_FILEIO_H 1
+
+#include <nebase/cdefs.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "types.h"
+
+/*
+ * Async Regular File I/O Functions
+ *  io_uring ops are used with io_uring driver if available, and a thread pool
+ *  for others
+ */
+
+#define NEB_EVDP_FILEIO_DEFAULT_THREADS 4
+
+struct neb_evdp_fileio;
+typedef struct neb_evdp_fileio* neb_evdp_fileio_t;
+
+/**
+ * \param[in] res the same as the sync version on success, i.e. bytes for
+ *                read/write, new fd for openat, 0 for fsync/stat, or -errno
+ *                if failed
+ */
+typedef void (*neb_evdp_fileio_handler_t)(ssize_t res, void *udata);
+
+/**
+ * \param[in] nthreads worker thread number, NEB_EVDP_FILEIO_DEFAULT_THREADS if <= 0,
+ *                     it's ignored with io_uring
+ */
+extern neb_evdp_fileio_t neb_evdp_fileio_create(int nthreads)
+	_nattr_warn_unused_result;
+/**
+ * \note callbacks for unfinished ops will not be called, but the buffers should
+ *       be kept valid until this function returns
+ */
+extern void neb_evdp_fileio_destroy(neb_evdp_fileio_t f)
+	_nattr_nonnull((1));
+
+extern int neb_evdp_fileio_attach(neb_evdp_fileio_t f, neb_evdp_queue_t q)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \note ops can be submitted after detach, but callbacks will be delayed until attached again
+ */
+extern int neb_evdp_fileio_detach(neb_evdp_fileio_t f)
+	_nattr_nonnull((1));
+
+/*
+ * The following functions return 0 if the op is submitted, and cb will be called
+ * in the evdp queue when done. The buf, path and st should be kept valid until then.
+ */
+
+extern int neb_evdp_fileio_read(neb_evdp_fileio_t f, int fd, void *buf, size_t len, off_t offset,
+                                neb_evdp_fileio_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3, 6));
+extern int neb_evdp_fileio_write(neb_evdp_fileio_t f, int fd, const void *buf, size_t len, off_t offset,
+                                 neb_evdp_fileio_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3, 6));
+/**
+ * \param[in] datasync use fdatasync if set and available
+ */
+extern int neb_evdp_fileio_fsync(neb_evdp_fileio_t f, int fd, int datasync,
+                                 neb_evdp_fileio_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 4));
+/**
+ * \note O_CLOEXEC will always be added to flags
+ */
+extern int neb_evdp_fileio_openat(neb_evdp_fileio_t f, int dirfd, const char *path, int flags, mode_t mode,
+                                  neb_evdp_fileio_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3, 6));
+/**
+ * \brief async fstatat, statx is used with io_uring
+ * \param[in] flags AT_* flags for fstatat
+ */
+extern int neb_evdp_fileio_stat(neb_evdp_fileio_t f, int dirfd, const char *path, int flags, struct stat *st,
+                                neb_evdp_fileio_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3, 5, 6));
+
+#endif
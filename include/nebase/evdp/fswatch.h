@@ -0,0 +1,72 @@
+
+#ifndef NEB_EVDP_FSWATCH_H
+#define NEB_EVDP_FSWATCH_H 1
+
+#include <nebase/cdefs.h>
+#include <stdint.h>
+
+#include "types.h"
+
+/*
+ * File Watch Functions
+ *  inotify is used on Linux, and kqueue vnode filter is used on BSD & Darwin
+ */
+
+#define NEB_FSWATCH_CREATE  0x0001 // file created in watched dir
+#define NEB_FSWATCH_MODIFY  0x0002 // content modified, or entries changed in watched dir on BSD
+#define NEB_FSWATCH_ATTRIB  0x0004 // metadata changed
+#define NEB_FSWATCH_MOVE    0x0008 // moved from/to, or the watched path itself moved
+#define NEB_FSWATCH_DELETE  0x0010 // deleted, or the watched path itself deleted
+#define NEB_FSWATCH_IGNORED 0x0020 // the watch is removed by the kernel, the id is released after the callback
+#define NEB_FSWATCH_OVERFLOW 0x0040 // kernel event queue overflowed, some events are lost
+
+#define NEB_FSWATCH_DEFAULT_DEDUP_MSEC 100
+
+struct neb_evdp_fswatch;
+typedef struct neb_evdp_fswatch* neb_evdp_fswatch_t;
+
+typedef struct {
+	int id;           // the value returned by neb_evdp_fswatch_add, -1 for OVERFLOW
+	const char *path; // the registered path
+	const char *name; // the entry name inside watched dir, NULL for the path itself
+	uint32_t events;  // coalesced NEB_FSWATCH_* events
+} neb_evdp_fswatch_event_t;
+
+/**
+ * \param[in] evs coalesced events, valid only during the callback
+ */
+typedef void (*neb_evdp_fswatch_handler_t)(const neb_evdp_fswatch_event_t *evs, int count, void *udata);
+
+/**
+ * \param[in] dedup_msec events within this window since the first one will be
+ *                       coalesced and delivered in one callback, 0 to disable
+ */
+extern neb_evdp_fswatch_t neb_evdp_fswatch_create(int dedup_msec, neb_evdp_fswatch_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+/**
+ * \note it should be detached first
+ */
+extern void neb_evdp_fswatch_destroy(neb_evdp_fswatch_t w)
+	_nattr_nonnull((1));
+
+/**
+ * \brief watch a file or a directory, dir entries are watched but not recursively
+ * \return watch id (>= 0), or -1 if failed
+ */
+extern int neb_evdp_fswatch_add(neb_evdp_fswatch_t w, const char *path)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern int neb_evdp_fswatch_rm(neb_evdp_fswatch_t w, int id)
+	_nattr_nonnull((1));
+
+/**
+ * \note the queue timer is required if dedup_msec is not 0
+ */
+extern int neb_evdp_fswatch_attach(neb_evdp_fswatch_t w, neb_evdp_queue_t q)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \note pending events will be dropped
+ */
+extern int neb_evdp_fswatch_detach(neb_evdp_fswatch_t w)
+	_nattr_nonnull((1));
+
+#endif
@@ -0,0 +1,81 @@
+
+#ifndef NEB_EVDP_HANDOFF_H
+#define NEB_EVDP_HANDOFF_H 1
+
+#include <nebase/cdefs.h>
+#include <stddef.h>
+
+#include "types.h"
+
+/*
+ * Handoff Functions
+ *  hot restart by handing live fds, i.e. listening and established sockets,
+ *  along with small opaque states from the old process to the new one over
+ *  a connected unix stream socket, so the new one goes on serving them warm
+ *
+ *  the old process collects the fds, directly or from sources of its queues,
+ *  and sends them all in the queue thread, so the queue is not running and
+ *  no more data will be read from them. After acknowledged, it should stop
+ *  using the fds and exit, or if failed, it can just go on running.
+ */
+
+#define NEB_EVDP_HANDOFF_MAX_STATE 4096
+
+struct neb_evdp_handoff;
+typedef struct neb_evdp_handoff* neb_evdp_handoff_t;
+
+/**
+ * \param[in] s running source with utype set
+ * \param[in] udata the udata of s
+ * \return 0 to go on, or -1 to abort
+ * \note call neb_evdp_handoff_add for the fds to hand in it
+ */
+typedef int (*neb_evdp_handoff_collect_t)(neb_evdp_handoff_t h, neb_evdp_source_t s, int utype, void *udata);
+/**
+ * \param[in] fd the received fd, which is cloexec and owned by the handler
+ * \param[in] state only valid in the handler, NULL if len is 0
+ * \return 0 if ok, or -1 to abort, no ack will be sent then
+ */
+typedef int (*neb_evdp_handoff_restore_t)(int fd, int utype, const void *state, size_t len, void *udata);
+
+extern neb_evdp_handoff_t neb_evdp_handoff_create(void)
+	_nattr_warn_unused_result;
+/**
+ * \note the added fds will not be closed
+ */
+extern void neb_evdp_handoff_destroy(neb_evdp_handoff_t h)
+	_nattr_nonnull((1));
+
+/**
+ * \param[in] utype passed to the restore handler, to tell what the fd is
+ * \param[in] state copied, and len should be <= NEB_EVDP_HANDOFF_MAX_STATE
+ */
+extern int neb_evdp_handoff_add(neb_evdp_handoff_t h, int fd, int utype, const void *state, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief call cb on each running source of the queue that has utype set
+ * \note it should not be called in foreach
+ */
+extern int neb_evdp_handoff_collect(neb_evdp_handoff_t h, neb_evdp_queue_t q, neb_evdp_handoff_collect_t cb)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2, 3));
+extern int neb_evdp_handoff_get_count(neb_evdp_handoff_t h)
+	_nattr_nonnull((1)) _nattr_pure;
+
+/**
+ * \brief send all added fds, and wait for the ack of the receiver
+ * \param[in] fd connected unix stream socket
+ * \param[in] timeout_msec for each wait of the socket
+ * \return 0 if acknowledged, or -1 if failed
+ */
+extern int neb_evdp_handoff_send(neb_evdp_handoff_t h, int fd, int timeout_msec)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief receive all fds and ack the sender after all restored
+ * \param[in] fd connected unix stream socket
+ * \param[in] timeout_msec for each wait of the socket
+ * \return the number of fds restored, or -1 if failed
+ */
+extern int neb_evdp_handoff_recv(int fd, int timeout_msec, neb_evdp_handoff_restore_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((3));
+
+#endif
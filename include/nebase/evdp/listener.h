@@ -0,0 +1,130 @@
+
+#ifndef NEB_EVDP_LISTENER_H
+#define NEB_EVDP_LISTENER_H 1
+
+#include <nebase/cdefs.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "types.h"
+
+/*
+ * Listener Functions
+ *  accept connections in batch on each wakeup of the listening socket
+ *
+ *  accepting will be paused for a while on resource errors like EMFILE,
+ *  during which the listener source is detached, and an itimer source is
+ *  attached to the same queue to resume it
+ */
+
+#define NEB_EVDP_LISTENER_DEFAULT_BATCH 64
+
+struct neb_evdp_listener;
+typedef struct neb_evdp_listener* neb_evdp_listener_t;
+
+typedef struct {
+	int fd;              // nonblock and cloexec
+	neb_evdp_source_t s; // the os_fd source if auto source is enabled, or NULL
+	socklen_t addrlen;
+	struct sockaddr_storage addr;
+} neb_evdp_listener_conn_t;
+
+/**
+ * \param[in] conns accepted connections in this round, the fds and sources
+ *                  are owned by the handler
+ * \return the same as ro_fd read handler
+ * \note if auto source is enabled, the sources will be attached to the queue
+ *       after this handler returns, so read/write handlers and udata should
+ *       be set here. If the handler deletes, closes or keeps the source and
+ *       fd by itself, it should claim the conn by setting s to NULL, and the
+ *       listener will not touch it any more
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_listener_handler_t)(neb_evdp_listener_t l, neb_evdp_listener_conn_t *conns,
+                                                         int count, void *udata);
+
+/**
+ * \param[in] fd nonblocking listening socket, which will not be closed by the listener
+ * \param[in] batch max connections to accept in one round,
+ *                  NEB_EVDP_LISTENER_DEFAULT_BATCH if <= 0
+ */
+extern neb_evdp_listener_t neb_evdp_listener_create(int fd, int batch, neb_evdp_listener_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((3));
+extern void neb_evdp_listener_destroy(neb_evdp_listener_t l)
+	_nattr_nonnull((1));
+
+/**
+ * \brief create os_fd sources for accepted fds with the hup handler
+ * \param[in] hf NULL to disable
+ * \note the sources will be deleted after removed from the queue
+ */
+extern void neb_evdp_listener_set_auto_source(neb_evdp_listener_t l, neb_evdp_io_handler_t hf)
+	_nattr_nonnull((1));
+
+extern int neb_evdp_listener_attach(neb_evdp_listener_t l, neb_evdp_queue_t q)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern int neb_evdp_listener_detach(neb_evdp_listener_t l)
+	_nattr_nonnull((1));
+
+/*
+ * Listener Group Functions
+ *  share one listening address among worker queues without thundering herd
+ *
+ *  in reuseport modes, each worker owns a SO_REUSEPORT socket, and with
+ *  cpu steering the connection is accepted by the worker at index
+ *  (cpu % count), where cpu is the one handling the packet, so the worker
+ *  threads should be pinned to the matching cpus for cache locality. In
+ *  exclusive mode, the workers share one socket, and only one of them is
+ *  woken up for each connection by the epoll driver.
+ */
+
+enum {
+	NEB_EVDP_LISTENER_GROUP_REUSEPORT_CPU = 0, // falls back to REUSEPORT if steering not supported
+	NEB_EVDP_LISTENER_GROUP_REUSEPORT,         // falls back to EXCLUSIVE if reuseport not supported
+	NEB_EVDP_LISTENER_GROUP_EXCLUSIVE,
+};
+
+struct neb_evdp_listener_group;
+typedef struct neb_evdp_listener_group* neb_evdp_listener_group_t;
+
+struct neb_sock_tcp_profile;
+
+/**
+ * \param[in] count number of workers
+ * \param[in] mode NEB_EVDP_LISTENER_GROUP_*, the actual one may be a fallback
+ * \param[in] p tcp profile, NULL to use the default one. reuseport is added
+ *              automatically for reuseport modes
+ * \note if the port is 0, all reuseport sockets will use the same random port
+ */
+extern neb_evdp_listener_group_t neb_evdp_listener_group_create(const struct sockaddr *addr, socklen_t addrlen,
+                                                                int count, int mode,
+                                                                const struct neb_sock_tcp_profile *p)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief close all the listening sockets
+ * \note the listeners created from the group should be destroyed before
+ */
+extern void neb_evdp_listener_group_destroy(neb_evdp_listener_group_t g)
+	_nattr_nonnull((1));
+
+/**
+ * \return the actual mode
+ */
+extern int neb_evdp_listener_group_get_mode(neb_evdp_listener_group_t g)
+	_nattr_nonnull((1));
+/**
+ * \return the listening socket of worker idx, which is the shared one in
+ *         exclusive mode, or -1 if idx is out of range
+ */
+extern int neb_evdp_listener_group_get_fd(neb_evdp_listener_group_t g, int idx)
+	_nattr_nonnull((1));
+/**
+ * \brief create the listener for worker idx, which should be attached to the
+ *        queue of the worker
+ * \note in reuseport modes, connections steered to a worker will wait there
+ *       until accepted, so all workers should be running
+ */
+extern neb_evdp_listener_t neb_evdp_listener_group_new_listener(neb_evdp_listener_group_t g, int idx, int batch,
+                                                                neb_evdp_listener_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 4));
+
+#endif
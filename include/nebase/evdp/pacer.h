@@ -0,0 +1,65 @@
+
+#ifndef NEB_EVDP_PACER_H
+#define NEB_EVDP_PACER_H 1
+
+#include <nebase/cdefs.h>
+
+#include "types.h"
+
+/*
+ * Pacer Functions
+ *  token bucket pacing on the queue timer, the handler is called with the
+ *  available tokens, and the pacer only wakes up when tokens run out
+ */
+
+struct neb_evdp_pacer;
+typedef struct neb_evdp_pacer* neb_evdp_pacer_t;
+
+/**
+ * \param[in] budget number of tokens available now, always > 0
+ * \return number of tokens used, which should be <= budget, the pacer will be
+ *         idle until started again if less than budget is used, or -1 to stop
+ * \note the pacer should not be destroyed in it, stop it instead
+ */
+typedef int (*neb_evdp_pacer_handler_t)(neb_evdp_pacer_t p, unsigned int budget, void *udata);
+
+/**
+ * \param[in] rate tokens per second, should > 0
+ * \param[in] burst the bucket size, should > 0, the bucket is full at first
+ * \note the queue timer is required, and the pacer is idle after created
+ */
+extern neb_evdp_pacer_t neb_evdp_pacer_create(neb_evdp_queue_t q, unsigned int rate, unsigned int burst,
+                                              neb_evdp_pacer_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 4));
+/**
+ * \note it should be destroyed before the queue timer
+ */
+extern void neb_evdp_pacer_destroy(neb_evdp_pacer_t p)
+	_nattr_nonnull((1));
+
+/**
+ * \brief change the rate and burst, the tokens already in bucket are kept
+ *        within the new burst
+ */
+extern int neb_evdp_pacer_set_rate(neb_evdp_pacer_t p, unsigned int rate, unsigned int burst)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+/**
+ * \brief start or wake up the pacer, i.e. when there is new data to send, the
+ *        handler will be called in the next queue loop
+ */
+extern int neb_evdp_pacer_start(neb_evdp_pacer_t p)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief stop the pacer, tokens are still refilled until the bucket is full
+ */
+extern void neb_evdp_pacer_stop(neb_evdp_pacer_t p)
+	_nattr_nonnull((1));
+
+/**
+ * \brief get the number of tokens available now
+ */
+extern unsigned int neb_evdp_pacer_get_tokens(neb_evdp_pacer_t p)
+	_nattr_nonnull((1));
+
+#endif
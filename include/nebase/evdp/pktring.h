@@ -0,0 +1,92 @@
+
+#ifndef NEB_EVDP_PKTRING_H
+#define NEB_EVDP_PKTRING_H 1
+
+#include <nebase/cdefs.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "types.h"
+
+/*
+ * Packet Ring Functions
+ *  packet capture via the mmap'ed TPACKET_V3 rx ring on Linux, the ring is
+ *  handed over block by block, and the packets are read in place
+ */
+
+struct neb_evdp_pktring;
+typedef struct neb_evdp_pktring* neb_evdp_pktring_t;
+
+struct neb_evdp_pktring_conf {
+	uint16_t protocol;         // ETH_P_* in host order, 0 for ETH_P_ALL
+	unsigned int ifindex;      // 0 for all interfaces
+	int cooked;                // start packets at the network header if set
+	unsigned int block_size;   // multiple of page size, 0 for the default 1MB
+	unsigned int block_num;    // 0 for the default 64
+	unsigned int frame_size;   // max captured size per packet, 0 for the default 2048
+	unsigned int timeout_msec; // block retire timeout, 0 for the default 10ms
+};
+
+typedef struct {
+	const u_char *data;
+	unsigned int len;      // captured length
+	unsigned int orig_len; // length on the wire
+	struct timespec ts;    // kernel timestamp
+	unsigned int ifindex;
+	uint16_t protocol;     // ETH_P_* in host order
+} neb_evdp_pkt_t;
+
+typedef struct {
+	unsigned int pkt_num;
+	/* private */
+	unsigned int pkt_idx;
+	const u_char *block;
+	const u_char *next;
+} neb_evdp_pktblock_t;
+
+/**
+ * \param[in] blk the block is returned to the kernel after the callback, so
+ *                packets are only valid during the callback
+ * \return NEB_EVDP_CB_CONTINUE or NEB_EVDP_CB_BREAK_*
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_pktring_handler_t)(neb_evdp_pktblock_t *blk, void *udata);
+
+/**
+ * \param[in] conf NULL to capture all packets on all interfaces with defaults
+ * \note CAP_NET_RAW is required, ENOTSUP will be set if not supported
+ */
+extern neb_evdp_pktring_t neb_evdp_pktring_create(const struct neb_evdp_pktring_conf *conf,
+                                                  neb_evdp_pktring_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+/**
+ * \note it should be detached first
+ */
+extern void neb_evdp_pktring_destroy(neb_evdp_pktring_t r)
+	_nattr_nonnull((1));
+
+/**
+ * \return the packet socket, which can be used to attach filters
+ */
+extern int neb_evdp_pktring_get_fd(neb_evdp_pktring_t r)
+	_nattr_nonnull((1)) _nattr_pure;
+/**
+ * \brief get and reset the kernel counters
+ * \param[out] drops packets dropped as the ring is full
+ */
+extern int neb_evdp_pktring_get_stats(neb_evdp_pktring_t r, unsigned int *packets, unsigned int *drops)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2, 3));
+
+extern int neb_evdp_pktring_attach(neb_evdp_pktring_t r, neb_evdp_queue_t q)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern int neb_evdp_pktring_detach(neb_evdp_pktring_t r)
+	_nattr_nonnull((1));
+
+/**
+ * \brief get the next packet in the block
+ * \return 1 if got, 0 if no more
+ */
+extern int neb_evdp_pktblock_next(neb_evdp_pktblock_t *blk, neb_evdp_pkt_t *pkt)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+
+#endif
@@ -0,0 +1,106 @@
+
+#ifndef NEB_EVDP_PREFORK_H
+#define NEB_EVDP_PREFORK_H 1
+
+#include <nebase/cdefs.h>
+#include <sys/types.h>
+
+#include "types.h"
+
+/*
+ * Prefork Functions
+ *  a supervisor on the evdp queue which forks worker processes, hands the
+ *  listening sockets to them over unix sockets, restarts the crashed ones
+ *  and signals them to reload or quit
+ *
+ *  workers run the worker function in the forked child, so no code needs to
+ *  be thread-safe, i.e. non thread-safe plugins. They should create their
+ *  own queues and never use the inherited ones. Signal handlers and mask are
+ *  also inherited, so reset them in workers if needed.
+ */
+
+struct neb_evdp_prefork;
+typedef struct neb_evdp_prefork* neb_evdp_prefork_t;
+
+#define NEB_EVDP_PREFORK_EXIT_LOCKED 75 // the worker lock file is held by another process
+
+/**
+ * \param[in] ctl_fd the unix socket to the supervisor, which will hup after
+ *                   the supervisor exited, so workers won't be orphans
+ * \param[in] fds the handed listening sockets, which are cloexec
+ * \return the exit status of the worker process
+ */
+typedef int (*neb_evdp_prefork_worker_t)(int idx, int ctl_fd, const int *fds, int fd_num, void *udata);
+/**
+ * \param[in] wstatus the same as in proc handler
+ * \note called after the worker is reaped and before it is restarted. Set
+ *       T_E_QUIT in thread_events to quit the queue if needed
+ */
+typedef void (*neb_evdp_prefork_exit_handler_t)(int idx, pid_t pid, int wstatus, void *udata);
+
+struct neb_evdp_prefork_conf {
+	int worker_num;
+	neb_evdp_prefork_worker_t worker;
+	neb_evdp_prefork_exit_handler_t on_exit; // can be NULL
+	void *udata;
+	int close_fd;           // closed in workers, i.e. the pidfile fd of the supervisor, -1 if none
+	int lock_dirfd;         // dir of the worker lock files, -1 to disable
+	const char *lock_name;  // lock file name prefix, the worker index will be appended
+	int restart_delay_msec; // delay before restarting crashed workers, see neb_evdp_prefork_start
+	int reload_signo;       // sent by neb_evdp_prefork_reload, SIGHUP if 0
+};
+
+/**
+ * \note the worker locks are taken by neb_pidlock in workers, which exit with
+ *       NEB_EVDP_PREFORK_EXIT_LOCKED if the lock is held, i.e. by workers of a
+ *       previous supervisor, and they will be restarted as the crashed ones
+ */
+extern neb_evdp_prefork_t neb_evdp_prefork_create(const struct neb_evdp_prefork_conf *conf)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief kill and reap all running workers, and free the supervisor
+ * \note it should be destroyed before the queue and its timer
+ */
+extern void neb_evdp_prefork_destroy(neb_evdp_prefork_t p)
+	_nattr_nonnull((1));
+
+/**
+ * \brief set the listening sockets handed to workers started later
+ * \param[in] fd_num should be > 0 and < NEB_UNIX_MAX_CMSG_FD
+ * \note the fds are not dupped, so keep them open while workers may start
+ */
+extern int neb_evdp_prefork_set_fds(neb_evdp_prefork_t p, const int *fds, int fd_num)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+
+/**
+ * \brief start all workers, and watch them on the queue
+ * \note the fds should be set first, and the queue timer is required. Workers
+ *       failed again soon after restarted, or exited as locked, are restarted
+ *       with exponential backoff from 100 msec up to 10 sec, which is reset
+ *       after they are up for 10 sec
+ */
+extern int neb_evdp_prefork_start(neb_evdp_prefork_t p, neb_evdp_queue_t q)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \param[in] respawn 0 to send the reload signal to workers, or others to
+ *                    send SIGTERM and start new workers after they exited,
+ *                    which will get the fds set currently
+ */
+extern int neb_evdp_prefork_reload(neb_evdp_prefork_t p, int respawn)
+	_nattr_nonnull((1));
+/**
+ * \brief signal all workers to quit and don't restart them any more
+ * \param[in] signo SIGTERM if 0
+ */
+extern int neb_evdp_prefork_stop(neb_evdp_prefork_t p, int signo)
+	_nattr_nonnull((1));
+
+extern int neb_evdp_prefork_get_running(neb_evdp_prefork_t p)
+	_nattr_nonnull((1)) _nattr_pure;
+/**
+ * \return the pid of worker idx, or 0 if it is not running
+ */
+extern pid_t neb_evdp_prefork_get_pid(neb_evdp_prefork_t p, int idx)
+	_nattr_nonnull((1)) _nattr_pure;
+
+#endif
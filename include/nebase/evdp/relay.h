@@ -0,0 +1,61 @@
+
+#ifndef NEB_EVDP_RELAY_H
+#define NEB_EVDP_RELAY_H 1
+
+#include <nebase/cdefs.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types.h"
+
+/*
+ * Relay Functions
+ *  move data between two fds in both directions, splice through internal
+ *  pipes is used on Linux, and a userspace buffer for others
+ */
+
+#define NEB_EVDP_RELAY_A2B 0
+#define NEB_EVDP_RELAY_B2A 1
+
+struct neb_evdp_relay;
+typedef struct neb_evdp_relay* neb_evdp_relay_t;
+
+/**
+ * \param[in] err 0 if both directions have been closed normally, or the errno
+ * \return the same as os_fd handler
+ * \note the relay should not be destroyed in this handler, do it in the queue
+ *       batch handler or after the queue returns
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_relay_handler_t)(neb_evdp_relay_t r, int err, void *udata);
+
+/**
+ * \param[in] fd_a, fd_b nonblocking fds, which will not be closed by the relay
+ * \param[in] buf_size pipe or buffer size for each direction, 0 to use the default one
+ * \note when read EOF from one fd and all data relayed, the write side of the
+ *       other fd will be shutdown if it's a socket, and the handler is called
+ *       after both directions are closed, or any error occurs. If one fd is
+ *       hung up, the data left in it is still relayed until EOF, and it's an
+ *       error only if there is data to write to it
+ */
+extern neb_evdp_relay_t neb_evdp_relay_create(int fd_a, int fd_b, size_t buf_size,
+                                              neb_evdp_relay_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((4));
+/**
+ * \note pending data will be dropped
+ */
+extern void neb_evdp_relay_destroy(neb_evdp_relay_t r)
+	_nattr_nonnull((1));
+
+extern int neb_evdp_relay_attach(neb_evdp_relay_t r, neb_evdp_queue_t q)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern int neb_evdp_relay_detach(neb_evdp_relay_t r)
+	_nattr_nonnull((1));
+
+/**
+ * \param[in] dir NEB_EVDP_RELAY_A2B or NEB_EVDP_RELAY_B2A
+ * \return bytes that have been written to the destination fd
+ */
+extern uint64_t neb_evdp_relay_get_bytes(neb_evdp_relay_t r, int dir)
+	_nattr_nonnull((1));
+
+#endif
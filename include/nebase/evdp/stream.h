@@ -0,0 +1,128 @@
+
+#ifndef NEB_EVDP_STREAM_H
+#define NEB_EVDP_STREAM_H 1
+
+#include <nebase/cdefs.h>
+#include <stddef.h>
+
+#include "types.h"
+
+/*
+ * Buffered Stream Functions
+ *  a growable read buffer and a coalescing write queue on top of os_fd source
+ */
+
+struct neb_evdp_stream;
+typedef struct neb_evdp_stream* neb_evdp_stream_t;
+
+typedef struct {
+	size_t rbuf_size;      // initial read buffer size
+	size_t rbuf_max_size;  // the read buffer will grow up to this size
+	size_t chunk_size;     // write queue chunk size, small writes will be copied into the same chunk
+	size_t wq_high;        // write queue high watermark in bytes
+	size_t wq_low;         // write queue low watermark in bytes
+	int pause_read_on_wq_high; // stop reading until write queue drained below wq_low
+} neb_evdp_stream_conf_t;
+
+enum {
+	NEB_EVDP_STREAM_EV_EOF = 1, // peer closed normally, all data has been passed to read handler
+	NEB_EVDP_STREAM_EV_HUP,     // hup received, err is the sockerr if available
+	NEB_EVDP_STREAM_EV_ERROR,   // read/write error, or read buffer overflow (ENOBUFS)
+	NEB_EVDP_STREAM_EV_WQ_LOW,  // write queue drained below wq_low after reached wq_high
+};
+
+/**
+ * \param[in] data all unconsumed data in read buffer
+ * \param[out] consumed set to the number of consumed bytes, default to 0
+ * \return the same as os_fd read handler
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_stream_read_handler_t)(neb_evdp_stream_t st, const char *data, size_t len,
+                                                            size_t *consumed, void *udata);
+/**
+ * \return the same as os_fd handler
+ * \note read is stopped after EOF, HUP and ERROR, return CLOSE or REMOVE if
+ *       the stream should be removed from queue
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_stream_event_handler_t)(neb_evdp_stream_t st, int event, int err, void *udata);
+/**
+ * \brief called when the buffer passed to neb_evdp_stream_write_zc can be
+ *        reused, the stream should not be destroyed in it
+ */
+typedef void (*neb_evdp_stream_zc_done_t)(neb_evdp_stream_t st, const void *data, size_t len, void *udata);
+
+extern void neb_evdp_stream_conf_init(neb_evdp_stream_conf_t *conf)
+	_nattr_nonnull((1));
+
+/**
+ * \param[in] fd nonblocking fd, which will not be closed by the stream
+ * \param[in] conf NULL to use the default one
+ */
+extern neb_evdp_stream_t neb_evdp_stream_create(int fd, const neb_evdp_stream_conf_t *conf,
+                                                neb_evdp_stream_read_handler_t rf,
+                                                neb_evdp_stream_event_handler_t ef, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((3, 4));
+/**
+ * \note it should be detached first, all pending data will be dropped
+ */
+extern void neb_evdp_stream_destroy(neb_evdp_stream_t st)
+	_nattr_nonnull((1));
+
+extern int neb_evdp_stream_attach(neb_evdp_stream_t st, neb_evdp_queue_t q)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \param[in] to_close the same as neb_evdp_queue_detach
+ */
+extern int neb_evdp_stream_detach(neb_evdp_stream_t st, int to_close)
+	_nattr_nonnull((1));
+
+extern int neb_evdp_stream_get_fd(neb_evdp_stream_t st)
+	_nattr_nonnull((1));
+/**
+ * \brief get the pending bytes in write queue
+ */
+extern size_t neb_evdp_stream_get_wq_bytes(neb_evdp_stream_t st)
+	_nattr_nonnull((1));
+
+/**
+ * \brief queue data to write, all pending data will be sent in one writev
+ *        when the fd is writable
+ * \return 0 if ok, 1 if the write queue is above wq_high, in which case the
+ *         caller should stop writing until NEB_EVDP_STREAM_EV_WQ_LOW, or -1 if failed
+ * \note data is copied, and SIGPIPE should be ignored if fd is a socket or pipe
+ */
+extern int neb_evdp_stream_write(neb_evdp_stream_t st, const void *data, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+
+/**
+ * \brief enable zerocopy send for neb_evdp_stream_write_zc, which is only
+ *        supported for tcp sockets on Linux
+ * \return 0 if ok, or -1 if not supported, and neb_evdp_stream_write_zc will
+ *         still work, but the data will be copied by the kernel
+ */
+extern int neb_evdp_stream_enable_zerocopy(neb_evdp_stream_t st)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief queue data to write without copy, zerocopy chunks are sent by separated
+ *        sendmsg calls with MSG_ZEROCOPY if enabled
+ * \param[in] df called when the kernel no longer uses the data, which may be
+ *               after it's acked by the peer, or when the stream is destroyed
+ * \return the same as neb_evdp_stream_write
+ * \note it only pays off for large buffers, i.e. 64KB or more, and the kernel
+ *       may fall back to copy, e.g. for loopback, then MSG_ZEROCOPY will not be
+ *       used for this stream any more.
+ *       Notifications are received as error events, so df may be delayed if
+ *       neither read nor write is armed.
+ */
+extern int neb_evdp_stream_write_zc(neb_evdp_stream_t st, const void *data, size_t len,
+                                    neb_evdp_stream_zc_done_t df, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2, 4));
+
+/**
+ * \brief pause or resume reading, i.e. when the peer stream is not writable
+ */
+extern int neb_evdp_stream_pause_read(neb_evdp_stream_t st)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern int neb_evdp_stream_resume_read(neb_evdp_stream_t st)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+#endif
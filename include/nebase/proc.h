@@ -4,9 +4,45 @@
 
 #include "cdefs.h"
 
+#include <sys/types.h>
+
 extern void neb_proc_child_exit(int status)
 	_nattr_noreturn;
 extern void neb_proc_child_flush_exit(int status)
 	_nattr_noreturn;
 
+/*
+ * Spawn Functions
+ */
+
+#define NEB_PROC_SPAWN_FD_INHERIT -2
+
+typedef struct {
+	int stdin_fd;     // NEB_PROC_SPAWN_FD_INHERIT to keep, -1 for /dev/null
+	int stdout_fd;    // NEB_PROC_SPAWN_FD_INHERIT to keep, -1 for /dev/null
+	int stderr_fd;    // NEB_PROC_SPAWN_FD_INHERIT to keep, -1 for /dev/null
+	int pty_slave_fd; // >= 0 to use it as ctty and stdio, the std fds above will be ignored
+	int new_session;  // call setsid in child, implied if pty_slave_fd is set
+} neb_proc_spawn_attr_t;
+
+/**
+ * \brief init attr to inherit all std fds
+ */
+extern void neb_proc_spawn_attr_init(neb_proc_spawn_attr_t *attr)
+	_nattr_nonnull((1));
+
+/**
+ * \brief spawn a new child process without copying pages of the parent
+ * \param[in] path the executable path, PATH env will not be searched
+ * \param[in] envp NULL if environ should be used
+ * \param[in] attr NULL if all std fds should be inherited
+ * \param[out] pidfd the pidfd of the child, which is cloexec and should be
+ *                   closed by the caller, -1 if not available on this platform
+ * \return the pid of the child, or -1 if failed, including exec failure
+ * \note signal handlers will be reset to default in child, and signal mask will be kept
+ */
+extern pid_t neb_proc_spawn(const char *path, char *const argv[], char *const envp[],
+                            const neb_proc_spawn_attr_t *attr, int *pidfd)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2, 5));
+
 #endif
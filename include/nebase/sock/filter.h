@@ -0,0 +1,94 @@
+
+#ifndef NEB_SOCK_FILTER_H
+#define NEB_SOCK_FILTER_H 1
+
+#include <nebase/cdefs.h>
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+/*
+ * Socket Filter Functions
+ *  build classic bpf programs with common predicates, all of which should
+ *  match for a packet to be accepted, and attach them to raw or udp sockets
+ *  so that the unwanted packets are dropped in the kernel
+ *
+ *  only the ip header without extension headers is supported for ipv6.
+ *  SO_ATTACH_FILTER is only available on Linux, and ENOTSUP is set if not
+ *  supported.
+ */
+
+struct neb_sock_filter;
+typedef struct neb_sock_filter* neb_sock_filter_t;
+
+#define NEB_SOCK_FILTER_MAX_INSNS 200
+
+/**
+ * \param[in] family AF_INET or AF_INET6
+ */
+extern neb_sock_filter_t neb_sock_filter_create(int family)
+	_nattr_warn_unused_result;
+extern void neb_sock_filter_destroy(neb_sock_filter_t f)
+	_nattr_nonnull((1));
+
+/**
+ * \brief match protocol in ip header, or next header in ipv6 header
+ */
+extern int neb_sock_filter_ip_proto(neb_sock_filter_t f, uint8_t proto)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern int neb_sock_filter_ip4_src(neb_sock_filter_t f, const struct in_addr *addr)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern int neb_sock_filter_ip4_dst(neb_sock_filter_t f, const struct in_addr *addr)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern int neb_sock_filter_ip6_src(neb_sock_filter_t f, const struct in6_addr *addr)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern int neb_sock_filter_ip6_dst(neb_sock_filter_t f, const struct in6_addr *addr)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+
+/*
+ * the following l4 predicates don't check the protocol, so add the protocol
+ * predicate first, and ipv4 fragments other than the first one are dropped
+ */
+
+/**
+ * \brief match the type of icmp or icmpv6 header
+ */
+extern int neb_sock_filter_icmp_type(neb_sock_filter_t f, uint8_t type)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief match the identifier of icmp or icmpv6 echo header
+ * \param[in] id in network byte order, the same as in icmp header
+ */
+extern int neb_sock_filter_icmp_id(neb_sock_filter_t f, uint16_t id)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief match the ports of udp or tcp header
+ * \param[in] port in host byte order
+ */
+extern int neb_sock_filter_src_port(neb_sock_filter_t f, uint16_t port)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern int neb_sock_filter_dst_port(neb_sock_filter_t f, uint16_t port)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+/**
+ * \brief attach the filter to fd, which will replace the old one
+ * \note the filter can be destroyed after attached
+ */
+extern int neb_sock_filter_attach(neb_sock_filter_t f, int fd)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern int neb_sock_filter_detach(int fd);
+
+/**
+ * \brief steer new connections or datagrams of a SO_REUSEPORT group to the
+ *        socket at index (cpu % group_size), where cpu is the one handling
+ *        the packet in the kernel
+ * \param[in] fd any socket in the group, the program applies to all of them
+ * \param[in] group_size the number of sockets in the group, which are indexed
+ *                       in the order they are bound
+ * \note the sockets should be owned by threads pinned to the matching cpus
+ *       to get the cache locality
+ */
+extern int neb_sock_filter_attach_reuseport_cpu(int fd, int group_size)
+	_nattr_warn_unused_result;
+
+#endif
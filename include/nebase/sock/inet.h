@@ -6,6 +6,8 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdint.h>
 #include <time.h>
 
 enum {
@@ -16,6 +18,9 @@ enum {
 	NEB_CMSG_TYPE_LOOP_END = 0,   // null
 	NEB_CMSG_TYPE_TIMESTAMP = 1,  // struct timespec
 	NEB_CMSG_TYPE_IP4IFINDEX = 2, // unsigned int, not reliable for raw sockets
+	NEB_CMSG_TYPE_UDP_GRO_SEGSIZE = 3, // unsigned int, see neb_sock_inet_udp_gro_split
+	NEB_CMSG_TYPE_HW_TIMESTAMP = 4, // struct timespec, raw hardware one, see neb_sock_inet_enable_timestamping
+	NEB_CMSG_TYPE_CTRUNC = 5,     // null, the cmsgs are truncated and skipped, see neb_sock_inet_recvmmsg
 };
 
 /**
@@ -34,6 +39,78 @@ struct neb_sock_msghdr {
 extern ssize_t neb_sock_inet_recvmsg(int fd, struct neb_sock_msghdr *msg)
 	_nattr_warn_unused_result _nattr_nonnull((2));
 
+#define NEB_SOCK_MMSG_MAX 64
+
+struct neb_sock_mmsghdr {
+	struct neb_sock_msghdr msg_hdr;
+	size_t                 msg_len; // bytes received or sent
+};
+
+/**
+ * \brief receive at most NEB_SOCK_MMSG_MAX messages in one syscall
+ * \param[in] msgs set msg_peer family as for neb_sock_inet_recvmsg, and the
+ *                 msg_control_cb of each message will be called with its own
+ *                 msg_udata, the cmsg buffer is limited to timestamp, pktinfo
+ *                 and gro segment size, if it's truncated for a message, the
+ *                 cmsgs of that message are reported as NEB_CMSG_TYPE_CTRUNC
+ *                 only, and the other messages are not affected
+ * \return the number of messages received, 0 if no more, or -1 if failed
+ */
+extern int neb_sock_inet_recvmmsg(int fd, struct neb_sock_mmsghdr *msgs, unsigned int vlen)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+/**
+ * \brief send at most NEB_SOCK_MMSG_MAX messages in one syscall
+ * \param[in] msgs msg_peer is the destination or NULL if connected, and
+ *                 msg_control_cb is not used
+ * \return the number of messages sent, 0 if blocked, or -1 if failed
+ */
+extern int neb_sock_inet_sendmmsg(int fd, struct neb_sock_mmsghdr *msgs, unsigned int vlen)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+
+/*
+ * Fixed Layout Receive
+ *  decode the enabled cmsg into a fixed struct without callbacks
+ */
+
+#define NEB_SOCK_PKTINFO_TIMESTAMP 0x01
+#define NEB_SOCK_PKTINFO_IFINDEX   0x02
+#define NEB_SOCK_PKTINFO_DSTADDR   0x04
+#define NEB_SOCK_PKTINFO_TTL       0x08 // ttl for ipv4, or hop limit for ipv6
+#define NEB_SOCK_PKTINFO_GRO       0x10
+
+struct neb_sock_pktinfo {
+	unsigned int flags; // the fields got
+	struct timespec ts;
+	unsigned int ifindex;
+	union {
+		struct in_addr v4;
+		struct in6_addr v6;
+	} dst_addr;
+	int ttl;
+	unsigned int gro_segsize;
+};
+
+/**
+ * \brief enable the socket options needed for the NEB_SOCK_PKTINFO_* flags
+ * \param[in] family AF_INET or AF_INET6
+ */
+extern int neb_sock_inet_enable_pktinfo(int fd, int family, unsigned int flags)
+	_nattr_warn_unused_result;
+/**
+ * \brief the same as neb_sock_inet_recvmsg, but msg_control_cb is not used
+ * \param[in] flags the enabled NEB_SOCK_PKTINFO_* flags, to size the cmsg buffer
+ * \param[out] info fields not got are not set, check info->flags
+ */
+extern ssize_t neb_sock_inet_recvmsg_pktinfo(int fd, struct neb_sock_msghdr *msg,
+                                             unsigned int flags, struct neb_sock_pktinfo *info)
+	_nattr_warn_unused_result _nattr_nonnull((2, 4));
+/**
+ * \brief the same as neb_sock_inet_recvmmsg, with infos filled for each message
+ */
+extern int neb_sock_inet_recvmmsg_pktinfo(int fd, struct neb_sock_mmsghdr *msgs, unsigned int vlen,
+                                          unsigned int flags, struct neb_sock_pktinfo *infos)
+	_nattr_warn_unused_result _nattr_nonnull((2, 5));
+
 /**
  * \brief get a new nonblock and cloexec socket, which can be closed by close()
  */
@@ -46,4 +123,122 @@ extern int neb_sock_inet_new(int domain, int type, int protocol)
 extern int neb_sock_inet_enable_recv_time(int fd)
 	_nattr_warn_unused_result;
 
+/*
+ * Timestamping
+ *  software and hardware timestamps taken in the kernel and the NIC, which
+ *  are much closer to the wire than the ones taken in userspace
+ */
+
+#define NEB_SOCK_TSTAMP_RX_SOFTWARE 0x01 // reported as NEB_CMSG_TYPE_TIMESTAMP cmsg
+#define NEB_SOCK_TSTAMP_RX_HARDWARE 0x02 // reported as NEB_CMSG_TYPE_HW_TIMESTAMP cmsg
+#define NEB_SOCK_TSTAMP_TX_SOFTWARE 0x04 // when the packet is handed to the driver
+#define NEB_SOCK_TSTAMP_TX_HARDWARE 0x08 // when the packet is sent by the NIC
+#define NEB_SOCK_TSTAMP_TX_SCHED    0x10 // before the packet enters the qdisc
+
+enum {
+	NEB_SOCK_TSTAMP_TYPE_SND = 0,
+	NEB_SOCK_TSTAMP_TYPE_SCHED = 1,
+	NEB_SOCK_TSTAMP_TYPE_ACK = 2, // all data acked, for tcp only
+};
+
+struct neb_sock_tx_tstamp {
+	uint32_t id;        // counted from 0 for every sent datagram, or the byte offset for tcp
+	int type;           // NEB_SOCK_TSTAMP_TYPE_*
+	unsigned int flags; // NEB_SOCK_TSTAMP_TX_SOFTWARE and NEB_SOCK_TSTAMP_TX_HARDWARE for the ones got
+	struct timespec sw;
+	struct timespec hw;
+};
+
+/**
+ * \brief enable SO_TIMESTAMPING for the NEB_SOCK_TSTAMP_* flags
+ * \return 0 if ok, or -1 with errno set, which is ENOTSUP if not supported
+ * \note it replaces neb_sock_inet_enable_recv_time, and the fixed layout
+ *       receive can not be used then. Hardware ones also require the NIC to
+ *       be configured by SIOCSHWTSTAMP, or they will just not be reported
+ */
+extern int neb_sock_inet_enable_timestamping(int fd, unsigned int flags)
+	_nattr_warn_unused_result;
+/**
+ * \brief read one tx timestamp from the error queue, which is signaled by
+ *        error events, see neb_evdp_source_os_fd_set_error
+ * \return 1 if got one, 0 if no more, or -1 if failed
+ * \note other messages in the error queue are dropped, so use
+ *       neb_sock_inet_recv_errqueue if zerocopy is also enabled
+ */
+extern int neb_sock_inet_recv_tx_timestamp(int fd, struct neb_sock_tx_tstamp *t)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+
+/**
+ * \brief enable MSG_ZEROCOPY send for tcp and udp sockets
+ * \return 0 if ok, or -1 with errno set, which is ENOTSUP if not supported
+ */
+extern int neb_sock_inet_enable_zerocopy(int fd)
+	_nattr_warn_unused_result;
+/**
+ * \brief read one zerocopy completion notification from the error queue
+ * \param[out] lo,hi the inclusive range of completed send calls, which are
+ *                   counted from 0 for every successful MSG_ZEROCOPY send
+ * \param[out] copied set if the kernel fell back to copy the data
+ * \return 1 if got one, 0 if no more, or -1 if failed
+ * \note other messages in the error queue are dropped, so use
+ *       neb_sock_inet_recv_errqueue if tx timestamping is also enabled
+ */
+extern int neb_sock_inet_recv_zerocopy(int fd, uint32_t *lo, uint32_t *hi, int *copied)
+	_nattr_warn_unused_result _nattr_nonnull((2, 3, 4));
+
+enum {
+	NEB_SOCK_ERRQUEUE_OTHER = 0,
+	NEB_SOCK_ERRQUEUE_TSTAMP,
+	NEB_SOCK_ERRQUEUE_ZEROCOPY,
+};
+
+struct neb_sock_errqueue_msg {
+	int type; // NEB_SOCK_ERRQUEUE_*
+	union {
+		struct neb_sock_tx_tstamp tstamp;
+		struct {
+			uint32_t lo;
+			uint32_t hi;
+			int copied;
+		} zc;
+		int err; // errno of the other ones, e.g. icmp errors
+	};
+};
+
+/**
+ * \brief read one message of any type from the error queue
+ * \return 1 if got one, 0 if no more, or -1 if failed
+ */
+extern int neb_sock_inet_recv_errqueue(int fd, struct neb_sock_errqueue_msg *m)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+
+/**
+ * \brief set the gso segment size for all following sends of the udp socket
+ * \param[in] segsize 0 to disable, otherwise each send will be split into
+ *                    datagrams of this size, with the last one maybe shorter
+ * \return 0 if ok, or -1 with errno set, which is ENOTSUP if not supported
+ */
+extern int neb_sock_inet_set_udp_gso(int fd, uint16_t segsize)
+	_nattr_warn_unused_result;
+/**
+ * \brief let the kernel coalesce received udp datagrams of the same flow
+ * \return 0 if ok, or -1 with errno set, which is ENOTSUP if not supported
+ * \note the recv buffer should be large enough, up to 64KB, and the segment
+ *       size is reported as NEB_CMSG_TYPE_UDP_GRO_SEGSIZE cmsg if coalesced
+ */
+extern int neb_sock_inet_enable_udp_gro(int fd)
+	_nattr_warn_unused_result;
+
+/**
+ * \return 0 if success, others to stop splitting with the same return value
+ */
+typedef int (*neb_sock_udp_seg_cb)(const u_char *data, size_t len, void *udata);
+/**
+ * \brief split the received gro buffer into the original datagrams
+ * \param[in] segsize the one reported by cmsg, or 0 if not coalesced
+ */
+extern int neb_sock_inet_udp_gro_split(const u_char *data, size_t len, unsigned int segsize,
+                                       neb_sock_udp_seg_cb f, void *udata)
+	_nattr_nonnull((1, 4));
+
 #endif
@@ -5,6 +5,7 @@
 #include <nebase/cdefs.h>
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <stdint.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
@@ -22,6 +23,13 @@ extern int neb_sock_raw4_new(int protocol)
  */
 extern ssize_t neb_sock_raw4_send(int fd, const u_char *data, size_t len)
 	_nattr_warn_unused_result _nattr_nonnull((2));
+/**
+ * \brief send at most NEB_SOCK_MMSG_MAX packets in one syscall
+ * \param[in] pkts each one is a full packet, the same as in neb_sock_raw4_send
+ * \return the number of packets sent, 0 if blocked, or -1 if error
+ */
+extern int neb_sock_raw4_sendmmsg(int fd, const struct iovec *pkts, unsigned int n)
+	_nattr_warn_unused_result _nattr_nonnull((2));
 
 /**
  * \brief get the real ip total_len getting from raw hdrincl sockets
@@ -45,6 +53,16 @@ extern ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
                                        const struct in_addr *dst,
                                        const struct in_addr *src)
 	_nattr_warn_unused_result _nattr_nonnull((2, 4));
+/**
+ * \brief send at most NEB_SOCK_MMSG_MAX packets in one syscall
+ * \param[in] dsts the destination of each packet
+ * \param[in] src the source address for all packets, can be NULL
+ * \return the number of packets sent, 0 if blocked, or -1 if error
+ */
+extern int neb_sock_raw_icmp4_sendmmsg(int fd, const struct iovec *pkts,
+                                       const struct in_addr *dsts, unsigned int n,
+                                       const struct in_addr *src)
+	_nattr_warn_unused_result _nattr_nonnull((2, 3));
 
 /*
  * ICMPv6 Raw Sockets (Local)
@@ -0,0 +1,79 @@
+#ifndef NEB_SOCK_TCP_H
+#define NEB_SOCK_TCP_H 1
+
+#include <nebase/cdefs.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/*
+ * TCP Socket Functions
+ *  create listeners and connectors with tuning profiles, options not
+ *  supported by the platform or rejected by the kernel are skipped, and the
+ *  accepted ones are reported
+ */
+
+#define NEB_SOCK_TCP_OPT_REUSEADDR     0x0001
+#define NEB_SOCK_TCP_OPT_REUSEPORT     0x0002 // listener only
+#define NEB_SOCK_TCP_OPT_NODELAY       0x0004
+#define NEB_SOCK_TCP_OPT_FASTOPEN      0x0008 // queue length for listener, or data in SYN for connector
+#define NEB_SOCK_TCP_OPT_DEFER_ACCEPT  0x0010 // listener only
+#define NEB_SOCK_TCP_OPT_QUICKACK      0x0020 // not sticky, apply again after reading if needed
+#define NEB_SOCK_TCP_OPT_NOTSENT_LOWAT 0x0040
+#define NEB_SOCK_TCP_OPT_BUSY_POLL     0x0080
+#define NEB_SOCK_TCP_OPT_SNDBUF        0x0100
+#define NEB_SOCK_TCP_OPT_RCVBUF        0x0200
+
+enum {
+	NEB_SOCK_TCP_PROFILE_DEFAULT = 0, // nodelay, and notsent lowat to wake up writers in time
+	NEB_SOCK_TCP_PROFILE_LATENCY,     // plus fastopen, defer accept, quickack and busy poll
+	NEB_SOCK_TCP_PROFILE_THROUGHPUT,  // large buffers and notsent lowat, nagle enabled
+};
+
+struct neb_sock_tcp_profile {
+	unsigned int opts;       // NEB_SOCK_TCP_OPT_* to set
+	int backlog;             // for listen
+	int fastopen_qlen;       // for listener
+	int defer_accept_sec;
+	int notsent_lowat;       // in bytes
+	int busy_poll_usec;
+	int sndbuf;              // in bytes
+	int rcvbuf;              // in bytes
+};
+
+/**
+ * \brief init the profile with predefined values, which can be changed later
+ * \param[in] type NEB_SOCK_TCP_PROFILE_*
+ */
+extern void neb_sock_tcp_profile_init(struct neb_sock_tcp_profile *p, int type)
+	_nattr_nonnull((1));
+
+/**
+ * \param[in] p NULL to use the default profile
+ * \param[out] applied the NEB_SOCK_TCP_OPT_* accepted by the kernel, can be NULL
+ * \return the nonblock and cloexec listening socket, or -1 if failed
+ * \note accepted sockets inherit the options except quickack on Linux, use
+ *       neb_sock_tcp_apply on them if needed on other platforms
+ */
+extern int neb_sock_tcp_listen(const struct sockaddr *addr, socklen_t addrlen,
+                               const struct neb_sock_tcp_profile *p, unsigned int *applied)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief create a nonblock and cloexec socket to be connected, e.g. by neb_evdp_connect_fd
+ * \param[in] family AF_INET or AF_INET6
+ * \param[in] p NULL to use the default profile
+ * \param[out] applied the same as in neb_sock_tcp_listen
+ * \note with fastopen, connect may return at once, and the SYN is sent along
+ *       with the first write
+ */
+extern int neb_sock_tcp_new_connector(int family, const struct neb_sock_tcp_profile *p, unsigned int *applied)
+	_nattr_warn_unused_result;
+
+/**
+ * \brief apply the per connection options of the profile to a connected socket
+ * \return the NEB_SOCK_TCP_OPT_* accepted by the kernel
+ */
+extern unsigned int neb_sock_tcp_apply(int fd, const struct neb_sock_tcp_profile *p)
+	_nattr_nonnull((2));
+
+#endif
@@ -26,6 +26,7 @@ extern int neb_sock_unix_new_binded(int type, const char *addr)
  * \param timeout in milliseconds
  * \return a new connected fd, which will be nonblock and cloexec
  *         -1 if failed, and errno will be set to ETIMEDOUT if timeout
+ * \note it blocks until connected, use neb_evdp_connect_unix in evdp queue
  */
 extern int neb_sock_unix_new_connected(int type, const char *addr, int timeout)
 	_nattr_warn_unused_result _nattr_nonnull((2));
@@ -0,0 +1,208 @@
+
+#include <nebase/syslog.h>
+#include <nebase/sock/unix.h>
+#include <nebase/sock/inet.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/connect.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/un.h>
+
+struct neb_evdp_connect {
+	int fd;
+	neb_evdp_source_t s;
+	neb_evdp_queue_t q;
+	neb_evdp_timer_t t;
+	neb_evdp_timer_point tp;
+	neb_evdp_connect_handler_t cb;
+	void *udata;
+};
+
+static void connect_free(neb_evdp_connect_t c)
+{
+	if (c->tp)
+		neb_evdp_timer_del_point(c->t, c->tp);
+	if (c->fd >= 0)
+		close(c->fd);
+	free(c);
+}
+
+static int connect_on_remove(neb_evdp_source_t s)
+{
+	neb_evdp_connect_t c = neb_evdp_source_get_udata(s);
+	neb_evdp_source_del(s);
+	connect_free(c);
+	return 0;
+}
+
+static void connect_done(neb_evdp_connect_t c, int err)
+{
+	if (c->tp) {
+		neb_evdp_timer_del_point(c->t, c->tp);
+		c->tp = NULL;
+	}
+	int fd = -1;
+	if (!err) { // hand over the fd
+		fd = c->fd;
+		c->fd = -1;
+	}
+	c->cb(fd, err, c->udata);
+}
+
+static neb_evdp_cb_ret_t connect_on_write(int fd, void *udata, const void *context)
+{
+	neb_evdp_connect_t c = udata;
+
+	int err = 0;
+	if (neb_evdp_source_fd_get_sockerr(context, &err) != 0) {
+		neb_syslog(LOG_ERR, "Failed to get sockerr for connecting fd %d", fd);
+		err = EIO;
+	}
+	connect_done(c, err);
+	return NEB_EVDP_CB_REMOVE;
+}
+
+static neb_evdp_cb_ret_t connect_on_hup(int fd, void *udata, const void *context)
+{
+	neb_evdp_connect_t c = udata;
+
+	int err = 0;
+	if (neb_evdp_source_fd_get_sockerr(context, &err) != 0)
+		neb_syslog(LOG_ERR, "Failed to get sockerr for connecting fd %d", fd);
+	connect_done(c, err ? err : ECONNREFUSED);
+	return NEB_EVDP_CB_REMOVE;
+}
+
+static neb_evdp_timeout_ret_t connect_on_timeout(void *udata)
+{
+	neb_evdp_connect_t c = udata;
+	c->tp = NULL;
+	connect_done(c, ETIMEDOUT);
+	if (neb_evdp_queue_detach(c->q, c->s, 0) != 0) // c will be freed in on_remove
+		neb_syslog(LOG_CRIT, "Failed to detach timed out connect source");
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static neb_evdp_connect_t connect_start(neb_evdp_queue_t q, int fd, const struct sockaddr *addr, socklen_t addrlen,
+                                        int timeout, neb_evdp_connect_handler_t cb, void *udata)
+{
+	neb_evdp_timer_t t = NULL;
+	if (timeout > 0) {
+		t = neb_evdp_queue_get_timer(q);
+		if (!t) {
+			neb_syslog(LOG_ERR, "queue timer is required for connect timeout");
+			close(fd);
+			return NULL;
+		}
+	}
+
+	if (connect(fd, addr, addrlen) == -1 && errno != EINPROGRESS && errno != EINTR) {
+		int err = errno;
+		neb_syslogl(LOG_ERR, "connect: %m");
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+
+	neb_evdp_connect_t c = calloc(1, sizeof(struct neb_evdp_connect));
+	if (!c) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		close(fd);
+		return NULL;
+	}
+	c->fd = fd;
+	c->q = q;
+	c->t = t;
+	c->cb = cb;
+	c->udata = udata;
+
+	c->s = neb_evdp_source_new_os_fd(fd, connect_on_hup);
+	if (!c->s) {
+		neb_syslog(LOG_ERR, "Failed to create os_fd source for connect");
+		connect_free(c);
+		return NULL;
+	}
+	neb_evdp_source_set_udata(c->s, c);
+	if (neb_evdp_source_os_fd_next_write(c->s, connect_on_write) != 0) {
+		neb_evdp_source_del(c->s);
+		connect_free(c);
+		return NULL;
+	}
+
+	if (t) {
+		c->tp = neb_evdp_timer_new_point(t, neb_evdp_queue_get_abs_timeout(q, timeout), connect_on_timeout, c);
+		if (!c->tp) {
+			neb_syslog(LOG_ERR, "Failed to add connect timer point");
+			neb_evdp_source_del(c->s);
+			connect_free(c);
+			return NULL;
+		}
+	}
+
+	if (neb_evdp_queue_attach(q, c->s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach connect source");
+		neb_evdp_source_del(c->s);
+		connect_free(c);
+		return NULL;
+	}
+	neb_evdp_source_set_on_remove(c->s, connect_on_remove);
+
+	return c;
+}
+
+neb_evdp_connect_t neb_evdp_connect_unix(neb_evdp_queue_t q, int type, const char *addr, int timeout,
+                                         neb_evdp_connect_handler_t cb, void *udata)
+{
+	if (strlen(addr) > NEB_UNIX_ADDR_MAXLEN) {
+		neb_syslog(LOG_ERR, "Invalid unix socket addr %s: length overflow", addr);
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+	struct sockaddr_un saddr;
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sun_family = AF_UNIX;
+	strncpy(saddr.sun_path, addr, sizeof(saddr.sun_path) - 1);
+
+	int fd = neb_sock_unix_new(type);
+	if (fd == -1)
+		return NULL;
+
+	return connect_start(q, fd, (struct sockaddr *)&saddr, sizeof(saddr), timeout, cb, udata);
+}
+
+neb_evdp_connect_t neb_evdp_connect_inet(neb_evdp_queue_t q, int type, const struct sockaddr *addr, socklen_t addrlen,
+                                         int timeout, neb_evdp_connect_handler_t cb, void *udata)
+{
+	switch (addr->sa_family) {
+	case AF_INET:
+	case AF_INET6:
+		break;
+	default:
+		neb_syslog(LOG_ERR, "Unsupported address family %d", addr->sa_family);
+		errno = EAFNOSUPPORT;
+		return NULL;
+		break;
+	}
+
+	int fd = neb_sock_inet_new(addr->sa_family, type, 0);
+	if (fd == -1)
+		return NULL;
+
+	return connect_start(q, fd, addr, addrlen, timeout, cb, udata);
+}
+
+neb_evdp_connect_t neb_evdp_connect_fd(neb_evdp_queue_t q, int fd, const struct sockaddr *addr, socklen_t addrlen,
+                                       int timeout, neb_evdp_connect_handler_t cb, void *udata)
+{
+	return connect_start(q, fd, addr, addrlen, timeout, cb, udata);
+}
+
+void neb_evdp_connect_cancel(neb_evdp_connect_t c)
+{
+	if (neb_evdp_queue_detach(c->q, c->s, 0) != 0) // c will be freed in on_remove
+		neb_syslog(LOG_CRIT, "Failed to detach connect source");
+}
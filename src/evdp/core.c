@@ -6,8 +6,12 @@
 
 #include "core.h"
 #include "timer.h"
+#include "probes.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/wait.h>
 
 /*
  * TODO do batch detach, in q_foreach and q_destroy
@@ -27,6 +31,34 @@ static neb_evdp_source_t evdp_source_new_empty(neb_evdp_queue_t q)
 	return s;
 }
 
+#if !defined(WITH_EVDP_RUNTIME_DRIVER)
+# if defined(USE_IO_URING)
+#  define EVDP_DRIVER_NAME_STR "io_uring"
+# elif defined(USE_AIO_POLL)
+#  define EVDP_DRIVER_NAME_STR "aio_poll"
+# elif defined(OS_LINUX)
+#  define EVDP_DRIVER_NAME_STR "epoll"
+# elif defined(OSTYPE_BSD) || defined(OS_DARWIN)
+#  define EVDP_DRIVER_NAME_STR "kevent"
+# else
+#  define EVDP_DRIVER_NAME_STR "event_port"
+# endif
+
+int neb_evdp_driver_select(const char *name)
+{
+	if (strcmp(name, EVDP_DRIVER_NAME_STR) != 0) {
+		neb_syslog(LOG_ERR, "evdp driver %s is not compiled in", name);
+		return -1;
+	}
+	return 0;
+}
+
+const char *neb_evdp_driver_name(void)
+{
+	return EVDP_DRIVER_NAME_STR;
+}
+#endif
+
 neb_evdp_queue_t neb_evdp_queue_create(int batch_size)
 {
 	if (batch_size <= 0)
@@ -38,6 +70,8 @@ neb_evdp_queue_t neb_evdp_queue_create(int batch_size)
 		return NULL;
 	}
 	q->batch_size = batch_size;
+	q->slots.free_head = EVDP_SLOT_NONE;
+	q->cur_msec = neb_time_get_msec(); // for abs timeout before run
 
 	q->running_qs = evdp_source_new_empty(q);
 	if (!q->running_qs) {
@@ -62,6 +96,195 @@ neb_evdp_queue_t neb_evdp_queue_create(int batch_size)
 	return q;
 }
 
+#define EVDP_SLOT_TABLE_MIN_SIZE 64
+#define EVDP_FD_TABLE_MIN_SIZE 64
+
+static int evdp_queue_alloc_slot(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	if (q->slots.free_head == EVDP_SLOT_NONE) {
+		uint32_t old_size = q->slots.size;
+		uint32_t new_size = old_size ? old_size * 2 : EVDP_SLOT_TABLE_MIN_SIZE;
+		if (new_size <= old_size || new_size == EVDP_SLOT_NONE) {
+			neb_syslog(LOG_ERR, "Too many sources attached to queue %p", q);
+			return -1;
+		}
+		struct evdp_slot *table = realloc(q->slots.table, new_size * sizeof(struct evdp_slot));
+		if (!table) {
+			neb_syslogl(LOG_ERR, "realloc: %m");
+			return -1;
+		}
+		for (uint32_t i = old_size; i < new_size; i++) {
+			table[i].s = NULL;
+			table[i].gen = 1; // so tag 0 is always invalid
+			table[i].next_free = i + 1 < new_size ? i + 1 : EVDP_SLOT_NONE;
+		}
+		q->slots.table = table;
+		q->slots.size = new_size;
+		q->slots.free_head = old_size;
+	}
+
+	uint32_t idx = q->slots.free_head;
+	struct evdp_slot *slot = q->slots.table + idx;
+	q->slots.free_head = slot->next_free;
+	slot->next_free = EVDP_SLOT_NONE;
+	slot->s = s;
+	s->tag = ((uint64_t)slot->gen << 32) | idx;
+	return 0;
+}
+
+static void evdp_queue_free_slot(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	uint32_t idx = (uint32_t)s->tag;
+	struct evdp_slot *slot = q->slots.table + idx;
+	slot->s = NULL;
+	if (++slot->gen == 0) // stale events will be rejected
+		slot->gen = 1;
+	slot->next_free = q->slots.free_head;
+	q->slots.free_head = idx;
+	s->tag = 0;
+}
+
+static int evdp_source_get_index_fd(neb_evdp_source_t s)
+{
+	switch (s->type) {
+	case EVDP_SOURCE_RO_FD:
+		return ((const struct evdp_conf_ro_fd *)s->conf)->fd;
+		break;
+	case EVDP_SOURCE_OS_FD:
+		return ((const struct evdp_conf_fd *)s->conf)->fd;
+		break;
+	default:
+		return -1;
+		break;
+	}
+}
+
+static int evdp_queue_index_fd(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	int fd = evdp_source_get_index_fd(s);
+	if (fd < 0)
+		return 0;
+
+	if (fd >= q->fd_table_size) {
+		int new_size = q->fd_table_size ? q->fd_table_size : EVDP_FD_TABLE_MIN_SIZE;
+		while (new_size <= fd)
+			new_size *= 2;
+		neb_evdp_source_t *table = realloc(q->fd_table, new_size * sizeof(neb_evdp_source_t));
+		if (!table) {
+			neb_syslogl(LOG_ERR, "realloc: %m");
+			return -1;
+		}
+		memset(table + q->fd_table_size, 0, (new_size - q->fd_table_size) * sizeof(neb_evdp_source_t));
+		q->fd_table = table;
+		q->fd_table_size = new_size;
+	}
+
+	q->fd_table[fd] = s;
+	s->indexed_fd = fd;
+	s->fd_indexed = 1;
+	return 0;
+}
+
+static void evdp_queue_unindex_fd(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	if (!s->fd_indexed)
+		return;
+	if (q->fd_table[s->indexed_fd] == s)
+		q->fd_table[s->indexed_fd] = NULL;
+	s->fd_indexed = 0;
+}
+
+/*
+ * os_fd deadline by queue timer, for drivers without native support
+ */
+
+static void do_detach_from_queue(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close);
+
+static neb_evdp_timeout_ret_t os_fd_on_deadline(void *udata)
+{
+	neb_evdp_source_t s = udata;
+	struct evdp_conf_fd *conf = s->conf;
+	neb_evdp_queue_t q = s->q_in_use;
+	conf->deadline_tp = NULL;
+
+	if (neb_evdp_source_os_fd_next_read(s, NULL) != 0 || neb_evdp_source_os_fd_next_write(s, NULL) != 0)
+		neb_syslog(LOG_ERR, "Failed to disable os_fd source %p after deadline", s);
+
+	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
+	if (conf->do_timeout) {
+		s->no_detach = 1;
+		ret = conf->do_timeout(conf->fd, s->udata, NULL);
+		s->no_detach = 0;
+	}
+	switch (ret) {
+	case NEB_EVDP_CB_REMOVE:
+		do_detach_from_queue(q, s, 0);
+		break;
+	case NEB_EVDP_CB_CLOSE:
+		do_detach_from_queue(q, s, 1);
+		break;
+	case NEB_EVDP_CB_BREAK_ERR:
+	case NEB_EVDP_CB_BREAK_EXP:
+		neb_syslog(LOG_ERR, "BREAK is not supported in os_fd timeout handler");
+		break;
+	default:
+		break;
+	}
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static int os_fd_deadline_need_timer(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	const struct evdp_conf_fd *conf = s->conf;
+	if (!conf->deadline_msec || evdp_source_os_fd_native_deadline())
+		return 0;
+	if (!q->timer) {
+		neb_syslog(LOG_ERR, "queue timer is required for os_fd deadline");
+		return -1;
+	}
+	return 1;
+}
+
+static void os_fd_arm_deadline(neb_evdp_source_t s)
+{
+	struct evdp_conf_fd *conf = s->conf;
+	neb_evdp_queue_t q = s->q_in_use;
+	if (conf->deadline_tp || (!conf->do_read && !conf->do_write))
+		return;
+	if (os_fd_deadline_need_timer(q, s) != 1)
+		return;
+	conf->deadline_tp = neb_evdp_timer_new_point(q->timer, neb_time_get_msec() + conf->deadline_msec, os_fd_on_deadline, s);
+	if (!conf->deadline_tp)
+		neb_syslog(LOG_ERR, "Failed to add os_fd deadline timer point");
+}
+
+static void os_fd_disarm_deadline(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_conf_fd *conf = s->conf;
+	if (conf->deadline_tp) {
+		neb_evdp_timer_del_point(q->timer, conf->deadline_tp);
+		conf->deadline_tp = NULL;
+	}
+}
+
+static neb_evdp_cb_ret_t os_fd_handle(neb_evdp_queue_t q, const struct neb_evdp_event *ne)
+{
+	neb_evdp_source_t s = ne->source;
+	struct evdp_conf_fd *conf = s->conf;
+	// so a wait armed again in the handlers gets a new deadline
+	neb_evdp_timer_point tp = conf->deadline_tp;
+	conf->deadline_tp = NULL;
+
+	neb_evdp_cb_ret_t ret = evdp_source_os_fd_handle(ne);
+	if (!tp)
+		return ret;
+	if (!conf->deadline_tp && evdp_source_os_fd_is_waiting(s))
+		conf->deadline_tp = tp; // the armed wait is not completed, i.e. error events
+	else
+		neb_evdp_timer_del_point(q->timer, tp);
+	return ret;
+}
+
 static void do_detach_from_queue(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
 {
 	evdp_queue_rm_pending_events(q, s);
@@ -80,16 +303,25 @@ static void do_detach_from_queue(neb_evdp_queue_t q, neb_evdp_source_t s, int to
 		evdp_source_ro_fd_detach(q, s, to_close);
 		break;
 	case EVDP_SOURCE_OS_FD:
+		os_fd_disarm_deadline(q, s);
 		evdp_source_os_fd_detach(q, s, to_close);
 		break;
 	case EVDP_SOURCE_LT_FD:
 		// TODO type and platform specific detach
 		break;
+	case EVDP_SOURCE_PROC:
+		evdp_source_proc_detach(q, s, to_close);
+		break;
 	default:
 		neb_syslog(LOG_ERR, "Unsupported evdp_source type %d", s->type);
 		break;
 	}
 
+	EVDP_PROBE4(detach, q, s, s->type, to_close);
+
+	evdp_queue_unindex_fd(q, s);
+	evdp_queue_free_slot(q, s);
+
 	// remove all s from running_q or pending_q
 	EVDP_SLIST_REMOVE(s);
 	if (s->pending) {
@@ -112,6 +344,8 @@ void neb_evdp_queue_destroy(neb_evdp_queue_t q)
 {
 	q->destroying = 1;
 	if (q->foreach_s) {
+		neb_evdp_queue_foreach_set_end(q); // unlink it from running_qs
+		q->foreach_s->q_in_use = NULL;
 		neb_evdp_source_del(q->foreach_s);
 		q->foreach_s = NULL;
 	}
@@ -137,6 +371,11 @@ void neb_evdp_queue_destroy(neb_evdp_queue_t q)
 		q->context = NULL;
 	}
 
+	if (q->slots.table)
+		free(q->slots.table);
+	if (q->fd_table)
+		free(q->fd_table);
+
 	free(q);
 }
 
@@ -188,6 +427,14 @@ int neb_evdp_queue_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 
 	s->foreach_id = q->foreach_id; // skip ongoing foreach
 
+	// the tag is needed by drivers when attach
+	if (evdp_queue_alloc_slot(q, s) != 0)
+		return -1;
+	if (evdp_queue_index_fd(q, s) != 0) {
+		evdp_queue_free_slot(q, s);
+		return -1;
+	}
+
 	// s may be in running_q or in pending_q, it depends
 	int ret = 0;
 	switch (s->type) {
@@ -206,11 +453,14 @@ int neb_evdp_queue_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 		ret = evdp_source_ro_fd_attach(q, s);
 		break;
 	case EVDP_SOURCE_OS_FD:
-		ret = evdp_source_os_fd_attach(q, s);
+		ret = os_fd_deadline_need_timer(q, s) < 0 ? -1 : evdp_source_os_fd_attach(q, s);
 		break;
 	case EVDP_SOURCE_LT_FD:
 		// TODO type and platform specific attach (pending)
 		break;
+	case EVDP_SOURCE_PROC:
+		ret = evdp_source_proc_attach(q, s);
+		break;
 	default:
 		neb_syslog(LOG_ERR, "Unsupported evdp_source type %d", s->type);
 		ret = -1;
@@ -218,10 +468,15 @@ int neb_evdp_queue_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 	}
 	if (ret != 0) {
 		neb_syslog(LOG_ERR, "Failed to attach source");
+		evdp_queue_unindex_fd(q, s);
+		evdp_queue_free_slot(q, s);
 		return -1;
 	}
 
 	s->q_in_use = q;
+	if (s->type == EVDP_SOURCE_OS_FD)
+		os_fd_arm_deadline(s);
+	EVDP_PROBE3(attach, q, s, s->type);
 	return 0;
 }
 
@@ -370,6 +625,7 @@ static neb_evdp_cb_ret_t handle_event(neb_evdp_queue_t q)
 	}
 
 	int ret = NEB_EVDP_CB_CONTINUE;
+	EVDP_PROBE3(dispatch, q, ne.source, ne.source->type);
 	ne.source->no_detach = 1;
 	switch (ne.source->type) {
 	case EVDP_SOURCE_NONE:
@@ -385,16 +641,20 @@ static neb_evdp_cb_ret_t handle_event(neb_evdp_queue_t q)
 		ret = evdp_source_ro_fd_handle(&ne);
 		break;
 	case EVDP_SOURCE_OS_FD:
-		ret = evdp_source_os_fd_handle(&ne);
+		ret = os_fd_handle(q, &ne);
 		break;
 	case EVDP_SOURCE_LT_FD:
 		// TODO type and platform specific handle
 		break;
+	case EVDP_SOURCE_PROC:
+		ret = evdp_source_proc_handle(&ne);
+		break;
 	default:
 		neb_syslog(LOG_ERR, "Unsupported evdp_source type %d", ne.source->type);
 		break;
 	}
 	ne.source->no_detach = 0;
+	EVDP_PROBE4(callback_ret, q, ne.source, ne.source->type, ret);
 
 	switch (ret) {
 	case NEB_EVDP_CB_REMOVE:
@@ -439,7 +699,10 @@ int neb_evdp_queue_run(neb_evdp_queue_t q)
 			}
 		}
 
-		if (evdp_queue_flush_pending_sources(q) != 0) {
+		EVDP_PROBE2(flush_start, q, q->stats.pending);
+		int flush_ret = evdp_queue_flush_pending_sources(q);
+		EVDP_PROBE3(flush_end, q, q->stats.pending, flush_ret);
+		if (flush_ret != 0) {
 			neb_syslog(LOG_ERR, "Failed to add pending sources");
 			goto exit_err;
 		}
@@ -447,10 +710,12 @@ int neb_evdp_queue_run(neb_evdp_queue_t q)
 		q->cur_msec = neb_time_get_msec();
 		int timeout_ms = q->timer ? evdp_timer_get_min(q->timer, q->cur_msec) : -1;
 
+		EVDP_PROBE2(wait_start, q, timeout_ms);
 		if (evdp_queue_wait_events(q, timeout_ms) != 0) {
 			neb_syslog(LOG_ERR, "Error occured while getting evdp events");
 			goto exit_err;
 		}
+		EVDP_PROBE2(wait_end, q, q->nevents);
 
 		q->cur_msec = neb_time_get_msec();
 		int64_t expire_msec = q->cur_msec;
@@ -500,6 +765,13 @@ exit_err:
 	return -1;
 }
 
+neb_evdp_source_t neb_evdp_queue_find_fd(neb_evdp_queue_t q, int fd)
+{
+	if (fd < 0 || fd >= q->fd_table_size)
+		return NULL;
+	return q->fd_table[fd];
+}
+
 int neb_evdp_source_del(neb_evdp_source_t s)
 {
 	if (s->q_in_use) {
@@ -529,6 +801,10 @@ int neb_evdp_source_del(neb_evdp_source_t s)
 		case EVDP_SOURCE_LT_FD:
 			// TODO type and platform specific deinit
 			break;
+		case EVDP_SOURCE_PROC:
+			evdp_destroy_source_proc_context(s->context);
+			s->context = NULL;
+			break;
 		default:
 			neb_syslog(LOG_ERR, "Unsupported evdp_source type %d", s->type);
 			break;
@@ -561,6 +837,21 @@ neb_evdp_queue_t neb_evdp_source_get_queue(neb_evdp_source_t s)
 	return s->q_in_use;
 }
 
+int neb_evdp_source_get_fd(neb_evdp_source_t s)
+{
+	switch (s->type) {
+	case EVDP_SOURCE_RO_FD:
+		return ((const struct evdp_conf_ro_fd *)s->conf)->fd;
+		break;
+	case EVDP_SOURCE_OS_FD:
+		return ((const struct evdp_conf_fd *)s->conf)->fd;
+		break;
+	default:
+		return -1;
+		break;
+	}
+}
+
 void neb_evdp_source_set_on_remove(neb_evdp_source_t s, neb_evdp_source_handler_t on_remove)
 {
 	s->on_remove = on_remove;
@@ -709,6 +1000,22 @@ neb_evdp_source_t neb_evdp_source_new_ro_fd(int fd, neb_evdp_io_handler_t rf, ne
 	return s;
 }
 
+int neb_evdp_source_ro_fd_set_exclusive(neb_evdp_source_t s, int on)
+{
+	if (s->type != EVDP_SOURCE_RO_FD) {
+		neb_syslog(LOG_ERR, "exclusive wakeup is only supported for ro_fd source");
+		return -1;
+	}
+	if (s->q_in_use) {
+		neb_syslog(LOG_ERR, "exclusive wakeup should be set before attached");
+		return -1;
+	}
+
+	struct evdp_conf_ro_fd *conf = s->conf;
+	conf->exclusive = on ? 1 : 0;
+	return 0;
+}
+
 neb_evdp_source_t neb_evdp_source_new_os_fd(int fd, neb_evdp_io_handler_t hf)
 {
 	neb_evdp_source_t s = calloc(1, sizeof(struct neb_evdp_source));
@@ -767,6 +1074,7 @@ int neb_evdp_source_os_fd_next_read(neb_evdp_source_t s, neb_evdp_io_handler_t r
 		evdp_source_os_fd_init_read(s, rf);
 		return 0;
 	} else if (rf) {
+		os_fd_arm_deadline(s);
 		return evdp_source_os_fd_reset_read(s);
 	} else {
 		return evdp_source_os_fd_unset_read(s);
@@ -781,8 +1089,101 @@ int neb_evdp_source_os_fd_next_write(neb_evdp_source_t s, neb_evdp_io_handler_t
 		evdp_source_os_fd_init_write(s, wf);
 		return 0;
 	} else if (wf) {
+		os_fd_arm_deadline(s);
 		return evdp_source_os_fd_reset_write(s);
 	} else {
 		return evdp_source_os_fd_unset_write(s);
 	}
 }
+
+void neb_evdp_source_os_fd_set_error(neb_evdp_source_t s, neb_evdp_io_handler_t ef)
+{
+	struct evdp_conf_fd *conf = s->conf;
+	conf->do_error = ef;
+}
+
+int neb_evdp_source_os_fd_set_deadline(neb_evdp_source_t s, int msec, neb_evdp_io_handler_t tf)
+{
+	if (s->type != EVDP_SOURCE_OS_FD) {
+		neb_syslog(LOG_ERR, "deadline is only supported for os_fd source");
+		return -1;
+	}
+
+	struct evdp_conf_fd *conf = s->conf;
+	conf->deadline_msec = msec > 0 ? msec : 0;
+	conf->do_timeout = tf;
+	if (s->q_in_use) {
+		if (!conf->deadline_msec)
+			os_fd_disarm_deadline(s->q_in_use, s);
+		else if (os_fd_deadline_need_timer(s->q_in_use, s) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+neb_evdp_source_t neb_evdp_source_new_proc(pid_t pid, int pidfd, neb_evdp_proc_handler_t pf)
+{
+	if (pid <= 0) {
+		neb_syslog(LOG_ERR, "Invalid pid value: %d", pid);
+		return NULL;
+	}
+
+	neb_evdp_source_t s = calloc(1, sizeof(struct neb_evdp_source));
+	if (!s) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	s->type = EVDP_SOURCE_PROC;
+
+	struct evdp_conf_proc *conf = calloc(1, sizeof(struct evdp_conf_proc));
+	if (!conf) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		neb_evdp_source_del(s);
+		return NULL;
+	}
+	conf->pid = pid;
+	conf->pidfd = pidfd;
+	conf->do_exit = pf;
+	s->conf = conf;
+
+	s->context = evdp_create_source_proc_context(s);
+	if (!s->context) {
+		neb_evdp_source_del(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+neb_evdp_cb_ret_t evdp_source_proc_do_exit(neb_evdp_source_t s)
+{
+	const struct evdp_conf_proc *conf = s->conf;
+
+	int wstatus = -1;
+	pid_t ret_pid = waitpid(conf->pid, &wstatus, WNOHANG);
+	switch (ret_pid) {
+	case -1:
+		if (errno != ECHILD)
+			neb_syslogl(LOG_ERR, "waitpid(%d): %m", conf->pid);
+		wstatus = -1; // reaped elsewhere
+		break;
+	case 0: // not exited, should not happen
+		neb_syslog(LOG_NOTICE, "child %d is still running when exit event received", conf->pid);
+		return NEB_EVDP_CB_CONTINUE;
+		break;
+	default:
+		break;
+	}
+
+	neb_evdp_cb_ret_t ret = conf->do_exit(conf->pid, wstatus, s->udata);
+	switch (ret) {
+	case NEB_EVDP_CB_BREAK_ERR:
+	case NEB_EVDP_CB_BREAK_EXP:
+	case NEB_EVDP_CB_CLOSE:
+		return ret;
+		break;
+	default:
+		return NEB_EVDP_CB_REMOVE;
+		break;
+	}
+}
@@ -2,9 +2,15 @@
 #ifndef NEB_SRC_EVDP_CORE_H
 #define NEB_SRC_EVDP_CORE_H 1
 
+#include "options.h"
+
 #include <nebase/cdefs.h>
 #include <nebase/evdp/base.h>
 
+#if defined(WITH_EVDP_RUNTIME_DRIVER) && defined(EVDP_DRIVER_NAME)
+# include "driver/rename.h"
+#endif
+
 #include <stdint.h>
 #include <stddef.h>
 
@@ -16,6 +22,7 @@ enum {
 	EVDP_SOURCE_RO_FD,    /* read-only fd */
 	EVDP_SOURCE_OS_FD,    /* oneshot fd */
 	EVDP_SOURCE_LT_FD,    /* level-triggered fd */
+	EVDP_SOURCE_PROC,     /* child process exit */
 };
 
 #define TOTAL_DAY_SECONDS (24 * 3600)
@@ -25,6 +32,20 @@ extern void *evdp_create_queue_context(neb_evdp_queue_t q)
 extern void evdp_destroy_queue_context(void *context)
 	_nattr_nonnull((1)) _nattr_hidden;
 
+/*
+ * every attached source has a slot in the queue slot table, and the tag, which
+ * is (generation << 32 | slot), is used as kernel user data by drivers that
+ * support 64bit user data, so stale events of detached sources are rejected
+ * in O(1) when fetched
+ */
+struct evdp_slot {
+	neb_evdp_source_t s;
+	uint32_t gen;
+	uint32_t next_free;
+};
+
+#define EVDP_SLOT_NONE UINT32_MAX
+
 struct neb_evdp_queue {
 	void *context;
 	int batch_size;
@@ -56,8 +77,32 @@ struct neb_evdp_queue {
 		int pending;
 		int running;
 	} stats;
+
+	struct {
+		struct evdp_slot *table;
+		uint32_t size;
+		uint32_t free_head;
+	} slots;
+
+	neb_evdp_source_t *fd_table; // indexed by fd of os_fd and ro_fd sources
+	int fd_table_size;
 };
 
+/**
+ * \brief get the attached source by tag
+ * \return NULL if the source has been detached
+ */
+static inline neb_evdp_source_t evdp_queue_get_source(neb_evdp_queue_t q, uint64_t tag)
+{
+	uint32_t idx = (uint32_t)tag;
+	if (idx >= q->slots.size)
+		return NULL;
+	const struct evdp_slot *slot = q->slots.table + idx;
+	if (slot->gen != (uint32_t)(tag >> 32))
+		return NULL;
+	return slot->s;
+}
+
 struct evdp_conf_itimer {
 	unsigned int ident;
 	union {
@@ -85,6 +130,7 @@ extern int evdp_source_abstimer_regulate(neb_evdp_source_t s)
 
 struct evdp_conf_ro_fd {
 	int fd;
+	int exclusive;
 	neb_evdp_io_handler_t do_hup;
 	neb_evdp_io_handler_t do_read;
 };
@@ -98,6 +144,10 @@ struct evdp_conf_fd {
 	neb_evdp_io_handler_t do_hup;
 	neb_evdp_io_handler_t do_read;
 	neb_evdp_io_handler_t do_write;
+	neb_evdp_io_handler_t do_error;
+	neb_evdp_io_handler_t do_timeout;
+	int deadline_msec;
+	neb_evdp_timer_point deadline_tp; // only used if no native deadline support
 };
 extern void *evdp_create_source_os_fd_context(neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
@@ -106,6 +156,21 @@ extern void evdp_reset_source_os_fd_context(neb_evdp_source_t s)
 extern void evdp_destroy_source_os_fd_context(void *context)
 	_nattr_nonnull((1)) _nattr_hidden;
 
+struct evdp_conf_proc {
+	pid_t pid;
+	int pidfd;
+	neb_evdp_proc_handler_t do_exit;
+};
+extern void *evdp_create_source_proc_context(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+extern void evdp_destroy_source_proc_context(void *context)
+	_nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief reap the child and call the exit handler, shared by all drivers
+ */
+extern neb_evdp_cb_ret_t evdp_source_proc_do_exit(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+
 struct neb_evdp_source {
 	neb_evdp_source_t prev;
 	neb_evdp_source_t next;
@@ -116,6 +181,10 @@ struct neb_evdp_source {
 	uint32_t foreach_id;
 	uint32_t pending:1;   /* whether is in pending q */
 	uint32_t no_detach:1; /* detach protected */
+	uint32_t fd_indexed:1; /* whether is in queue fd_table */
+
+	uint64_t tag;         /* slot tag, 0 if not attached */
+	int indexed_fd;
 
 	int utype;
 	void *udata;
@@ -232,5 +301,100 @@ extern int evdp_source_os_fd_reset_write(neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
 extern int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \return 1 if the driver supports os_fd deadline by itself, or 0 if the
+ *         queue timer should be used
+ */
+extern int evdp_source_os_fd_native_deadline(void)
+	_nattr_hidden;
+/**
+ * \return 1 if read or write is still armed, i.e. after handled the event
+ */
+extern int evdp_source_os_fd_is_waiting(neb_evdp_source_t s)
+	_nattr_nonnull((1)) _nattr_hidden;
+
+extern int evdp_source_proc_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+extern void evdp_source_proc_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+	_nattr_nonnull((1, 2)) _nattr_hidden;
+extern neb_evdp_cb_ret_t evdp_source_proc_handle(const struct neb_evdp_event *ne)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+
+#if defined(WITH_EVDP_RUNTIME_DRIVER)
+struct evdp_driver {
+	const char *name;
+	int (*probe)(void);
+	int (*fd_get_sockerr)(const void *context, int *sockerr);
+	int (*fd_get_nread)(const void *context, int *nbytes);
+
+	void *(*create_queue_context)(neb_evdp_queue_t q);
+	void (*destroy_queue_context)(void *context);
+	void (*queue_rm_pending_events)(neb_evdp_queue_t q, neb_evdp_source_t s);
+	int (*queue_wait_events)(neb_evdp_queue_t q, int timeout_ms);
+	int (*queue_flush_pending_sources)(neb_evdp_queue_t q);
+	int (*queue_fetch_event)(neb_evdp_queue_t q, struct neb_evdp_event *nee);
+	void (*queue_finish_event)(neb_evdp_queue_t q, struct neb_evdp_event *nee);
+
+	void *(*create_source_itimer_context)(neb_evdp_source_t s);
+	void (*destroy_source_itimer_context)(void *context);
+	int (*source_itimer_attach)(neb_evdp_queue_t q, neb_evdp_source_t s);
+	void (*source_itimer_detach)(neb_evdp_queue_t q, neb_evdp_source_t s);
+	neb_evdp_cb_ret_t (*source_itimer_handle)(const struct neb_evdp_event *ne);
+
+	void *(*create_source_abstimer_context)(neb_evdp_source_t s);
+	void (*destroy_source_abstimer_context)(void *context);
+	int (*source_abstimer_regulate)(neb_evdp_source_t s);
+	int (*source_abstimer_attach)(neb_evdp_queue_t q, neb_evdp_source_t s);
+	void (*source_abstimer_detach)(neb_evdp_queue_t q, neb_evdp_source_t s);
+	neb_evdp_cb_ret_t (*source_abstimer_handle)(const struct neb_evdp_event *ne);
+
+	void *(*create_source_ro_fd_context)(neb_evdp_source_t s);
+	void (*destroy_source_ro_fd_context)(void *context);
+	int (*source_ro_fd_attach)(neb_evdp_queue_t q, neb_evdp_source_t s);
+	void (*source_ro_fd_detach)(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close);
+	neb_evdp_cb_ret_t (*source_ro_fd_handle)(const struct neb_evdp_event *ne);
+
+	void *(*create_source_os_fd_context)(neb_evdp_source_t s);
+	void (*reset_source_os_fd_context)(neb_evdp_source_t s);
+	void (*destroy_source_os_fd_context)(void *context);
+	int (*source_os_fd_attach)(neb_evdp_queue_t q, neb_evdp_source_t s);
+	void (*source_os_fd_detach)(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close);
+	neb_evdp_cb_ret_t (*source_os_fd_handle)(const struct neb_evdp_event *ne);
+	void (*source_os_fd_init_read)(neb_evdp_source_t s, neb_evdp_io_handler_t rf);
+	int (*source_os_fd_reset_read)(neb_evdp_source_t s);
+	int (*source_os_fd_unset_read)(neb_evdp_source_t s);
+	void (*source_os_fd_init_write)(neb_evdp_source_t s, neb_evdp_io_handler_t wf);
+	int (*source_os_fd_reset_write)(neb_evdp_source_t s);
+	int (*source_os_fd_unset_write)(neb_evdp_source_t s);
+	int (*source_os_fd_native_deadline)(void);
+	int (*source_os_fd_is_waiting)(neb_evdp_source_t s);
+
+	void *(*create_source_proc_context)(neb_evdp_source_t s);
+	void (*destroy_source_proc_context)(void *context);
+	int (*source_proc_attach)(neb_evdp_queue_t q, neb_evdp_source_t s);
+	void (*source_proc_detach)(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close);
+	neb_evdp_cb_ret_t (*source_proc_handle)(const struct neb_evdp_event *ne);
+};
+
+/**
+ * \brief get the driver in use, select one if not yet
+ * \return NULL if no driver is available
+ */
+extern const struct evdp_driver *evdp_driver_get(void)
+	_nattr_warn_unused_result _nattr_hidden;
+
+# if defined(EVDP_DRIVER_NAME)
+extern const struct evdp_driver evdp_driver_ops _nattr_hidden;
+/**
+ * \return 0 if the driver can be used in the running system
+ */
+extern int evdp_driver_probe(void)
+	_nattr_warn_unused_result _nattr_hidden;
+extern int neb_evdp_source_fd_get_sockerr(const void *context, int *sockerr)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+extern int neb_evdp_source_fd_get_nread(const void *context, int *nbytes)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+# endif
+#endif
 
 #endif
@@ -0,0 +1,658 @@
+
+#include <nebase/syslog.h>
+#include <nebase/sysconf.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/coroutine.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#if !defined(MAP_ANON)
+# define MAP_ANON MAP_ANONYMOUS
+#endif
+#if !defined(MAP_STACK)
+# define MAP_STACK 0
+#endif
+
+#if defined(__x86_64__) || defined(__aarch64__)
+# define CO_CTX_ASM 1
+#else
+# include <ucontext.h>
+#endif
+
+#define CO_WAIT_READ  0x01
+#define CO_WAIT_WRITE 0x02
+#define CO_WAIT_TIMER 0x04
+
+#define CO_STACK_POOL_MAX 64
+
+struct co_ctx {
+#if defined(CO_CTX_ASM)
+	void *sp;
+#else
+	ucontext_t uc;
+#endif
+};
+
+struct neb_co {
+	struct co_ctx ctx;
+	struct co_ctx *caller;
+	void *stack;       // the mapping, with the guard page at the lowest address
+	size_t stack_size; // the mapping size
+
+	neb_evdp_queue_t q;
+	neb_co_func_t fn;
+	void *arg;
+
+	neb_evdp_source_t s;
+	int s_fd;
+	int armed_dir;
+
+	int wait_fd;
+	int wait_dir;
+	int wait_err;
+
+	uint32_t done:1;
+	uint32_t in_handler:1;     // resumed by the handler of s
+	uint32_t s_closed:1;       // fd of s closed in the handler of s
+	uint32_t s_retarget:1;     // s should be attached to wait_fd after removed
+	uint32_t s_detaching:1;    // detached by ourself, skip on_remove
+	uint32_t free_on_remove:1;
+};
+
+struct co_stack {
+	struct co_stack *next;
+};
+
+static _Thread_local neb_co_t co_current = NULL;
+static _Thread_local struct co_ctx co_thread_ctx;
+static _Thread_local struct co_stack *co_stack_pool = NULL;
+static _Thread_local int co_stack_pool_count = 0;
+
+/*
+ * Context switch
+ *  only callee-saved registers are saved, as the switch is always a function
+ *  call, and no signal mask is touched, which is what ucontext does
+ */
+
+extern void evdp_co_main(neb_co_t co) _nattr_hidden;
+extern void evdp_co_entry(void) _nattr_hidden;
+extern void evdp_co_switch(struct co_ctx *from, struct co_ctx *to) _nattr_hidden;
+
+#if defined(CO_CTX_ASM)
+
+# if defined(__APPLE__)
+#  define CO_ASM_SYM(x) "_" #x
+#  define CO_ASM_GLOBAL(x) "\t.globl _" #x "\n\t.private_extern _" #x "\n"
+# else
+#  define CO_ASM_SYM(x) #x
+#  define CO_ASM_GLOBAL(x) "\t.globl " #x "\n\t.hidden " #x "\n"
+# endif
+
+# if defined(__x86_64__)
+
+/*
+ * stack layout from sp: mxcsr & x87 cw, r15, r14, r13, r12, rbx, rbp, ret
+ */
+#define CO_CTX_FRAME_SIZE 64
+
+__asm__(
+	"\t.text\n"
+	"\t.p2align 4\n"
+	CO_ASM_GLOBAL(evdp_co_switch)
+	CO_ASM_SYM(evdp_co_switch) ":\n"
+	"\tpushq %rbp\n"
+	"\tpushq %rbx\n"
+	"\tpushq %r12\n"
+	"\tpushq %r13\n"
+	"\tpushq %r14\n"
+	"\tpushq %r15\n"
+	"\tsubq $8, %rsp\n"
+	"\tstmxcsr (%rsp)\n"
+	"\tfnstcw 4(%rsp)\n"
+	"\tmovq %rsp, (%rdi)\n"
+	"\tmovq (%rsi), %rsp\n"
+	"\tldmxcsr (%rsp)\n"
+	"\tfldcw 4(%rsp)\n"
+	"\taddq $8, %rsp\n"
+	"\tpopq %r15\n"
+	"\tpopq %r14\n"
+	"\tpopq %r13\n"
+	"\tpopq %r12\n"
+	"\tpopq %rbx\n"
+	"\tpopq %rbp\n"
+	"\tret\n"
+	"\t.p2align 4\n"
+	CO_ASM_GLOBAL(evdp_co_entry)
+	CO_ASM_SYM(evdp_co_entry) ":\n"
+	"\tmovq %rbx, %rdi\n"
+	"\tcall " CO_ASM_SYM(evdp_co_main) "\n"
+	"\tud2\n"
+);
+
+static void co_ctx_init(struct co_ctx *ctx, void *stack_top, neb_co_t co)
+{
+	uintptr_t *sp = (uintptr_t *)(((uintptr_t)stack_top & ~(uintptr_t)15) - CO_CTX_FRAME_SIZE);
+	for (int i = 0; i < CO_CTX_FRAME_SIZE / 8; i++)
+		sp[i] = 0;
+	uint32_t *fpu = (uint32_t *)sp;
+	fpu[0] = 0x1F80; // mxcsr default
+	fpu[1] = 0x037F; // x87 cw default
+	sp[5] = (uintptr_t)co; // rbx
+	sp[7] = (uintptr_t)evdp_co_entry;
+	ctx->sp = sp;
+}
+
+# elif defined(__aarch64__)
+
+/*
+ * stack layout from sp: x19-x28, x29, x30, d8-d15
+ */
+#define CO_CTX_FRAME_SIZE 176
+
+__asm__(
+	"\t.text\n"
+	"\t.p2align 4\n"
+	CO_ASM_GLOBAL(evdp_co_switch)
+	CO_ASM_SYM(evdp_co_switch) ":\n"
+	"\tsub sp, sp, #176\n"
+	"\tstp x19, x20, [sp, #0]\n"
+	"\tstp x21, x22, [sp, #16]\n"
+	"\tstp x23, x24, [sp, #32]\n"
+	"\tstp x25, x26, [sp, #48]\n"
+	"\tstp x27, x28, [sp, #64]\n"
+	"\tstp x29, x30, [sp, #80]\n"
+	"\tstp d8, d9, [sp, #96]\n"
+	"\tstp d10, d11, [sp, #112]\n"
+	"\tstp d12, d13, [sp, #128]\n"
+	"\tstp d14, d15, [sp, #144]\n"
+	"\tmov x9, sp\n"
+	"\tstr x9, [x0]\n"
+	"\tldr x9, [x1]\n"
+	"\tmov sp, x9\n"
+	"\tldp x19, x20, [sp, #0]\n"
+	"\tldp x21, x22, [sp, #16]\n"
+	"\tldp x23, x24, [sp, #32]\n"
+	"\tldp x25, x26, [sp, #48]\n"
+	"\tldp x27, x28, [sp, #64]\n"
+	"\tldp x29, x30, [sp, #80]\n"
+	"\tldp d8, d9, [sp, #96]\n"
+	"\tldp d10, d11, [sp, #112]\n"
+	"\tldp d12, d13, [sp, #128]\n"
+	"\tldp d14, d15, [sp, #144]\n"
+	"\tadd sp, sp, #176\n"
+	"\tret\n"
+	"\t.p2align 4\n"
+	CO_ASM_GLOBAL(evdp_co_entry)
+	CO_ASM_SYM(evdp_co_entry) ":\n"
+	"\tmov x0, x19\n"
+	"\tbl " CO_ASM_SYM(evdp_co_main) "\n"
+	"\tbrk #0\n"
+);
+
+static void co_ctx_init(struct co_ctx *ctx, void *stack_top, neb_co_t co)
+{
+	uintptr_t *sp = (uintptr_t *)(((uintptr_t)stack_top & ~(uintptr_t)15) - CO_CTX_FRAME_SIZE);
+	for (int i = 0; i < CO_CTX_FRAME_SIZE / 8; i++)
+		sp[i] = 0;
+	sp[0] = (uintptr_t)co; // x19
+	sp[11] = (uintptr_t)evdp_co_entry; // x30
+	ctx->sp = sp;
+}
+
+# endif
+
+#else /* ucontext fallback for other arches */
+
+static void co_uc_entry(unsigned int hi, unsigned int lo)
+{
+	uint64_t p = ((uint64_t)hi << 32) | lo;
+	evdp_co_main((neb_co_t)(uintptr_t)p);
+}
+
+void evdp_co_entry(void)
+{
+	abort();
+}
+
+static void co_ctx_init(struct co_ctx *ctx, void *stack_top, neb_co_t co)
+{
+	getcontext(&ctx->uc);
+	ctx->uc.uc_stack.ss_sp = (char *)co->stack + neb_sysconf_pagesize;
+	ctx->uc.uc_stack.ss_size = (char *)stack_top - (char *)ctx->uc.uc_stack.ss_sp;
+	ctx->uc.uc_link = NULL;
+	uint64_t p = (uintptr_t)co;
+	makecontext(&ctx->uc, (void (*)(void))co_uc_entry, 2, (unsigned int)(p >> 32), (unsigned int)p);
+}
+
+void evdp_co_switch(struct co_ctx *from, struct co_ctx *to)
+{
+	swapcontext(&from->uc, &to->uc);
+}
+
+#endif
+
+/*
+ * Stack
+ */
+
+static size_t co_stack_map_size(size_t stack_size)
+{
+	size_t page = neb_sysconf_pagesize;
+	return ((stack_size + page - 1) / page) * page + page; // with guard page
+}
+
+static void *co_stack_alloc(size_t map_size)
+{
+	if (map_size == co_stack_map_size(NEB_CO_DEFAULT_STACK_SIZE) && co_stack_pool) {
+		struct co_stack *cs = co_stack_pool;
+		co_stack_pool = cs->next;
+		co_stack_pool_count--;
+		return (char *)cs - neb_sysconf_pagesize;
+	}
+
+	void *stack = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_STACK, -1, 0);
+	if (stack == MAP_FAILED) {
+		neb_syslogl(LOG_ERR, "mmap: %m");
+		return NULL;
+	}
+	if (mprotect(stack, neb_sysconf_pagesize, PROT_NONE) == -1) {
+		neb_syslogl(LOG_ERR, "mprotect: %m");
+		munmap(stack, map_size);
+		return NULL;
+	}
+	return stack;
+}
+
+static void co_stack_free(void *stack, size_t map_size)
+{
+	if (map_size == co_stack_map_size(NEB_CO_DEFAULT_STACK_SIZE) && co_stack_pool_count < CO_STACK_POOL_MAX) {
+		struct co_stack *cs = (struct co_stack *)((char *)stack + neb_sysconf_pagesize);
+		cs->next = co_stack_pool;
+		co_stack_pool = cs;
+		co_stack_pool_count++;
+		return;
+	}
+	munmap(stack, map_size);
+}
+
+void neb_co_stack_pool_clear(void)
+{
+	size_t map_size = co_stack_map_size(NEB_CO_DEFAULT_STACK_SIZE);
+	while (co_stack_pool) {
+		struct co_stack *cs = co_stack_pool;
+		co_stack_pool = cs->next;
+		munmap((char *)cs - neb_sysconf_pagesize, map_size);
+	}
+	co_stack_pool_count = 0;
+}
+
+/*
+ * Scheduling
+ */
+
+static void co_destroy(neb_co_t co)
+{
+	if (co->s) {
+		if (neb_evdp_source_get_queue(co->s)) {
+			co->s_detaching = 1;
+			if (neb_evdp_queue_detach(co->q, co->s, co->s_closed) != 0)
+				neb_syslog(LOG_ERR, "Failed to detach coroutine source");
+		}
+		neb_evdp_source_del(co->s);
+	}
+	co_stack_free(co->stack, co->stack_size);
+	free(co);
+}
+
+static void co_resume(neb_co_t co)
+{
+	neb_co_t prev = co_current;
+	co->caller = prev ? &prev->ctx : &co_thread_ctx;
+	co_current = co;
+	evdp_co_switch(co->caller, &co->ctx);
+	co_current = prev;
+
+	if (co->done && !co->in_handler) // or it will be freed in on_remove
+		co_destroy(co);
+}
+
+static void co_suspend(neb_co_t co)
+{
+	evdp_co_switch(&co->ctx, co->caller);
+}
+
+void evdp_co_main(neb_co_t co)
+{
+	co->fn(co->arg);
+	co->done = 1;
+	co_suspend(co);
+	abort(); // never resumed
+}
+
+/*
+ * Waiting on fd
+ */
+
+static neb_evdp_cb_ret_t co_on_hup(int fd, void *udata, const void *context);
+static neb_evdp_cb_ret_t co_on_read(int fd, void *udata, const void *context);
+static neb_evdp_cb_ret_t co_on_write(int fd, void *udata, const void *context);
+static int co_on_remove(neb_evdp_source_t s);
+
+static int co_source_set_dir(neb_co_t co)
+{
+	if (co->wait_dir == CO_WAIT_READ) {
+		if ((co->armed_dir & CO_WAIT_WRITE) && neb_evdp_source_os_fd_next_write(co->s, NULL) != 0)
+			return -1;
+		co->armed_dir &= ~CO_WAIT_WRITE;
+		if (!(co->armed_dir & CO_WAIT_READ) && neb_evdp_source_os_fd_next_read(co->s, co_on_read) != 0)
+			return -1;
+		co->armed_dir |= CO_WAIT_READ;
+	} else {
+		if ((co->armed_dir & CO_WAIT_READ) && neb_evdp_source_os_fd_next_read(co->s, NULL) != 0)
+			return -1;
+		co->armed_dir &= ~CO_WAIT_READ;
+		if (!(co->armed_dir & CO_WAIT_WRITE) && neb_evdp_source_os_fd_next_write(co->s, co_on_write) != 0)
+			return -1;
+		co->armed_dir |= CO_WAIT_WRITE;
+	}
+	return 0;
+}
+
+static int co_source_arm(neb_co_t co)
+{
+	if (!co->s) {
+		co->s = neb_evdp_source_new_os_fd(co->wait_fd, co_on_hup);
+		if (!co->s)
+			return -1;
+		neb_evdp_source_set_udata(co->s, co);
+		neb_evdp_source_set_on_remove(co->s, co_on_remove);
+	} else if (neb_evdp_source_get_queue(co->s)) {
+		if (co->s_fd == co->wait_fd && !co->s_closed)
+			return co_source_set_dir(co);
+		if (co->in_handler) { // not allowed to detach s now
+			co->s_retarget = 1;
+			return 0;
+		}
+		co->s_detaching = 1;
+		int ret = neb_evdp_queue_detach(co->q, co->s, co->s_closed);
+		co->s_detaching = 0;
+		if (ret != 0)
+			return -1;
+	}
+
+	if (neb_evdp_source_os_fd_reset(co->s, co->wait_fd) != 0)
+		return -1;
+	co->s_fd = co->wait_fd;
+	co->s_closed = 0;
+	co->armed_dir = 0;
+	if (co_source_set_dir(co) != 0)
+		return -1;
+	return neb_evdp_queue_attach(co->q, co->s);
+}
+
+static neb_evdp_cb_ret_t co_wake_in_handler(neb_co_t co)
+{
+	co->in_handler = 1;
+	co_resume(co);
+	co->in_handler = 0;
+
+	if (co->done)
+		co->free_on_remove = 1;
+	else if (!co->s_retarget && !co->s_closed)
+		return NEB_EVDP_CB_CONTINUE;
+	return co->s_closed ? NEB_EVDP_CB_CLOSE : NEB_EVDP_CB_REMOVE;
+}
+
+static neb_evdp_cb_ret_t co_on_read(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_co_t co = udata;
+	co->armed_dir &= ~CO_WAIT_READ;
+	if (co->wait_dir != CO_WAIT_READ)
+		return NEB_EVDP_CB_CONTINUE;
+	return co_wake_in_handler(co);
+}
+
+static neb_evdp_cb_ret_t co_on_write(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_co_t co = udata;
+	co->armed_dir &= ~CO_WAIT_WRITE;
+	if (co->wait_dir != CO_WAIT_WRITE)
+		return NEB_EVDP_CB_CONTINUE;
+	return co_wake_in_handler(co);
+}
+
+static neb_evdp_cb_ret_t co_on_hup(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_co_t co = udata;
+	if (!(co->wait_dir & (CO_WAIT_READ | CO_WAIT_WRITE)))
+		return NEB_EVDP_CB_REMOVE;
+	// the error will be returned by the next syscall
+	return co_wake_in_handler(co);
+}
+
+static int co_on_remove(neb_evdp_source_t s)
+{
+	neb_co_t co = neb_evdp_source_get_udata(s);
+	co->armed_dir = 0;
+	if (co->s_detaching)
+		return 0;
+	if (co->free_on_remove) {
+		co_destroy(co);
+		return 0;
+	}
+
+	// removed after hup, after fd changed in handler, or by queue destroy
+	co->s_retarget = 0;
+	if (co->wait_dir & (CO_WAIT_READ | CO_WAIT_WRITE)) {
+		if (co_source_arm(co) != 0) {
+			co->wait_err = ECANCELED;
+			co_resume(co);
+		}
+	}
+	return 0;
+}
+
+static int co_wait_fd(neb_co_t co, int fd, int dir)
+{
+	co->wait_fd = fd;
+	co->wait_dir = dir;
+	co->wait_err = 0;
+	if (co_source_arm(co) != 0) {
+		co->wait_dir = 0;
+		return -1;
+	}
+	co_suspend(co);
+	co->wait_dir = 0;
+	if (co->wait_err) {
+		errno = co->wait_err;
+		return -1;
+	}
+	return 0;
+}
+
+static neb_co_t co_get_current(void)
+{
+	if (!co_current) {
+		neb_syslog(LOG_ERR, "Not in any coroutine");
+		errno = EPERM;
+	}
+	return co_current;
+}
+
+/*
+ * Public
+ */
+
+int neb_co_spawn(neb_evdp_queue_t q, neb_co_func_t fn, void *arg, size_t stack_size)
+{
+	if (!stack_size)
+		stack_size = NEB_CO_DEFAULT_STACK_SIZE;
+
+	neb_co_t co = calloc(1, sizeof(struct neb_co));
+	if (!co) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return -1;
+	}
+	co->q = q;
+	co->fn = fn;
+	co->arg = arg;
+	co->s_fd = -1;
+	co->wait_fd = -1;
+
+	co->stack_size = co_stack_map_size(stack_size);
+	co->stack = co_stack_alloc(co->stack_size);
+	if (!co->stack) {
+		free(co);
+		return -1;
+	}
+	co_ctx_init(&co->ctx, (char *)co->stack + co->stack_size, co);
+
+	co_resume(co);
+	return 0;
+}
+
+neb_co_t neb_co_self(void)
+{
+	return co_current;
+}
+
+neb_evdp_queue_t neb_co_get_queue(neb_co_t co)
+{
+	return co->q;
+}
+
+ssize_t neb_co_read(int fd, void *buf, size_t len)
+{
+	neb_co_t co = co_get_current();
+	if (!co)
+		return -1;
+
+	for (;;) {
+		ssize_t n = read(fd, buf, len);
+		if (n >= 0)
+			return n;
+		switch (errno) {
+		case EINTR:
+			break;
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			if (co_wait_fd(co, fd, CO_WAIT_READ) != 0)
+				return -1;
+			break;
+		default:
+			return -1;
+			break;
+		}
+	}
+}
+
+ssize_t neb_co_write(int fd, const void *buf, size_t len)
+{
+	neb_co_t co = co_get_current();
+	if (!co)
+		return -1;
+
+	size_t done = 0;
+	while (done < len) {
+		ssize_t n = write(fd, (const char *)buf + done, len - done);
+		if (n >= 0) {
+			done += n;
+			continue;
+		}
+		switch (errno) {
+		case EINTR:
+			break;
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			if (co_wait_fd(co, fd, CO_WAIT_WRITE) != 0)
+				return -1;
+			break;
+		default:
+			return -1;
+			break;
+		}
+	}
+	return len;
+}
+
+int neb_co_connect(int fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+	neb_co_t co = co_get_current();
+	if (!co)
+		return -1;
+
+	if (connect(fd, addr, addrlen) == 0)
+		return 0;
+	if (errno != EINPROGRESS && errno != EINTR) // it will be done in background for EINTR
+		return -1;
+
+	if (co_wait_fd(co, fd, CO_WAIT_WRITE) != 0)
+		return -1;
+
+	int err = 0;
+	socklen_t len = sizeof(err);
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+		return -1;
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+static neb_evdp_timeout_ret_t co_on_timeout(void *udata)
+{
+	neb_co_t co = udata;
+	co_resume(co);
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+int neb_co_sleep(int msec)
+{
+	neb_co_t co = co_get_current();
+	if (!co)
+		return -1;
+
+	neb_evdp_timer_t t = neb_evdp_queue_get_timer(co->q);
+	if (!t) {
+		neb_syslog(LOG_ERR, "queue timer is required for coroutine sleep");
+		errno = EINVAL;
+		return -1;
+	}
+	// cur_msec of the queue is not updated if spawned outside of the queue loop
+	neb_evdp_timer_point p = neb_evdp_timer_new_point(t, neb_time_get_msec() + msec, co_on_timeout, co);
+	if (!p) {
+		neb_syslog(LOG_ERR, "Failed to add coroutine timer point");
+		return -1;
+	}
+
+	co->wait_dir = CO_WAIT_TIMER;
+	co_suspend(co);
+	co->wait_dir = 0;
+	return 0;
+}
+
+int neb_co_close(int fd)
+{
+	neb_co_t co = co_current;
+	if (co && co->s && co->s_fd == fd && !co->s_closed && neb_evdp_source_get_queue(co->s)) {
+		if (co->in_handler) { // detach after the handler returns
+			co->s_closed = 1;
+		} else {
+			co->s_detaching = 1;
+			if (neb_evdp_queue_detach(co->q, co->s, 1) != 0)
+				neb_syslog(LOG_ERR, "Failed to detach coroutine source");
+			co->s_detaching = 0;
+		}
+	}
+	return close(fd);
+}
@@ -5,6 +5,7 @@
 #include "types.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 void *evdp_create_queue_context(neb_evdp_queue_t q)
@@ -52,18 +53,9 @@ void evdp_destroy_queue_context(void *context)
 	free(c);
 }
 
-void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+void evdp_queue_rm_pending_events(neb_evdp_queue_t q _nattr_unused, neb_evdp_source_t s _nattr_unused)
 {
-	void *s_got = NULL, *s_to_rm = s;
-	const struct evdp_queue_context *c = q->context;
-	if (!c->ee)
-		return;
-	for (int i = q->current_event; i < q->nevents; i++) {
-		struct io_event *e = c->ee + i;
-		s_got = (neb_evdp_source_t)e->data;
-		if (s_got == s_to_rm)
-			e->data = 0;
-	}
+	return; // stale events are rejected by tag when fetched
 }
 
 int evdp_queue_wait_events(neb_evdp_queue_t q, int timeout_msec)
@@ -99,7 +91,7 @@ int evdp_queue_fetch_event(neb_evdp_queue_t q, struct neb_evdp_event *nee)
 
 	struct io_event *e = c->ee + q->current_event;
 	nee->event = e;
-	nee->source = (neb_evdp_source_t)e->data;
+	nee->source = evdp_queue_get_source(q, e->data);
 	return 0;
 }
 
@@ -118,7 +110,7 @@ static int do_batch_flush(neb_evdp_queue_t q, int nr)
 	q->stats.pending -= nr;
 	q->stats.running += nr;
 	for (int i = 0; i < nr; i++) {
-		neb_evdp_source_t s = (neb_evdp_source_t)qc->iocbv[i]->aio_data;
+		neb_evdp_source_t s = evdp_queue_get_source(q, qc->iocbv[i]->aio_data);
 		EVDP_SLIST_REMOVE(s);
 		EVDP_SLIST_RUNNING_INSERT_NO_STATS(q, s);
 		struct evdp_source_conext *sc = s->context;
@@ -151,3 +143,39 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 	}
 	return 0;
 }
+
+#if defined(WITH_EVDP_RUNTIME_DRIVER)
+int evdp_driver_probe(void)
+{
+	aio_context_t id;
+	if (neb_aio_poll_create(1, &id) == -1) {
+		neb_syslogl(LOG_INFO, "aio_poll_create: %m");
+		return -1;
+	}
+
+	int ret = -1;
+	int fds[2];
+	if (pipe(fds) == -1) {
+		neb_syslogl(LOG_ERR, "pipe: %m");
+		goto exit_destroy;
+	}
+
+	// poll support is added in 4.19, which will return EINVAL before that
+	struct iocb iocb;
+	memset(&iocb, 0, sizeof(iocb));
+	iocb.aio_lio_opcode = IOCB_CMD_POLL;
+	iocb.aio_fildes = fds[1];
+	iocb.aio_buf = POLLOUT;
+	struct iocb *iocbp = &iocb;
+	if (neb_aio_poll_submit(id, 1, &iocbp) == 1)
+		ret = 0;
+	else
+		neb_syslogl(LOG_INFO, "aio_poll_submit: %m");
+
+	close(fds[0]);
+	close(fds[1]);
+exit_destroy:
+	neb_aio_poll_destroy(id);
+	return ret;
+}
+#endif
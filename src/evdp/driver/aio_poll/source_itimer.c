@@ -24,8 +24,9 @@ void *evdp_create_source_itimer_context(neb_evdp_source_t s)
 		c->its.it_interval.tv_sec = c->its.it_value.tv_sec;
 		break;
 	case EVDP_SOURCE_ITIMER_MSEC:
-		c->its.it_value.tv_nsec = conf->msec * 1000000;
-		c->its.it_interval.tv_nsec = c->its.it_value.tv_nsec;
+		c->its.it_value.tv_sec = conf->msec / 1000;
+		c->its.it_value.tv_nsec = (conf->msec % 1000) * 1000000;
+		c->its.it_interval = c->its.it_value;
 		break;
 	default:
 		neb_syslog(LOG_CRIT, "Invalid itimer source type");
@@ -70,7 +71,7 @@ int evdp_source_itimer_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 
 	sc->ctl_event.aio_lio_opcode = IOCB_CMD_POLL;
 	sc->ctl_event.aio_fildes = sc->fd;
-	sc->ctl_event.aio_data = (uint64_t)s;
+	sc->ctl_event.aio_data = s->tag;
 	sc->ctl_event.aio_buf = POLLIN;
 
 	EVDP_SLIST_PENDING_INSERT(q, s);
@@ -84,9 +85,9 @@ void evdp_source_itimer_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
 	struct evdp_source_timer_context *sc = s->context;
 
 	if (sc->in_action) {
-		sc->its.it_value.tv_sec = 0;
-		sc->its.it_value.tv_nsec = 0;
-		if (timerfd_settime(sc->fd, 0, &sc->its, NULL) == -1)
+		// keep sc->its for the next attach
+		const struct itimerspec its = {.it_value = {.tv_sec = 0, .tv_nsec = 0}};
+		if (timerfd_settime(sc->fd, 0, &its, NULL) == -1)
 			neb_syslogl(LOG_ERR, "timerfd_settime: %m");
 		sc->in_action = 0;
 	}
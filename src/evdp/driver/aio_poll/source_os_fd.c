@@ -44,7 +44,7 @@ int evdp_source_os_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 
 	sc->ctl_event.aio_lio_opcode = IOCB_CMD_POLL;
 	sc->ctl_event.aio_fildes = conf->fd;
-	sc->ctl_event.aio_data = (uint64_t)s;
+	sc->ctl_event.aio_data = s->tag;
 	// event type is dynamic
 
 	if (sc->ctl_event.aio_buf & (POLLIN | POLLOUT)) {
@@ -71,8 +71,10 @@ static int do_cancel_os_fd(const struct evdp_queue_context *qc, struct evdp_sour
 {
 	struct io_event e;
 	if (neb_aio_poll_cancel(qc->id, &sc->ctl_event, &e) == -1) {
-		if (errno == ENOENT)
+		if (errno == ENOENT) { // already completed
 			sc->submitted = 0;
+			return 0;
+		}
 		neb_syslogl(LOG_ERR, "aio_poll_cancel: %m");
 		return -1;
 	}
@@ -107,6 +109,11 @@ neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
 
 	const int fd = iocb->aio_fildes;
 	const struct evdp_conf_fd *conf = s->conf;
+	if ((e->res & POLLERR) && conf->do_error) {
+		ret = conf->do_error(fd, s->udata, &fd);
+		if (ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
 	if ((e->res & POLLIN) && conf->do_read) {
 		sc->ctl_event.aio_buf &= ~POLLIN;
 		ret = conf->do_read(fd, s->udata, &fd);
@@ -248,3 +255,14 @@ int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
 	}
 	return 0;
 }
+
+int evdp_source_os_fd_native_deadline(void)
+{
+	return 0;
+}
+
+int evdp_source_os_fd_is_waiting(neb_evdp_source_t s)
+{
+	const struct evdp_source_os_fd_context *sc = s->context;
+	return (sc->ctl_event.aio_buf & (POLLIN | POLLOUT)) ? 1 : 0;
+}
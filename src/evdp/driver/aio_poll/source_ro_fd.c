@@ -35,7 +35,7 @@ int evdp_source_ro_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 
 	sc->ctl_event.aio_lio_opcode = IOCB_CMD_POLL;
 	sc->ctl_event.aio_fildes = conf->fd;
-	sc->ctl_event.aio_data = (uint64_t)s;
+	sc->ctl_event.aio_data = s->tag;
 	sc->ctl_event.aio_buf = POLLIN;
 
 	EVDP_SLIST_PENDING_INSERT(q, s);
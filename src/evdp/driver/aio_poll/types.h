@@ -36,4 +36,9 @@ struct evdp_source_os_fd_context {
 	int submitted;
 };
 
+struct evdp_source_proc_context {
+	struct iocb ctl_event;
+	int submitted;
+};
+
 #endif
\ No newline at end of file
@@ -45,18 +45,9 @@ void evdp_destroy_queue_context(void *context)
 	free(c);
 }
 
-void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+void evdp_queue_rm_pending_events(neb_evdp_queue_t q _nattr_unused, neb_evdp_source_t s _nattr_unused)
 {
-	void *s_got = NULL, *s_to_rm = s;
-	const struct evdp_queue_context *c = q->context;
-	if (!c->ee)
-		return;
-	for (int i = q->current_event; i < q->nevents; i++) {
-		struct epoll_event *e = c->ee + i;
-		s_got = e->data.ptr;
-		if (s_got == s_to_rm)
-			e->data.ptr = NULL;
-	}
+	return; // stale events are rejected by tag when fetched
 }
 
 int evdp_queue_wait_events(neb_evdp_queue_t q, int timeout_msec)
@@ -84,7 +75,7 @@ int evdp_queue_fetch_event(neb_evdp_queue_t q, struct neb_evdp_event *nee)
 
 	struct epoll_event *e = c->ee + q->current_event;
 	nee->event = e;
-	nee->source = e->data.ptr;
+	nee->source = evdp_queue_get_source(q, e->data.u64);
 	return 0;
 }
 
@@ -112,6 +103,9 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 		case EVDP_SOURCE_OS_FD:
 			fd = ((struct evdp_conf_fd *)s->conf)->fd;
 			break;
+		case EVDP_SOURCE_PROC:
+			fd = ((struct evdp_conf_proc *)s->conf)->pidfd;
+			break;
 		case EVDP_SOURCE_LT_FD: // TODO
 		default:
 			neb_syslog(LOG_ERR, "Unsupported epoll(ADD/MOD) source type %d", s->type);
@@ -133,3 +127,16 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 	}
 	return 0;
 }
+
+#if defined(WITH_EVDP_RUNTIME_DRIVER)
+int evdp_driver_probe(void)
+{
+	int fd = epoll_create1(EPOLL_CLOEXEC);
+	if (fd == -1) {
+		neb_syslogl(LOG_INFO, "epoll_create1: %m");
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+#endif
@@ -81,7 +81,7 @@ int evdp_source_abstimer_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 	}
 
 	sc->ctl_op = EPOLL_CTL_ADD;
-	sc->ctl_event.data.ptr = s;
+	sc->ctl_event.data.u64 = s->tag;
 	sc->ctl_event.events = EPOLLIN;
 
 	EVDP_SLIST_PENDING_INSERT(q, s);
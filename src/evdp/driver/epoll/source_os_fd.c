@@ -42,7 +42,7 @@ int evdp_source_os_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 	struct evdp_source_os_fd_context *sc = s->context;
 
 	sc->ctl_op = EPOLL_CTL_ADD;
-	sc->ctl_event.data.ptr = s;
+	sc->ctl_event.data.u64 = s->tag;
 	sc->ctl_event.events |= EPOLLONESHOT; // the real event is dynamic
 
 	if (sc->ctl_event.events & (EPOLLIN | EPOLLOUT)) {
@@ -91,7 +91,8 @@ void evdp_source_os_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_cl
 		return;
 	}
 
-	if (sc->added)
+	// still in the epoll set if disabled by oneshot
+	if (sc->added || sc->ctl_op == EPOLL_CTL_MOD)
 		do_del_os_fd(qc, s);
 }
 
@@ -107,6 +108,11 @@ neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
 	const struct epoll_event *e = ne->event;
 
 	const struct evdp_conf_fd *conf = s->conf;
+	if ((e->events & EPOLLERR) && conf->do_error) {
+		ret = conf->do_error(conf->fd, s->udata, &conf->fd);
+		if (ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
 	if ((e->events & EPOLLIN) && conf->do_read) {
 		sc->ctl_event.events &= ~EPOLLIN;
 		ret = conf->do_read(conf->fd, s->udata, &conf->fd);
@@ -248,3 +254,14 @@ int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
 	}
 	return 0;
 }
+
+int evdp_source_os_fd_native_deadline(void)
+{
+	return 0;
+}
+
+int evdp_source_os_fd_is_waiting(neb_evdp_source_t s)
+{
+	const struct evdp_source_os_fd_context *sc = s->context;
+	return (sc->ctl_event.events & (EPOLLIN | EPOLLOUT)) ? 1 : 0;
+}
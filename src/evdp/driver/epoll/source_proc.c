@@ -0,0 +1,70 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "types.h"
+
+#include <stdlib.h>
+
+void *evdp_create_source_proc_context(neb_evdp_source_t s)
+{
+	const struct evdp_conf_proc *conf = s->conf;
+	if (conf->pidfd < 0) {
+		neb_syslog(LOG_ERR, "pidfd is required for proc source");
+		return NULL;
+	}
+
+	struct evdp_source_proc_context *c = calloc(1, sizeof(struct evdp_source_proc_context));
+	if (!c) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+
+	c->added = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_proc_context(void *context)
+{
+	struct evdp_source_proc_context *c = context;
+
+	free(c);
+}
+
+int evdp_source_proc_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_source_proc_context *sc = s->context;
+
+	sc->ctl_op = EPOLL_CTL_ADD;
+	sc->ctl_event.data.u64 = s->tag;
+	sc->ctl_event.events = EPOLLIN | EPOLLONESHOT;
+
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_proc_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_proc_context *sc = s->context;
+	const struct evdp_conf_proc *conf = s->conf;
+
+	if (to_close) {
+		sc->added = 0;
+		return;
+	}
+
+	if (sc->added) {
+		if (epoll_ctl(qc->fd, EPOLL_CTL_DEL, conf->pidfd, NULL) == -1)
+			neb_syslogl(LOG_ERR, "epoll_ctl: %m");
+		sc->added = 0;
+	}
+}
+
+neb_evdp_cb_ret_t evdp_source_proc_handle(const struct neb_evdp_event *ne)
+{
+	return evdp_source_proc_do_exit(ne->source);
+}
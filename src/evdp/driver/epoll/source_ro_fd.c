@@ -32,8 +32,13 @@ int evdp_source_ro_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 	struct evdp_source_ro_fd_context *sc = s->context;
 
 	sc->ctl_op = EPOLL_CTL_ADD;
-	sc->ctl_event.data.ptr = s;
+	sc->ctl_event.data.u64 = s->tag;
 	sc->ctl_event.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+	const struct evdp_conf_ro_fd *conf = s->conf;
+	if (conf->exclusive) // only valid for EPOLL_CTL_ADD, which is the only op here
+		sc->ctl_event.events |= EPOLLEXCLUSIVE;
+#endif
 
 	EVDP_SLIST_PENDING_INSERT(q, s);
 
@@ -37,4 +37,10 @@ struct evdp_source_os_fd_context {
 	int added;
 };
 
+struct evdp_source_proc_context {
+	struct epoll_event ctl_event;
+	int ctl_op;
+	int added;
+};
+
 #endif
@@ -23,8 +23,9 @@ void *evdp_create_source_itimer_context(neb_evdp_source_t s)
 		c->its.it_interval.tv_sec = c->its.it_value.tv_sec;
 		break;
 	case EVDP_SOURCE_ITIMER_MSEC:
-		c->its.it_value.tv_nsec = conf->msec * 1000000;
-		c->its.it_interval.tv_nsec = c->its.it_value.tv_nsec;
+		c->its.it_value.tv_sec = conf->msec / 1000;
+		c->its.it_value.tv_nsec = (conf->msec % 1000) * 1000000;
+		c->its.it_interval = c->its.it_value;
 		break;
 	default:
 		neb_syslog(LOG_CRIT, "Invalid itimer source type");
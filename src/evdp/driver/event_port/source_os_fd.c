@@ -104,6 +104,11 @@ neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
 
 	const int fd = e->portev_object;
 	const struct evdp_conf_fd *conf = s->conf;
+	if ((e->portev_events & POLLERR) && conf->do_error) {
+		ret = conf->do_error(fd, s->udata, &fd);
+		if (ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
 	if ((e->portev_events & POLLIN) && conf->do_read) {
 		sc->events &= ~POLLIN;
 		ret = conf->do_read(fd, s->udata, &fd);
@@ -245,3 +250,14 @@ int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
 	}
 	return 0;
 }
+
+int evdp_source_os_fd_native_deadline(void)
+{
+	return 0;
+}
+
+int evdp_source_os_fd_is_waiting(neb_evdp_source_t s)
+{
+	const struct evdp_source_os_fd_context *sc = s->context;
+	return (sc->events & (POLLIN | POLLOUT)) ? 1 : 0;
+}
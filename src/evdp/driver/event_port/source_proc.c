@@ -0,0 +1,35 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "types.h"
+
+/*
+ * There is no process exit notification in event ports, use SIGCHLD instead
+ */
+
+void *evdp_create_source_proc_context(neb_evdp_source_t s _nattr_unused)
+{
+	neb_syslog(LOG_ERR, "proc source is not supported by event port");
+	return NULL;
+}
+
+void evdp_destroy_source_proc_context(void *context _nattr_unused)
+{
+	return;
+}
+
+int evdp_source_proc_attach(neb_evdp_queue_t q _nattr_unused, neb_evdp_source_t s _nattr_unused)
+{
+	return -1;
+}
+
+void evdp_source_proc_detach(neb_evdp_queue_t q _nattr_unused, neb_evdp_source_t s _nattr_unused, int to_close _nattr_unused)
+{
+	return;
+}
+
+neb_evdp_cb_ret_t evdp_source_proc_handle(const struct neb_evdp_event *ne _nattr_unused)
+{
+	return NEB_EVDP_CB_REMOVE;
+}
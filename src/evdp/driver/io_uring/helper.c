@@ -5,7 +5,7 @@
 
 #include <liburing.h>
 
-int neb_io_uring_submit_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
+int neb_io_uring_prep_poll(struct evdp_queue_context *qc, neb_evdp_source_t s)
 {
 	struct evdp_source_context *sc = s->context;
 	struct io_uring_sqe *sqe = io_uring_get_sqe(&qc->ring);
@@ -14,7 +14,34 @@ int neb_io_uring_submit_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
 		return -1;
 	}
 	io_uring_prep_poll_add(sqe, sc->fd, sc->ctl_event);
-	io_uring_sqe_set_data(sqe, s);
+	io_uring_sqe_set_data(sqe, (void *)(uintptr_t)s->tag);
+
+	if (s->type != EVDP_SOURCE_OS_FD)
+		return 0;
+	const struct evdp_conf_fd *conf = s->conf;
+	struct evdp_source_os_fd_context *oc = s->context;
+	oc->deadline_armed = 0;
+	if (!conf->deadline_msec)
+		return 0;
+	struct io_uring_sqe *tsqe = io_uring_get_sqe(&qc->ring);
+	if (!tsqe) {
+		neb_syslog(LOG_ERR, "no sqe left for os_fd deadline");
+		return 0;
+	}
+	oc->deadline_ts.tv_sec = conf->deadline_msec / 1000;
+	oc->deadline_ts.tv_nsec = (conf->deadline_msec % 1000) * 1000000;
+	sqe->flags |= IOSQE_IO_LINK;
+	io_uring_prep_link_timeout(tsqe, &oc->deadline_ts, 0);
+	// -ETIME only if the timeout fired, and the poll will be -ECANCELED
+	io_uring_sqe_set_data(tsqe, (void *)(uintptr_t)s->tag);
+	oc->deadline_armed = 1;
+	return 0;
+}
+
+int neb_io_uring_submit_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
+{
+	if (neb_io_uring_prep_poll(qc, s) != 0)
+		return -1;
 	int ret = io_uring_submit(&qc->ring);
 	if (ret < 0) {
 		neb_syslogl(LOG_ERR, "io_uring_submit: %m");
@@ -30,7 +57,8 @@ int neb_io_uring_cancel_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
 		neb_syslog(LOG_CRIT, "no sqe left");
 		return -1;
 	}
-	io_uring_prep_poll_remove(sqe, s);
+	io_uring_prep_poll_remove(sqe, (void *)(uintptr_t)s->tag);
+	io_uring_sqe_set_data(sqe, NULL); // no source for the remove itself
 	int ret = io_uring_submit(&qc->ring);
 	if (ret < 0) {
 		neb_syslogl(LOG_ERR, "io_uring_submit: %m");
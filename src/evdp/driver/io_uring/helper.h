@@ -7,6 +7,13 @@
 #include "core.h"
 #include "types.h"
 
+/**
+ * \brief prep poll sqe for the source, and link a timeout if it's an os_fd
+ *        source with deadline
+ */
+extern int neb_io_uring_prep_poll(struct evdp_queue_context *qc, neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+
 extern int neb_io_uring_submit_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1, 2));
 
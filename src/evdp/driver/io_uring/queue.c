@@ -46,18 +46,9 @@ void evdp_destroy_queue_context(void *context)
 	free(c);
 }
 
-void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+void evdp_queue_rm_pending_events(neb_evdp_queue_t q _nattr_unused, neb_evdp_source_t s _nattr_unused)
 {
-	void *s_got = NULL, *s_to_rm = s;
-	const struct evdp_queue_context *c = q->context;
-	if (!c->cqe)
-		return;
-	for (int i = q->current_event; i < q->nevents; i++) {
-		struct io_uring_cqe *e = c->cqe[i];
-		s_got = (neb_evdp_source_t)e->user_data;
-		if (s_got == s_to_rm)
-			e->user_data = 0;
-	}
+	return; // stale events are rejected by tag when fetched
 }
 
 int evdp_queue_wait_events(neb_evdp_queue_t q, int timeout_msec)
@@ -105,7 +96,7 @@ int evdp_queue_fetch_event(neb_evdp_queue_t q, struct neb_evdp_event *nee)
 
 	struct io_uring_cqe *e = c->cqe[q->current_event];
 	nee->event = e;
-	nee->source = (neb_evdp_source_t)e->user_data;
+	nee->source = evdp_queue_get_source(q, e->user_data);
 	return 0;
 }
 
@@ -120,16 +111,9 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 	struct evdp_queue_context *qc = q->context;
 	int count = 0;
 	for (neb_evdp_source_t s = q->pending_qs->next; s; s = q->pending_qs->next) {
-		struct evdp_source_context *sc = s->context;
-		struct io_uring_sqe *sqe = io_uring_get_sqe(&qc->ring);
-		if (!sqe) { // FIXME
-			neb_syslog(LOG_CRIT, "no sqe available");
-			return -1;
-		}
-
 		// FIXME we may want to prep for other events
-		io_uring_prep_poll_add(sqe, sc->fd, sc->ctl_event);
-		io_uring_sqe_set_data(sqe, s);
+		if (neb_io_uring_prep_poll(qc, s) != 0) // FIXME
+			return -1;
 
 		EVDP_SLIST_REMOVE(s);
 		EVDP_SLIST_RUNNING_INSERT_NO_STATS(q, s);
@@ -148,3 +132,17 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 
 	return 0;
 }
+
+#if defined(WITH_EVDP_RUNTIME_DRIVER)
+int evdp_driver_probe(void)
+{
+	struct io_uring ring;
+	int ret = io_uring_queue_init(2, &ring, 0);
+	if (ret < 0) { // io_uring may be disabled by sysctl or seccomp
+		neb_syslogl_en(-ret, LOG_INFO, "io_uring_queue_init: %m");
+		return -1;
+	}
+	io_uring_queue_exit(&ring);
+	return 0;
+}
+#endif
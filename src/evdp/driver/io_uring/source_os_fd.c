@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <poll.h>
+#include <errno.h>
 
 void *evdp_create_source_os_fd_context(neb_evdp_source_t s)
 {
@@ -74,6 +75,7 @@ static int do_cancel_os_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
 		return -1;
 	}
 	sc->submitted = 0;
+	sc->deadline_armed = 0;
 	return 0;
 }
 
@@ -97,12 +99,32 @@ neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
 
 	neb_evdp_source_t s = ne->source;
 	struct evdp_source_os_fd_context *sc = s->context;
-	sc->submitted = 0;
-
 	const struct io_uring_cqe *e = ne->event;
-
 	const int fd = sc->fd;
-	const struct evdp_conf_fd *conf = s->conf;
+	struct evdp_conf_fd *conf = s->conf;
+
+	if (e->res < 0) {
+		// the poll is -ECANCELED by us or by the linked timeout, and the
+		// linked timeout is -ETIME only if it fired
+		if (e->res != -ETIME || !sc->deadline_armed)
+			return NEB_EVDP_CB_CONTINUE;
+		sc->submitted = 0;
+		sc->deadline_armed = 0;
+		sc->ctl_event = 0;
+		conf->do_read = NULL;
+		conf->do_write = NULL;
+		if (conf->do_timeout)
+			ret = conf->do_timeout(fd, s->udata, NULL);
+		return ret;
+	}
+
+	sc->submitted = 0;
+	sc->deadline_armed = 0;
+	if ((e->res & POLLERR) && conf->do_error) {
+		ret = conf->do_error(fd, s->udata, &fd);
+		if (ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
 	if ((e->res & POLLIN) && conf->do_read) {
 		sc->ctl_event &= ~POLLIN;
 		ret = conf->do_read(fd, s->udata, &fd);
@@ -244,3 +266,14 @@ int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
 	}
 	return 0;
 }
+
+int evdp_source_os_fd_native_deadline(void)
+{
+	return 1;
+}
+
+int evdp_source_os_fd_is_waiting(neb_evdp_source_t s)
+{
+	const struct evdp_source_os_fd_context *sc = s->context;
+	return (sc->ctl_event & (POLLIN | POLLOUT)) ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "types.h"
+#include "helper.h"
+
+#include <stdlib.h>
+#include <poll.h>
+
+void *evdp_create_source_proc_context(neb_evdp_source_t s)
+{
+	const struct evdp_conf_proc *conf = s->conf;
+	if (conf->pidfd < 0) {
+		neb_syslog(LOG_ERR, "pidfd is required for proc source");
+		return NULL;
+	}
+
+	struct evdp_source_proc_context *c = calloc(1, sizeof(struct evdp_source_proc_context));
+	if (!c) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+
+	c->submitted = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_proc_context(void *context)
+{
+	struct evdp_source_proc_context *c = context;
+
+	free(c);
+}
+
+int evdp_source_proc_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_source_proc_context *sc = s->context;
+	const struct evdp_conf_proc *conf = s->conf;
+
+	sc->ctl_event = POLLIN;
+	sc->fd = conf->pidfd;
+
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_proc_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	struct evdp_queue_context *qc = q->context;
+	struct evdp_source_proc_context *sc = s->context;
+
+	if (to_close) {
+		sc->submitted = 0;
+		return;
+	}
+
+	if (sc->submitted) {
+		if (neb_io_uring_cancel_fd(qc, s) != 0)
+			neb_syslog(LOG_ERR, "failed to cancel proc source");
+		sc->submitted = 0;
+	}
+}
+
+neb_evdp_cb_ret_t evdp_source_proc_handle(const struct neb_evdp_event *ne)
+{
+	struct evdp_source_proc_context *sc = ne->source->context;
+	sc->submitted = 0;
+
+	return evdp_source_proc_do_exit(ne->source);
+}
@@ -35,6 +35,14 @@ struct evdp_source_os_fd_context {
 	short ctl_event;
 	int fd;
 	int submitted;
+	int deadline_armed;
+	struct __kernel_timespec deadline_ts;
+};
+
+struct evdp_source_proc_context {
+	short ctl_event;
+	int fd;
+	int submitted;
 };
 
 #endif
@@ -214,6 +214,9 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 		case EVDP_SOURCE_RO_FD:
 			memcpy(qc->ee + count++, &((struct evdp_source_ro_fd_context *)s->context)->ctl_event, sizeof(struct kevent));
 			break;
+		case EVDP_SOURCE_PROC:
+			memcpy(qc->ee + count++, &((struct evdp_source_proc_context *)s->context)->ctl_event, sizeof(struct kevent));
+			break;
 		case EVDP_SOURCE_OS_FD: // TODO
 		{
 			struct evdp_source_os_fd_context *sc = s->context;
@@ -253,3 +253,14 @@ int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
 	}
 	return 0;
 }
+
+int evdp_source_os_fd_native_deadline(void)
+{
+	return 0;
+}
+
+int evdp_source_os_fd_is_waiting(neb_evdp_source_t s)
+{
+	const struct evdp_source_os_fd_context *sc = s->context;
+	return (sc->rd.added || sc->rd.to_add || sc->wr.added || sc->wr.to_add) ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "types.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+void *evdp_create_source_proc_context(neb_evdp_source_t s)
+{
+	struct evdp_source_proc_context *c = calloc(1, sizeof(struct evdp_source_proc_context));
+	if (!c) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_proc_context(void *context)
+{
+	struct evdp_source_proc_context *c = context;
+
+	free(c);
+}
+
+int evdp_source_proc_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_source_proc_context *sc = s->context;
+	const struct evdp_conf_proc *conf = s->conf;
+
+	EV_SET(&sc->ctl_event, conf->pid, EVFILT_PROC, EV_ADD | EV_ENABLE | EV_ONESHOT, NOTE_EXIT, 0, s);
+
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_proc_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close _nattr_unused)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_proc_context *sc = s->context;
+
+	if (!s->pending) {
+		sc->ctl_event.flags = EV_DISABLE | EV_DELETE;
+		if (kevent(qc->fd, &sc->ctl_event, 1, NULL, 0, NULL) == -1 && errno != ENOENT && errno != ESRCH)
+			neb_syslogl(LOG_ERR, "kevent: %m");
+	}
+}
+
+neb_evdp_cb_ret_t evdp_source_proc_handle(const struct neb_evdp_event *ne)
+{
+	return evdp_source_proc_do_exit(ne->source);
+}
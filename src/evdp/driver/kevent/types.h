@@ -32,4 +32,8 @@ struct evdp_source_os_fd_context {
 	int stats_updated;
 };
 
+struct evdp_source_proc_context {
+	struct kevent ctl_event;
+};
+
 #endif
@@ -0,0 +1,64 @@
+
+/*
+ * Compiled within each driver when WITH_EVDP_RUNTIME_DRIVER is set
+ */
+
+#include "core.h"
+
+#define EVDP_DRIVER_STR_(n) #n
+#define EVDP_DRIVER_STR(n) EVDP_DRIVER_STR_(n)
+
+const struct evdp_driver evdp_driver_ops = {
+	.name = EVDP_DRIVER_STR(EVDP_DRIVER_NAME),
+	.probe = evdp_driver_probe,
+	.fd_get_sockerr = neb_evdp_source_fd_get_sockerr,
+	.fd_get_nread = neb_evdp_source_fd_get_nread,
+
+	.create_queue_context = evdp_create_queue_context,
+	.destroy_queue_context = evdp_destroy_queue_context,
+	.queue_rm_pending_events = evdp_queue_rm_pending_events,
+	.queue_wait_events = evdp_queue_wait_events,
+	.queue_flush_pending_sources = evdp_queue_flush_pending_sources,
+	.queue_fetch_event = evdp_queue_fetch_event,
+	.queue_finish_event = evdp_queue_finish_event,
+
+	.create_source_itimer_context = evdp_create_source_itimer_context,
+	.destroy_source_itimer_context = evdp_destroy_source_itimer_context,
+	.source_itimer_attach = evdp_source_itimer_attach,
+	.source_itimer_detach = evdp_source_itimer_detach,
+	.source_itimer_handle = evdp_source_itimer_handle,
+
+	.create_source_abstimer_context = evdp_create_source_abstimer_context,
+	.destroy_source_abstimer_context = evdp_destroy_source_abstimer_context,
+	.source_abstimer_regulate = evdp_source_abstimer_regulate,
+	.source_abstimer_attach = evdp_source_abstimer_attach,
+	.source_abstimer_detach = evdp_source_abstimer_detach,
+	.source_abstimer_handle = evdp_source_abstimer_handle,
+
+	.create_source_ro_fd_context = evdp_create_source_ro_fd_context,
+	.destroy_source_ro_fd_context = evdp_destroy_source_ro_fd_context,
+	.source_ro_fd_attach = evdp_source_ro_fd_attach,
+	.source_ro_fd_detach = evdp_source_ro_fd_detach,
+	.source_ro_fd_handle = evdp_source_ro_fd_handle,
+
+	.create_source_os_fd_context = evdp_create_source_os_fd_context,
+	.reset_source_os_fd_context = evdp_reset_source_os_fd_context,
+	.destroy_source_os_fd_context = evdp_destroy_source_os_fd_context,
+	.source_os_fd_attach = evdp_source_os_fd_attach,
+	.source_os_fd_detach = evdp_source_os_fd_detach,
+	.source_os_fd_handle = evdp_source_os_fd_handle,
+	.source_os_fd_init_read = evdp_source_os_fd_init_read,
+	.source_os_fd_reset_read = evdp_source_os_fd_reset_read,
+	.source_os_fd_unset_read = evdp_source_os_fd_unset_read,
+	.source_os_fd_init_write = evdp_source_os_fd_init_write,
+	.source_os_fd_reset_write = evdp_source_os_fd_reset_write,
+	.source_os_fd_unset_write = evdp_source_os_fd_unset_write,
+	.source_os_fd_native_deadline = evdp_source_os_fd_native_deadline,
+	.source_os_fd_is_waiting = evdp_source_os_fd_is_waiting,
+
+	.create_source_proc_context = evdp_create_source_proc_context,
+	.destroy_source_proc_context = evdp_destroy_source_proc_context,
+	.source_proc_attach = evdp_source_proc_attach,
+	.source_proc_detach = evdp_source_proc_detach,
+	.source_proc_handle = evdp_source_proc_handle,
+};
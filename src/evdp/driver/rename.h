@@ -0,0 +1,66 @@
+
+#ifndef NEB_SRC_EVDP_DRIVER_RENAME_H
+#define NEB_SRC_EVDP_DRIVER_RENAME_H 1
+
+/*
+ * Add the driver name to all driver functions, so that all drivers can be
+ * linked into the same library, and used via struct evdp_driver
+ */
+
+#if !defined(EVDP_DRIVER_NAME)
+# error "EVDP_DRIVER_NAME should be defined"
+#endif
+
+#define EVDP_DRIVER_SYM__(n, f) evdp_##n##_##f
+#define EVDP_DRIVER_SYM_(n, f) EVDP_DRIVER_SYM__(n, f)
+#define EVDP_DRIVER_SYM(f) EVDP_DRIVER_SYM_(EVDP_DRIVER_NAME, f)
+
+#define evdp_driver_ops EVDP_DRIVER_SYM(driver_ops)
+#define evdp_driver_probe EVDP_DRIVER_SYM(driver_probe)
+#define neb_evdp_source_fd_get_sockerr EVDP_DRIVER_SYM(source_fd_get_sockerr)
+#define neb_evdp_source_fd_get_nread EVDP_DRIVER_SYM(source_fd_get_nread)
+
+#define evdp_create_queue_context EVDP_DRIVER_SYM(create_queue_context)
+#define evdp_destroy_queue_context EVDP_DRIVER_SYM(destroy_queue_context)
+#define evdp_queue_rm_pending_events EVDP_DRIVER_SYM(queue_rm_pending_events)
+#define evdp_queue_wait_events EVDP_DRIVER_SYM(queue_wait_events)
+#define evdp_queue_flush_pending_sources EVDP_DRIVER_SYM(queue_flush_pending_sources)
+#define evdp_queue_fetch_event EVDP_DRIVER_SYM(queue_fetch_event)
+#define evdp_queue_finish_event EVDP_DRIVER_SYM(queue_finish_event)
+#define evdp_create_source_itimer_context EVDP_DRIVER_SYM(create_source_itimer_context)
+#define evdp_destroy_source_itimer_context EVDP_DRIVER_SYM(destroy_source_itimer_context)
+#define evdp_source_itimer_attach EVDP_DRIVER_SYM(source_itimer_attach)
+#define evdp_source_itimer_detach EVDP_DRIVER_SYM(source_itimer_detach)
+#define evdp_source_itimer_handle EVDP_DRIVER_SYM(source_itimer_handle)
+#define evdp_create_source_abstimer_context EVDP_DRIVER_SYM(create_source_abstimer_context)
+#define evdp_destroy_source_abstimer_context EVDP_DRIVER_SYM(destroy_source_abstimer_context)
+#define evdp_source_abstimer_regulate EVDP_DRIVER_SYM(source_abstimer_regulate)
+#define evdp_source_abstimer_attach EVDP_DRIVER_SYM(source_abstimer_attach)
+#define evdp_source_abstimer_detach EVDP_DRIVER_SYM(source_abstimer_detach)
+#define evdp_source_abstimer_handle EVDP_DRIVER_SYM(source_abstimer_handle)
+#define evdp_create_source_ro_fd_context EVDP_DRIVER_SYM(create_source_ro_fd_context)
+#define evdp_destroy_source_ro_fd_context EVDP_DRIVER_SYM(destroy_source_ro_fd_context)
+#define evdp_source_ro_fd_attach EVDP_DRIVER_SYM(source_ro_fd_attach)
+#define evdp_source_ro_fd_detach EVDP_DRIVER_SYM(source_ro_fd_detach)
+#define evdp_source_ro_fd_handle EVDP_DRIVER_SYM(source_ro_fd_handle)
+#define evdp_create_source_os_fd_context EVDP_DRIVER_SYM(create_source_os_fd_context)
+#define evdp_reset_source_os_fd_context EVDP_DRIVER_SYM(reset_source_os_fd_context)
+#define evdp_destroy_source_os_fd_context EVDP_DRIVER_SYM(destroy_source_os_fd_context)
+#define evdp_source_os_fd_attach EVDP_DRIVER_SYM(source_os_fd_attach)
+#define evdp_source_os_fd_detach EVDP_DRIVER_SYM(source_os_fd_detach)
+#define evdp_source_os_fd_handle EVDP_DRIVER_SYM(source_os_fd_handle)
+#define evdp_source_os_fd_init_read EVDP_DRIVER_SYM(source_os_fd_init_read)
+#define evdp_source_os_fd_reset_read EVDP_DRIVER_SYM(source_os_fd_reset_read)
+#define evdp_source_os_fd_unset_read EVDP_DRIVER_SYM(source_os_fd_unset_read)
+#define evdp_source_os_fd_init_write EVDP_DRIVER_SYM(source_os_fd_init_write)
+#define evdp_source_os_fd_reset_write EVDP_DRIVER_SYM(source_os_fd_reset_write)
+#define evdp_source_os_fd_unset_write EVDP_DRIVER_SYM(source_os_fd_unset_write)
+#define evdp_source_os_fd_native_deadline EVDP_DRIVER_SYM(source_os_fd_native_deadline)
+#define evdp_source_os_fd_is_waiting EVDP_DRIVER_SYM(source_os_fd_is_waiting)
+#define evdp_create_source_proc_context EVDP_DRIVER_SYM(create_source_proc_context)
+#define evdp_destroy_source_proc_context EVDP_DRIVER_SYM(destroy_source_proc_context)
+#define evdp_source_proc_attach EVDP_DRIVER_SYM(source_proc_attach)
+#define evdp_source_proc_detach EVDP_DRIVER_SYM(source_proc_detach)
+#define evdp_source_proc_handle EVDP_DRIVER_SYM(source_proc_handle)
+
+#endif
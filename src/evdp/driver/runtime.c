@@ -0,0 +1,367 @@
+
+/*
+ * Select one of the compiled in drivers at runtime, and forward the driver
+ * functions used by core to it
+ */
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(USE_IO_URING)
+extern const struct evdp_driver evdp_io_uring_driver_ops _nattr_hidden;
+#endif
+#if defined(USE_AIO_POLL)
+extern const struct evdp_driver evdp_aio_poll_driver_ops _nattr_hidden;
+#endif
+extern const struct evdp_driver evdp_epoll_driver_ops _nattr_hidden;
+
+// in the order of preference
+static const struct evdp_driver *const evdp_drivers[] = {
+#if defined(USE_IO_URING)
+	&evdp_io_uring_driver_ops,
+#endif
+#if defined(USE_AIO_POLL)
+	&evdp_aio_poll_driver_ops,
+#endif
+	&evdp_epoll_driver_ops,
+};
+#define EVDP_DRIVER_NUM (sizeof(evdp_drivers) / sizeof(evdp_drivers[0]))
+
+// set only once under the lock, but read without it, so always access it atomically
+static const struct evdp_driver *evdp_driver = NULL;
+static pthread_mutex_t evdp_driver_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline const struct evdp_driver *evdp_driver_load(void)
+{
+	return __atomic_load_n(&evdp_driver, __ATOMIC_ACQUIRE);
+}
+
+static const struct evdp_driver *evdp_driver_find(const char *name)
+{
+	for (size_t i = 0; i < EVDP_DRIVER_NUM; i++) {
+		if (strcmp(evdp_drivers[i]->name, name) == 0)
+			return evdp_drivers[i];
+	}
+	return NULL;
+}
+
+/**
+ * \note should be called with lock held
+ */
+static int evdp_driver_do_select(const char *name)
+{
+	const struct evdp_driver *d = evdp_driver_find(name);
+	if (!d) {
+		neb_syslog(LOG_ERR, "evdp driver %s is not compiled in", name);
+		return -1;
+	}
+	if (evdp_driver) {
+		if (evdp_driver == d)
+			return 0;
+		neb_syslog(LOG_ERR, "evdp driver %s is already in use", evdp_driver_load()->name);
+		return -1;
+	}
+	if (d->probe() != 0) {
+		neb_syslog(LOG_ERR, "evdp driver %s is not available", name);
+		return -1;
+	}
+	__atomic_store_n(&evdp_driver, d, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void evdp_driver_auto_select(void)
+{
+	const char *name = getenv(NEB_EVDP_DRIVER_ENV);
+	if (name && *name) {
+		if (evdp_driver_do_select(name) == 0)
+			return;
+		neb_syslog(LOG_WARNING, "Failed to use evdp driver %s from env, fallback to auto select", name);
+	}
+
+	for (size_t i = 0; i < EVDP_DRIVER_NUM; i++) {
+		const struct evdp_driver *d = evdp_drivers[i];
+		if (d->probe() == 0) {
+			__atomic_store_n(&evdp_driver, d, __ATOMIC_RELEASE);
+			return;
+		}
+		neb_syslog(LOG_INFO, "evdp driver %s is not available, try the next one", d->name);
+	}
+	neb_syslog(LOG_CRIT, "No evdp driver is available");
+}
+
+const struct evdp_driver *evdp_driver_get(void)
+{
+	const struct evdp_driver *d = evdp_driver_load();
+	if (d)
+		return d;
+
+	pthread_mutex_lock(&evdp_driver_lock);
+	if (!evdp_driver)
+		evdp_driver_auto_select();
+	d = evdp_driver;
+	pthread_mutex_unlock(&evdp_driver_lock);
+	return d;
+}
+
+int neb_evdp_driver_select(const char *name)
+{
+	pthread_mutex_lock(&evdp_driver_lock);
+	int ret = evdp_driver_do_select(name);
+	pthread_mutex_unlock(&evdp_driver_lock);
+	return ret;
+}
+
+const char *neb_evdp_driver_name(void)
+{
+	const struct evdp_driver *d = evdp_driver_get();
+	return d ? d->name : NULL;
+}
+
+int neb_evdp_source_fd_get_sockerr(const void *context, int *sockerr)
+{
+	return evdp_driver_load()->fd_get_sockerr(context, sockerr);
+}
+
+int neb_evdp_source_fd_get_nread(const void *context, int *nbytes)
+{
+	return evdp_driver_load()->fd_get_nread(context, nbytes);
+}
+
+/*
+ * Contexts should be created before any other calls, so the driver is always
+ * selected when calling the others
+ */
+void *evdp_create_queue_context(neb_evdp_queue_t q)
+{
+	const struct evdp_driver *d = evdp_driver_get();
+	if (!d)
+		return NULL;
+	return d->create_queue_context(q);
+}
+
+void evdp_destroy_queue_context(void *context)
+{
+	evdp_driver_load()->destroy_queue_context(context);
+}
+
+void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	evdp_driver_load()->queue_rm_pending_events(q, s);
+}
+
+int evdp_queue_wait_events(neb_evdp_queue_t q, int timeout_ms)
+{
+	return evdp_driver_load()->queue_wait_events(q, timeout_ms);
+}
+
+int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
+{
+	return evdp_driver_load()->queue_flush_pending_sources(q);
+}
+
+int evdp_queue_fetch_event(neb_evdp_queue_t q, struct neb_evdp_event *nee)
+{
+	return evdp_driver_load()->queue_fetch_event(q, nee);
+}
+
+void evdp_queue_finish_event(neb_evdp_queue_t q, struct neb_evdp_event *nee)
+{
+	evdp_driver_load()->queue_finish_event(q, nee);
+}
+
+void *evdp_create_source_itimer_context(neb_evdp_source_t s)
+{
+	const struct evdp_driver *d = evdp_driver_get();
+	if (!d)
+		return NULL;
+	return d->create_source_itimer_context(s);
+}
+
+void evdp_destroy_source_itimer_context(void *context)
+{
+	evdp_driver_load()->destroy_source_itimer_context(context);
+}
+
+int evdp_source_itimer_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_itimer_attach(q, s);
+}
+
+void evdp_source_itimer_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	evdp_driver_load()->source_itimer_detach(q, s);
+}
+
+neb_evdp_cb_ret_t evdp_source_itimer_handle(const struct neb_evdp_event *ne)
+{
+	return evdp_driver_load()->source_itimer_handle(ne);
+}
+
+void *evdp_create_source_abstimer_context(neb_evdp_source_t s)
+{
+	const struct evdp_driver *d = evdp_driver_get();
+	if (!d)
+		return NULL;
+	return d->create_source_abstimer_context(s);
+}
+
+void evdp_destroy_source_abstimer_context(void *context)
+{
+	evdp_driver_load()->destroy_source_abstimer_context(context);
+}
+
+int evdp_source_abstimer_regulate(neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_abstimer_regulate(s);
+}
+
+int evdp_source_abstimer_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_abstimer_attach(q, s);
+}
+
+void evdp_source_abstimer_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	evdp_driver_load()->source_abstimer_detach(q, s);
+}
+
+neb_evdp_cb_ret_t evdp_source_abstimer_handle(const struct neb_evdp_event *ne)
+{
+	return evdp_driver_load()->source_abstimer_handle(ne);
+}
+
+void *evdp_create_source_ro_fd_context(neb_evdp_source_t s)
+{
+	const struct evdp_driver *d = evdp_driver_get();
+	if (!d)
+		return NULL;
+	return d->create_source_ro_fd_context(s);
+}
+
+void evdp_destroy_source_ro_fd_context(void *context)
+{
+	evdp_driver_load()->destroy_source_ro_fd_context(context);
+}
+
+int evdp_source_ro_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_ro_fd_attach(q, s);
+}
+
+void evdp_source_ro_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	evdp_driver_load()->source_ro_fd_detach(q, s, to_close);
+}
+
+neb_evdp_cb_ret_t evdp_source_ro_fd_handle(const struct neb_evdp_event *ne)
+{
+	return evdp_driver_load()->source_ro_fd_handle(ne);
+}
+
+void *evdp_create_source_os_fd_context(neb_evdp_source_t s)
+{
+	const struct evdp_driver *d = evdp_driver_get();
+	if (!d)
+		return NULL;
+	return d->create_source_os_fd_context(s);
+}
+
+void evdp_reset_source_os_fd_context(neb_evdp_source_t s)
+{
+	evdp_driver_load()->reset_source_os_fd_context(s);
+}
+
+void evdp_destroy_source_os_fd_context(void *context)
+{
+	evdp_driver_load()->destroy_source_os_fd_context(context);
+}
+
+int evdp_source_os_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_os_fd_attach(q, s);
+}
+
+void evdp_source_os_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	evdp_driver_load()->source_os_fd_detach(q, s, to_close);
+}
+
+neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
+{
+	return evdp_driver_load()->source_os_fd_handle(ne);
+}
+
+void evdp_source_os_fd_init_read(neb_evdp_source_t s, neb_evdp_io_handler_t rf)
+{
+	evdp_driver_load()->source_os_fd_init_read(s, rf);
+}
+
+int evdp_source_os_fd_reset_read(neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_os_fd_reset_read(s);
+}
+
+int evdp_source_os_fd_unset_read(neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_os_fd_unset_read(s);
+}
+
+void evdp_source_os_fd_init_write(neb_evdp_source_t s, neb_evdp_io_handler_t wf)
+{
+	evdp_driver_load()->source_os_fd_init_write(s, wf);
+}
+
+int evdp_source_os_fd_reset_write(neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_os_fd_reset_write(s);
+}
+
+int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_os_fd_unset_write(s);
+}
+
+int evdp_source_os_fd_native_deadline(void)
+{
+	return evdp_driver_load()->source_os_fd_native_deadline();
+}
+
+int evdp_source_os_fd_is_waiting(neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_os_fd_is_waiting(s);
+}
+
+void *evdp_create_source_proc_context(neb_evdp_source_t s)
+{
+	const struct evdp_driver *d = evdp_driver_get();
+	if (!d)
+		return NULL;
+	return d->create_source_proc_context(s);
+}
+
+void evdp_destroy_source_proc_context(void *context)
+{
+	evdp_driver_load()->destroy_source_proc_context(context);
+}
+
+int evdp_source_proc_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	return evdp_driver_load()->source_proc_attach(q, s);
+}
+
+void evdp_source_proc_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	evdp_driver_load()->source_proc_detach(q, s, to_close);
+}
+
+neb_evdp_cb_ret_t evdp_source_proc_handle(const struct neb_evdp_event *ne)
+{
+	return evdp_driver_load()->source_proc_handle(ne);
+}
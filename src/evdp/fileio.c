@@ -0,0 +1,711 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/fileio.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/queue.h>
+
+#include <signal.h>
+#include <pthread.h>
+#if defined(OS_LINUX)
+# include <sys/eventfd.h>
+#else
+# include <nebase/pipe.h>
+#endif
+#if defined(USE_IO_URING)
+# include <sys/sysmacros.h>
+# include <liburing.h>
+# define FILEIO_RING_ENTRIES 256
+#endif
+
+#define FILEIO_OP_CACHE_SIZE 64
+
+enum {
+	FILEIO_OP_READ,
+	FILEIO_OP_WRITE,
+	FILEIO_OP_FSYNC,
+	FILEIO_OP_OPENAT,
+	FILEIO_OP_STAT,
+};
+
+struct fileio_op {
+	STAILQ_ENTRY(fileio_op) list;
+	int type;
+	int fd;
+	union {
+		void *buf;
+		const void *cbuf;
+		const char *path;
+	};
+	size_t len;
+	off_t offset;
+	int flags;
+	mode_t mode;
+	struct stat *st;
+#if defined(USE_IO_URING)
+	struct statx stx;
+#endif
+	ssize_t res;
+	neb_evdp_fileio_handler_t cb;
+	void *udata;
+};
+
+STAILQ_HEAD(fileio_op_list, fileio_op);
+
+struct fileio_backend {
+	void (*deinit)(neb_evdp_fileio_t f);
+	int (*submit)(neb_evdp_fileio_t f, struct fileio_op *op);
+	int (*reap)(neb_evdp_fileio_t f);
+};
+
+struct neb_evdp_fileio {
+	neb_evdp_queue_t q;
+	neb_evdp_source_t s;
+	const struct fileio_backend *backend;
+	int notify_fd; // eventfd or the read end of pipe
+#if defined(USE_IO_URING)
+	struct io_uring ring;
+	int ring_ok;
+	int inflight; // ops submitted to the ring but not reaped
+#endif
+	int notify_wfd; // the same as notify_fd for eventfd
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int lock_ok;
+	int cond_ok;
+	struct fileio_op_list todo_ops;
+	struct fileio_op_list done_ops;
+	int quit;
+	pthread_t *threads;
+	int nthreads;
+	int running_threads;
+
+	struct {
+		struct fileio_op **ops;
+		int count;
+	} cache;
+};
+
+static struct fileio_op *fileio_op_new(neb_evdp_fileio_t f, int type, int fd,
+                                       neb_evdp_fileio_handler_t cb, void *udata)
+{
+	struct fileio_op *op;
+	if (f->cache.count) {
+		op = f->cache.ops[--f->cache.count];
+	} else {
+		op = malloc(sizeof(struct fileio_op));
+		if (!op) {
+			neb_syslogl(LOG_ERR, "malloc: %m");
+			return NULL;
+		}
+	}
+	op->type = type;
+	op->fd = fd;
+	op->res = 0;
+	op->cb = cb;
+	op->udata = udata;
+	return op;
+}
+
+static void fileio_op_del(neb_evdp_fileio_t f, struct fileio_op *op)
+{
+	if (f->cache.count < FILEIO_OP_CACHE_SIZE)
+		f->cache.ops[f->cache.count++] = op;
+	else
+		free(op);
+}
+
+static void fileio_op_finish(neb_evdp_fileio_t f, struct fileio_op *op)
+{
+	neb_evdp_fileio_handler_t cb = op->cb;
+	void *udata = op->udata;
+	ssize_t res = op->res;
+	fileio_op_del(f, op); // del first, as new op may be submitted in cb
+	cb(res, udata);
+}
+
+static int fileio_drain_notify(neb_evdp_fileio_t f)
+{
+#if defined(OS_LINUX)
+	uint64_t count;
+	if (read(f->notify_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+		neb_syslogl(LOG_ERR, "read(eventfd): %m");
+		return -1;
+	}
+#else
+	char buf[64];
+	for (;;) {
+		ssize_t nr = read(f->notify_fd, buf, sizeof(buf));
+		if (nr == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+			neb_syslogl(LOG_ERR, "read(pipe): %m");
+			return -1;
+		}
+		if (nr < (ssize_t)sizeof(buf))
+			break;
+	}
+#endif
+	return 0;
+}
+
+#if defined(USE_IO_URING)
+
+static void fileio_convert_statx(const struct statx *stx, struct stat *st)
+{
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+static int fileio_uring_init(neb_evdp_fileio_t f)
+{
+	int ret = io_uring_queue_init(FILEIO_RING_ENTRIES, &f->ring, 0);
+	if (ret < 0) {
+		neb_syslogl_en(-ret, LOG_ERR, "io_uring_queue_init: %m");
+		return -1;
+	}
+	f->ring_ok = 1;
+
+	f->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (f->notify_fd == -1) {
+		neb_syslogl(LOG_ERR, "eventfd: %m");
+		return -1;
+	}
+
+	ret = io_uring_register_eventfd(&f->ring, f->notify_fd);
+	if (ret < 0) {
+		neb_syslogl_en(-ret, LOG_ERR, "io_uring_register_eventfd: %m");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void fileio_uring_deinit(neb_evdp_fileio_t f)
+{
+	if (f->ring_ok) {
+		// wait for the in-flight ops, as the kernel may still write to them
+		if (f->inflight)
+			io_uring_submit(&f->ring);
+		while (f->inflight) {
+			struct io_uring_cqe *cqe = NULL;
+			int ret = io_uring_wait_cqe(&f->ring, &cqe);
+			if (ret < 0) {
+				if (ret == -EINTR)
+					continue;
+				neb_syslogl_en(-ret, LOG_ERR, "io_uring_wait_cqe: %m");
+				break;
+			}
+			struct fileio_op *op = io_uring_cqe_get_data(cqe);
+			io_uring_cqe_seen(&f->ring, cqe);
+			if (op) {
+				f->inflight--;
+				fileio_op_del(f, op);
+			}
+		}
+		io_uring_queue_exit(&f->ring);
+		f->ring_ok = 0;
+	}
+	if (f->notify_fd >= 0) {
+		close(f->notify_fd);
+		f->notify_fd = -1;
+	}
+}
+
+static int fileio_uring_submit(neb_evdp_fileio_t f, struct fileio_op *op)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&f->ring);
+	if (!sqe) { // sq is full, flush and retry
+		io_uring_submit(&f->ring);
+		sqe = io_uring_get_sqe(&f->ring);
+		if (!sqe) {
+			neb_syslog(LOG_ERR, "no sqe available for fileio");
+			return -1;
+		}
+	}
+
+	switch (op->type) {
+	case FILEIO_OP_READ:
+		io_uring_prep_read(sqe, op->fd, op->buf, op->len, op->offset);
+		break;
+	case FILEIO_OP_WRITE:
+		io_uring_prep_write(sqe, op->fd, op->cbuf, op->len, op->offset);
+		break;
+	case FILEIO_OP_FSYNC:
+		io_uring_prep_fsync(sqe, op->fd, op->flags ? IORING_FSYNC_DATASYNC : 0);
+		break;
+	case FILEIO_OP_OPENAT:
+		io_uring_prep_openat(sqe, op->fd, op->path, op->flags, op->mode);
+		break;
+	case FILEIO_OP_STAT:
+		io_uring_prep_statx(sqe, op->fd, op->path, op->flags, STATX_BASIC_STATS, &op->stx);
+		break;
+	default:
+		neb_syslog(LOG_CRIT, "Invalid fileio op type %d", op->type);
+		io_uring_prep_nop(sqe);
+		break;
+	}
+	io_uring_sqe_set_data(sqe, op);
+
+	int ret = io_uring_submit(&f->ring);
+	if (ret < 0) {
+		neb_syslogl_en(-ret, LOG_ERR, "io_uring_submit: %m");
+		// the sqe is still queued, and op will be deleted by the caller
+		io_uring_prep_nop(sqe);
+		io_uring_sqe_set_data(sqe, NULL);
+		return -1;
+	}
+	f->inflight++;
+	return 0;
+}
+
+static int fileio_uring_reap(neb_evdp_fileio_t f)
+{
+	struct io_uring_cqe *cqe = NULL;
+	while (io_uring_peek_cqe(&f->ring, &cqe) == 0) {
+		struct fileio_op *op = io_uring_cqe_get_data(cqe);
+		if (!op) { // nop for failed submission
+			io_uring_cqe_seen(&f->ring, cqe);
+			continue;
+		}
+		f->inflight--;
+		op->res = cqe->res;
+		io_uring_cqe_seen(&f->ring, cqe);
+		if (op->type == FILEIO_OP_STAT && op->res == 0)
+			fileio_convert_statx(&op->stx, op->st);
+		fileio_op_finish(f, op);
+	}
+	return 0;
+}
+
+static const struct fileio_backend fileio_uring_backend = {
+	.deinit = fileio_uring_deinit,
+	.submit = fileio_uring_submit,
+	.reap = fileio_uring_reap,
+};
+
+#endif
+
+static void fileio_do_op(struct fileio_op *op)
+{
+	ssize_t ret;
+	switch (op->type) {
+	case FILEIO_OP_READ:
+		ret = pread(op->fd, op->buf, op->len, op->offset);
+		break;
+	case FILEIO_OP_WRITE:
+		ret = pwrite(op->fd, op->cbuf, op->len, op->offset);
+		break;
+	case FILEIO_OP_FSYNC:
+#if defined(OS_LINUX)
+		ret = op->flags ? fdatasync(op->fd) : fsync(op->fd);
+#else
+		ret = fsync(op->fd);
+#endif
+		break;
+	case FILEIO_OP_OPENAT:
+		ret = openat(op->fd, op->path, op->flags, op->mode);
+		break;
+	case FILEIO_OP_STAT:
+		ret = fstatat(op->fd, op->path, op->st, op->flags);
+		break;
+	default:
+		ret = -1;
+		errno = EINVAL;
+		break;
+	}
+	op->res = (ret == -1) ? -errno : ret;
+}
+
+static void fileio_notify(neb_evdp_fileio_t f)
+{
+#if defined(OS_LINUX)
+	uint64_t one = 1;
+	if (write(f->notify_wfd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+		neb_syslogl(LOG_ERR, "write(eventfd): %m");
+#else
+	char c = 0;
+	if (write(f->notify_wfd, &c, 1) == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+		neb_syslogl(LOG_ERR, "write(pipe): %m");
+#endif
+}
+
+static void *fileio_worker(void *arg)
+{
+	neb_evdp_fileio_t f = arg;
+
+	pthread_mutex_lock(&f->lock);
+	for (;;) {
+		struct fileio_op *op = STAILQ_FIRST(&f->todo_ops);
+		if (!op) {
+			if (f->quit)
+				break;
+			pthread_cond_wait(&f->cond, &f->lock);
+			continue;
+		}
+		STAILQ_REMOVE_HEAD(&f->todo_ops, list);
+		pthread_mutex_unlock(&f->lock);
+
+		fileio_do_op(op);
+
+		pthread_mutex_lock(&f->lock);
+		int need_notify = STAILQ_EMPTY(&f->done_ops); // notify only once for each batch
+		STAILQ_INSERT_TAIL(&f->done_ops, op, list);
+		if (need_notify)
+			fileio_notify(f);
+	}
+	pthread_mutex_unlock(&f->lock);
+
+	return NULL;
+}
+
+static int fileio_thread_init(neb_evdp_fileio_t f, int nthreads)
+{
+	STAILQ_INIT(&f->todo_ops);
+	STAILQ_INIT(&f->done_ops);
+
+#if defined(OS_LINUX)
+	f->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (f->notify_fd == -1) {
+		neb_syslogl(LOG_ERR, "eventfd: %m");
+		return -1;
+	}
+	f->notify_wfd = f->notify_fd;
+#else
+	int pipefd[2];
+	if (neb_pipe_new(pipefd) != 0) {
+		neb_syslog(LOG_ERR, "Failed to create notify pipe");
+		return -1;
+	}
+	f->notify_fd = pipefd[0];
+	f->notify_wfd = pipefd[1];
+#endif
+
+	int ret = pthread_mutex_init(&f->lock, NULL);
+	if (ret != 0) {
+		neb_syslogl_en(ret, LOG_ERR, "pthread_mutex_init: %m");
+		return -1;
+	}
+	f->lock_ok = 1;
+	ret = pthread_cond_init(&f->cond, NULL);
+	if (ret != 0) {
+		neb_syslogl_en(ret, LOG_ERR, "pthread_cond_init: %m");
+		return -1;
+	}
+	f->cond_ok = 1;
+
+	f->threads = calloc(nthreads, sizeof(pthread_t));
+	if (!f->threads) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return -1;
+	}
+	f->nthreads = nthreads;
+
+	// signals should be handled in the main thread
+	sigset_t set, old_set;
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old_set);
+	for (int i = 0; i < nthreads; i++) {
+		ret = pthread_create(f->threads + i, NULL, fileio_worker, f);
+		if (ret != 0) {
+			neb_syslogl_en(ret, LOG_ERR, "pthread_create: %m");
+			break;
+		}
+		f->running_threads++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+	return ret == 0 ? 0 : -1;
+}
+
+static void fileio_thread_deinit(neb_evdp_fileio_t f)
+{
+	if (f->running_threads) {
+		pthread_mutex_lock(&f->lock);
+		f->quit = 1;
+		// drop ops that are not started
+		while (!STAILQ_EMPTY(&f->todo_ops)) {
+			struct fileio_op *op = STAILQ_FIRST(&f->todo_ops);
+			STAILQ_REMOVE_HEAD(&f->todo_ops, list);
+			fileio_op_del(f, op);
+		}
+		pthread_cond_broadcast(&f->cond);
+		pthread_mutex_unlock(&f->lock);
+
+		for (int i = 0; i < f->running_threads; i++)
+			pthread_join(f->threads[i], NULL);
+		f->running_threads = 0;
+	}
+	if (f->threads) {
+		free(f->threads);
+		f->threads = NULL;
+	}
+
+	while (!STAILQ_EMPTY(&f->done_ops)) {
+		struct fileio_op *op = STAILQ_FIRST(&f->done_ops);
+		STAILQ_REMOVE_HEAD(&f->done_ops, list);
+		fileio_op_del(f, op);
+	}
+
+	if (f->cond_ok) {
+		pthread_cond_destroy(&f->cond);
+		f->cond_ok = 0;
+	}
+	if (f->lock_ok) {
+		pthread_mutex_destroy(&f->lock);
+		f->lock_ok = 0;
+	}
+
+	if (f->notify_wfd >= 0 && f->notify_wfd != f->notify_fd)
+		close(f->notify_wfd);
+	f->notify_wfd = -1;
+	if (f->notify_fd >= 0) {
+		close(f->notify_fd);
+		f->notify_fd = -1;
+	}
+}
+
+static int fileio_thread_submit(neb_evdp_fileio_t f, struct fileio_op *op)
+{
+	pthread_mutex_lock(&f->lock);
+	STAILQ_INSERT_TAIL(&f->todo_ops, op, list);
+	pthread_cond_signal(&f->cond);
+	pthread_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int fileio_thread_reap(neb_evdp_fileio_t f)
+{
+	struct fileio_op_list done_ops = STAILQ_HEAD_INITIALIZER(done_ops);
+
+	pthread_mutex_lock(&f->lock);
+	STAILQ_CONCAT(&done_ops, &f->done_ops);
+	pthread_mutex_unlock(&f->lock);
+
+	while (!STAILQ_EMPTY(&done_ops)) {
+		struct fileio_op *op = STAILQ_FIRST(&done_ops);
+		STAILQ_REMOVE_HEAD(&done_ops, list);
+		fileio_op_finish(f, op);
+	}
+	return 0;
+}
+
+static const struct fileio_backend fileio_thread_backend = {
+	.deinit = fileio_thread_deinit,
+	.submit = fileio_thread_submit,
+	.reap = fileio_thread_reap,
+};
+
+/*
+ * io_uring is used only with the io_uring driver, and it may still be not
+ * available if the driver is selected in other ways, so fallback to threads
+ */
+static int fileio_backend_init(neb_evdp_fileio_t f, int nthreads)
+{
+#if defined(USE_IO_URING)
+	const char *driver = neb_evdp_driver_name();
+	if (driver && strcmp(driver, "io_uring") == 0) {
+		f->backend = &fileio_uring_backend;
+		if (fileio_uring_init(f) == 0)
+			return 0;
+		fileio_uring_deinit(f);
+		neb_syslog(LOG_NOTICE, "io_uring is not available for fileio, fallback to thread pool");
+	}
+#endif
+	f->backend = &fileio_thread_backend;
+	return fileio_thread_init(f, nthreads);
+}
+
+static neb_evdp_cb_ret_t fileio_on_notify(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_fileio_t f = udata;
+
+	if (fileio_drain_notify(f) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	if (f->backend->reap(f) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t fileio_on_hup(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	neb_syslog(LOG_CRIT, "fileio notify fd %d hup", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+neb_evdp_fileio_t neb_evdp_fileio_create(int nthreads)
+{
+	if (nthreads <= 0)
+		nthreads = NEB_EVDP_FILEIO_DEFAULT_THREADS;
+
+	neb_evdp_fileio_t f = calloc(1, sizeof(struct neb_evdp_fileio));
+	if (!f) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	f->notify_fd = -1;
+	f->notify_wfd = -1;
+
+	f->cache.ops = malloc(FILEIO_OP_CACHE_SIZE * sizeof(struct fileio_op *));
+	if (!f->cache.ops) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		neb_evdp_fileio_destroy(f);
+		return NULL;
+	}
+
+	if (fileio_backend_init(f, nthreads) != 0) {
+		neb_evdp_fileio_destroy(f);
+		return NULL;
+	}
+
+	f->s = neb_evdp_source_new_ro_fd(f->notify_fd, fileio_on_notify, fileio_on_hup);
+	if (!f->s) {
+		neb_syslog(LOG_ERR, "Failed to create ro_fd source for fileio");
+		neb_evdp_fileio_destroy(f);
+		return NULL;
+	}
+	neb_evdp_source_set_udata(f->s, f);
+
+	return f;
+}
+
+void neb_evdp_fileio_destroy(neb_evdp_fileio_t f)
+{
+	if (f->q)
+		neb_evdp_fileio_detach(f);
+	if (f->s)
+		neb_evdp_source_del(f->s);
+	if (f->backend)
+		f->backend->deinit(f);
+	if (f->cache.ops) {
+		for (int i = 0; i < f->cache.count; i++)
+			free(f->cache.ops[i]);
+		free(f->cache.ops);
+	}
+	free(f);
+}
+
+int neb_evdp_fileio_attach(neb_evdp_fileio_t f, neb_evdp_queue_t q)
+{
+	if (f->q) {
+		neb_syslog(LOG_ERR, "fileio %p has already been attached to queue %p", f, f->q);
+		return -1;
+	}
+
+	if (neb_evdp_queue_attach(q, f->s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach fileio source");
+		return -1;
+	}
+	f->q = q;
+
+	return 0;
+}
+
+int neb_evdp_fileio_detach(neb_evdp_fileio_t f)
+{
+	if (!f->q) {
+		neb_syslog(LOG_ERR, "fileio %p is not attached", f);
+		return -1;
+	}
+
+	int ret = 0;
+	if (neb_evdp_source_get_queue(f->s)) {
+		ret = neb_evdp_queue_detach(f->q, f->s, 0);
+		if (ret != 0)
+			neb_syslog(LOG_ERR, "Failed to detach fileio source");
+	}
+	f->q = NULL;
+
+	return ret;
+}
+
+static int fileio_submit_op(neb_evdp_fileio_t f, struct fileio_op *op)
+{
+	if (f->backend->submit(f, op) != 0) {
+		fileio_op_del(f, op);
+		return -1;
+	}
+	return 0;
+}
+
+int neb_evdp_fileio_read(neb_evdp_fileio_t f, int fd, void *buf, size_t len, off_t offset,
+                         neb_evdp_fileio_handler_t cb, void *udata)
+{
+	struct fileio_op *op = fileio_op_new(f, FILEIO_OP_READ, fd, cb, udata);
+	if (!op)
+		return -1;
+	op->buf = buf;
+	op->len = len;
+	op->offset = offset;
+	return fileio_submit_op(f, op);
+}
+
+int neb_evdp_fileio_write(neb_evdp_fileio_t f, int fd, const void *buf, size_t len, off_t offset,
+                          neb_evdp_fileio_handler_t cb, void *udata)
+{
+	struct fileio_op *op = fileio_op_new(f, FILEIO_OP_WRITE, fd, cb, udata);
+	if (!op)
+		return -1;
+	op->cbuf = buf;
+	op->len = len;
+	op->offset = offset;
+	return fileio_submit_op(f, op);
+}
+
+int neb_evdp_fileio_fsync(neb_evdp_fileio_t f, int fd, int datasync,
+                          neb_evdp_fileio_handler_t cb, void *udata)
+{
+	struct fileio_op *op = fileio_op_new(f, FILEIO_OP_FSYNC, fd, cb, udata);
+	if (!op)
+		return -1;
+	op->flags = datasync;
+	return fileio_submit_op(f, op);
+}
+
+int neb_evdp_fileio_openat(neb_evdp_fileio_t f, int dirfd, const char *path, int flags, mode_t mode,
+                           neb_evdp_fileio_handler_t cb, void *udata)
+{
+	struct fileio_op *op = fileio_op_new(f, FILEIO_OP_OPENAT, dirfd, cb, udata);
+	if (!op)
+		return -1;
+	op->path = path;
+	op->flags = flags | O_CLOEXEC;
+	op->mode = mode;
+	return fileio_submit_op(f, op);
+}
+
+int neb_evdp_fileio_stat(neb_evdp_fileio_t f, int dirfd, const char *path, int flags, struct stat *st,
+                         neb_evdp_fileio_handler_t cb, void *udata)
+{
+	struct fileio_op *op = fileio_op_new(f, FILEIO_OP_STAT, dirfd, cb, udata);
+	if (!op)
+		return -1;
+	op->path = path;
+	op->flags = flags;
+	op->st = st;
+	return fileio_submit_op(f, op);
+}
@@ -0,0 +1,544 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/fswatch.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+
+#if defined(OS_LINUX)
+# include <sys/inotify.h>
+# define FSWATCH_INOTIFY_MASK (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | \
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | \
+                               IN_DELETE | IN_DELETE_SELF)
+#elif defined(OSTYPE_BSD) || defined(OS_DARWIN)
+# define FSWATCH_USE_KQUEUE 1
+# include <sys/types.h>
+# include <sys/event.h>
+# include <sys/time.h>
+# define FSWATCH_VNODE_FFLAGS (NOTE_DELETE | NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | \
+                               NOTE_LINK | NOTE_RENAME | NOTE_REVOKE)
+# define FSWATCH_KEVENT_BATCH 32
+#endif
+
+#define FSWATCH_PENDING_MAX 64
+
+struct fswatch_entry {
+	int wd;      // inotify wd or vnode fd, -1 if slot not used
+	char *path;
+	int removed; // removed during delivering
+};
+
+struct fswatch_pending {
+	int id;
+	uint32_t events;
+	int has_name;
+	char name[NAME_MAX + 1];
+};
+
+struct neb_evdp_fswatch {
+	int fd; // inotify fd or kqueue fd
+	int dedup_msec;
+	neb_evdp_fswatch_handler_t cb;
+	void *udata;
+
+	neb_evdp_queue_t q;
+	neb_evdp_source_t s;
+	neb_evdp_timer_point tp;
+
+	struct fswatch_entry *entries;
+	int entry_size;
+	int delivering;
+
+	struct fswatch_pending *pending;
+	int pending_count;
+	neb_evdp_fswatch_event_t *evs;
+};
+
+static void fswatch_entry_free(neb_evdp_fswatch_t w, int id)
+{
+	struct fswatch_entry *e = w->entries + id;
+	if (w->delivering) { // path may be referenced in current callback
+		e->removed = 1;
+		return;
+	}
+	if (e->path) {
+		free(e->path);
+		e->path = NULL;
+	}
+	e->wd = -1;
+	e->removed = 0;
+}
+
+static int fswatch_find_id(neb_evdp_fswatch_t w, int wd)
+{
+	for (int i = 0; i < w->entry_size; i++) {
+		const struct fswatch_entry *e = w->entries + i;
+		if (e->wd == wd && !e->removed)
+			return i;
+	}
+	return -1;
+}
+
+static void fswatch_deliver(neb_evdp_fswatch_t w)
+{
+	int count = w->pending_count;
+	if (!count)
+		return;
+
+	for (int i = 0; i < count; i++) {
+		const struct fswatch_pending *p = w->pending + i;
+		neb_evdp_fswatch_event_t *ev = w->evs + i;
+		ev->id = p->id;
+		ev->path = p->id >= 0 ? w->entries[p->id].path : NULL;
+		ev->name = p->has_name ? p->name : NULL;
+		ev->events = p->events;
+	}
+	w->pending_count = 0;
+
+	w->delivering = 1;
+	w->cb(w->evs, count, w->udata);
+	w->delivering = 0;
+
+	for (int i = 0; i < w->entry_size; i++) {
+		if (w->entries[i].removed)
+			fswatch_entry_free(w, i);
+	}
+}
+
+static neb_evdp_timeout_ret_t fswatch_on_timeout(void *udata)
+{
+	neb_evdp_fswatch_t w = udata;
+	w->tp = NULL;
+	fswatch_deliver(w);
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static void fswatch_add_pending(neb_evdp_fswatch_t w, int id, const char *name, uint32_t events)
+{
+	for (int i = 0; i < w->pending_count; i++) {
+		struct fswatch_pending *p = w->pending + i;
+		if (p->id != id)
+			continue;
+		if (name) {
+			if (!p->has_name || strcmp(p->name, name) != 0)
+				continue;
+		} else if (p->has_name) {
+			continue;
+		}
+		p->events |= events;
+		return;
+	}
+
+	if (w->pending_count == FSWATCH_PENDING_MAX) // no room, deliver now
+		fswatch_deliver(w);
+
+	struct fswatch_pending *p = w->pending + w->pending_count++;
+	p->id = id;
+	p->events = events;
+	if (name) {
+		p->has_name = 1;
+		strncpy(p->name, name, sizeof(p->name) - 1);
+		p->name[sizeof(p->name) - 1] = '\0';
+	} else {
+		p->has_name = 0;
+	}
+}
+
+#if defined(OS_LINUX)
+static uint32_t fswatch_convert_events(uint32_t mask)
+{
+	uint32_t events = 0;
+	if (mask & IN_CREATE)
+		events |= NEB_FSWATCH_CREATE;
+	if (mask & (IN_MODIFY | IN_CLOSE_WRITE))
+		events |= NEB_FSWATCH_MODIFY;
+	if (mask & IN_ATTRIB)
+		events |= NEB_FSWATCH_ATTRIB;
+	if (mask & (IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF))
+		events |= NEB_FSWATCH_MOVE;
+	if (mask & (IN_DELETE | IN_DELETE_SELF))
+		events |= NEB_FSWATCH_DELETE;
+	if (mask & IN_IGNORED)
+		events |= NEB_FSWATCH_IGNORED;
+	return events;
+}
+
+static int fswatch_read_events(neb_evdp_fswatch_t w)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	for (;;) {
+		ssize_t len = read(w->fd, buf, sizeof(buf));
+		if (len == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+			neb_syslogl(LOG_ERR, "read(inotify): %m");
+			return -1;
+		}
+		if (len == 0)
+			break;
+
+		for (char *ptr = buf; ptr < buf + len; ) {
+			const struct inotify_event *ie = (const struct inotify_event *)ptr;
+			ptr += sizeof(struct inotify_event) + ie->len;
+
+			if (ie->mask & IN_Q_OVERFLOW) {
+				fswatch_add_pending(w, -1, NULL, NEB_FSWATCH_OVERFLOW);
+				continue;
+			}
+
+			int id = fswatch_find_id(w, ie->wd);
+			if (id < 0) // already removed
+				continue;
+			uint32_t events = fswatch_convert_events(ie->mask);
+			if (events)
+				fswatch_add_pending(w, id, ie->len ? ie->name : NULL, events);
+			if (ie->mask & IN_IGNORED) { // release the id after delivered
+				w->entries[id].wd = -1;
+				w->entries[id].removed = 1;
+			}
+		}
+	}
+
+	return 0;
+}
+#elif defined(FSWATCH_USE_KQUEUE)
+static uint32_t fswatch_convert_events(uint32_t fflags)
+{
+	uint32_t events = 0;
+	if (fflags & (NOTE_WRITE | NOTE_EXTEND))
+		events |= NEB_FSWATCH_MODIFY;
+	if (fflags & (NOTE_ATTRIB | NOTE_LINK))
+		events |= NEB_FSWATCH_ATTRIB;
+	if (fflags & NOTE_RENAME)
+		events |= NEB_FSWATCH_MOVE;
+	if (fflags & NOTE_DELETE)
+		events |= NEB_FSWATCH_DELETE;
+	if (fflags & NOTE_REVOKE)
+		events |= NEB_FSWATCH_IGNORED;
+	return events;
+}
+
+static int fswatch_read_events(neb_evdp_fswatch_t w)
+{
+	struct kevent kevs[FSWATCH_KEVENT_BATCH];
+	const struct timespec ts = {.tv_sec = 0, .tv_nsec = 0};
+
+	for (;;) {
+		int n = kevent(w->fd, NULL, 0, kevs, FSWATCH_KEVENT_BATCH, &ts);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			neb_syslogl(LOG_ERR, "kevent: %m");
+			return -1;
+		}
+
+		for (int i = 0; i < n; i++) {
+			const struct kevent *e = kevs + i;
+			int id = fswatch_find_id(w, (int)e->ident);
+			if (id < 0) // already removed
+				continue;
+			uint32_t events = fswatch_convert_events(e->fflags);
+			if (events)
+				fswatch_add_pending(w, id, NULL, events);
+		}
+
+		if (n < FSWATCH_KEVENT_BATCH)
+			break;
+	}
+
+	return 0;
+}
+#else
+static int fswatch_read_events(neb_evdp_fswatch_t w _nattr_unused)
+{
+	return -1;
+}
+#endif
+
+static neb_evdp_cb_ret_t fswatch_on_read(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_fswatch_t w = udata;
+
+	if (fswatch_read_events(w) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+
+	if (!w->pending_count)
+		return NEB_EVDP_CB_CONTINUE;
+
+	if (!w->dedup_msec) {
+		fswatch_deliver(w);
+	} else if (!w->tp) {
+		neb_evdp_timer_t t = neb_evdp_queue_get_timer(w->q);
+		int64_t abs_msec = neb_evdp_queue_get_abs_timeout(w->q, w->dedup_msec);
+		w->tp = neb_evdp_timer_new_point(t, abs_msec, fswatch_on_timeout, w);
+		if (!w->tp) {
+			neb_syslog(LOG_ERR, "Failed to add dedup timer point, deliver now");
+			fswatch_deliver(w);
+		}
+	}
+
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t fswatch_on_hup(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	neb_syslog(LOG_CRIT, "fswatch fd %d hup", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+neb_evdp_fswatch_t neb_evdp_fswatch_create(int dedup_msec, neb_evdp_fswatch_handler_t cb, void *udata)
+{
+#if !defined(OS_LINUX) && !defined(FSWATCH_USE_KQUEUE)
+	neb_syslog(LOG_ERR, "fswatch is not supported on this platform");
+	return NULL;
+#endif
+	if (dedup_msec < 0) {
+		neb_syslog(LOG_ERR, "Invalid dedup_msec value: %d", dedup_msec);
+		return NULL;
+	}
+
+	neb_evdp_fswatch_t w = calloc(1, sizeof(struct neb_evdp_fswatch));
+	if (!w) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	w->fd = -1;
+	w->dedup_msec = dedup_msec;
+	w->cb = cb;
+	w->udata = udata;
+
+	w->pending = malloc(FSWATCH_PENDING_MAX * sizeof(struct fswatch_pending));
+	if (!w->pending) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		neb_evdp_fswatch_destroy(w);
+		return NULL;
+	}
+	w->evs = malloc(FSWATCH_PENDING_MAX * sizeof(neb_evdp_fswatch_event_t));
+	if (!w->evs) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		neb_evdp_fswatch_destroy(w);
+		return NULL;
+	}
+
+#if defined(OS_LINUX)
+	w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (w->fd == -1) {
+		neb_syslogl(LOG_ERR, "inotify_init1: %m");
+		neb_evdp_fswatch_destroy(w);
+		return NULL;
+	}
+#elif defined(FSWATCH_USE_KQUEUE)
+	w->fd = kqueue();
+	if (w->fd == -1) {
+		neb_syslogl(LOG_ERR, "kqueue: %m");
+		neb_evdp_fswatch_destroy(w);
+		return NULL;
+	}
+	if (fcntl(w->fd, F_SETFD, FD_CLOEXEC) == -1) {
+		neb_syslogl(LOG_ERR, "fcntl(FD_CLOEXEC): %m");
+		neb_evdp_fswatch_destroy(w);
+		return NULL;
+	}
+#endif
+
+	w->s = neb_evdp_source_new_ro_fd(w->fd, fswatch_on_read, fswatch_on_hup);
+	if (!w->s) {
+		neb_syslog(LOG_ERR, "Failed to create ro_fd source for fswatch");
+		neb_evdp_fswatch_destroy(w);
+		return NULL;
+	}
+	neb_evdp_source_set_udata(w->s, w);
+
+	return w;
+}
+
+void neb_evdp_fswatch_destroy(neb_evdp_fswatch_t w)
+{
+	if (w->q)
+		neb_evdp_fswatch_detach(w);
+	if (w->s)
+		neb_evdp_source_del(w->s);
+	if (w->entries) {
+		for (int i = 0; i < w->entry_size; i++) {
+			struct fswatch_entry *e = w->entries + i;
+#if defined(FSWATCH_USE_KQUEUE)
+			if (e->wd >= 0)
+				close(e->wd);
+#endif
+			if (e->path)
+				free(e->path);
+		}
+		free(w->entries);
+	}
+	if (w->fd >= 0)
+		close(w->fd); // all inotify watches will be removed
+	if (w->evs)
+		free(w->evs);
+	if (w->pending)
+		free(w->pending);
+	free(w);
+}
+
+static int fswatch_get_free_id(neb_evdp_fswatch_t w)
+{
+	for (int i = 0; i < w->entry_size; i++) {
+		const struct fswatch_entry *e = w->entries + i;
+		if (e->wd == -1 && !e->path)
+			return i;
+	}
+
+	int new_size = w->entry_size ? w->entry_size * 2 : 8;
+	struct fswatch_entry *entries = realloc(w->entries, new_size * sizeof(struct fswatch_entry));
+	if (!entries) {
+		neb_syslogl(LOG_ERR, "realloc: %m");
+		return -1;
+	}
+	for (int i = w->entry_size; i < new_size; i++) {
+		entries[i].wd = -1;
+		entries[i].path = NULL;
+		entries[i].removed = 0;
+	}
+	int id = w->entry_size;
+	w->entries = entries;
+	w->entry_size = new_size;
+	return id;
+}
+
+int neb_evdp_fswatch_add(neb_evdp_fswatch_t w, const char *path)
+{
+	int id = fswatch_get_free_id(w);
+	if (id < 0)
+		return -1;
+	struct fswatch_entry *e = w->entries + id;
+
+	e->path = strdup(path);
+	if (!e->path) {
+		neb_syslogl(LOG_ERR, "strdup: %m");
+		return -1;
+	}
+
+#if defined(OS_LINUX)
+	int wd = inotify_add_watch(w->fd, path, FSWATCH_INOTIFY_MASK);
+	if (wd == -1) {
+		neb_syslogl(LOG_ERR, "inotify_add_watch(%s): %m", path);
+		fswatch_entry_free(w, id);
+		return -1;
+	}
+	// the same wd is returned for the same inode
+	int old_id = fswatch_find_id(w, wd);
+	if (old_id >= 0) {
+		fswatch_entry_free(w, id);
+		return old_id;
+	}
+	e->wd = wd;
+#elif defined(FSWATCH_USE_KQUEUE)
+# if defined(O_EVTONLY)
+	int fd = open(path, O_EVTONLY | O_CLOEXEC);
+# else
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+# endif
+	if (fd == -1) {
+		neb_syslogl(LOG_ERR, "open(%s): %m", path);
+		fswatch_entry_free(w, id);
+		return -1;
+	}
+	struct kevent kev;
+	EV_SET(&kev, fd, EVFILT_VNODE, EV_ADD | EV_ENABLE | EV_CLEAR, FSWATCH_VNODE_FFLAGS, 0, 0);
+	if (kevent(w->fd, &kev, 1, NULL, 0, NULL) == -1) {
+		neb_syslogl(LOG_ERR, "kevent(EVFILT_VNODE): %m");
+		close(fd);
+		fswatch_entry_free(w, id);
+		return -1;
+	}
+	e->wd = fd;
+#endif
+
+	return id;
+}
+
+int neb_evdp_fswatch_rm(neb_evdp_fswatch_t w, int id)
+{
+	if (id < 0 || id >= w->entry_size || !w->entries[id].path || w->entries[id].removed) {
+		neb_syslog(LOG_ERR, "Invalid fswatch id %d", id);
+		return -1;
+	}
+	struct fswatch_entry *e = w->entries + id;
+
+	if (e->wd >= 0) {
+#if defined(OS_LINUX)
+		if (inotify_rm_watch(w->fd, e->wd) == -1 && errno != EINVAL)
+			neb_syslogl(LOG_ERR, "inotify_rm_watch: %m");
+#elif defined(FSWATCH_USE_KQUEUE)
+		close(e->wd); // the knote will also be removed
+#endif
+	}
+
+	// drop pending events of this id
+	int n = 0;
+	for (int i = 0; i < w->pending_count; i++) {
+		if (w->pending[i].id == id)
+			continue;
+		if (n != i)
+			memcpy(w->pending + n, w->pending + i, sizeof(struct fswatch_pending));
+		n++;
+	}
+	w->pending_count = n;
+
+	e->wd = -1;
+	fswatch_entry_free(w, id);
+	return 0;
+}
+
+int neb_evdp_fswatch_attach(neb_evdp_fswatch_t w, neb_evdp_queue_t q)
+{
+	if (w->q) {
+		neb_syslog(LOG_ERR, "fswatch %p has already been attached to queue %p", w, w->q);
+		return -1;
+	}
+	if (w->dedup_msec && !neb_evdp_queue_get_timer(q)) {
+		neb_syslog(LOG_ERR, "queue timer is required for fswatch dedup");
+		return -1;
+	}
+
+	if (neb_evdp_queue_attach(q, w->s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach fswatch source");
+		return -1;
+	}
+	w->q = q;
+
+	return 0;
+}
+
+int neb_evdp_fswatch_detach(neb_evdp_fswatch_t w)
+{
+	if (!w->q) {
+		neb_syslog(LOG_ERR, "fswatch %p is not attached", w);
+		return -1;
+	}
+
+	if (w->tp) {
+		neb_evdp_timer_del_point(neb_evdp_queue_get_timer(w->q), w->tp);
+		w->tp = NULL;
+	}
+	w->pending_count = 0;
+
+	int ret = 0;
+	if (neb_evdp_source_get_queue(w->s)) {
+		ret = neb_evdp_queue_detach(w->q, w->s, 0);
+		if (ret != 0)
+			neb_syslog(LOG_ERR, "Failed to detach fswatch source");
+	}
+	w->q = NULL;
+
+	return ret;
+}
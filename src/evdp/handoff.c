@@ -0,0 +1,338 @@
+
+#include <nebase/syslog.h>
+#include <nebase/sock/common.h>
+#include <nebase/sock/unix.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/handoff.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+#define HANDOFF_MAGIC 0x4e424846 // NBHF
+#define HANDOFF_INIT_SIZE 64
+
+enum {
+	HANDOFF_T_FD = 1, // followed by the state, with the fd attached
+	HANDOFF_T_END,    // len is the fd count
+	HANDOFF_T_ACK,    // len is the fd count
+};
+
+struct handoff_hdr {
+	uint32_t magic;
+	uint32_t type;
+	int32_t utype;
+	uint32_t len;
+};
+
+struct handoff_rec {
+	int fd;
+	int utype;
+	size_t len;
+	void *state;
+};
+
+struct neb_evdp_handoff {
+	int count;
+	int size;
+	struct handoff_rec *recs;
+
+	neb_evdp_handoff_collect_t collect_cb;
+	int collect_err;
+};
+
+static _Thread_local neb_evdp_handoff_t handoff_collecting = NULL;
+
+neb_evdp_handoff_t neb_evdp_handoff_create(void)
+{
+	neb_evdp_handoff_t h = calloc(1, sizeof(struct neb_evdp_handoff));
+	if (!h) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	return h;
+}
+
+void neb_evdp_handoff_destroy(neb_evdp_handoff_t h)
+{
+	for (int i = 0; i < h->count; i++)
+		free(h->recs[i].state);
+	free(h->recs);
+	free(h);
+}
+
+int neb_evdp_handoff_add(neb_evdp_handoff_t h, int fd, int utype, const void *state, size_t len)
+{
+	if (fd < 0 || len > NEB_EVDP_HANDOFF_MAX_STATE || (len && !state)) {
+		neb_syslog(LOG_ERR, "Invalid handoff fd %d with state len %zu", fd, len);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (h->count == h->size) {
+		int size = h->size ? h->size * 2 : HANDOFF_INIT_SIZE;
+		struct handoff_rec *recs = realloc(h->recs, sizeof(struct handoff_rec) * size);
+		if (!recs) {
+			neb_syslogl(LOG_ERR, "realloc: %m");
+			return -1;
+		}
+		h->recs = recs;
+		h->size = size;
+	}
+
+	struct handoff_rec *r = h->recs + h->count;
+	r->fd = fd;
+	r->utype = utype;
+	r->len = len;
+	r->state = NULL;
+	if (len) {
+		r->state = malloc(len);
+		if (!r->state) {
+			neb_syslogl(LOG_ERR, "malloc: %m");
+			return -1;
+		}
+		memcpy(r->state, state, len);
+	}
+	h->count++;
+	return 0;
+}
+
+static neb_evdp_cb_ret_t handoff_on_each(neb_evdp_source_t s, int utype, void *udata)
+{
+	neb_evdp_handoff_t h = handoff_collecting;
+	if (h->collect_cb(h, s, utype, udata) != 0) {
+		h->collect_err = 1;
+		return NEB_EVDP_CB_END_FOREACH;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int neb_evdp_handoff_collect(neb_evdp_handoff_t h, neb_evdp_queue_t q, neb_evdp_handoff_collect_t cb)
+{
+	if (handoff_collecting) {
+		neb_syslog(LOG_ERR, "handoff collect is not reentrant");
+		return -1;
+	}
+	if (neb_evdp_queue_foreach_start(q, handoff_on_each) < 0) {
+		neb_syslog(LOG_ERR, "Failed to start foreach for handoff");
+		return -1;
+	}
+
+	handoff_collecting = h;
+	h->collect_cb = cb;
+	h->collect_err = 0;
+	int ret = neb_evdp_queue_foreach_next(q, 0) < 0 ? -1 : 0;
+	neb_evdp_queue_foreach_set_end(q);
+	handoff_collecting = NULL;
+
+	if (h->collect_err) {
+		neb_syslog(LOG_ERR, "handoff collect is aborted");
+		ret = -1;
+	}
+	return ret;
+}
+
+int neb_evdp_handoff_get_count(neb_evdp_handoff_t h)
+{
+	return h->count;
+}
+
+static int handoff_wait(int fd, short events, int msec)
+{
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = events,
+	};
+	for (;;) {
+		int ret = poll(&pfd, 1, msec);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			neb_syslogl(LOG_ERR, "poll: %m");
+			return -1;
+		}
+		if (ret == 0) {
+			neb_syslog(LOG_ERR, "handoff socket %d timeout", fd);
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		break;
+	}
+	if (pfd.revents & (POLLERR | POLLNVAL) || (!(pfd.revents & events) && (pfd.revents & POLLHUP))) {
+		neb_syslog(LOG_ERR, "handoff socket %d is closed", fd);
+		errno = EPIPE;
+		return -1;
+	}
+	return 0;
+}
+
+static int handoff_write_full(int fd, const char *buf, size_t len, int msec)
+{
+	while (len) {
+		if (handoff_wait(fd, POLLOUT, msec) != 0)
+			return -1;
+		ssize_t nw = send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (nw == -1) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			neb_syslogl(LOG_ERR, "send: %m");
+			return -1;
+		}
+		buf += nw;
+		len -= nw;
+	}
+	return 0;
+}
+
+static int handoff_read_full(int fd, char *buf, size_t len, int msec)
+{
+	while (len) {
+		if (handoff_wait(fd, POLLIN, msec) != 0)
+			return -1;
+		ssize_t nr = recv(fd, buf, len, MSG_DONTWAIT);
+		if (nr == -1) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			neb_syslogl(LOG_ERR, "recv: %m");
+			return -1;
+		}
+		if (nr == 0) {
+			neb_syslog(LOG_ERR, "handoff socket %d is closed by peer", fd);
+			errno = EPIPE;
+			return -1;
+		}
+		buf += nr;
+		len -= nr;
+	}
+	return 0;
+}
+
+static int handoff_send_rec(int fd, const struct handoff_rec *r, int msec)
+{
+	char buf[sizeof(struct handoff_hdr) + NEB_EVDP_HANDOFF_MAX_STATE];
+	struct handoff_hdr hdr = {
+		.magic = HANDOFF_MAGIC,
+		.type = HANDOFF_T_FD,
+		.utype = r->utype,
+		.len = r->len,
+	};
+	memcpy(buf, &hdr, sizeof(hdr));
+	if (r->len)
+		memcpy(buf + sizeof(hdr), r->state, r->len);
+	size_t len = sizeof(hdr) + r->len;
+
+	int rfd = r->fd;
+	for (;;) {
+		if (handoff_wait(fd, POLLOUT, msec) != 0)
+			return -1;
+		int nw = neb_sock_unix_send_with_fds(fd, buf, len, &rfd, 1, NULL, 0);
+		if (nw == -1) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -1;
+		}
+		// the fd goes with the first byte, the rest may be sent later
+		return handoff_write_full(fd, buf + nw, len - nw, msec);
+	}
+}
+
+int neb_evdp_handoff_send(neb_evdp_handoff_t h, int fd, int timeout_msec)
+{
+	for (int i = 0; i < h->count; i++) {
+		if (handoff_send_rec(fd, h->recs + i, timeout_msec) != 0) {
+			neb_syslog(LOG_ERR, "Failed to hand fd %d", h->recs[i].fd);
+			return -1;
+		}
+	}
+
+	struct handoff_hdr hdr = {
+		.magic = HANDOFF_MAGIC,
+		.type = HANDOFF_T_END,
+		.utype = 0,
+		.len = h->count,
+	};
+	if (handoff_write_full(fd, (const char *)&hdr, sizeof(hdr), timeout_msec) != 0) {
+		neb_syslog(LOG_ERR, "Failed to send handoff end");
+		return -1;
+	}
+
+	if (handoff_read_full(fd, (char *)&hdr, sizeof(hdr), timeout_msec) != 0) {
+		neb_syslog(LOG_ERR, "Failed to get handoff ack");
+		return -1;
+	}
+	if (hdr.magic != HANDOFF_MAGIC || hdr.type != HANDOFF_T_ACK || hdr.len != (uint32_t)h->count) {
+		neb_syslog(LOG_ERR, "Invalid handoff ack: type %u count %u", hdr.type, hdr.len);
+		return -1;
+	}
+	return 0;
+}
+
+int neb_evdp_handoff_recv(int fd, int timeout_msec, neb_evdp_handoff_restore_t cb, void *udata)
+{
+	char state[NEB_EVDP_HANDOFF_MAX_STATE];
+	int count = 0, rfd = -1;
+	for (;;) {
+		if (handoff_wait(fd, POLLIN, timeout_msec) != 0)
+			return -1;
+
+		struct handoff_hdr hdr;
+		int fd_num = 1;
+		rfd = -1;
+		int nr = neb_sock_unix_recv_with_fds(fd, (char *)&hdr, sizeof(hdr), &rfd, &fd_num);
+		if (nr <= 0) {
+			if (nr == 0) {
+				neb_syslog(LOG_ERR, "handoff socket %d is closed by peer", fd);
+			}
+			return -1;
+		}
+		if ((size_t)nr < sizeof(hdr) &&
+		    handoff_read_full(fd, (char *)&hdr + nr, sizeof(hdr) - nr, timeout_msec) != 0)
+			goto exit_err;
+		if (hdr.magic != HANDOFF_MAGIC) {
+			neb_syslog(LOG_ERR, "Invalid handoff magic %#x", hdr.magic);
+			goto exit_err;
+		}
+
+		switch (hdr.type) {
+		case HANDOFF_T_FD:
+			if (!fd_num || hdr.len > NEB_EVDP_HANDOFF_MAX_STATE) {
+				neb_syslog(LOG_ERR, "Invalid handoff record: fd num %d, state len %u", fd_num, hdr.len);
+				goto exit_err;
+			}
+			if (hdr.len && handoff_read_full(fd, state, hdr.len, timeout_msec) != 0)
+				goto exit_err;
+			count++;
+			if (cb(rfd, hdr.utype, hdr.len ? state : NULL, hdr.len, udata) != 0) {
+				neb_syslog(LOG_ERR, "Failed to restore handoff fd with utype %d", hdr.utype);
+				return -1;
+			}
+			break;
+		case HANDOFF_T_END:
+			if (fd_num)
+				close(rfd);
+			if (hdr.len != (uint32_t)count) {
+				neb_syslog(LOG_ERR, "handoff count mismatch: sent %u, received %d", hdr.len, count);
+				return -1;
+			}
+			hdr.type = HANDOFF_T_ACK;
+			if (handoff_write_full(fd, (const char *)&hdr, sizeof(hdr), timeout_msec) != 0) {
+				neb_syslog(LOG_ERR, "Failed to send handoff ack");
+				return -1;
+			}
+			return count;
+			break;
+		default:
+			neb_syslog(LOG_ERR, "Invalid handoff message type %u", hdr.type);
+			goto exit_err;
+			break;
+		}
+	}
+
+exit_err:
+	if (rfd >= 0)
+		close(rfd);
+	return -1;
+}
@@ -0,0 +1,378 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/listener.h>
+#include <nebase/sock/tcp.h>
+#include <nebase/sock/filter.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#if defined(OS_DARWIN) || defined(OS_HAIKU)
+# define LISTENER_NO_ACCEPT4
+#endif
+
+#define LISTENER_PAUSE_MSEC 100
+
+struct neb_evdp_listener {
+	int fd;
+	int batch;
+	neb_evdp_source_t s;
+	neb_evdp_source_t resume_s; // itimer to resume accepting after paused
+	neb_evdp_listener_handler_t on_accept;
+	neb_evdp_io_handler_t auto_hf;
+	void *udata;
+	neb_evdp_listener_conn_t conns[];
+};
+
+struct neb_evdp_listener_group {
+	int mode;
+	int count;
+	int fd_num;
+	int fds[];
+};
+
+static int listener_accept(int fd, neb_evdp_listener_conn_t *c)
+{
+	c->addrlen = sizeof(c->addr);
+#if defined(LISTENER_NO_ACCEPT4)
+	int nfd = accept(fd, (struct sockaddr *)&c->addr, &c->addrlen);
+	if (nfd == -1)
+		return -1;
+	if (fcntl(nfd, F_SETFL, O_NONBLOCK) == -1) {
+		neb_syslogl(LOG_ERR, "fcntl(F_SETFL, O_NONBLOCK): %m");
+		close(nfd);
+		errno = EINTR; // go on with the next one
+		return -1;
+	}
+	if (fcntl(nfd, F_SETFD, FD_CLOEXEC) == -1) {
+		neb_syslogl(LOG_ERR, "fcntl(F_SETFD, FD_CLOEXEC): %m");
+		close(nfd);
+		errno = EINTR;
+		return -1;
+	}
+#else
+	int nfd = accept4(fd, (struct sockaddr *)&c->addr, &c->addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (nfd == -1)
+		return -1;
+#endif
+	c->fd = nfd;
+	c->s = NULL;
+	return 0;
+}
+
+static neb_evdp_cb_ret_t listener_on_resume(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata)
+{
+	neb_evdp_listener_t l = udata;
+	neb_evdp_queue_t q = neb_evdp_source_get_queue(l->resume_s);
+	if (neb_evdp_queue_attach(q, l->s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to resume listener source, retry later");
+		return NEB_EVDP_CB_CONTINUE;
+	}
+	return NEB_EVDP_CB_REMOVE;
+}
+
+/**
+ * \return 0 if the resume timer is attached, and the listener source should be removed
+ */
+static int listener_pause(neb_evdp_listener_t l)
+{
+	if (neb_evdp_queue_attach(neb_evdp_source_get_queue(l->s), l->resume_s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach resume source for listener");
+		return -1;
+	}
+	return 0;
+}
+
+static neb_evdp_cb_ret_t listener_on_read(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_listener_t l = udata;
+
+	int count = 0, pause = 0;
+	while (count < l->batch) {
+		neb_evdp_listener_conn_t *c = l->conns + count;
+		if (listener_accept(fd, c) != 0) {
+			int stop = 0;
+			switch (errno) {
+			case EINTR:
+			case ECONNABORTED:
+			case EPROTO:
+				break;
+			case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+#endif
+				stop = 1;
+				break;
+			default: // EMFILE, ENFILE, ENOBUFS etc.
+				// the connection is still pending, so pause to avoid busy looping
+				neb_syslogl(LOG_ERR, "accept: %m, pause for %dms", LISTENER_PAUSE_MSEC);
+				stop = 1;
+				pause = 1;
+				break;
+			}
+			if (stop)
+				break;
+			continue;
+		}
+
+		if (l->auto_hf) {
+			c->s = neb_evdp_source_new_os_fd(c->fd, l->auto_hf);
+			if (!c->s) {
+				neb_syslog(LOG_ERR, "Failed to create os_fd source for fd %d", c->fd);
+				close(c->fd);
+				continue;
+			}
+			neb_evdp_source_set_on_remove(c->s, neb_evdp_source_del);
+		}
+		count++;
+	}
+
+	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
+	if (count) {
+		ret = l->on_accept(l, l->conns, count, l->udata);
+
+		if (l->auto_hf) {
+			neb_evdp_queue_t q = neb_evdp_source_get_queue(l->s);
+			for (int i = 0; i < count; i++) {
+				neb_evdp_listener_conn_t *c = l->conns + i;
+				// the handler may have deleted it, so check the claimed ones first
+				if (!c->s || neb_evdp_source_get_queue(c->s))
+					continue;
+				if (neb_evdp_queue_attach(q, c->s) != 0) {
+					neb_syslog(LOG_ERR, "Failed to attach os_fd source for fd %d", c->fd);
+					neb_evdp_source_del(c->s);
+					close(c->fd);
+				}
+			}
+		}
+	}
+
+	if (pause && ret == NEB_EVDP_CB_CONTINUE && listener_pause(l) == 0)
+		ret = NEB_EVDP_CB_REMOVE;
+	return ret;
+}
+
+static neb_evdp_cb_ret_t listener_on_hup(int fd, void *udata _nattr_unused, const void *context)
+{
+	int sockerr = 0;
+	if (neb_evdp_source_fd_get_sockerr(context, &sockerr) != 0) {
+		neb_syslog(LOG_ERR, "Failed to get sockerr for listener fd %d", fd);
+	} else {
+		neb_syslog_en(sockerr, LOG_ERR, "listener fd %d hup: %m", fd);
+	}
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+neb_evdp_listener_t neb_evdp_listener_create(int fd, int batch, neb_evdp_listener_handler_t cb, void *udata)
+{
+	if (batch <= 0)
+		batch = NEB_EVDP_LISTENER_DEFAULT_BATCH;
+
+	neb_evdp_listener_t l = calloc(1, sizeof(struct neb_evdp_listener) + sizeof(neb_evdp_listener_conn_t) * batch);
+	if (!l) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	l->fd = fd;
+	l->batch = batch;
+	l->on_accept = cb;
+	l->udata = udata;
+
+	l->s = neb_evdp_source_new_ro_fd(fd, listener_on_read, listener_on_hup);
+	if (!l->s) {
+		neb_syslog(LOG_ERR, "Failed to create ro_fd source for listener");
+		free(l);
+		return NULL;
+	}
+	neb_evdp_source_set_udata(l->s, l);
+
+	// created here as there may be no fd left when pausing
+	l->resume_s = neb_evdp_source_new_itimer_ms(0, LISTENER_PAUSE_MSEC, listener_on_resume);
+	if (!l->resume_s) {
+		neb_syslog(LOG_ERR, "Failed to create itimer_ms source for listener");
+		neb_evdp_source_del(l->s);
+		free(l);
+		return NULL;
+	}
+	neb_evdp_source_set_udata(l->resume_s, l);
+
+	return l;
+}
+
+void neb_evdp_listener_destroy(neb_evdp_listener_t l)
+{
+	neb_evdp_queue_t q = neb_evdp_source_get_queue(l->s);
+	if (q && neb_evdp_queue_detach(q, l->s, 0) != 0)
+		neb_syslog(LOG_ERR, "Failed to detach listener source");
+	neb_evdp_source_del(l->s);
+	q = neb_evdp_source_get_queue(l->resume_s);
+	if (q && neb_evdp_queue_detach(q, l->resume_s, 0) != 0)
+		neb_syslog(LOG_ERR, "Failed to detach listener resume source");
+	neb_evdp_source_del(l->resume_s);
+	free(l);
+}
+
+void neb_evdp_listener_set_auto_source(neb_evdp_listener_t l, neb_evdp_io_handler_t hf)
+{
+	l->auto_hf = hf;
+}
+
+int neb_evdp_listener_attach(neb_evdp_listener_t l, neb_evdp_queue_t q)
+{
+	if (neb_evdp_queue_attach(q, l->s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach listener source");
+		return -1;
+	}
+	return 0;
+}
+
+int neb_evdp_listener_detach(neb_evdp_listener_t l)
+{
+	neb_evdp_queue_t q = neb_evdp_source_get_queue(l->resume_s);
+	if (q) // paused
+		return neb_evdp_queue_detach(q, l->resume_s, 0);
+	q = neb_evdp_source_get_queue(l->s);
+	if (!q) {
+		neb_syslog(LOG_ERR, "listener %p is not attached", l);
+		return -1;
+	}
+	return neb_evdp_queue_detach(q, l->s, 0);
+}
+
+static int listener_group_add_reuseport(neb_evdp_listener_group_t g, struct sockaddr_storage *addr, socklen_t addrlen,
+                                        const struct neb_sock_tcp_profile *p)
+{
+	unsigned int applied = 0;
+	int fd = neb_sock_tcp_listen((struct sockaddr *)addr, addrlen, p, &applied);
+	if (fd == -1)
+		return -1;
+	g->fds[g->fd_num++] = fd;
+
+	if (g->fd_num > 1)
+		return 0;
+	if (!(applied & NEB_SOCK_TCP_OPT_REUSEPORT)) {
+		neb_syslog(LOG_NOTICE, "reuseport is not supported, fallback to exclusive mode");
+		g->mode = NEB_EVDP_LISTENER_GROUP_EXCLUSIVE;
+		return 0;
+	}
+	// use the same port for all others if it's chosen by the kernel
+	socklen_t len = addrlen;
+	if (getsockname(fd, (struct sockaddr *)addr, &len) == -1) {
+		neb_syslogl(LOG_ERR, "getsockname: %m");
+		return -1;
+	}
+	return 0;
+}
+
+neb_evdp_listener_group_t neb_evdp_listener_group_create(const struct sockaddr *addr, socklen_t addrlen,
+                                                         int count, int mode,
+                                                         const struct neb_sock_tcp_profile *p)
+{
+	if (count <= 0 || addrlen > sizeof(struct sockaddr_storage)) {
+		neb_syslog(LOG_ERR, "Invalid listener group params");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	neb_evdp_listener_group_t g = calloc(1, sizeof(struct neb_evdp_listener_group) + sizeof(int) * count);
+	if (!g) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	g->mode = mode;
+	g->count = count;
+
+	struct neb_sock_tcp_profile profile;
+	if (p)
+		memcpy(&profile, p, sizeof(profile));
+	else
+		neb_sock_tcp_profile_init(&profile, NEB_SOCK_TCP_PROFILE_DEFAULT);
+
+	struct sockaddr_storage saddr;
+	memcpy(&saddr, addr, addrlen);
+
+	switch (mode) {
+	case NEB_EVDP_LISTENER_GROUP_REUSEPORT_CPU:
+	case NEB_EVDP_LISTENER_GROUP_REUSEPORT:
+		profile.opts |= NEB_SOCK_TCP_OPT_REUSEPORT;
+		// the index in the reuseport group is in the order of listen
+		while (g->fd_num < count && g->mode != NEB_EVDP_LISTENER_GROUP_EXCLUSIVE) {
+			if (listener_group_add_reuseport(g, &saddr, addrlen, &profile) != 0) {
+				neb_syslog(LOG_ERR, "Failed to add socket %d to the reuseport group", g->fd_num);
+				neb_evdp_listener_group_destroy(g);
+				return NULL;
+			}
+		}
+		if (g->mode == NEB_EVDP_LISTENER_GROUP_REUSEPORT_CPU &&
+		    neb_sock_filter_attach_reuseport_cpu(g->fds[0], count) != 0) {
+			neb_syslog(LOG_NOTICE, "cpu steering is not available, fallback to reuseport mode");
+			g->mode = NEB_EVDP_LISTENER_GROUP_REUSEPORT;
+		}
+		break;
+	case NEB_EVDP_LISTENER_GROUP_EXCLUSIVE:
+		g->fds[0] = neb_sock_tcp_listen(addr, addrlen, &profile, NULL);
+		if (g->fds[0] == -1) {
+			neb_syslog(LOG_ERR, "Failed to create the shared listening socket");
+			neb_evdp_listener_group_destroy(g);
+			return NULL;
+		}
+		g->fd_num = 1;
+		break;
+	default:
+		neb_syslog(LOG_ERR, "Invalid listener group mode %d", mode);
+		free(g);
+		errno = EINVAL;
+		return NULL;
+		break;
+	}
+
+	return g;
+}
+
+void neb_evdp_listener_group_destroy(neb_evdp_listener_group_t g)
+{
+	for (int i = 0; i < g->fd_num; i++)
+		close(g->fds[i]);
+	free(g);
+}
+
+int neb_evdp_listener_group_get_mode(neb_evdp_listener_group_t g)
+{
+	return g->mode;
+}
+
+int neb_evdp_listener_group_get_fd(neb_evdp_listener_group_t g, int idx)
+{
+	if (idx < 0 || idx >= g->count)
+		return -1;
+	if (g->mode == NEB_EVDP_LISTENER_GROUP_EXCLUSIVE)
+		return g->fds[0];
+	return g->fds[idx];
+}
+
+neb_evdp_listener_t neb_evdp_listener_group_new_listener(neb_evdp_listener_group_t g, int idx, int batch,
+                                                         neb_evdp_listener_handler_t cb, void *udata)
+{
+	int fd = neb_evdp_listener_group_get_fd(g, idx);
+	if (fd == -1) {
+		neb_syslog(LOG_ERR, "Invalid worker index %d for listener group", idx);
+		return NULL;
+	}
+
+	neb_evdp_listener_t l = neb_evdp_listener_create(fd, batch, cb, udata);
+	if (!l)
+		return NULL;
+	if (g->mode == NEB_EVDP_LISTENER_GROUP_EXCLUSIVE &&
+	    neb_evdp_source_ro_fd_set_exclusive(l->s, 1) != 0) {
+		neb_syslog(LOG_ERR, "Failed to enable exclusive wakeup for listener");
+		neb_evdp_listener_destroy(l);
+		return NULL;
+	}
+	return l;
+}
@@ -0,0 +1,193 @@
+
+#include <nebase/syslog.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/pacer.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define PACER_UNIT 1000 // credit is counted in milli-tokens, so rate is credit per msec
+
+struct neb_evdp_pacer {
+	neb_evdp_queue_t q;
+	neb_evdp_timer_t t;
+	neb_evdp_timer_point tp; // kept after fired, and reset to wake up again
+	int scheduled;
+	int active;
+	int in_cb;
+	int restart; // started in cb
+
+	int64_t rate;   // tokens per second
+	int64_t limit;  // burst in credit
+	int64_t credit;
+	int64_t last_msec;
+
+	neb_evdp_pacer_handler_t cb;
+	void *udata;
+};
+
+static void pacer_refill(neb_evdp_pacer_t p)
+{
+	int64_t now = neb_evdp_queue_get_abs_timeout(p->q, 0);
+	int64_t elapsed = now - p->last_msec;
+	p->last_msec = now;
+	if (elapsed <= 0 || p->credit >= p->limit)
+		return;
+	if (elapsed >= (p->limit - p->credit) / p->rate + 1)
+		p->credit = p->limit;
+	else
+		p->credit += elapsed * p->rate;
+	if (p->credit > p->limit)
+		p->credit = p->limit;
+}
+
+static neb_evdp_timeout_ret_t pacer_on_timeout(void *udata);
+
+static int pacer_schedule(neb_evdp_pacer_t p, int64_t abs_msec)
+{
+	if (!p->tp) {
+		p->tp = neb_evdp_timer_new_point(p->t, abs_msec, pacer_on_timeout, p);
+		if (!p->tp) {
+			neb_syslog(LOG_ERR, "Failed to add pacer timer point");
+			return -1;
+		}
+	} else if (neb_evdp_timer_point_reset(p->t, p->tp, abs_msec) != 0) {
+		neb_syslog(LOG_ERR, "Failed to reset pacer timer point");
+		return -1;
+	}
+	p->scheduled = 1;
+	return 0;
+}
+
+/**
+ * \brief schedule the wakeup for the next whole token
+ */
+static int pacer_schedule_next(neb_evdp_pacer_t p)
+{
+	int64_t need = PACER_UNIT - p->credit;
+	int64_t msec = need > 0 ? (need + p->rate - 1) / p->rate : 0;
+	if (msec < 1)
+		msec = 1;
+	return pacer_schedule(p, p->last_msec + msec);
+}
+
+static neb_evdp_timeout_ret_t pacer_on_timeout(void *udata)
+{
+	neb_evdp_pacer_t p = udata;
+	p->scheduled = 0;
+	if (!p->active)
+		return NEB_EVDP_TIMEOUT_KEEP;
+
+	pacer_refill(p);
+	int64_t budget = p->credit / PACER_UNIT;
+	if (!budget) {
+		if (pacer_schedule_next(p) != 0)
+			p->active = 0;
+		return NEB_EVDP_TIMEOUT_KEEP;
+	}
+	if (budget > UINT32_MAX)
+		budget = UINT32_MAX;
+
+	p->in_cb = 1;
+	p->restart = 0;
+	int used = p->cb(p, (unsigned int)budget, p->udata);
+	p->in_cb = 0;
+	if (used < 0) {
+		p->active = 0;
+		return NEB_EVDP_TIMEOUT_KEEP;
+	}
+	if (used > budget)
+		used = budget;
+	p->credit -= (int64_t)used * PACER_UNIT;
+	if (!p->active) // stopped in cb
+		return NEB_EVDP_TIMEOUT_KEEP;
+	if (used < budget && !p->restart) {
+		p->active = 0;
+		return NEB_EVDP_TIMEOUT_KEEP;
+	}
+
+	if (pacer_schedule_next(p) != 0)
+		p->active = 0;
+	return NEB_EVDP_TIMEOUT_KEEP;
+}
+
+neb_evdp_pacer_t neb_evdp_pacer_create(neb_evdp_queue_t q, unsigned int rate, unsigned int burst,
+                                       neb_evdp_pacer_handler_t cb, void *udata)
+{
+	if (!rate || !burst) {
+		neb_syslog(LOG_ERR, "Invalid pacer rate %u burst %u", rate, burst);
+		return NULL;
+	}
+	neb_evdp_timer_t t = neb_evdp_queue_get_timer(q);
+	if (!t) {
+		neb_syslog(LOG_ERR, "queue timer is required for pacer");
+		return NULL;
+	}
+
+	neb_evdp_pacer_t p = calloc(1, sizeof(struct neb_evdp_pacer));
+	if (!p) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	p->q = q;
+	p->t = t;
+	p->rate = rate;
+	p->limit = (int64_t)burst * PACER_UNIT;
+	p->credit = p->limit;
+	p->last_msec = neb_evdp_queue_get_abs_timeout(q, 0);
+	p->cb = cb;
+	p->udata = udata;
+	return p;
+}
+
+void neb_evdp_pacer_destroy(neb_evdp_pacer_t p)
+{
+	if (p->tp)
+		neb_evdp_timer_del_point(p->t, p->tp);
+	free(p);
+}
+
+int neb_evdp_pacer_set_rate(neb_evdp_pacer_t p, unsigned int rate, unsigned int burst)
+{
+	if (!rate || !burst) {
+		neb_syslog(LOG_ERR, "Invalid pacer rate %u burst %u", rate, burst);
+		return -1;
+	}
+	pacer_refill(p);
+	p->rate = rate;
+	p->limit = (int64_t)burst * PACER_UNIT;
+	if (p->credit > p->limit)
+		p->credit = p->limit;
+	if (p->active && p->scheduled && p->credit < PACER_UNIT)
+		return pacer_schedule_next(p);
+	return 0;
+}
+
+int neb_evdp_pacer_start(neb_evdp_pacer_t p)
+{
+	if (p->in_cb) { // the firing point is rescheduled after the credit is used
+		p->active = 1;
+		p->restart = 1;
+		return 0;
+	}
+	if (p->active && p->scheduled)
+		return 0;
+	p->active = 1;
+	pacer_refill(p);
+	if (p->credit < PACER_UNIT)
+		return pacer_schedule_next(p);
+	return pacer_schedule(p, p->last_msec);
+}
+
+void neb_evdp_pacer_stop(neb_evdp_pacer_t p)
+{
+	p->active = 0;
+	p->restart = 0;
+}
+
+unsigned int neb_evdp_pacer_get_tokens(neb_evdp_pacer_t p)
+{
+	pacer_refill(p);
+	int64_t tokens = p->credit / PACER_UNIT;
+	return tokens > UINT32_MAX ? UINT32_MAX : (unsigned int)tokens;
+}
@@ -0,0 +1,287 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/pktring.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#if defined(OS_LINUX)
+# include <sys/socket.h>
+# include <sys/mman.h>
+# include <arpa/inet.h>
+# include <net/ethernet.h>
+# include <linux/if_packet.h>
+#endif
+
+#define PKTRING_DEFAULT_BLOCK_SIZE (1 << 20)
+#define PKTRING_DEFAULT_BLOCK_NUM 64
+#define PKTRING_DEFAULT_FRAME_SIZE 2048
+#define PKTRING_DEFAULT_TIMEOUT_MSEC 10
+
+struct neb_evdp_pktring {
+	int fd;
+	neb_evdp_pktring_handler_t cb;
+	void *udata;
+
+	neb_evdp_queue_t q;
+	neb_evdp_source_t s;
+
+	u_char *map;
+	size_t map_size;
+	unsigned int block_size;
+	unsigned int block_num;
+	unsigned int block_cur;
+};
+
+#if defined(OS_LINUX)
+static int pktring_setup(neb_evdp_pktring_t r, const struct neb_evdp_pktring_conf *conf)
+{
+	uint16_t protocol = conf->protocol ? conf->protocol : ETH_P_ALL;
+	r->fd = socket(AF_PACKET, (conf->cooked ? SOCK_DGRAM : SOCK_RAW) | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(protocol));
+	if (r->fd == -1) {
+		neb_syslogl(LOG_ERR, "socket(AF_PACKET): %m");
+		return -1;
+	}
+
+	int version = TPACKET_V3;
+	if (setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(PACKET_VERSION): %m");
+		return -1;
+	}
+
+	long page_size = sysconf(_SC_PAGESIZE);
+	r->block_size = conf->block_size ? conf->block_size : PKTRING_DEFAULT_BLOCK_SIZE;
+	r->block_num = conf->block_num ? conf->block_num : PKTRING_DEFAULT_BLOCK_NUM;
+	unsigned int frame_size = conf->frame_size ? conf->frame_size : PKTRING_DEFAULT_FRAME_SIZE;
+	if (page_size <= 0 || r->block_size % page_size != 0 || frame_size % TPACKET_ALIGNMENT != 0 ||
+	    frame_size > r->block_size) {
+		neb_syslog(LOG_ERR, "Invalid pktring block size %u or frame size %u", r->block_size, frame_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct tpacket_req3 req = {
+		.tp_block_size = r->block_size,
+		.tp_block_nr = r->block_num,
+		.tp_frame_size = frame_size,
+		.tp_frame_nr = (r->block_size / frame_size) * r->block_num,
+		.tp_retire_blk_tov = conf->timeout_msec ? conf->timeout_msec : PKTRING_DEFAULT_TIMEOUT_MSEC,
+		.tp_sizeof_priv = 0,
+		.tp_feature_req_word = 0,
+	};
+	if (setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(PACKET_RX_RING): %m");
+		return -1;
+	}
+
+	r->map_size = (size_t)r->block_size * r->block_num;
+	void *map = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+	if (map == MAP_FAILED) {
+		neb_syslogl(LOG_ERR, "mmap: %m");
+		r->map_size = 0;
+		return -1;
+	}
+	r->map = map;
+
+	// bind after the ring is set, so no packet is missed in the ring
+	struct sockaddr_ll sll = {
+		.sll_family = AF_PACKET,
+		.sll_protocol = htons(protocol),
+		.sll_ifindex = conf->ifindex,
+	};
+	if (bind(r->fd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
+		neb_syslogl(LOG_ERR, "bind(AF_PACKET): %m");
+		return -1;
+	}
+
+	return 0;
+}
+
+static neb_evdp_cb_ret_t pktring_on_read(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_pktring_t r = udata;
+
+	for (unsigned int i = 0; i < r->block_num; i++) {
+		struct tpacket_block_desc *bd = (struct tpacket_block_desc *)(r->map + (size_t)r->block_cur * r->block_size);
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+			break;
+
+		neb_evdp_pktblock_t blk = {
+			.pkt_num = bd->hdr.bh1.num_pkts,
+			.pkt_idx = 0,
+			.block = (const u_char *)bd,
+			.next = (const u_char *)bd + bd->hdr.bh1.offset_to_first_pkt,
+		};
+		neb_evdp_cb_ret_t ret = r->cb(&blk, r->udata);
+
+		__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		r->block_cur = (r->block_cur + 1) % r->block_num;
+
+		if (ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
+
+	return NEB_EVDP_CB_CONTINUE;
+}
+#else
+static int pktring_setup(neb_evdp_pktring_t r _nattr_unused, const struct neb_evdp_pktring_conf *conf _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+static neb_evdp_cb_ret_t pktring_on_read(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+#endif
+
+static neb_evdp_cb_ret_t pktring_on_hup(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	neb_syslog(LOG_CRIT, "pktring fd %d hup", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+neb_evdp_pktring_t neb_evdp_pktring_create(const struct neb_evdp_pktring_conf *conf,
+                                           neb_evdp_pktring_handler_t cb, void *udata)
+{
+#if !defined(OS_LINUX)
+	neb_syslog(LOG_ERR, "pktring is not supported on this platform");
+	errno = ENOTSUP;
+	return NULL;
+#endif
+	const struct neb_evdp_pktring_conf default_conf = NEB_STRUCT_INITIALIZER;
+	if (!conf)
+		conf = &default_conf;
+
+	neb_evdp_pktring_t r = calloc(1, sizeof(struct neb_evdp_pktring));
+	if (!r) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	r->fd = -1;
+	r->cb = cb;
+	r->udata = udata;
+
+	if (pktring_setup(r, conf) != 0) {
+		int err = errno;
+		neb_evdp_pktring_destroy(r);
+		errno = err;
+		return NULL;
+	}
+
+	r->s = neb_evdp_source_new_ro_fd(r->fd, pktring_on_read, pktring_on_hup);
+	if (!r->s) {
+		neb_syslog(LOG_ERR, "Failed to create ro_fd source for pktring");
+		neb_evdp_pktring_destroy(r);
+		return NULL;
+	}
+	neb_evdp_source_set_udata(r->s, r);
+
+	return r;
+}
+
+void neb_evdp_pktring_destroy(neb_evdp_pktring_t r)
+{
+	if (r->q)
+		neb_evdp_pktring_detach(r);
+	if (r->s)
+		neb_evdp_source_del(r->s);
+#if defined(OS_LINUX)
+	if (r->map)
+		munmap(r->map, r->map_size);
+#endif
+	if (r->fd >= 0)
+		close(r->fd);
+	free(r);
+}
+
+int neb_evdp_pktring_get_fd(neb_evdp_pktring_t r)
+{
+	return r->fd;
+}
+
+int neb_evdp_pktring_get_stats(neb_evdp_pktring_t r, unsigned int *packets, unsigned int *drops)
+{
+#if defined(OS_LINUX)
+	struct tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+	if (getsockopt(r->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == -1) {
+		neb_syslogl(LOG_ERR, "getsockopt(PACKET_STATISTICS): %m");
+		return -1;
+	}
+	*packets = st.tp_packets;
+	*drops = st.tp_drops;
+	return 0;
+#else
+	*packets = 0;
+	*drops = 0;
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+int neb_evdp_pktring_attach(neb_evdp_pktring_t r, neb_evdp_queue_t q)
+{
+	if (r->q) {
+		neb_syslog(LOG_ERR, "pktring %p has already been attached to queue %p", r, r->q);
+		return -1;
+	}
+
+	if (neb_evdp_queue_attach(q, r->s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach pktring source");
+		return -1;
+	}
+	r->q = q;
+
+	return 0;
+}
+
+int neb_evdp_pktring_detach(neb_evdp_pktring_t r)
+{
+	if (!r->q) {
+		neb_syslog(LOG_ERR, "pktring %p is not attached", r);
+		return -1;
+	}
+
+	int ret = 0;
+	if (neb_evdp_source_get_queue(r->s)) {
+		ret = neb_evdp_queue_detach(r->q, r->s, 0);
+		if (ret != 0)
+			neb_syslog(LOG_ERR, "Failed to detach pktring source");
+	}
+	r->q = NULL;
+
+	return ret;
+}
+
+int neb_evdp_pktblock_next(neb_evdp_pktblock_t *blk, neb_evdp_pkt_t *pkt)
+{
+#if defined(OS_LINUX)
+	if (blk->pkt_idx >= blk->pkt_num)
+		return 0;
+
+	const struct tpacket3_hdr *h = (const struct tpacket3_hdr *)blk->next;
+	const struct sockaddr_ll *sll = (const struct sockaddr_ll *)((const u_char *)h + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+	pkt->data = (const u_char *)h + h->tp_mac;
+	pkt->len = h->tp_snaplen;
+	pkt->orig_len = h->tp_len;
+	pkt->ts.tv_sec = h->tp_sec;
+	pkt->ts.tv_nsec = h->tp_nsec;
+	pkt->ifindex = sll->sll_ifindex;
+	pkt->protocol = ntohs(sll->sll_protocol);
+
+	blk->pkt_idx++;
+	blk->next = (const u_char *)h + h->tp_next_offset;
+	return 1;
+#else
+	(void)pkt;
+	blk->pkt_idx = blk->pkt_num;
+	return 0;
+#endif
+}
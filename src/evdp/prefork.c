@@ -0,0 +1,472 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/proc.h>
+#include <nebase/pidfile.h>
+#include <nebase/sock/common.h>
+#include <nebase/sock/unix.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/prefork.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+#if defined(OS_LINUX)
+# include <sys/syscall.h>
+#endif
+
+#define PREFORK_HANDOFF_TIMEOUT_MSEC 5000
+#define PREFORK_BACKOFF_MIN_MSEC 100
+#define PREFORK_BACKOFF_MAX_MSEC 10000
+#define PREFORK_BACKOFF_MAX_SHIFT 7
+#define PREFORK_STABLE_MSEC 10000 // reset the backoff if a worker is up for so long
+
+struct prefork_worker {
+	neb_evdp_prefork_t p;
+	int idx;
+	pid_t pid;   // 0 if not running
+	int pidfd;
+	int ctl_fd;  // the supervisor side
+	int retiring;
+	int fails;         // failed restarts in a row
+	int64_t start_msec;
+	neb_evdp_source_t s;
+	neb_evdp_timer_point tp; // pending restart
+};
+
+struct neb_evdp_prefork {
+	struct neb_evdp_prefork_conf conf;
+	char *lock_name;
+
+	neb_evdp_queue_t q;
+	neb_evdp_timer_t t;
+	int stopping;
+	int running;
+
+	int fd_num;
+	int fds[NEB_UNIX_MAX_CMSG_FD];
+
+	struct prefork_worker workers[];
+};
+
+static int prefork_spawn(struct prefork_worker *w);
+
+static pid_t prefork_fork(int *pidfd)
+{
+	*pidfd = -1;
+	pid_t pid = fork();
+	if (pid == -1) {
+		neb_syslogl(LOG_ERR, "fork: %m");
+		return -1;
+	}
+#if defined(OS_LINUX) && defined(SYS_pidfd_open)
+	if (pid > 0) {
+		*pidfd = syscall(SYS_pidfd_open, pid, 0);
+		if (*pidfd == -1)
+			neb_syslogl(LOG_NOTICE, "pidfd_open: %m");
+	}
+#endif
+	return pid;
+}
+
+static void prefork_worker_run(struct prefork_worker *w)
+	_nattr_noreturn;
+static void prefork_worker_run(struct prefork_worker *w)
+{
+	neb_evdp_prefork_t p = w->p;
+
+	if (p->conf.close_fd >= 0)
+		close(p->conf.close_fd);
+	// the siblings should see hup after the supervisor exited
+	for (int i = 0; i < p->conf.worker_num; i++) {
+		struct prefork_worker *o = p->workers + i;
+		if (o == w)
+			continue;
+		if (o->ctl_fd >= 0)
+			close(o->ctl_fd);
+		if (o->pidfd >= 0)
+			close(o->pidfd);
+	}
+	// use the handed ones only
+	for (int i = 0; i < p->fd_num; i++)
+		close(p->fds[i]);
+
+	if (p->conf.lock_dirfd >= 0) {
+		char name[NAME_MAX + 1];
+		snprintf(name, sizeof(name), "%s%d", p->lock_name, w->idx);
+		pid_t locker = 0;
+		int lock_fd = neb_pidlock(p->conf.lock_dirfd, name, &locker);
+		if (lock_fd == -1) {
+			if (locker > 0)
+				neb_syslog(LOG_ERR, "worker %d lock %s is held by %d", w->idx, name, locker);
+			neb_proc_child_flush_exit(NEB_EVDP_PREFORK_EXIT_LOCKED);
+		}
+		// keep it open, the lock is gone after exit
+	}
+
+	int hup = 0;
+	if (!neb_sock_timed_read_ready(w->ctl_fd, PREFORK_HANDOFF_TIMEOUT_MSEC, &hup)) {
+		neb_syslog(LOG_ERR, "worker %d: no fds handed from supervisor", w->idx);
+		neb_proc_child_flush_exit(EXIT_FAILURE);
+	}
+	int idx = -1;
+	int fds[NEB_UNIX_MAX_CMSG_FD];
+	int fd_num = NEB_UNIX_MAX_CMSG_FD - 1;
+	if (neb_sock_unix_recv_with_fds(w->ctl_fd, (char *)&idx, sizeof(idx), fds, &fd_num) != sizeof(idx) ||
+	    idx != w->idx) {
+		neb_syslog(LOG_ERR, "worker %d: failed to get fds from supervisor", w->idx);
+		neb_proc_child_flush_exit(EXIT_FAILURE);
+	}
+
+	int status = p->conf.worker(w->idx, w->ctl_fd, fds, fd_num, p->conf.udata);
+	neb_proc_child_flush_exit(status);
+}
+
+static neb_evdp_timeout_ret_t prefork_on_restart(void *udata)
+{
+	struct prefork_worker *w = udata;
+	w->tp = NULL;
+	if (!w->p->stopping && !w->pid && prefork_spawn(w) != 0)
+		neb_syslog(LOG_ERR, "Failed to restart worker %d", w->idx);
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static void prefork_schedule_restart(struct prefork_worker *w, int delay)
+{
+	neb_evdp_prefork_t p = w->p;
+	if (delay <= 0) {
+		if (prefork_spawn(w) != 0)
+			neb_syslog(LOG_ERR, "Failed to restart worker %d", w->idx);
+		return;
+	}
+	if (w->tp)
+		return;
+	int64_t abs_msec = neb_evdp_queue_get_abs_timeout(p->q, delay);
+	w->tp = neb_evdp_timer_new_point(p->t, abs_msec, prefork_on_restart, w);
+	if (!w->tp)
+		neb_syslog(LOG_ERR, "Failed to add restart timer point for worker %d", w->idx);
+}
+
+/**
+ * \brief the configured delay for the first failure after a stable run, and
+ *        exponential backoff for the following ones and the locked exits
+ */
+static int prefork_failure_delay(struct prefork_worker *w, int wstatus)
+{
+	neb_evdp_prefork_t p = w->p;
+	if (neb_evdp_queue_get_abs_timeout(p->q, 0) - w->start_msec >= PREFORK_STABLE_MSEC)
+		w->fails = 0;
+
+	int delay = p->conf.restart_delay_msec;
+	int locked = wstatus != -1 && WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == NEB_EVDP_PREFORK_EXIT_LOCKED;
+	if (w->fails || locked) {
+		int shift = w->fails < PREFORK_BACKOFF_MAX_SHIFT ? w->fails : PREFORK_BACKOFF_MAX_SHIFT;
+		int backoff = PREFORK_BACKOFF_MIN_MSEC << shift;
+		if (backoff > PREFORK_BACKOFF_MAX_MSEC)
+			backoff = PREFORK_BACKOFF_MAX_MSEC;
+		if (delay < backoff)
+			delay = backoff;
+	}
+	w->fails++;
+	return delay;
+}
+
+static neb_evdp_cb_ret_t prefork_on_exit(pid_t pid, int wstatus, void *udata)
+{
+	struct prefork_worker *w = udata;
+	neb_evdp_prefork_t p = w->p;
+
+	w->s = NULL; // deleted after removed
+	w->pid = 0;
+	if (w->pidfd >= 0) {
+		close(w->pidfd);
+		w->pidfd = -1;
+	}
+	if (w->ctl_fd >= 0) {
+		close(w->ctl_fd);
+		w->ctl_fd = -1;
+	}
+	p->running--;
+
+	int retiring = w->retiring;
+	w->retiring = 0;
+
+	if (wstatus == -1) {
+		neb_syslog(LOG_NOTICE, "worker %d (pid %d) is reaped elsewhere", w->idx, pid);
+	} else if (WIFSIGNALED(wstatus) && !p->stopping && !retiring) {
+		neb_syslog(LOG_ERR, "worker %d (pid %d) is killed by signal %d", w->idx, pid, WTERMSIG(wstatus));
+	} else if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) != 0) {
+		neb_syslog(LOG_ERR, "worker %d (pid %d) exited with status %d", w->idx, pid, WEXITSTATUS(wstatus));
+	}
+
+	if (p->conf.on_exit)
+		p->conf.on_exit(w->idx, pid, wstatus, p->conf.udata);
+
+	if (p->stopping) {
+		;
+	} else if (retiring) {
+		prefork_schedule_restart(w, 0);
+	} else if (wstatus == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+		prefork_schedule_restart(w, prefork_failure_delay(w, wstatus));
+	}
+
+	return NEB_EVDP_CB_CLOSE;
+}
+
+static int prefork_handoff(struct prefork_worker *w)
+{
+	neb_evdp_prefork_t p = w->p;
+	int idx = w->idx;
+	if (neb_sock_unix_send_with_fds(w->ctl_fd, (const char *)&idx, sizeof(idx), p->fds, p->fd_num, NULL, 0) != sizeof(idx)) {
+		neb_syslog(LOG_ERR, "Failed to hand fds to worker %d", w->idx);
+		return -1;
+	}
+	return 0;
+}
+
+static int prefork_spawn(struct prefork_worker *w)
+{
+	neb_evdp_prefork_t p = w->p;
+
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		neb_syslogl(LOG_ERR, "socketpair: %m");
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		if (fcntl(sv[i], F_SETFD, FD_CLOEXEC) == -1) {
+			neb_syslogl(LOG_ERR, "fcntl(F_SETFD, FD_CLOEXEC): %m");
+			close(sv[0]);
+			close(sv[1]);
+			return -1;
+		}
+	}
+
+	// don't let the child flush the buffered data again
+	fflush(stdout);
+	fflush(stderr);
+
+	int pidfd = -1;
+	pid_t pid = prefork_fork(&pidfd);
+	switch (pid) {
+	case -1:
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+		break;
+	case 0:
+		close(sv[0]);
+		w->ctl_fd = sv[1];
+		prefork_worker_run(w);
+		break;
+	default:
+		break;
+	}
+
+	close(sv[1]);
+	w->ctl_fd = sv[0];
+	w->pid = pid;
+	w->pidfd = pidfd;
+	w->start_msec = neb_evdp_queue_get_abs_timeout(p->q, 0);
+	p->running++;
+
+	if (prefork_handoff(w) != 0) // the worker will exit and be restarted
+		kill(pid, SIGKILL);
+
+	w->s = neb_evdp_source_new_proc(pid, pidfd, prefork_on_exit);
+	if (!w->s) {
+		neb_syslog(LOG_ERR, "Failed to create proc source for worker %d", w->idx);
+		goto exit_kill;
+	}
+	neb_evdp_source_set_udata(w->s, w);
+	neb_evdp_source_set_on_remove(w->s, neb_evdp_source_del);
+	if (neb_evdp_queue_attach(p->q, w->s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach proc source for worker %d", w->idx);
+		neb_evdp_source_del(w->s);
+		w->s = NULL;
+		goto exit_kill;
+	}
+
+	return 0;
+
+exit_kill:
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	w->pid = 0;
+	if (w->pidfd >= 0) {
+		close(w->pidfd);
+		w->pidfd = -1;
+	}
+	close(w->ctl_fd);
+	w->ctl_fd = -1;
+	p->running--;
+	return -1;
+}
+
+neb_evdp_prefork_t neb_evdp_prefork_create(const struct neb_evdp_prefork_conf *conf)
+{
+	if (conf->worker_num <= 0 || !conf->worker) {
+		neb_syslog(LOG_ERR, "Invalid prefork conf");
+		errno = EINVAL;
+		return NULL;
+	}
+	if (conf->lock_dirfd >= 0 && !conf->lock_name) {
+		neb_syslog(LOG_ERR, "lock_name is required if lock_dirfd is set");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	neb_evdp_prefork_t p = calloc(1, sizeof(struct neb_evdp_prefork) + sizeof(struct prefork_worker) * conf->worker_num);
+	if (!p) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	memcpy(&p->conf, conf, sizeof(p->conf));
+	if (!p->conf.reload_signo)
+		p->conf.reload_signo = SIGHUP;
+	if (conf->lock_dirfd >= 0) {
+		p->lock_name = strdup(conf->lock_name);
+		if (!p->lock_name) {
+			neb_syslogl(LOG_ERR, "strdup: %m");
+			free(p);
+			return NULL;
+		}
+	}
+	p->conf.lock_name = p->lock_name;
+
+	for (int i = 0; i < conf->worker_num; i++) {
+		struct prefork_worker *w = p->workers + i;
+		w->p = p;
+		w->idx = i;
+		w->pidfd = -1;
+		w->ctl_fd = -1;
+	}
+
+	return p;
+}
+
+void neb_evdp_prefork_destroy(neb_evdp_prefork_t p)
+{
+	for (int i = 0; i < p->conf.worker_num; i++) {
+		struct prefork_worker *w = p->workers + i;
+		if (w->tp) {
+			neb_evdp_timer_del_point(p->t, w->tp);
+			w->tp = NULL;
+		}
+		if (w->s) { // deleted by on_remove after detached
+			if (neb_evdp_queue_detach(p->q, w->s, 0) != 0)
+				neb_syslog(LOG_ERR, "Failed to detach proc source for worker %d", w->idx);
+			w->s = NULL;
+		}
+		if (w->pid > 0) {
+			kill(w->pid, SIGKILL);
+			waitpid(w->pid, NULL, 0);
+			w->pid = 0;
+		}
+		if (w->pidfd >= 0)
+			close(w->pidfd);
+		if (w->ctl_fd >= 0)
+			close(w->ctl_fd);
+	}
+	free(p->lock_name);
+	free(p);
+}
+
+int neb_evdp_prefork_set_fds(neb_evdp_prefork_t p, const int *fds, int fd_num)
+{
+	if (fd_num <= 0 || fd_num >= NEB_UNIX_MAX_CMSG_FD) {
+		neb_syslog(LOG_ERR, "Invalid prefork fd num %d", fd_num);
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(p->fds, fds, sizeof(int) * fd_num);
+	p->fd_num = fd_num;
+	return 0;
+}
+
+int neb_evdp_prefork_start(neb_evdp_prefork_t p, neb_evdp_queue_t q)
+{
+	if (!p->fd_num) {
+		neb_syslog(LOG_ERR, "No fds set for prefork workers");
+		return -1;
+	}
+	if (p->q) {
+		neb_syslog(LOG_ERR, "prefork is already started");
+		return -1;
+	}
+	p->q = q;
+	p->t = neb_evdp_queue_get_timer(q);
+	if (!p->t) {
+		neb_syslog(LOG_ERR, "queue timer is required for restart delay and backoff");
+		p->q = NULL;
+		return -1;
+	}
+
+	for (int i = 0; i < p->conf.worker_num; i++) {
+		if (prefork_spawn(p->workers + i) != 0) {
+			neb_syslog(LOG_ERR, "Failed to start worker %d", i);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int neb_evdp_prefork_reload(neb_evdp_prefork_t p, int respawn)
+{
+	int ret = 0;
+	int signo = respawn ? SIGTERM : p->conf.reload_signo;
+	for (int i = 0; i < p->conf.worker_num; i++) {
+		struct prefork_worker *w = p->workers + i;
+		if (!w->pid)
+			continue;
+		if (kill(w->pid, signo) == -1) {
+			neb_syslogl(LOG_ERR, "kill(%d, %d): %m", w->pid, signo);
+			ret = -1;
+			continue;
+		}
+		if (respawn)
+			w->retiring = 1;
+	}
+	return ret;
+}
+
+int neb_evdp_prefork_stop(neb_evdp_prefork_t p, int signo)
+{
+	int ret = 0;
+	if (!signo)
+		signo = SIGTERM;
+	p->stopping = 1;
+	for (int i = 0; i < p->conf.worker_num; i++) {
+		struct prefork_worker *w = p->workers + i;
+		if (w->tp) {
+			neb_evdp_timer_del_point(p->t, w->tp);
+			w->tp = NULL;
+		}
+		if (w->pid && kill(w->pid, signo) == -1) {
+			neb_syslogl(LOG_ERR, "kill(%d, %d): %m", w->pid, signo);
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+int neb_evdp_prefork_get_running(neb_evdp_prefork_t p)
+{
+	return p->running;
+}
+
+pid_t neb_evdp_prefork_get_pid(neb_evdp_prefork_t p, int idx)
+{
+	if (idx < 0 || idx >= p->conf.worker_num)
+		return 0;
+	return p->workers[idx].pid;
+}
@@ -0,0 +1,40 @@
+
+#ifndef NEB_SRC_EVDP_PROBES_H
+#define NEB_SRC_EVDP_PROBES_H 1
+
+#include "options.h"
+
+/*
+ * USDT probes, provider nebase_evdp
+ *  they are nops until attached by tools like bpftrace or perf, the arguments
+ *  are only evaluated into registers or stack, so keep them simple
+ *
+ *  wait_start(q, timeout_ms)       before waiting for events
+ *  wait_end(q, nevents)            after waiting for events
+ *  flush_start(q, pending)         before adding pending sources to driver
+ *  flush_end(q, pending, ret)      after adding pending sources to driver
+ *  dispatch(q, s, type)            before calling the source handler
+ *  callback_ret(q, s, type, ret)   after the source handler returned
+ *  attach(q, s, type)              source attached to queue
+ *  detach(q, s, type, to_close)    source detached from queue
+ *  timer_fire(t, udata, ret)       timer point callback returned
+ */
+
+#if defined(WITH_USDT)
+# include <sys/sdt.h>
+# define EVDP_PROBE1(name, a1) \
+	DTRACE_PROBE1(nebase_evdp, name, a1)
+# define EVDP_PROBE2(name, a1, a2) \
+	DTRACE_PROBE2(nebase_evdp, name, a1, a2)
+# define EVDP_PROBE3(name, a1, a2, a3) \
+	DTRACE_PROBE3(nebase_evdp, name, a1, a2, a3)
+# define EVDP_PROBE4(name, a1, a2, a3, a4) \
+	DTRACE_PROBE4(nebase_evdp, name, a1, a2, a3, a4)
+#else
+# define EVDP_PROBE1(name, a1) do {} while (0)
+# define EVDP_PROBE2(name, a1, a2) do {} while (0)
+# define EVDP_PROBE3(name, a1, a2, a3) do {} while (0)
+# define EVDP_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#endif
+
+#endif
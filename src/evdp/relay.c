@@ -0,0 +1,413 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/pipe.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/relay.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#define RELAY_DEFAULT_BUF_SIZE (64 * 1024)
+
+struct relay_dir {
+#if defined(OS_LINUX)
+	int pipefd[2];
+#else
+	char *buf;
+	size_t head;
+#endif
+	size_t size;
+	size_t pending;
+	uint64_t bytes;
+	int eof;
+	int done;
+};
+
+struct relay_end {
+	neb_evdp_relay_t r;
+	int fd;
+	neb_evdp_source_t s;
+	int read_armed;
+	int write_armed;
+	int hup;
+};
+
+struct neb_evdp_relay {
+	struct relay_end end[2];
+	struct relay_dir dir[2]; // dir[i] is from end[i] to end[1 - i]
+	neb_evdp_relay_handler_t on_done;
+	void *udata;
+	int finished;
+};
+
+static neb_evdp_cb_ret_t relay_on_read(int fd, void *udata, const void *context);
+static neb_evdp_cb_ret_t relay_on_write(int fd, void *udata, const void *context);
+
+static int relay_dir_init(struct relay_dir *d, size_t size)
+{
+#if defined(OS_LINUX)
+	if (neb_pipe_new(d->pipefd) != 0) {
+		neb_syslog(LOG_ERR, "Failed to create relay pipe");
+		return -1;
+	}
+	int ps = fcntl(d->pipefd[1], F_SETPIPE_SZ, (int)size);
+	if (ps == -1) {
+		neb_syslogl(LOG_DEBUG, "fcntl(F_SETPIPE_SZ): %m");
+		ps = fcntl(d->pipefd[1], F_GETPIPE_SZ);
+		if (ps == -1) {
+			neb_syslogl(LOG_ERR, "fcntl(F_GETPIPE_SZ): %m");
+			return -1;
+		}
+	}
+	d->size = ps;
+#else
+	d->buf = malloc(size);
+	if (!d->buf) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		return -1;
+	}
+	d->size = size;
+#endif
+	return 0;
+}
+
+static void relay_dir_deinit(struct relay_dir *d)
+{
+#if defined(OS_LINUX)
+	for (int i = 0; i < 2; i++) {
+		if (d->pipefd[i] >= 0) {
+			close(d->pipefd[i]);
+			d->pipefd[i] = -1;
+		}
+	}
+#else
+	if (d->buf) {
+		free(d->buf);
+		d->buf = NULL;
+	}
+#endif
+}
+
+/**
+ * \return bytes read, 0 if EOF, -1 with errno set if failed
+ */
+static ssize_t relay_dir_fill(struct relay_dir *d, int fd)
+{
+#if defined(OS_LINUX)
+	ssize_t n = splice(fd, NULL, d->pipefd[1], NULL, d->size - d->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+	if (!d->pending)
+		d->head = 0;
+	size_t tail = d->head + d->pending;
+	ssize_t n = read(fd, d->buf + tail, d->size - tail);
+#endif
+	if (n > 0)
+		d->pending += n;
+	return n;
+}
+
+/**
+ * \return bytes written, -1 with errno set if failed
+ */
+static ssize_t relay_dir_flush(struct relay_dir *d, int fd)
+{
+#if defined(OS_LINUX)
+	ssize_t n = splice(d->pipefd[0], NULL, fd, NULL, d->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+	ssize_t n = write(fd, d->buf + d->head, d->pending);
+	if (n > 0)
+		d->head += n;
+#endif
+	if (n > 0) {
+		d->pending -= n;
+		d->bytes += n;
+	}
+	return n;
+}
+
+static int relay_dir_full(const struct relay_dir *d)
+{
+#if defined(OS_LINUX)
+	return d->pending >= d->size;
+#else
+	return d->head + d->pending >= d->size;
+#endif
+}
+
+static void relay_stop(neb_evdp_relay_t r)
+{
+	for (int i = 0; i < 2; i++) {
+		struct relay_end *e = &r->end[i];
+		if (e->read_armed && neb_evdp_source_os_fd_next_read(e->s, NULL) != 0)
+			neb_syslog(LOG_ERR, "Failed to unset read handler for relay %p", r);
+		e->read_armed = 0;
+		if (e->write_armed && neb_evdp_source_os_fd_next_write(e->s, NULL) != 0)
+			neb_syslog(LOG_ERR, "Failed to unset write handler for relay %p", r);
+		e->write_armed = 0;
+	}
+}
+
+static neb_evdp_cb_ret_t relay_finish(neb_evdp_relay_t r, int err)
+{
+	relay_stop(r);
+	r->finished = 1;
+	return r->on_done(r, err, r->udata);
+}
+
+static int relay_arm_read(struct relay_end *e)
+{
+	if (e->read_armed)
+		return 0;
+	if (neb_evdp_source_os_fd_next_read(e->s, relay_on_read) != 0)
+		return -1;
+	e->read_armed = 1;
+	return 0;
+}
+
+static int relay_arm_write(struct relay_end *e)
+{
+	if (e->write_armed)
+		return 0;
+	if (neb_evdp_source_os_fd_next_write(e->s, relay_on_write) != 0)
+		return -1;
+	e->write_armed = 1;
+	return 0;
+}
+
+/**
+ * \brief flush data of dir i to the other end, and update arm state
+ */
+static neb_evdp_cb_ret_t relay_dir_progress(neb_evdp_relay_t r, int i, int read_again)
+{
+	struct relay_dir *d = &r->dir[i];
+	struct relay_end *src = &r->end[i];
+	struct relay_end *dst = &r->end[1 - i];
+
+	for (;;) {
+		if (d->pending) {
+			if (relay_dir_flush(d, dst->fd) == -1) {
+				switch (errno) {
+				case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+				case EWOULDBLOCK:
+#endif
+				case EINTR:
+					break;
+				default:
+					return relay_finish(r, errno);
+					break;
+				}
+			}
+			if (d->pending) {
+				if (dst->hup) // no more write events
+					return relay_finish(r, EPIPE);
+				if (relay_arm_write(dst) != 0)
+					return NEB_EVDP_CB_BREAK_ERR;
+				break;
+			}
+		}
+		if (d->eof || !src->hup)
+			break;
+
+		// there will be no more read events after hup, so read until EOF
+		ssize_t n = relay_dir_fill(d, src->fd);
+		if (n > 0)
+			continue;
+		if (n == 0) {
+			d->eof = 1;
+			break;
+		}
+		switch (errno) {
+		case EINTR:
+			continue;
+			break;
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			d->eof = 1;
+			break;
+		default:
+			return relay_finish(r, errno);
+			break;
+		}
+	}
+
+	if (d->eof) {
+		if (!d->pending && !d->done) {
+			d->done = 1;
+			if (shutdown(dst->fd, SHUT_WR) == -1 && errno != ENOTSOCK && errno != ENOTCONN)
+				neb_syslogl(LOG_DEBUG, "shutdown(%d, SHUT_WR): %m", dst->fd);
+			if (r->dir[1 - i].done)
+				return relay_finish(r, 0);
+		}
+		return NEB_EVDP_CB_CONTINUE;
+	}
+
+	// if read got EAGAIN with pending data, the pipe may be full, wait for the flush
+	if (read_again && !src->hup && !relay_dir_full(d) && relay_arm_read(src) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t relay_on_read(int fd, void *udata, const void *context _nattr_unused)
+{
+	struct relay_end *e = udata;
+	neb_evdp_relay_t r = e->r;
+	int i = e - r->end;
+	struct relay_dir *d = &r->dir[i];
+	e->read_armed = 0;
+
+	int read_again = 1;
+	ssize_t n = relay_dir_fill(d, fd);
+	if (n == 0) {
+		d->eof = 1;
+	} else if (n == -1) {
+		switch (errno) {
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			if (d->pending)
+				read_again = 0;
+			break;
+		case EINTR:
+			break;
+		default:
+			return relay_finish(r, errno);
+			break;
+		}
+	}
+
+	return relay_dir_progress(r, i, read_again);
+}
+
+static neb_evdp_cb_ret_t relay_on_write(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	struct relay_end *e = udata;
+	neb_evdp_relay_t r = e->r;
+	e->write_armed = 0;
+
+	int i = 1 - (e - r->end); // the dir to this end
+	return relay_dir_progress(r, i, 1);
+}
+
+static neb_evdp_cb_ret_t relay_on_hup(int fd, void *udata, const void *context)
+{
+	struct relay_end *e = udata;
+	neb_evdp_relay_t r = e->r;
+	if (r->finished)
+		return NEB_EVDP_CB_REMOVE;
+
+	int sockerr = 0;
+	if (neb_evdp_source_fd_get_sockerr(context, &sockerr) != 0)
+		neb_syslog(LOG_DEBUG, "Failed to get sockerr for relay fd %d", fd);
+	if (sockerr)
+		return relay_finish(r, sockerr);
+
+	// the source will be removed, but data may still be available for read,
+	// and writing to it is failed only if there is data to write
+	int i = e - r->end;
+	e->hup = 1;
+	e->read_armed = 0;
+	e->write_armed = 0;
+	if (r->dir[1 - i].pending) {
+		neb_evdp_cb_ret_t ret = relay_dir_progress(r, 1 - i, 0);
+		if (r->finished || ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
+	return relay_dir_progress(r, i, 0);
+}
+
+neb_evdp_relay_t neb_evdp_relay_create(int fd_a, int fd_b, size_t buf_size,
+                                       neb_evdp_relay_handler_t cb, void *udata)
+{
+	neb_evdp_relay_t r = calloc(1, sizeof(struct neb_evdp_relay));
+	if (!r) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	r->on_done = cb;
+	r->udata = udata;
+	if (!buf_size)
+		buf_size = RELAY_DEFAULT_BUF_SIZE;
+
+	r->end[0].fd = fd_a;
+	r->end[1].fd = fd_b;
+#if defined(OS_LINUX)
+	for (int i = 0; i < 2; i++)
+		r->dir[i].pipefd[0] = r->dir[i].pipefd[1] = -1;
+#endif
+	for (int i = 0; i < 2; i++) {
+		if (relay_dir_init(&r->dir[i], buf_size) != 0) {
+			neb_evdp_relay_destroy(r);
+			return NULL;
+		}
+
+		struct relay_end *e = &r->end[i];
+		e->r = r;
+		e->s = neb_evdp_source_new_os_fd(e->fd, relay_on_hup);
+		if (!e->s) {
+			neb_syslog(LOG_ERR, "Failed to create os_fd source for relay");
+			neb_evdp_relay_destroy(r);
+			return NULL;
+		}
+		neb_evdp_source_set_udata(e->s, e);
+		if (relay_arm_read(e) != 0) { // before attach
+			neb_evdp_relay_destroy(r);
+			return NULL;
+		}
+	}
+
+	return r;
+}
+
+void neb_evdp_relay_destroy(neb_evdp_relay_t r)
+{
+	for (int i = 0; i < 2; i++) {
+		neb_evdp_source_t s = r->end[i].s;
+		if (s) {
+			neb_evdp_queue_t q = neb_evdp_source_get_queue(s);
+			if (q && neb_evdp_queue_detach(q, s, 0) != 0)
+				neb_syslog(LOG_ERR, "Failed to detach relay source");
+			neb_evdp_source_del(s);
+		}
+		relay_dir_deinit(&r->dir[i]);
+	}
+	free(r);
+}
+
+int neb_evdp_relay_attach(neb_evdp_relay_t r, neb_evdp_queue_t q)
+{
+	for (int i = 0; i < 2; i++) {
+		if (neb_evdp_queue_attach(q, r->end[i].s) != 0) {
+			neb_syslog(LOG_ERR, "Failed to attach relay source");
+			if (i && neb_evdp_queue_detach(q, r->end[0].s, 0) != 0)
+				neb_syslog(LOG_ERR, "Failed to detach relay source");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int neb_evdp_relay_detach(neb_evdp_relay_t r)
+{
+	int ret = 0;
+	for (int i = 0; i < 2; i++) {
+		neb_evdp_source_t s = r->end[i].s;
+		neb_evdp_queue_t q = neb_evdp_source_get_queue(s);
+		if (q && neb_evdp_queue_detach(q, s, 0) != 0)
+			ret = -1;
+	}
+	return ret;
+}
+
+uint64_t neb_evdp_relay_get_bytes(neb_evdp_relay_t r, int dir)
+{
+	return r->dir[dir ? 1 : 0].bytes;
+}
@@ -0,0 +1,604 @@
+
+#include <nebase/syslog.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/stream.h>
+#include <nebase/sock/inet.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/queue.h>
+
+#define STREAM_DEFAULT_RBUF_SIZE 4096
+#define STREAM_DEFAULT_RBUF_MAX_SIZE (64 * 1024)
+#define STREAM_DEFAULT_CHUNK_SIZE 4096
+#define STREAM_DEFAULT_WQ_HIGH (64 * 1024)
+#define STREAM_DEFAULT_WQ_LOW (16 * 1024)
+
+#define STREAM_IOV_MAX 64
+#define STREAM_CHUNK_CACHE_SIZE 4
+
+#define STREAM_PAUSE_BY_USER 0x01
+#define STREAM_PAUSE_BY_WQ   0x02
+
+struct stream_chunk {
+	TAILQ_ENTRY(stream_chunk) list;
+	size_t size;
+	size_t start; // sent offset
+	size_t end;   // filled offset
+	char *buf;    // data, or the user buffer for zerocopy chunks
+	neb_evdp_stream_zc_done_t zc_done; // set for zerocopy chunks
+	void *zc_udata;
+	uint32_t zc_seq; // the last zerocopy send call that covers it
+	int zc_pinned;   // sent with MSG_ZEROCOPY, so wait for the notification
+	char data[];
+};
+
+TAILQ_HEAD(stream_chunk_list, stream_chunk);
+
+struct neb_evdp_stream {
+	int fd;
+	neb_evdp_source_t s;
+	neb_evdp_stream_conf_t conf;
+
+	neb_evdp_stream_read_handler_t on_read;
+	neb_evdp_stream_event_handler_t on_event;
+	void *udata;
+
+	struct {
+		char *buf;
+		size_t size;
+		size_t head;
+		size_t tail;
+	} rbuf;
+
+	struct {
+		struct stream_chunk_list chunks;
+		size_t bytes;
+		int above_high;
+		int armed;
+	} wq;
+
+	struct {
+		struct stream_chunk *chunks[STREAM_CHUNK_CACHE_SIZE];
+		int count;
+	} cache;
+
+	struct {
+		struct stream_chunk_list sent; // pinned chunks waiting for notification
+		uint32_t next_seq;
+		uint32_t done_seq; // all send calls before it are completed
+		int enabled;
+		int copied; // the kernel fell back to copy, so stop using MSG_ZEROCOPY
+	} zc;
+
+	int read_paused;
+	int read_stopped; // EOF, HUP or ERROR
+};
+
+static neb_evdp_cb_ret_t stream_on_read(int fd, void *udata, const void *context);
+static neb_evdp_cb_ret_t stream_on_write(int fd, void *udata, const void *context);
+
+static struct stream_chunk *stream_chunk_new(neb_evdp_stream_t st, size_t len)
+{
+	struct stream_chunk *c;
+	if (len <= st->conf.chunk_size && st->cache.count) {
+		c = st->cache.chunks[--st->cache.count];
+	} else {
+		size_t size = len > st->conf.chunk_size ? len : st->conf.chunk_size;
+		c = malloc(sizeof(struct stream_chunk) + size);
+		if (!c) {
+			neb_syslogl(LOG_ERR, "malloc: %m");
+			return NULL;
+		}
+		c->size = size;
+	}
+	c->start = 0;
+	c->end = 0;
+	c->buf = c->data;
+	c->zc_done = NULL;
+	return c;
+}
+
+static void stream_chunk_del(neb_evdp_stream_t st, struct stream_chunk *c)
+{
+	if (c->zc_done) {
+		c->zc_done(st, c->buf, c->size, c->zc_udata);
+		free(c);
+		return;
+	}
+	if (c->size == st->conf.chunk_size && st->cache.count < STREAM_CHUNK_CACHE_SIZE)
+		st->cache.chunks[st->cache.count++] = c;
+	else
+		free(c);
+}
+
+static int stream_rearm_read(neb_evdp_stream_t st)
+{
+	if (st->read_paused || st->read_stopped)
+		return 0;
+	return neb_evdp_source_os_fd_next_read(st->s, stream_on_read);
+}
+
+static void stream_pause_read(neb_evdp_stream_t st, int by)
+{
+	int was_paused = st->read_paused;
+	st->read_paused |= by;
+	if (!was_paused && !st->read_stopped) {
+		if (neb_evdp_source_os_fd_next_read(st->s, NULL) != 0)
+			neb_syslog(LOG_ERR, "Failed to unset read handler for stream %p", st);
+	}
+}
+
+static int stream_resume_read(neb_evdp_stream_t st, int by)
+{
+	if (!st->read_paused)
+		return 0;
+	st->read_paused &= ~by;
+	return stream_rearm_read(st);
+}
+
+/**
+ * \return 0 if has room, -1 if the buffer is full
+ */
+static int stream_rbuf_prepare(neb_evdp_stream_t st)
+{
+	if (st->rbuf.tail < st->rbuf.size)
+		return 0;
+
+	if (st->rbuf.head) { // move unconsumed data to the front
+		size_t len = st->rbuf.tail - st->rbuf.head;
+		memmove(st->rbuf.buf, st->rbuf.buf + st->rbuf.head, len);
+		st->rbuf.head = 0;
+		st->rbuf.tail = len;
+		return 0;
+	}
+
+	if (st->rbuf.size >= st->conf.rbuf_max_size)
+		return -1;
+
+	size_t new_size = st->rbuf.size * 2;
+	if (new_size > st->conf.rbuf_max_size)
+		new_size = st->conf.rbuf_max_size;
+	char *buf = realloc(st->rbuf.buf, new_size);
+	if (!buf) {
+		neb_syslogl(LOG_ERR, "realloc: %m");
+		return -1;
+	}
+	st->rbuf.buf = buf;
+	st->rbuf.size = new_size;
+	return 0;
+}
+
+static neb_evdp_cb_ret_t stream_on_read(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_stream_t st = udata;
+
+	if (stream_rbuf_prepare(st) != 0) {
+		st->read_stopped = 1;
+		return st->on_event(st, NEB_EVDP_STREAM_EV_ERROR, ENOBUFS, st->udata);
+	}
+
+	ssize_t nr = read(fd, st->rbuf.buf + st->rbuf.tail, st->rbuf.size - st->rbuf.tail);
+	if (nr == -1) {
+		switch (errno) {
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+		case EINTR:
+			if (stream_rearm_read(st) != 0)
+				return NEB_EVDP_CB_BREAK_ERR;
+			return NEB_EVDP_CB_CONTINUE;
+			break;
+		default:
+			st->read_stopped = 1;
+			return st->on_event(st, NEB_EVDP_STREAM_EV_ERROR, errno, st->udata);
+			break;
+		}
+	}
+	if (nr == 0) {
+		st->read_stopped = 1;
+		return st->on_event(st, NEB_EVDP_STREAM_EV_EOF, 0, st->udata);
+	}
+	st->rbuf.tail += nr;
+
+	size_t consumed = 0;
+	size_t len = st->rbuf.tail - st->rbuf.head;
+	neb_evdp_cb_ret_t ret = st->on_read(st, st->rbuf.buf + st->rbuf.head, len, &consumed, st->udata);
+	if (consumed >= len) {
+		st->rbuf.head = 0;
+		st->rbuf.tail = 0;
+	} else {
+		st->rbuf.head += consumed;
+	}
+	if (ret != NEB_EVDP_CB_CONTINUE)
+		return ret;
+
+	if (stream_rearm_read(st) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t stream_on_hup(int fd, void *udata, const void *context)
+{
+	neb_evdp_stream_t st = udata;
+
+	int sockerr = 0;
+	if (neb_evdp_source_fd_get_sockerr(context, &sockerr) != 0)
+		neb_syslog(LOG_DEBUG, "Failed to get sockerr for stream fd %d", fd);
+	st->read_stopped = 1;
+	return st->on_event(st, NEB_EVDP_STREAM_EV_HUP, sockerr, st->udata);
+}
+
+/**
+ * \return the number of notifications read, or -1 if failed
+ */
+static int stream_zc_reap(neb_evdp_stream_t st)
+{
+	int count = 0;
+	for (;;) {
+		uint32_t lo, hi;
+		int copied = 0;
+		int ret = neb_sock_inet_recv_zerocopy(st->fd, &lo, &hi, &copied);
+		if (ret < 0)
+			return -1;
+		if (ret == 0)
+			break;
+		count++;
+		if (copied)
+			st->zc.copied = 1;
+		// notifications of stream sockets are in order
+		if ((int32_t)(hi + 1 - st->zc.done_seq) > 0)
+			st->zc.done_seq = hi + 1;
+	}
+
+	struct stream_chunk *c;
+	while ((c = TAILQ_FIRST(&st->zc.sent)) && (int32_t)(c->zc_seq - st->zc.done_seq) < 0) {
+		TAILQ_REMOVE(&st->zc.sent, c, list);
+		stream_chunk_del(st, c);
+	}
+	return count;
+}
+
+static neb_evdp_cb_ret_t stream_on_error(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_stream_t st = udata;
+
+	int count = stream_zc_reap(st);
+	if (count < 0) {
+		st->read_stopped = 1;
+		return st->on_event(st, NEB_EVDP_STREAM_EV_ERROR, errno, st->udata);
+	}
+	if (count == 0) { // not for zerocopy, so it should be a socket error
+		int sockerr = 0;
+		socklen_t len = sizeof(sockerr);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &sockerr, &len) == -1)
+			sockerr = errno;
+		if (sockerr) {
+			st->read_stopped = 1;
+			return st->on_event(st, NEB_EVDP_STREAM_EV_ERROR, sockerr, st->udata);
+		}
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t stream_on_write(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_stream_t st = udata;
+	st->wq.armed = 0;
+
+	if (!TAILQ_EMPTY(&st->zc.sent) && stream_zc_reap(st) < 0)
+		return st->on_event(st, NEB_EVDP_STREAM_EV_ERROR, errno, st->udata);
+
+	// zerocopy chunks are sent alone, as all buffers in the call will be pinned
+	int use_zc = st->zc.enabled && !st->zc.copied;
+	struct stream_chunk *c = TAILQ_FIRST(&st->wq.chunks);
+	int zc_batch = use_zc && c && c->zc_done;
+
+	struct iovec iov[STREAM_IOV_MAX];
+	int iovcnt = 0;
+	TAILQ_FOREACH(c, &st->wq.chunks, list) {
+		if (iovcnt == STREAM_IOV_MAX)
+			break;
+		if (use_zc && (c->zc_done ? 1 : 0) != zc_batch)
+			break;
+		iov[iovcnt].iov_base = c->buf + c->start;
+		iov[iovcnt].iov_len = c->end - c->start;
+		iovcnt++;
+	}
+	if (!iovcnt)
+		return NEB_EVDP_CB_CONTINUE;
+
+	ssize_t nw;
+#if defined(MSG_ZEROCOPY)
+	if (zc_batch) {
+		struct msghdr msg = {
+			.msg_iov = iov,
+			.msg_iovlen = iovcnt,
+		};
+		nw = sendmsg(fd, &msg, MSG_ZEROCOPY);
+	} else {
+		nw = writev(fd, iov, iovcnt);
+	}
+#else
+	nw = writev(fd, iov, iovcnt);
+#endif
+	if (nw == -1) {
+		switch (errno) {
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+		case EINTR:
+			nw = 0;
+			break;
+		case ENOBUFS: // out of optmem for zerocopy, retry with copy
+			if (zc_batch) {
+				st->zc.copied = 1;
+				nw = 0;
+				break;
+			}
+			return st->on_event(st, NEB_EVDP_STREAM_EV_ERROR, errno, st->udata);
+			break;
+		default:
+			return st->on_event(st, NEB_EVDP_STREAM_EV_ERROR, errno, st->udata);
+			break;
+		}
+	} else if (zc_batch) {
+		uint32_t seq = st->zc.next_seq++;
+		size_t left = nw;
+		TAILQ_FOREACH(c, &st->wq.chunks, list) {
+			c->zc_pinned = 1;
+			c->zc_seq = seq;
+			size_t n = c->end - c->start;
+			if (left <= n)
+				break;
+			left -= n;
+		}
+	}
+
+	st->wq.bytes -= nw;
+	while (nw > 0) {
+		c = TAILQ_FIRST(&st->wq.chunks);
+		size_t left = c->end - c->start;
+		if ((size_t)nw < left) {
+			c->start += nw;
+			break;
+		}
+		nw -= left;
+		TAILQ_REMOVE(&st->wq.chunks, c, list);
+		if (c->zc_done && c->zc_pinned)
+			TAILQ_INSERT_TAIL(&st->zc.sent, c, list);
+		else
+			stream_chunk_del(st, c);
+	}
+
+	if (!TAILQ_EMPTY(&st->wq.chunks)) {
+		if (neb_evdp_source_os_fd_next_write(st->s, stream_on_write) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		st->wq.armed = 1;
+	}
+
+	if (st->wq.above_high && st->wq.bytes <= st->conf.wq_low) {
+		st->wq.above_high = 0;
+		if (stream_resume_read(st, STREAM_PAUSE_BY_WQ) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		return st->on_event(st, NEB_EVDP_STREAM_EV_WQ_LOW, 0, st->udata);
+	}
+
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+void neb_evdp_stream_conf_init(neb_evdp_stream_conf_t *conf)
+{
+	conf->rbuf_size = STREAM_DEFAULT_RBUF_SIZE;
+	conf->rbuf_max_size = STREAM_DEFAULT_RBUF_MAX_SIZE;
+	conf->chunk_size = STREAM_DEFAULT_CHUNK_SIZE;
+	conf->wq_high = STREAM_DEFAULT_WQ_HIGH;
+	conf->wq_low = STREAM_DEFAULT_WQ_LOW;
+	conf->pause_read_on_wq_high = 1;
+}
+
+neb_evdp_stream_t neb_evdp_stream_create(int fd, const neb_evdp_stream_conf_t *conf,
+                                         neb_evdp_stream_read_handler_t rf,
+                                         neb_evdp_stream_event_handler_t ef, void *udata)
+{
+	neb_evdp_stream_t st = calloc(1, sizeof(struct neb_evdp_stream));
+	if (!st) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	st->fd = fd;
+	if (conf)
+		memcpy(&st->conf, conf, sizeof(neb_evdp_stream_conf_t));
+	else
+		neb_evdp_stream_conf_init(&st->conf);
+	if (!st->conf.rbuf_size || !st->conf.chunk_size || st->conf.rbuf_max_size < st->conf.rbuf_size ||
+	    st->conf.wq_low > st->conf.wq_high) {
+		neb_syslog(LOG_ERR, "Invalid stream conf");
+		neb_evdp_stream_destroy(st);
+		return NULL;
+	}
+	st->on_read = rf;
+	st->on_event = ef;
+	st->udata = udata;
+	TAILQ_INIT(&st->wq.chunks);
+	TAILQ_INIT(&st->zc.sent);
+
+	st->rbuf.buf = malloc(st->conf.rbuf_size);
+	if (!st->rbuf.buf) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		neb_evdp_stream_destroy(st);
+		return NULL;
+	}
+	st->rbuf.size = st->conf.rbuf_size;
+
+	st->s = neb_evdp_source_new_os_fd(fd, stream_on_hup);
+	if (!st->s) {
+		neb_syslog(LOG_ERR, "Failed to create os_fd source for stream");
+		neb_evdp_stream_destroy(st);
+		return NULL;
+	}
+	neb_evdp_source_set_udata(st->s, st);
+	if (neb_evdp_source_os_fd_next_read(st->s, stream_on_read) != 0) { // before attach
+		neb_evdp_stream_destroy(st);
+		return NULL;
+	}
+
+	return st;
+}
+
+static void stream_chunk_list_free(neb_evdp_stream_t st, struct stream_chunk_list *l)
+{
+	while (!TAILQ_EMPTY(l)) {
+		struct stream_chunk *c = TAILQ_FIRST(l);
+		TAILQ_REMOVE(l, c, list);
+		if (c->zc_done)
+			c->zc_done(st, c->buf, c->size, c->zc_udata);
+		free(c);
+	}
+}
+
+void neb_evdp_stream_destroy(neb_evdp_stream_t st)
+{
+	if (st->s) {
+		neb_evdp_queue_t q = neb_evdp_source_get_queue(st->s);
+		if (q && neb_evdp_queue_detach(q, st->s, 0) != 0)
+			neb_syslog(LOG_ERR, "Failed to detach stream source");
+		neb_evdp_source_del(st->s);
+	}
+	stream_chunk_list_free(st, &st->wq.chunks);
+	stream_chunk_list_free(st, &st->zc.sent);
+	for (int i = 0; i < st->cache.count; i++)
+		free(st->cache.chunks[i]);
+	if (st->rbuf.buf)
+		free(st->rbuf.buf);
+	free(st);
+}
+
+int neb_evdp_stream_attach(neb_evdp_stream_t st, neb_evdp_queue_t q)
+{
+	if (neb_evdp_queue_attach(q, st->s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach stream source");
+		return -1;
+	}
+	return 0;
+}
+
+int neb_evdp_stream_detach(neb_evdp_stream_t st, int to_close)
+{
+	neb_evdp_queue_t q = neb_evdp_source_get_queue(st->s);
+	if (!q) {
+		neb_syslog(LOG_ERR, "stream %p is not attached", st);
+		return -1;
+	}
+	return neb_evdp_queue_detach(q, st->s, to_close);
+}
+
+int neb_evdp_stream_get_fd(neb_evdp_stream_t st)
+{
+	return st->fd;
+}
+
+size_t neb_evdp_stream_get_wq_bytes(neb_evdp_stream_t st)
+{
+	return st->wq.bytes;
+}
+
+static int stream_wq_commit(neb_evdp_stream_t st)
+{
+	if (!st->wq.armed) {
+		if (neb_evdp_source_os_fd_next_write(st->s, stream_on_write) != 0)
+			return -1;
+		st->wq.armed = 1;
+	}
+
+	if (!st->wq.above_high && st->wq.bytes >= st->conf.wq_high) {
+		st->wq.above_high = 1;
+		if (st->conf.pause_read_on_wq_high)
+			stream_pause_read(st, STREAM_PAUSE_BY_WQ);
+	}
+
+	return st->wq.above_high;
+}
+
+int neb_evdp_stream_write(neb_evdp_stream_t st, const void *data, size_t len)
+{
+	if (!len)
+		return st->wq.above_high;
+
+	const char *p = data;
+	struct stream_chunk *c = TAILQ_LAST(&st->wq.chunks, stream_chunk_list);
+	if (c && c->end < c->size) { // fill the tail chunk first
+		size_t n = c->size - c->end;
+		if (n > len)
+			n = len;
+		memcpy(c->buf + c->end, p, n);
+		c->end += n;
+		p += n;
+		len -= n;
+		st->wq.bytes += n;
+	}
+	if (len) {
+		c = stream_chunk_new(st, len);
+		if (!c)
+			return -1;
+		memcpy(c->buf, p, len);
+		c->end = len;
+		TAILQ_INSERT_TAIL(&st->wq.chunks, c, list);
+		st->wq.bytes += len;
+	}
+
+	return stream_wq_commit(st);
+}
+
+int neb_evdp_stream_enable_zerocopy(neb_evdp_stream_t st)
+{
+	if (neb_sock_inet_enable_zerocopy(st->fd) != 0)
+		return -1;
+	neb_evdp_source_os_fd_set_error(st->s, stream_on_error);
+	st->zc.enabled = 1;
+	return 0;
+}
+
+int neb_evdp_stream_write_zc(neb_evdp_stream_t st, const void *data, size_t len,
+                             neb_evdp_stream_zc_done_t df, void *udata)
+{
+	if (!len) {
+		df(st, data, len, udata);
+		return st->wq.above_high;
+	}
+
+	struct stream_chunk *c = malloc(sizeof(struct stream_chunk));
+	if (!c) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		return -1;
+	}
+	c->size = len;
+	c->start = 0;
+	c->end = len;
+	c->buf = (char *)data;
+	c->zc_done = df;
+	c->zc_udata = udata;
+	c->zc_seq = 0;
+	c->zc_pinned = 0;
+	TAILQ_INSERT_TAIL(&st->wq.chunks, c, list);
+	st->wq.bytes += len;
+
+	return stream_wq_commit(st);
+}
+
+int neb_evdp_stream_pause_read(neb_evdp_stream_t st)
+{
+	stream_pause_read(st, STREAM_PAUSE_BY_USER);
+	return 0;
+}
+
+int neb_evdp_stream_resume_read(neb_evdp_stream_t st)
+{
+	return stream_resume_read(st, STREAM_PAUSE_BY_USER);
+}
@@ -2,6 +2,7 @@
 #include <nebase/syslog.h>
 
 #include "timer.h"
+#include "probes.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -295,6 +296,7 @@ int evdp_timer_run_until(neb_evdp_timer_t t, int64_t abs_msec)
 				ln->running = 1;
 				neb_evdp_timeout_ret_t tret = ln->on_timeout(ln->udata);
 				ln->running = 0;
+				EVDP_PROBE3(timer_fire, t, ln->udata, tret);
 				count += 1;
 				if (!ln->ref_tnode) { // del_point is called in cb
 					evdp_timer_cblist_node_free(ln, t);
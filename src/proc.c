@@ -1,8 +1,29 @@
 
+#include "options.h"
+
+#include <nebase/syslog.h>
 #include <nebase/proc.h>
+#include <nebase/io.h>
+#include <nebase/pty.h>
 
 #include <stdio.h>
 #include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#if defined(OS_LINUX)
+# include <sched.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# ifndef CLONE_PIDFD
+#  define CLONE_PIDFD 0x00001000
+# endif
+#endif
+
+#define PROC_SPAWN_STACK_SIZE (256 * 1024)
+
+extern char **environ;
 
 void neb_proc_child_exit(int status)
 {
@@ -22,3 +43,166 @@ void neb_proc_child_flush_exit(int status)
 		fflush(stdout);
 	neb_proc_child_exit(status);
 }
+
+void neb_proc_spawn_attr_init(neb_proc_spawn_attr_t *attr)
+{
+	attr->stdin_fd = NEB_PROC_SPAWN_FD_INHERIT;
+	attr->stdout_fd = NEB_PROC_SPAWN_FD_INHERIT;
+	attr->stderr_fd = NEB_PROC_SPAWN_FD_INHERIT;
+	attr->pty_slave_fd = -1;
+	attr->new_session = 0;
+}
+
+struct proc_spawn_arg {
+	const char *path;
+	char *const *argv;
+	char *const *envp;
+	const neb_proc_spawn_attr_t *attr;
+	sigset_t old_set;
+	volatile int err; // set by child if failed before exec
+};
+
+/*
+ * NOTE the child shares memory with the parent, which is suspended until
+ *      the child exec or exit, so only modify the child's own resources here
+ */
+static int proc_spawn_child_setup(const struct proc_spawn_arg *a)
+{
+	for (int sig = 1; sig < NSIG; sig++) {
+		struct sigaction sa;
+		if (sigaction(sig, NULL, &sa) == -1)
+			continue;
+		if (sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL)
+			continue;
+		sa.sa_handler = SIG_DFL;
+		sa.sa_flags = 0;
+		sigemptyset(&sa.sa_mask);
+		sigaction(sig, &sa, NULL);
+	}
+
+	const neb_proc_spawn_attr_t *attr = a->attr;
+	if (attr) {
+		if (attr->pty_slave_fd >= 0) {
+			if (neb_pty_login_tty(attr->pty_slave_fd) != 0)
+				return -1;
+		} else {
+			if (attr->new_session && setsid() == -1)
+				return -1;
+			if (attr->stdin_fd != NEB_PROC_SPAWN_FD_INHERIT && neb_io_redirect_stdin(attr->stdin_fd) != 0)
+				return -1;
+			if (attr->stdout_fd != NEB_PROC_SPAWN_FD_INHERIT && neb_io_redirect_stdout(attr->stdout_fd) != 0)
+				return -1;
+			if (attr->stderr_fd != NEB_PROC_SPAWN_FD_INHERIT && neb_io_redirect_stderr(attr->stderr_fd) != 0)
+				return -1;
+		}
+	}
+
+	if (sigprocmask(SIG_SETMASK, &a->old_set, NULL) == -1)
+		return -1;
+
+	return 0;
+}
+
+static int proc_spawn_child(void *arg)
+{
+	struct proc_spawn_arg *a = arg;
+
+	if (proc_spawn_child_setup(a) == 0)
+		execve(a->path, a->argv, a->envp);
+
+	a->err = errno ? errno : ECHILD;
+	_exit(127);
+}
+
+#if defined(OS_LINUX)
+static pid_t proc_spawn_clone(struct proc_spawn_arg *a, int *pidfd)
+{
+	void *stack = mmap(NULL, PROC_SPAWN_STACK_SIZE, PROT_READ | PROT_WRITE,
+	                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (stack == MAP_FAILED) {
+		neb_syslogl(LOG_ERR, "mmap: %m");
+		return -1;
+	}
+	void *stack_top = (char *)stack + PROC_SPAWN_STACK_SIZE;
+
+	const int flags = CLONE_VM | CLONE_VFORK | SIGCHLD;
+	*pidfd = -1;
+	pid_t pid = clone(proc_spawn_child, stack_top, flags | CLONE_PIDFD, a, pidfd);
+	if (pid == -1 && errno == EINVAL) { // CLONE_PIDFD may be rejected as unknown by old kernels
+		*pidfd = -1;
+		pid = clone(proc_spawn_child, stack_top, flags, a);
+	}
+	if (pid == -1) {
+		neb_syslogl(LOG_ERR, "clone: %m");
+		*pidfd = -1;
+	} else if (*pidfd < 0) { // CLONE_PIDFD is only available since Linux 5.2, and may be ignored
+# ifdef SYS_pidfd_open
+		*pidfd = syscall(SYS_pidfd_open, pid, 0);
+		if (*pidfd == -1)
+			neb_syslogl(LOG_NOTICE, "pidfd_open: %m");
+# else
+		*pidfd = -1;
+# endif
+	}
+
+	munmap(stack, PROC_SPAWN_STACK_SIZE);
+	return pid;
+}
+#else
+static pid_t proc_spawn_vfork(struct proc_spawn_arg *a, int *pidfd)
+{
+	*pidfd = -1;
+	pid_t pid = vfork();
+	switch (pid) {
+	case -1:
+		neb_syslogl(LOG_ERR, "vfork: %m");
+		break;
+	case 0:
+		proc_spawn_child(a);
+		break;
+	default:
+		break;
+	}
+	return pid;
+}
+#endif
+
+pid_t neb_proc_spawn(const char *path, char *const argv[], char *const envp[],
+                     const neb_proc_spawn_attr_t *attr, int *pidfd)
+{
+	struct proc_spawn_arg a = {
+		.path = path,
+		.argv = argv,
+		.envp = envp ? envp : environ,
+		.attr = attr,
+		.err = 0,
+	};
+
+	sigset_t set;
+	sigfillset(&set);
+	if (sigprocmask(SIG_SETMASK, &set, &a.old_set) == -1) {
+		neb_syslogl(LOG_ERR, "sigprocmask(block all): %m");
+		return -1;
+	}
+
+#if defined(OS_LINUX)
+	pid_t pid = proc_spawn_clone(&a, pidfd);
+#else
+	pid_t pid = proc_spawn_vfork(&a, pidfd);
+#endif
+
+	sigprocmask(SIG_SETMASK, &a.old_set, NULL);
+
+	if (pid > 0 && a.err) { // the child has exited
+		if (*pidfd >= 0) {
+			close(*pidfd);
+			*pidfd = -1;
+		}
+		waitpid(pid, NULL, 0);
+		neb_syslog_en(a.err, LOG_ERR, "spawn(%s): %m", path);
+		errno = a.err;
+		return -1;
+	}
+
+	return pid;
+}
@@ -0,0 +1,27 @@
+#ifndef NEB_SRC_SOCK__MMSG_H
+#define NEB_SRC_SOCK__MMSG_H 1
+
+#include "options.h"
+
+#include <nebase/cdefs.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#if defined(OS_LINUX) || defined(OS_FREEBSD) || defined(OS_NETBSD)
+# define NEB_SOCK_HAVE_MMSG 1
+#else
+struct mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int  msg_len;
+};
+#endif
+
+/**
+ * \brief sendmmsg, or sendmsg in loop if not supported
+ * \return the number of messages sent, 0 if blocked, or -1 if failed
+ */
+extern int neb_sock_do_sendmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen)
+	_nattr_hidden _nattr_nonnull((2));
+
+#endif
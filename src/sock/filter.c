@@ -0,0 +1,341 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/sock/filter.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#if defined(OS_LINUX)
+# include <linux/filter.h>
+
+# define FILTER_JMP_DROP 0xff // placeholder, replaced with the offset to drop
+
+struct neb_sock_filter {
+	int family;
+	int l4_ready; // ipv4 fragment check added
+	int len;
+	struct sock_filter insns[NEB_SOCK_FILTER_MAX_INSNS + 2];
+};
+
+static int filter_add(neb_sock_filter_t f, uint16_t code, uint8_t jt, uint8_t jf, uint32_t k)
+{
+	if (f->len >= NEB_SOCK_FILTER_MAX_INSNS) {
+		neb_syslog(LOG_ERR, "Too many instructions in socket filter");
+		errno = E2BIG;
+		return -1;
+	}
+	struct sock_filter *insn = f->insns + f->len++;
+	insn->code = code;
+	insn->jt = jt;
+	insn->jf = jf;
+	insn->k = k;
+	return 0;
+}
+
+static int filter_load_net(neb_sock_filter_t f, uint16_t size, uint32_t off)
+{
+	return filter_add(f, BPF_LD | size | BPF_ABS, 0, 0, SKF_NET_OFF + off);
+}
+
+static int filter_jeq_or_drop(neb_sock_filter_t f, uint32_t k)
+{
+	return filter_add(f, BPF_JMP | BPF_JEQ | BPF_K, 0, FILTER_JMP_DROP, k);
+}
+
+static int filter_load_l4(neb_sock_filter_t f, uint16_t size, uint32_t off)
+{
+	switch (f->family) {
+	case AF_INET:
+		if (!f->l4_ready) {
+			// drop non-first fragments, which have no l4 header
+			if (filter_load_net(f, BPF_H, 6) != 0 ||
+			    filter_add(f, BPF_JMP | BPF_JSET | BPF_K, FILTER_JMP_DROP, 0, 0x1fff) != 0)
+				return -1;
+			f->l4_ready = 1;
+		}
+		if (filter_add(f, BPF_LDX | BPF_B | BPF_MSH, 0, 0, SKF_NET_OFF) != 0)
+			return -1;
+		return filter_add(f, BPF_LD | size | BPF_IND, 0, 0, SKF_NET_OFF + off);
+		break;
+	case AF_INET6:
+		return filter_load_net(f, size, 40 + off);
+		break;
+	default:
+		return -1;
+		break;
+	}
+}
+
+neb_sock_filter_t neb_sock_filter_create(int family)
+{
+	switch (family) {
+	case AF_INET:
+	case AF_INET6:
+		break;
+	default:
+		neb_syslog(LOG_ERR, "Unsupported address family %d", family);
+		errno = EAFNOSUPPORT;
+		return NULL;
+		break;
+	}
+
+	neb_sock_filter_t f = calloc(1, sizeof(struct neb_sock_filter));
+	if (!f) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	f->family = family;
+	return f;
+}
+
+void neb_sock_filter_destroy(neb_sock_filter_t f)
+{
+	free(f);
+}
+
+int neb_sock_filter_ip_proto(neb_sock_filter_t f, uint8_t proto)
+{
+	uint32_t off = f->family == AF_INET ? 9 : 6;
+	if (filter_load_net(f, BPF_B, off) != 0)
+		return -1;
+	return filter_jeq_or_drop(f, proto);
+}
+
+static int filter_ip4_addr(neb_sock_filter_t f, uint32_t off, const struct in_addr *addr)
+{
+	if (f->family != AF_INET) {
+		neb_syslog(LOG_ERR, "ipv4 address predicate is not for family %d", f->family);
+		errno = EINVAL;
+		return -1;
+	}
+	if (filter_load_net(f, BPF_W, off) != 0)
+		return -1;
+	return filter_jeq_or_drop(f, ntohl(addr->s_addr));
+}
+
+int neb_sock_filter_ip4_src(neb_sock_filter_t f, const struct in_addr *addr)
+{
+	return filter_ip4_addr(f, 12, addr);
+}
+
+int neb_sock_filter_ip4_dst(neb_sock_filter_t f, const struct in_addr *addr)
+{
+	return filter_ip4_addr(f, 16, addr);
+}
+
+static int filter_ip6_addr(neb_sock_filter_t f, uint32_t off, const struct in6_addr *addr)
+{
+	if (f->family != AF_INET6) {
+		neb_syslog(LOG_ERR, "ipv6 address predicate is not for family %d", f->family);
+		errno = EINVAL;
+		return -1;
+	}
+	for (int i = 0; i < 4; i++) {
+		uint32_t w;
+		memcpy(&w, addr->s6_addr + i * 4, sizeof(w));
+		if (filter_load_net(f, BPF_W, off + i * 4) != 0 || filter_jeq_or_drop(f, ntohl(w)) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+int neb_sock_filter_ip6_src(neb_sock_filter_t f, const struct in6_addr *addr)
+{
+	return filter_ip6_addr(f, 8, addr);
+}
+
+int neb_sock_filter_ip6_dst(neb_sock_filter_t f, const struct in6_addr *addr)
+{
+	return filter_ip6_addr(f, 24, addr);
+}
+
+int neb_sock_filter_icmp_type(neb_sock_filter_t f, uint8_t type)
+{
+	if (filter_load_l4(f, BPF_B, 0) != 0)
+		return -1;
+	return filter_jeq_or_drop(f, type);
+}
+
+int neb_sock_filter_icmp_id(neb_sock_filter_t f, uint16_t id)
+{
+	if (filter_load_l4(f, BPF_H, 4) != 0)
+		return -1;
+	return filter_jeq_or_drop(f, ntohs(id));
+}
+
+int neb_sock_filter_src_port(neb_sock_filter_t f, uint16_t port)
+{
+	if (filter_load_l4(f, BPF_H, 0) != 0)
+		return -1;
+	return filter_jeq_or_drop(f, port);
+}
+
+int neb_sock_filter_dst_port(neb_sock_filter_t f, uint16_t port)
+{
+	if (filter_load_l4(f, BPF_H, 2) != 0)
+		return -1;
+	return filter_jeq_or_drop(f, port);
+}
+
+int neb_sock_filter_attach(neb_sock_filter_t f, int fd)
+{
+	struct sock_filter insns[NEB_SOCK_FILTER_MAX_INSNS + 2];
+	int len = f->len;
+	memcpy(insns, f->insns, len * sizeof(struct sock_filter));
+	int drop = len + 1;
+	for (int i = 0; i < len; i++) {
+		struct sock_filter *insn = insns + i;
+		if (BPF_CLASS(insn->code) != BPF_JMP)
+			continue;
+		if (insn->jt == FILTER_JMP_DROP)
+			insn->jt = drop - i - 1;
+		if (insn->jf == FILTER_JMP_DROP)
+			insn->jf = drop - i - 1;
+	}
+	insns[len] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	insns[drop] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+	struct sock_fprog prog = {
+		.len = len + 2,
+		.filter = insns,
+	};
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(SO_ATTACH_FILTER): %m");
+		return -1;
+	}
+	return 0;
+}
+
+int neb_sock_filter_detach(int fd)
+{
+	int dummy = 0;
+	if (setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(SO_DETACH_FILTER): %m");
+		return -1;
+	}
+	return 0;
+}
+
+int neb_sock_filter_attach_reuseport_cpu(int fd, int group_size)
+{
+# if defined(SO_ATTACH_REUSEPORT_CBPF)
+	if (group_size <= 0) {
+		neb_syslog(LOG_ERR, "Invalid reuseport group size %d", group_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct sock_filter insns[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)),
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)group_size),
+		BPF_STMT(BPF_RET | BPF_A, 0),
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(insns) / sizeof(insns[0]),
+		.filter = insns,
+	};
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(SO_ATTACH_REUSEPORT_CBPF): %m");
+		return -1;
+	}
+	return 0;
+# else
+	neb_syslog(LOG_ERR, "SO_ATTACH_REUSEPORT_CBPF is not supported");
+	errno = ENOTSUP;
+	return -1;
+# endif
+}
+#else
+struct neb_sock_filter {
+	int family;
+};
+
+neb_sock_filter_t neb_sock_filter_create(int family _nattr_unused)
+{
+	neb_syslog(LOG_ERR, "socket filter is not supported on this platform");
+	errno = ENOTSUP;
+	return NULL;
+}
+
+void neb_sock_filter_destroy(neb_sock_filter_t f)
+{
+	free(f);
+}
+
+int neb_sock_filter_ip_proto(neb_sock_filter_t f _nattr_unused, uint8_t proto _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_ip4_src(neb_sock_filter_t f _nattr_unused, const struct in_addr *addr _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_ip4_dst(neb_sock_filter_t f _nattr_unused, const struct in_addr *addr _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_ip6_src(neb_sock_filter_t f _nattr_unused, const struct in6_addr *addr _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_ip6_dst(neb_sock_filter_t f _nattr_unused, const struct in6_addr *addr _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_icmp_type(neb_sock_filter_t f _nattr_unused, uint8_t type _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_icmp_id(neb_sock_filter_t f _nattr_unused, uint16_t id _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_src_port(neb_sock_filter_t f _nattr_unused, uint16_t port _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_dst_port(neb_sock_filter_t f _nattr_unused, uint16_t port _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_attach(neb_sock_filter_t f _nattr_unused, int fd _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_detach(int fd _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int neb_sock_filter_attach_reuseport_cpu(int fd _nattr_unused, int group_size _nattr_unused)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+#endif
@@ -1,19 +1,30 @@
 
 #include "options.h"
+#include "_mmsg.h"
 
 #include <nebase/syslog.h>
 #include <nebase/sock/inet.h>
 #include <nebase/time.h>
 
 #include <unistd.h>
+#include <string.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include <errno.h>
 
 #ifdef IP_RECVIF
 # include <net/if_dl.h>
 #endif
 
+#if defined(OS_LINUX)
+# include <linux/errqueue.h>
+# include <linux/net_tstamp.h>
+#endif
+
 #define RECVMSG_CMSG_BUF_SIZE 10240 // see rfc3542 20.1
+#define MMSG_CMSG_BUF_SIZE 256 // enough for timestamp, pktinfo and gro
 
 static int handle_cmsg(const struct cmsghdr *cmsg, neb_sock_cmsg_cb f, void *udata)
 {
@@ -47,6 +58,22 @@ static int handle_cmsg(const struct cmsghdr *cmsg, neb_sock_cmsg_cb f, void *uda
 			return f(NEB_CMSG_LEVEL_COMPAT, NEB_CMSG_TYPE_TIMESTAMP, (const u_char *)&ts, sizeof(struct timespec), udata);
 		}
 			break;
+#endif
+#ifdef SCM_TIMESTAMPING
+		case SCM_TIMESTAMPING:
+		{
+			struct timespec ts[3]; // software, deprecated, raw hardware
+			memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+			if (ts[0].tv_sec || ts[0].tv_nsec) {
+				int ret = f(NEB_CMSG_LEVEL_COMPAT, NEB_CMSG_TYPE_TIMESTAMP, (const u_char *)&ts[0], sizeof(struct timespec), udata);
+				if (ret != 0)
+					return ret;
+			}
+			if (ts[2].tv_sec || ts[2].tv_nsec)
+				return f(NEB_CMSG_LEVEL_COMPAT, NEB_CMSG_TYPE_HW_TIMESTAMP, (const u_char *)&ts[2], sizeof(struct timespec), udata);
+			return 0;
+		}
+			break;
 #endif
 		default:
 			break;
@@ -74,6 +101,20 @@ static int handle_cmsg(const struct cmsghdr *cmsg, neb_sock_cmsg_cb f, void *uda
 			break;
 		}
 		break;
+#ifdef UDP_GRO
+	case IPPROTO_UDP:
+		switch (cmsg->cmsg_type) {
+		case UDP_GRO:
+		{
+			unsigned int segsize = *(const int *)CMSG_DATA(cmsg);
+			return f(NEB_CMSG_LEVEL_COMPAT, NEB_CMSG_TYPE_UDP_GRO_SEGSIZE, (const u_char *)&segsize, sizeof(segsize), udata);
+		}
+			break;
+		default:
+			break;
+		}
+		break;
+#endif
 	default:
 		break;
 	}
@@ -117,24 +158,33 @@ static ssize_t do_plain_recvmsg(int fd, struct msghdr *m)
 	return nr;
 }
 
+static int get_peer_len(const struct sockaddr *peer, socklen_t *len)
+{
+	if (!peer) {
+		*len = 0;
+		return 0;
+	}
+	switch (peer->sa_family) {
+	case AF_INET:
+		*len = sizeof(struct sockaddr_in);
+		break;
+	case AF_INET6:
+		*len = sizeof(struct sockaddr_in6);
+		break;
+	default:
+		neb_syslog(LOG_ERR, "Unsupported address family %d", peer->sa_family);
+		return -1;
+		break;
+	}
+	return 0;
+}
+
 ssize_t neb_sock_inet_recvmsg(int fd, struct neb_sock_msghdr *m)
 {
 	void *name = m->msg_peer;
 	socklen_t namelen = 0;
-	if (name) {
-		switch (m->msg_peer->sa_family) {
-		case AF_INET:
-			namelen = sizeof(struct sockaddr_in);
-			break;
-		case AF_INET6:
-			namelen = sizeof(struct sockaddr_in6);
-			break;
-		default:
-			neb_syslog(LOG_ERR, "Unsupported address family %d", m->msg_peer->sa_family);
-			return -1;
-			break;
-		}
-	}
+	if (get_peer_len(m->msg_peer, &namelen) != 0)
+		return -1;
 
 	if (m->msg_control_cb) {
 		char buf[RECVMSG_CMSG_BUF_SIZE];
@@ -160,6 +210,395 @@ ssize_t neb_sock_inet_recvmsg(int fd, struct neb_sock_msghdr *m)
 	}
 }
 
+static int do_recvmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen)
+{
+#ifdef NEB_SOCK_HAVE_MMSG
+	int nr = recvmmsg(fd, msgs, vlen, MSG_DONTWAIT, NULL);
+	if (nr == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		neb_syslogl(LOG_ERR, "recvmmsg: %m");
+		return -1;
+	}
+	return nr;
+#else
+	unsigned int i;
+	for (i = 0; i < vlen; i++) {
+		ssize_t nr = recvmsg(fd, &msgs[i].msg_hdr, MSG_DONTWAIT);
+		if (nr == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (i > 0) // report it in the next call
+				break;
+			neb_syslogl(LOG_ERR, "recvmsg: %m");
+			return -1;
+		}
+		msgs[i].msg_len = nr;
+	}
+	return i;
+#endif
+}
+
+int neb_sock_do_sendmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen)
+{
+#ifdef NEB_SOCK_HAVE_MMSG
+	int nw = sendmmsg(fd, msgs, vlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (nw == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		neb_syslogl(LOG_ERR, "sendmmsg: %m");
+		return -1;
+	}
+	return nw;
+#else
+	unsigned int i;
+	for (i = 0; i < vlen; i++) {
+		ssize_t nw = sendmsg(fd, &msgs[i].msg_hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (nw == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (i > 0) // report it in the next call
+				break;
+			neb_syslogl(LOG_ERR, "sendmsg: %m");
+			return -1;
+		}
+		msgs[i].msg_len = nw;
+	}
+	return i;
+#endif
+}
+
+int neb_sock_inet_recvmmsg(int fd, struct neb_sock_mmsghdr *msgs, unsigned int vlen)
+{
+	if (vlen > NEB_SOCK_MMSG_MAX)
+		vlen = NEB_SOCK_MMSG_MAX;
+
+	struct mmsghdr mm[NEB_SOCK_MMSG_MAX];
+	char cbuf[NEB_SOCK_MMSG_MAX][MMSG_CMSG_BUF_SIZE];
+	for (unsigned int i = 0; i < vlen; i++) {
+		struct neb_sock_msghdr *m = &msgs[i].msg_hdr;
+		socklen_t namelen = 0;
+		if (get_peer_len(m->msg_peer, &namelen) != 0)
+			return -1;
+		mm[i].msg_hdr = (struct msghdr){
+			.msg_name = m->msg_peer,
+			.msg_namelen = namelen,
+			.msg_iov = m->msg_iov,
+			.msg_iovlen = m->msg_iovlen,
+			.msg_control = m->msg_control_cb ? cbuf[i] : NULL,
+			.msg_controllen = m->msg_control_cb ? sizeof(cbuf[i]) : 0,
+		};
+		mm[i].msg_len = 0;
+	}
+
+	int n = do_recvmmsg(fd, mm, vlen);
+	if (n <= 0)
+		return n;
+
+	for (int i = 0; i < n; i++) {
+		struct neb_sock_msghdr *m = &msgs[i].msg_hdr;
+		msgs[i].msg_len = mm[i].msg_len;
+		if (!m->msg_control_cb)
+			continue;
+
+		struct msghdr *h = &mm[i].msg_hdr;
+		if (h->msg_flags & MSG_CTRUNC) { // the last cmsg may be partial, so skip all of them
+			int ret = m->msg_control_cb(NEB_CMSG_LEVEL_COMPAT, NEB_CMSG_TYPE_CTRUNC, NULL, 0, m->msg_udata);
+			if (ret != 0)
+				return ret;
+		} else {
+			for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(h); cmsg; cmsg = CMSG_NXTHDR(h, cmsg)) {
+				int ret = handle_cmsg(cmsg, m->msg_control_cb, m->msg_udata);
+				if (ret != 0)
+					return ret;
+			}
+		}
+		int ret = m->msg_control_cb(NEB_CMSG_LEVEL_COMPAT, NEB_CMSG_TYPE_LOOP_END, NULL, 0, m->msg_udata);
+		if (ret != 0)
+			return ret;
+	}
+
+	return n;
+}
+
+int neb_sock_inet_sendmmsg(int fd, struct neb_sock_mmsghdr *msgs, unsigned int vlen)
+{
+	if (vlen > NEB_SOCK_MMSG_MAX)
+		vlen = NEB_SOCK_MMSG_MAX;
+
+	struct mmsghdr mm[NEB_SOCK_MMSG_MAX];
+	for (unsigned int i = 0; i < vlen; i++) {
+		struct neb_sock_msghdr *m = &msgs[i].msg_hdr;
+		socklen_t namelen = 0;
+		if (get_peer_len(m->msg_peer, &namelen) != 0)
+			return -1;
+		mm[i].msg_hdr = (struct msghdr){
+			.msg_name = m->msg_peer,
+			.msg_namelen = namelen,
+			.msg_iov = m->msg_iov,
+			.msg_iovlen = m->msg_iovlen,
+		};
+		mm[i].msg_len = 0;
+	}
+
+	int n = neb_sock_do_sendmmsg(fd, mm, vlen);
+	for (int i = 0; i < n; i++)
+		msgs[i].msg_len = mm[i].msg_len;
+	return n;
+}
+
+#if defined(IP_PKTINFO) || defined(IP_RECVPKTINFO)
+# define PKTINFO_ADDR_CMSG_SIZE CMSG_SPACE(sizeof(struct in6_pktinfo))
+#else
+# define PKTINFO_ADDR_CMSG_SIZE (CMSG_SPACE(sizeof(struct in6_pktinfo)) + \
+                                CMSG_SPACE(sizeof(struct sockaddr_dl)) + CMSG_SPACE(sizeof(struct in_addr)))
+#endif
+#define PKTINFO_CMSG_MAX_SIZE (CMSG_SPACE(sizeof(struct timespec)) + PKTINFO_ADDR_CMSG_SIZE + \
+                               CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(int)))
+
+static socklen_t pktinfo_cmsg_size(unsigned int flags)
+{
+	socklen_t size = 0;
+	if (flags & NEB_SOCK_PKTINFO_TIMESTAMP)
+		size += CMSG_SPACE(sizeof(struct timespec));
+	if (flags & (NEB_SOCK_PKTINFO_IFINDEX | NEB_SOCK_PKTINFO_DSTADDR))
+		size += PKTINFO_ADDR_CMSG_SIZE;
+	if (flags & NEB_SOCK_PKTINFO_TTL)
+		size += CMSG_SPACE(sizeof(int));
+	if (flags & NEB_SOCK_PKTINFO_GRO)
+		size += CMSG_SPACE(sizeof(int));
+	return size;
+}
+
+static int decode_pktinfo(const struct msghdr *m, struct neb_sock_pktinfo *info)
+{
+	info->flags = 0;
+	if (m->msg_flags & MSG_CTRUNC) {
+		neb_syslog(LOG_CRIT, "cmsg has ctrunc flag set");
+		return -1;
+	}
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(m); cmsg; cmsg = CMSG_NXTHDR((struct msghdr *)m, cmsg)) {
+		switch (cmsg->cmsg_level) {
+		case SOL_SOCKET:
+			switch (cmsg->cmsg_type) {
+#ifdef SCM_TIMESTAMPNS
+			case SCM_TIMESTAMPNS:
+				memcpy(&info->ts, CMSG_DATA(cmsg), sizeof(struct timespec));
+				info->flags |= NEB_SOCK_PKTINFO_TIMESTAMP;
+				break;
+#endif
+#ifdef SCM_BINTIME
+			case SCM_BINTIME:
+				bintime2timespec((const struct bintime *)CMSG_DATA(cmsg), &info->ts);
+				info->flags |= NEB_SOCK_PKTINFO_TIMESTAMP;
+				break;
+#endif
+#ifdef SCM_TIMESTAMP
+			case SCM_TIMESTAMP:
+				TIMEVAL_TO_TIMESPEC((const struct timeval *)CMSG_DATA(cmsg), &info->ts);
+				info->flags |= NEB_SOCK_PKTINFO_TIMESTAMP;
+				break;
+#endif
+			default:
+				break;
+			}
+			break;
+		case IPPROTO_IP:
+			switch (cmsg->cmsg_type) {
+#ifdef IP_PKTINFO
+			case IP_PKTINFO:
+			{
+				const struct in_pktinfo *pi = (const struct in_pktinfo *)CMSG_DATA(cmsg);
+				info->ifindex = pi->ipi_ifindex;
+				info->dst_addr.v4 = pi->ipi_addr;
+				info->flags |= NEB_SOCK_PKTINFO_IFINDEX | NEB_SOCK_PKTINFO_DSTADDR;
+			}
+				break;
+#else
+# ifdef IP_RECVDSTADDR
+			case IP_RECVDSTADDR:
+				memcpy(&info->dst_addr.v4, CMSG_DATA(cmsg), sizeof(struct in_addr));
+				info->flags |= NEB_SOCK_PKTINFO_DSTADDR;
+				break;
+# endif
+# ifdef IP_RECVIF
+			case IP_RECVIF:
+				info->ifindex = ((const struct sockaddr_dl *)CMSG_DATA(cmsg))->sdl_index;
+				info->flags |= NEB_SOCK_PKTINFO_IFINDEX;
+				break;
+# endif
+#endif
+#if defined(OS_LINUX)
+			case IP_TTL:
+				info->ttl = *(const int *)CMSG_DATA(cmsg);
+				info->flags |= NEB_SOCK_PKTINFO_TTL;
+				break;
+#elif defined(IP_RECVTTL)
+			case IP_RECVTTL:
+				info->ttl = *(const u_char *)CMSG_DATA(cmsg);
+				info->flags |= NEB_SOCK_PKTINFO_TTL;
+				break;
+#endif
+			default:
+				break;
+			}
+			break;
+		case IPPROTO_IPV6:
+			switch (cmsg->cmsg_type) {
+			case IPV6_PKTINFO:
+			{
+				const struct in6_pktinfo *pi = (const struct in6_pktinfo *)CMSG_DATA(cmsg);
+				info->ifindex = pi->ipi6_ifindex;
+				memcpy(&info->dst_addr.v6, &pi->ipi6_addr, sizeof(struct in6_addr));
+				info->flags |= NEB_SOCK_PKTINFO_IFINDEX | NEB_SOCK_PKTINFO_DSTADDR;
+			}
+				break;
+			case IPV6_HOPLIMIT:
+				info->ttl = *(const int *)CMSG_DATA(cmsg);
+				info->flags |= NEB_SOCK_PKTINFO_TTL;
+				break;
+			default:
+				break;
+			}
+			break;
+#ifdef UDP_GRO
+		case IPPROTO_UDP:
+			if (cmsg->cmsg_type == UDP_GRO) {
+				info->gro_segsize = *(const int *)CMSG_DATA(cmsg);
+				info->flags |= NEB_SOCK_PKTINFO_GRO;
+			}
+			break;
+#endif
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int set_int_option(int fd, int level, int name, const char *desc)
+{
+	int on = 1;
+	if (setsockopt(fd, level, name, &on, sizeof(on)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(%s): %m", desc);
+		return -1;
+	}
+	return 0;
+}
+
+int neb_sock_inet_enable_pktinfo(int fd, int family, unsigned int flags)
+{
+	if (flags & NEB_SOCK_PKTINFO_TIMESTAMP) {
+		if (neb_sock_inet_enable_recv_time(fd) != 0)
+			return -1;
+	}
+	if (flags & NEB_SOCK_PKTINFO_GRO) {
+		if (neb_sock_inet_enable_udp_gro(fd) != 0)
+			return -1;
+	}
+
+	switch (family) {
+	case AF_INET:
+		if (flags & (NEB_SOCK_PKTINFO_IFINDEX | NEB_SOCK_PKTINFO_DSTADDR)) {
+#if defined(IP_RECVPKTINFO)
+			if (set_int_option(fd, IPPROTO_IP, IP_RECVPKTINFO, "IP_RECVPKTINFO") != 0)
+				return -1;
+#elif defined(IP_PKTINFO)
+			if (set_int_option(fd, IPPROTO_IP, IP_PKTINFO, "IP_PKTINFO") != 0)
+				return -1;
+#elif defined(IP_RECVDSTADDR) && defined(IP_RECVIF)
+			if (set_int_option(fd, IPPROTO_IP, IP_RECVDSTADDR, "IP_RECVDSTADDR") != 0 ||
+			    set_int_option(fd, IPPROTO_IP, IP_RECVIF, "IP_RECVIF") != 0)
+				return -1;
+#else
+# error "fix me"
+#endif
+		}
+		if (flags & NEB_SOCK_PKTINFO_TTL) {
+			if (set_int_option(fd, IPPROTO_IP, IP_RECVTTL, "IP_RECVTTL") != 0)
+				return -1;
+		}
+		break;
+	case AF_INET6:
+		if (flags & (NEB_SOCK_PKTINFO_IFINDEX | NEB_SOCK_PKTINFO_DSTADDR)) {
+			if (set_int_option(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, "IPV6_RECVPKTINFO") != 0)
+				return -1;
+		}
+		if (flags & NEB_SOCK_PKTINFO_TTL) {
+			if (set_int_option(fd, IPPROTO_IPV6, IPV6_RECVHOPLIMIT, "IPV6_RECVHOPLIMIT") != 0)
+				return -1;
+		}
+		break;
+	default:
+		neb_syslog(LOG_ERR, "Unsupported address family %d", family);
+		return -1;
+		break;
+	}
+
+	return 0;
+}
+
+ssize_t neb_sock_inet_recvmsg_pktinfo(int fd, struct neb_sock_msghdr *m,
+                                      unsigned int flags, struct neb_sock_pktinfo *info)
+{
+	socklen_t namelen = 0;
+	if (get_peer_len(m->msg_peer, &namelen) != 0)
+		return -1;
+
+	char buf[PKTINFO_CMSG_MAX_SIZE];
+	socklen_t controllen = pktinfo_cmsg_size(flags);
+	struct msghdr msg = {
+		.msg_name = m->msg_peer,
+		.msg_namelen = namelen,
+		.msg_iov = m->msg_iov,
+		.msg_iovlen = m->msg_iovlen,
+		.msg_control = controllen ? buf : NULL,
+		.msg_controllen = controllen,
+	};
+	ssize_t nr = do_plain_recvmsg(fd, &msg);
+	if (nr == -1)
+		return -1;
+	if (decode_pktinfo(&msg, info) != 0)
+		return -1;
+	return nr;
+}
+
+int neb_sock_inet_recvmmsg_pktinfo(int fd, struct neb_sock_mmsghdr *msgs, unsigned int vlen,
+                                   unsigned int flags, struct neb_sock_pktinfo *infos)
+{
+	if (vlen > NEB_SOCK_MMSG_MAX)
+		vlen = NEB_SOCK_MMSG_MAX;
+
+	struct mmsghdr mm[NEB_SOCK_MMSG_MAX];
+	char cbuf[NEB_SOCK_MMSG_MAX][PKTINFO_CMSG_MAX_SIZE];
+	socklen_t controllen = pktinfo_cmsg_size(flags);
+	for (unsigned int i = 0; i < vlen; i++) {
+		struct neb_sock_msghdr *m = &msgs[i].msg_hdr;
+		socklen_t namelen = 0;
+		if (get_peer_len(m->msg_peer, &namelen) != 0)
+			return -1;
+		mm[i].msg_hdr = (struct msghdr){
+			.msg_name = m->msg_peer,
+			.msg_namelen = namelen,
+			.msg_iov = m->msg_iov,
+			.msg_iovlen = m->msg_iovlen,
+			.msg_control = controllen ? cbuf[i] : NULL,
+			.msg_controllen = controllen,
+		};
+		mm[i].msg_len = 0;
+	}
+
+	int n = do_recvmmsg(fd, mm, vlen);
+	for (int i = 0; i < n; i++) {
+		msgs[i].msg_len = mm[i].msg_len;
+		if (decode_pktinfo(&mm[i].msg_hdr, &infos[i]) != 0)
+			return -1;
+	}
+	return n;
+}
+
 int neb_sock_inet_new(int domain, int type, int protocol)
 {
 #ifdef SOCK_NONBLOCK
@@ -216,3 +655,245 @@ int neb_sock_inet_enable_recv_time(int fd)
 #endif
 	return 0;
 }
+
+int neb_sock_inet_enable_timestamping(int fd, unsigned int flags)
+{
+#if defined(SO_TIMESTAMPING) && defined(OS_LINUX)
+	int val = 0;
+	if (flags & NEB_SOCK_TSTAMP_RX_SOFTWARE)
+		val |= SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	if (flags & NEB_SOCK_TSTAMP_RX_HARDWARE)
+		val |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+	if (flags & NEB_SOCK_TSTAMP_TX_SOFTWARE)
+		val |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	if (flags & NEB_SOCK_TSTAMP_TX_HARDWARE)
+		val |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+	if (flags & NEB_SOCK_TSTAMP_TX_SCHED)
+		val |= SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_SOFTWARE;
+	// match tx ones by id, and don't loop the payload back
+	if (flags & (NEB_SOCK_TSTAMP_TX_SOFTWARE | NEB_SOCK_TSTAMP_TX_HARDWARE | NEB_SOCK_TSTAMP_TX_SCHED))
+		val |= SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+	if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &val, sizeof(val)) == -1) {
+		if (errno == ENOPROTOOPT)
+			errno = ENOTSUP;
+		neb_syslogl(LOG_ERR, "setsockopt(SO_TIMESTAMPING): %m");
+		return -1;
+	}
+	return 0;
+#else
+	neb_syslog(LOG_INFO, "timestamping is not supported on this platform");
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+int neb_sock_inet_enable_zerocopy(int fd)
+{
+#if defined(SO_ZEROCOPY)
+	int enable = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(SO_ZEROCOPY): %m");
+		return -1;
+	}
+	return 0;
+#else
+	neb_syslog(LOG_INFO, "zerocopy send is not supported on this platform");
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+int neb_sock_inet_set_udp_gso(int fd, uint16_t segsize)
+{
+#if defined(UDP_SEGMENT)
+	int val = segsize;
+	if (setsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof(val)) == -1) {
+		if (errno == ENOPROTOOPT)
+			errno = ENOTSUP;
+		neb_syslogl(LOG_ERR, "setsockopt(UDP_SEGMENT): %m");
+		return -1;
+	}
+	return 0;
+#else
+	neb_syslog(LOG_INFO, "udp gso is not supported on this platform");
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+int neb_sock_inet_enable_udp_gro(int fd)
+{
+#if defined(UDP_GRO)
+	int enable = 1;
+	if (setsockopt(fd, IPPROTO_UDP, UDP_GRO, &enable, sizeof(enable)) == -1) {
+		if (errno == ENOPROTOOPT)
+			errno = ENOTSUP;
+		neb_syslogl(LOG_ERR, "setsockopt(UDP_GRO): %m");
+		return -1;
+	}
+	return 0;
+#else
+	neb_syslog(LOG_INFO, "udp gro is not supported on this platform");
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+int neb_sock_inet_udp_gro_split(const u_char *data, size_t len, unsigned int segsize,
+                                neb_sock_udp_seg_cb f, void *udata)
+{
+	if (segsize == 0 || segsize >= len)
+		return f(data, len, udata);
+
+	for (size_t off = 0; off < len; off += segsize) {
+		size_t seglen = len - off;
+		if (seglen > segsize)
+			seglen = segsize;
+		int ret = f(data + off, seglen, udata);
+		if (ret != 0)
+			return ret;
+	}
+	return 0;
+}
+
+#if defined(OS_LINUX)
+static void errqueue_parse(struct msghdr *msg, struct neb_sock_errqueue_msg *m)
+{
+	const struct sock_extended_err *ee = NULL;
+# if defined(SCM_TIMESTAMPING)
+	struct timespec ts[3];
+	int got_ts = 0;
+# endif
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+# if defined(SCM_TIMESTAMPING)
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+			memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+			got_ts = 1;
+			continue;
+		}
+# endif
+		if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+		    (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+			ee = (const struct sock_extended_err *)CMSG_DATA(cmsg);
+	}
+
+	m->type = NEB_SOCK_ERRQUEUE_OTHER;
+	m->err = 0;
+	if (!ee)
+		return;
+# if defined(SO_EE_ORIGIN_TIMESTAMPING) && defined(SCM_TIMESTAMPING)
+	if (ee->ee_errno == ENOMSG && ee->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && got_ts) {
+		struct neb_sock_tx_tstamp *t = &m->tstamp;
+		switch (ee->ee_info) {
+		case SCM_TSTAMP_SCHED:
+			t->type = NEB_SOCK_TSTAMP_TYPE_SCHED;
+			break;
+		case SCM_TSTAMP_ACK:
+			t->type = NEB_SOCK_TSTAMP_TYPE_ACK;
+			break;
+		default:
+			t->type = NEB_SOCK_TSTAMP_TYPE_SND;
+			break;
+		}
+		t->id = ee->ee_data;
+		t->flags = 0;
+		if (ts[0].tv_sec || ts[0].tv_nsec) {
+			t->sw = ts[0];
+			t->flags |= NEB_SOCK_TSTAMP_TX_SOFTWARE;
+		}
+		if (ts[2].tv_sec || ts[2].tv_nsec) {
+			t->hw = ts[2];
+			t->flags |= NEB_SOCK_TSTAMP_TX_HARDWARE;
+		}
+		m->type = NEB_SOCK_ERRQUEUE_TSTAMP;
+		return;
+	}
+# endif
+# if defined(SO_EE_ORIGIN_ZEROCOPY)
+	if (ee->ee_errno == 0 && ee->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+		m->zc.lo = ee->ee_info;
+		m->zc.hi = ee->ee_data;
+		m->zc.copied = (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) ? 1 : 0;
+		m->type = NEB_SOCK_ERRQUEUE_ZEROCOPY;
+		return;
+	}
+# endif
+	m->err = ee->ee_errno;
+}
+#endif
+
+int neb_sock_inet_recv_errqueue(int fd, struct neb_sock_errqueue_msg *m)
+{
+#if defined(OS_LINUX)
+	char control[CMSG_SPACE(sizeof(struct timespec) * 3) +
+	             CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+	for (;;) {
+		struct msghdr msg = {
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+			switch (errno) {
+			case EINTR:
+				continue;
+				break;
+			case EAGAIN:
+# if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+# endif
+				return 0;
+				break;
+			default:
+				neb_syslogl(LOG_ERR, "recvmsg(MSG_ERRQUEUE): %m");
+				return -1;
+				break;
+			}
+		}
+		errqueue_parse(&msg, m);
+		return 1;
+	}
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+int neb_sock_inet_recv_zerocopy(int fd, uint32_t *lo, uint32_t *hi, int *copied)
+{
+#if defined(SO_EE_ORIGIN_ZEROCOPY)
+	for (;;) {
+		struct neb_sock_errqueue_msg m;
+		int ret = neb_sock_inet_recv_errqueue(fd, &m);
+		if (ret <= 0)
+			return ret;
+		if (m.type != NEB_SOCK_ERRQUEUE_ZEROCOPY) // drop it
+			continue;
+		*lo = m.zc.lo;
+		*hi = m.zc.hi;
+		*copied = m.zc.copied;
+		return 1;
+	}
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+int neb_sock_inet_recv_tx_timestamp(int fd, struct neb_sock_tx_tstamp *t)
+{
+#if defined(SO_EE_ORIGIN_TIMESTAMPING) && defined(SCM_TIMESTAMPING)
+	for (;;) {
+		struct neb_sock_errqueue_msg m;
+		int ret = neb_sock_inet_recv_errqueue(fd, &m);
+		if (ret <= 0)
+			return ret;
+		if (m.type != NEB_SOCK_ERRQUEUE_TSTAMP) // drop it
+			continue;
+		*t = m.tstamp;
+		return 1;
+	}
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
@@ -1,5 +1,6 @@
 
 #include "options.h"
+#include "_mmsg.h"
 
 #include <nebase/syslog.h>
 #include <nebase/sock/raw.h>
@@ -56,25 +57,29 @@ int neb_sock_raw4_new(int protocol)
 	return fd;
 }
 
-ssize_t neb_sock_raw4_send(int fd, const u_char *data, size_t len)
+static void raw4_get_dst(const u_char *data, struct sockaddr_in *sa)
 {
-	struct ip *iphdr = (struct ip *)data;
-	struct sockaddr_in sa = {
-		.sin_family = AF_INET,
-		.sin_port = 0,
-		.sin_addr.s_addr = iphdr->ip_dst.s_addr,
-	};
+	const struct ip *iphdr = (const struct ip *)data;
+	sa->sin_family = AF_INET;
+	sa->sin_port = 0;
+	sa->sin_addr.s_addr = iphdr->ip_dst.s_addr;
 	switch (iphdr->ip_p) {
 	case IPPROTO_TCP:
-		sa.sin_port = ((struct tcphdr *)(data + (iphdr->ip_hl << 2)))->th_dport;
+		sa->sin_port = ((const struct tcphdr *)(data + (iphdr->ip_hl << 2)))->th_dport;
 		break;
 	case IPPROTO_UDP:
-		sa.sin_port = ((struct udphdr *)(data + (iphdr->ip_hl << 2)))->uh_dport;
+		sa->sin_port = ((const struct udphdr *)(data + (iphdr->ip_hl << 2)))->uh_dport;
 		break;
 	case IPPROTO_ICMP: // should set port to 0
 	default:
 		break;
 	}
+}
+
+ssize_t neb_sock_raw4_send(int fd, const u_char *data, size_t len)
+{
+	struct sockaddr_in sa = NEB_STRUCT_INITIALIZER;
+	raw4_get_dst(data, &sa);
 
 	ssize_t nw = sendto(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL, (struct sockaddr *)&sa, sizeof(struct sockaddr_in));
 	if (nw == -1) {
@@ -85,6 +90,27 @@ ssize_t neb_sock_raw4_send(int fd, const u_char *data, size_t len)
 	return nw;
 }
 
+int neb_sock_raw4_sendmmsg(int fd, const struct iovec *pkts, unsigned int n)
+{
+	if (n > NEB_SOCK_MMSG_MAX)
+		n = NEB_SOCK_MMSG_MAX;
+
+	struct sockaddr_in sa[NEB_SOCK_MMSG_MAX];
+	struct mmsghdr mm[NEB_SOCK_MMSG_MAX];
+	for (unsigned int i = 0; i < n; i++) {
+		raw4_get_dst(pkts[i].iov_base, &sa[i]);
+		mm[i].msg_hdr = (struct msghdr){
+			.msg_name = &sa[i],
+			.msg_namelen = sizeof(struct sockaddr_in),
+			.msg_iov = (struct iovec *)&pkts[i],
+			.msg_iovlen = 1,
+		};
+		mm[i].msg_len = 0;
+	}
+
+	return neb_sock_do_sendmmsg(fd, mm, n);
+}
+
 size_t neb_sock_raw4_get_pktlen(const struct ip *iphdr)
 {
 #if defined(OS_NETBSD) || defined(OS_DARWIN)
@@ -130,6 +156,35 @@ int neb_sock_raw_icmp4_new(void)
 	return fd;
 }
 
+#if defined(IP_PKTINFO)
+# define ICMP4_SRC_CMSG_SIZE CMSG_SPACE(sizeof(struct in_pktinfo))
+#elif defined(IP_SENDSRCADDR)
+# define ICMP4_SRC_CMSG_SIZE CMSG_SPACE(sizeof(struct in_addr))
+#else
+# error "fix me"
+#endif
+
+static void icmp4_fill_src(struct msghdr *msg, const struct in_addr *src)
+{
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	cmsg->cmsg_level = IPPROTO_IP;
+#if defined(IP_PKTINFO)
+	cmsg->cmsg_type = IP_PKTINFO;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+	struct in_pktinfo *info = (struct in_pktinfo *)CMSG_DATA(cmsg);
+	info->ipi_ifindex = 0;
+	info->ipi_spec_dst.s_addr = src->s_addr;
+	info->ipi_addr.s_addr = 0;
+#elif defined(IP_SENDSRCADDR)
+	cmsg->cmsg_type = IP_SENDSRCADDR;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
+	struct in_addr *addr = (struct in_addr *)CMSG_DATA(cmsg);
+	addr->s_addr = src->s_addr;
+#else
+# error "fix me"
+#endif
+}
+
 ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
                                 const struct in_addr *dst, const struct in_addr *src)
 {
@@ -137,13 +192,7 @@ ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
 		.iov_base = (void *)data,
 		.iov_len = len
 	};
-#if defined(IP_PKTINFO)
-	char buf[CMSG_SPACE(sizeof(struct in_pktinfo))];
-#elif defined(IP_SENDSRCADDR)
-	char buf[CMSG_SPACE(sizeof(struct in_addr))];
-#else
-# error "fix me"
-#endif
+	char buf[ICMP4_SRC_CMSG_SIZE];
 	struct sockaddr_in dst_addr = {
 		.sin_family = AF_INET,
 		.sin_port = 0,
@@ -161,23 +210,7 @@ ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
 	if (src) {
 		msg.msg_control = buf;
 		msg.msg_controllen = sizeof(buf);
-		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-		cmsg->cmsg_level = IPPROTO_IP;
-#if defined(IP_PKTINFO)
-		cmsg->cmsg_type = IP_PKTINFO;
-		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
-		struct in_pktinfo *info = (struct in_pktinfo *)CMSG_DATA(cmsg);
-		info->ipi_ifindex = 0;
-		info->ipi_spec_dst.s_addr = src->s_addr;
-		info->ipi_addr.s_addr = 0;
-#elif defined(IP_SENDSRCADDR)
-		cmsg->cmsg_type = IP_SENDSRCADDR;
-		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
-		struct in_addr *addr = (struct in_addr *)CMSG_DATA(cmsg);
-		addr->s_addr = src->s_addr;
-#else
-# error "fix me"
-#endif
+		icmp4_fill_src(&msg, src);
 	}
 
 	ssize_t nw = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
@@ -189,6 +222,40 @@ ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
 	return nw;
 }
 
+int neb_sock_raw_icmp4_sendmmsg(int fd, const struct iovec *pkts,
+                                const struct in_addr *dsts, unsigned int n,
+                                const struct in_addr *src)
+{
+	if (n > NEB_SOCK_MMSG_MAX)
+		n = NEB_SOCK_MMSG_MAX;
+
+	char buf[ICMP4_SRC_CMSG_SIZE]; // shared by all messages as it is read only
+	struct sockaddr_in sa[NEB_SOCK_MMSG_MAX];
+	struct mmsghdr mm[NEB_SOCK_MMSG_MAX];
+	for (unsigned int i = 0; i < n; i++) {
+		sa[i] = (struct sockaddr_in){
+			.sin_family = AF_INET,
+			.sin_port = 0,
+			.sin_addr.s_addr = dsts[i].s_addr,
+		};
+		mm[i].msg_hdr = (struct msghdr){
+			.msg_name = &sa[i],
+			.msg_namelen = sizeof(struct sockaddr_in),
+			.msg_iov = (struct iovec *)&pkts[i],
+			.msg_iovlen = 1,
+		};
+		if (src) {
+			mm[i].msg_hdr.msg_control = buf;
+			mm[i].msg_hdr.msg_controllen = sizeof(buf);
+		}
+		mm[i].msg_len = 0;
+	}
+	if (src && n > 0)
+		icmp4_fill_src(&mm[0].msg_hdr, src);
+
+	return neb_sock_do_sendmmsg(fd, mm, n);
+}
+
 int neb_sock_raw_icmp6_new(void)
 {
 	int fd = neb_sock_inet_new(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
@@ -0,0 +1,189 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/sock/inet.h>
+#include <nebase/sock/tcp.h>
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define TCP_DEFAULT_BACKLOG 1024
+#define TCP_DEFAULT_NOTSENT_LOWAT (16 * 1024)
+
+void neb_sock_tcp_profile_init(struct neb_sock_tcp_profile *p, int type)
+{
+	memset(p, 0, sizeof(struct neb_sock_tcp_profile));
+	p->backlog = TCP_DEFAULT_BACKLOG;
+
+	switch (type) {
+	case NEB_SOCK_TCP_PROFILE_LATENCY:
+		p->opts = NEB_SOCK_TCP_OPT_REUSEADDR | NEB_SOCK_TCP_OPT_NODELAY | NEB_SOCK_TCP_OPT_NOTSENT_LOWAT |
+		          NEB_SOCK_TCP_OPT_FASTOPEN | NEB_SOCK_TCP_OPT_DEFER_ACCEPT | NEB_SOCK_TCP_OPT_QUICKACK |
+		          NEB_SOCK_TCP_OPT_BUSY_POLL;
+		p->notsent_lowat = TCP_DEFAULT_NOTSENT_LOWAT;
+		p->fastopen_qlen = 256;
+		p->defer_accept_sec = 1;
+		p->busy_poll_usec = 50;
+		break;
+	case NEB_SOCK_TCP_PROFILE_THROUGHPUT:
+		p->opts = NEB_SOCK_TCP_OPT_REUSEADDR | NEB_SOCK_TCP_OPT_NOTSENT_LOWAT |
+		          NEB_SOCK_TCP_OPT_SNDBUF | NEB_SOCK_TCP_OPT_RCVBUF;
+		p->notsent_lowat = 128 * 1024;
+		p->sndbuf = 4 * 1024 * 1024;
+		p->rcvbuf = 4 * 1024 * 1024;
+		break;
+	case NEB_SOCK_TCP_PROFILE_DEFAULT:
+	default:
+		p->opts = NEB_SOCK_TCP_OPT_REUSEADDR | NEB_SOCK_TCP_OPT_NODELAY | NEB_SOCK_TCP_OPT_NOTSENT_LOWAT;
+		p->notsent_lowat = TCP_DEFAULT_NOTSENT_LOWAT;
+		break;
+	}
+}
+
+static int tcp_set_opt(int fd, int level, int name, int value, const char *desc)
+{
+	if (setsockopt(fd, level, name, &value, sizeof(value)) == -1) {
+		neb_syslogl(LOG_NOTICE, "setsockopt(%s): %m", desc);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * options that should be set before listen or connect
+ */
+static unsigned int tcp_apply_pre(int fd, const struct neb_sock_tcp_profile *p, int is_listener)
+{
+	unsigned int applied = 0;
+
+	if (is_listener && (p->opts & NEB_SOCK_TCP_OPT_REUSEADDR)) {
+		if (tcp_set_opt(fd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR") == 0)
+			applied |= NEB_SOCK_TCP_OPT_REUSEADDR;
+	}
+#ifdef SO_REUSEPORT
+	if (is_listener && (p->opts & NEB_SOCK_TCP_OPT_REUSEPORT)) {
+		if (tcp_set_opt(fd, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT") == 0)
+			applied |= NEB_SOCK_TCP_OPT_REUSEPORT;
+	}
+#endif
+	// buffer sizes affect the window scale, which is negotiated in handshake
+	if (p->opts & NEB_SOCK_TCP_OPT_SNDBUF) {
+		if (tcp_set_opt(fd, SOL_SOCKET, SO_SNDBUF, p->sndbuf, "SO_SNDBUF") == 0)
+			applied |= NEB_SOCK_TCP_OPT_SNDBUF;
+	}
+	if (p->opts & NEB_SOCK_TCP_OPT_RCVBUF) {
+		if (tcp_set_opt(fd, SOL_SOCKET, SO_RCVBUF, p->rcvbuf, "SO_RCVBUF") == 0)
+			applied |= NEB_SOCK_TCP_OPT_RCVBUF;
+	}
+	if (p->opts & NEB_SOCK_TCP_OPT_FASTOPEN) {
+		if (is_listener) {
+#ifdef TCP_FASTOPEN
+			if (tcp_set_opt(fd, IPPROTO_TCP, TCP_FASTOPEN, p->fastopen_qlen, "TCP_FASTOPEN") == 0)
+				applied |= NEB_SOCK_TCP_OPT_FASTOPEN;
+#endif
+		} else {
+#ifdef TCP_FASTOPEN_CONNECT
+			if (tcp_set_opt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1, "TCP_FASTOPEN_CONNECT") == 0)
+				applied |= NEB_SOCK_TCP_OPT_FASTOPEN;
+#endif
+		}
+	}
+#ifdef TCP_DEFER_ACCEPT
+	if (is_listener && (p->opts & NEB_SOCK_TCP_OPT_DEFER_ACCEPT)) {
+		if (tcp_set_opt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, p->defer_accept_sec, "TCP_DEFER_ACCEPT") == 0)
+			applied |= NEB_SOCK_TCP_OPT_DEFER_ACCEPT;
+	}
+#endif
+
+	return applied;
+}
+
+unsigned int neb_sock_tcp_apply(int fd, const struct neb_sock_tcp_profile *p)
+{
+	unsigned int applied = 0;
+
+	if (p->opts & NEB_SOCK_TCP_OPT_NODELAY) {
+		if (tcp_set_opt(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY") == 0)
+			applied |= NEB_SOCK_TCP_OPT_NODELAY;
+	}
+#ifdef TCP_QUICKACK
+	if (p->opts & NEB_SOCK_TCP_OPT_QUICKACK) {
+		if (tcp_set_opt(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK") == 0)
+			applied |= NEB_SOCK_TCP_OPT_QUICKACK;
+	}
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+	if (p->opts & NEB_SOCK_TCP_OPT_NOTSENT_LOWAT) {
+		if (tcp_set_opt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, p->notsent_lowat, "TCP_NOTSENT_LOWAT") == 0)
+			applied |= NEB_SOCK_TCP_OPT_NOTSENT_LOWAT;
+	}
+#endif
+#ifdef SO_BUSY_POLL
+	if (p->opts & NEB_SOCK_TCP_OPT_BUSY_POLL) {
+		if (tcp_set_opt(fd, SOL_SOCKET, SO_BUSY_POLL, p->busy_poll_usec, "SO_BUSY_POLL") == 0)
+			applied |= NEB_SOCK_TCP_OPT_BUSY_POLL;
+	}
+#endif
+
+	return applied;
+}
+
+int neb_sock_tcp_listen(const struct sockaddr *addr, socklen_t addrlen,
+                        const struct neb_sock_tcp_profile *p, unsigned int *applied)
+{
+	struct neb_sock_tcp_profile default_profile;
+	if (!p) {
+		neb_sock_tcp_profile_init(&default_profile, NEB_SOCK_TCP_PROFILE_DEFAULT);
+		p = &default_profile;
+	}
+
+	int fd = neb_sock_inet_new(addr->sa_family, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+
+	unsigned int ok = tcp_apply_pre(fd, p, 1);
+	ok |= neb_sock_tcp_apply(fd, p);
+
+	if (bind(fd, addr, addrlen) == -1) {
+		int err = errno;
+		neb_syslogl(LOG_ERR, "bind: %m");
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	if (listen(fd, p->backlog > 0 ? p->backlog : TCP_DEFAULT_BACKLOG) == -1) {
+		int err = errno;
+		neb_syslogl(LOG_ERR, "listen: %m");
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	if (applied)
+		*applied = ok;
+	return fd;
+}
+
+int neb_sock_tcp_new_connector(int family, const struct neb_sock_tcp_profile *p, unsigned int *applied)
+{
+	struct neb_sock_tcp_profile default_profile;
+	if (!p) {
+		neb_sock_tcp_profile_init(&default_profile, NEB_SOCK_TCP_PROFILE_DEFAULT);
+		p = &default_profile;
+	}
+
+	int fd = neb_sock_inet_new(family, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+
+	unsigned int ok = tcp_apply_pre(fd, p, 0);
+	ok |= neb_sock_tcp_apply(fd, p);
+
+	if (applied)
+		*applied = ok;
+	return fd;
+}
@@ -636,6 +636,8 @@ int neb_sock_unix_recv_with_fds(int fd, char *data, int len, int *fds, int *fd_n
 
 	*fd_num = 0;
 	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg) // data only
+		return nr;
 	if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
 		neb_syslog(LOG_CRIT, "unexpected cmsg: level %d type %d", cmsg->cmsg_level, cmsg->cmsg_type);
 		return -1;
@@ -0,0 +1,194 @@
+
+/*
+ * Connect to a listening tcp socket, a closed tcp port, and a listening unix
+ * socket in parallel, all results should be delivered by the queue.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/connect.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+enum {
+	CONN_TCP_OK = 0,
+	CONN_TCP_REFUSED,
+	CONN_UNIX_OK,
+	CONN_NUM,
+};
+
+static int conn_err[CONN_NUM] = {-1, -1, -1};
+static int done_count = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static void connect_handler(int fd, int err, void *udata)
+{
+	int id = (int)(intptr_t)udata;
+	fprintf(stdout, "connect %d: fd %d err %d\n", id, fd, err);
+	conn_err[id] = err;
+	if (fd >= 0)
+		close(fd);
+	if (++done_count == CONN_NUM)
+		thread_events |= T_E_QUIT;
+}
+
+static int tcp_listen(struct sockaddr_in *addr, int do_listen)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(*addr);
+	if (bind(fd, (struct sockaddr *)addr, len) == -1 || getsockname(fd, (struct sockaddr *)addr, &len) == -1) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	if (do_listen && listen(fd, 4) == -1) {
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int tcp_fd = -1, unix_fd = -1;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_source_t dst = NULL;
+	char tmpdir[] = "/tmp/neb_connect_XXXXXX";
+	char unix_path[sizeof(tmpdir) + 16];
+
+	if (!mkdtemp(tmpdir)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	snprintf(unix_path, sizeof(unix_path), "%s/sock", tmpdir);
+
+	struct sockaddr_in ok_addr, refused_addr;
+	tcp_fd = tcp_listen(&ok_addr, 1);
+	if (tcp_fd == -1) {
+		ret = -1;
+		goto exit_clean;
+	}
+	int closed_fd = tcp_listen(&refused_addr, 0);
+	if (closed_fd == -1) {
+		ret = -1;
+		goto exit_clean;
+	}
+	close(closed_fd);
+
+	unix_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (unix_fd == -1) {
+		perror("socket");
+		ret = -1;
+		goto exit_clean;
+	}
+	struct sockaddr_un uaddr;
+	memset(&uaddr, 0, sizeof(uaddr));
+	uaddr.sun_family = AF_UNIX;
+	strncpy(uaddr.sun_path, unix_path, sizeof(uaddr.sun_path) - 1);
+	if (bind(unix_fd, (struct sockaddr *)&uaddr, sizeof(uaddr)) == -1 || listen(unix_fd, 4) == -1) {
+		perror("bind");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	t = neb_evdp_timer_create(4, 4);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	if (!neb_evdp_connect_inet(dq, SOCK_STREAM, (struct sockaddr *)&ok_addr, sizeof(ok_addr), 1000,
+	                           connect_handler, (void *)CONN_TCP_OK)) {
+		fprintf(stderr, "failed to start tcp connect\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (!neb_evdp_connect_inet(dq, SOCK_STREAM, (struct sockaddr *)&refused_addr, sizeof(refused_addr), 1000,
+	                           connect_handler, (void *)CONN_TCP_REFUSED)) {
+		if (errno != ECONNREFUSED) {
+			fprintf(stderr, "failed to start tcp connect to closed port\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		connect_handler(-1, errno, (void *)CONN_TCP_REFUSED);
+	}
+	if (!neb_evdp_connect_unix(dq, SOCK_STREAM, unix_path, 1000, connect_handler, (void *)CONN_UNIX_OK)) {
+		fprintf(stderr, "failed to start unix connect\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (timeout || conn_err[CONN_TCP_OK] != 0 || conn_err[CONN_TCP_REFUSED] != ECONNREFUSED ||
+	    conn_err[CONN_UNIX_OK] != 0)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	if (tcp_fd >= 0)
+		close(tcp_fd);
+	if (unix_fd >= 0)
+		close(unix_fd);
+	unlink(unix_path);
+	rmdir(tmpdir);
+	return ret;
+}
@@ -0,0 +1,185 @@
+
+/*
+ * Coroutines should be able to connect, ping-pong over a socketpair and sleep
+ * in straight-line code, and many short-lived ones should reuse the stacks.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/coroutine.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define ROUND_NUM 100
+#define SLEEPER_NUM 200
+#define SLEEP_MSEC 20
+
+static int sp[2] = {-1, -1};
+static struct sockaddr_in laddr;
+static int server_rounds = 0, client_rounds = 0, sleepers_done = 0, connected = 0, slept = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static void server_co(void *arg _nattr_unused)
+{
+	char buf[4];
+	for (;;) {
+		if (neb_co_read(sp[1], buf, sizeof(buf)) != sizeof(buf) || memcmp(buf, "ping", 4) != 0)
+			break;
+		if (neb_co_write(sp[1], "pong", 4) != 4)
+			break;
+		server_rounds++;
+	}
+	neb_co_close(sp[1]);
+	sp[1] = -1;
+}
+
+static void client_co(void *arg _nattr_unused)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd != -1 && fcntl(fd, F_SETFL, O_NONBLOCK) != -1 &&
+	    neb_co_connect(fd, (struct sockaddr *)&laddr, sizeof(laddr)) == 0)
+		connected = 1;
+	if (fd != -1)
+		neb_co_close(fd);
+
+	char buf[4];
+	for (int i = 0; i < ROUND_NUM; i++) {
+		if (neb_co_write(sp[0], "ping", 4) != 4)
+			break;
+		if (neb_co_read(sp[0], buf, sizeof(buf)) != sizeof(buf) || memcmp(buf, "pong", 4) != 0)
+			break;
+		client_rounds++;
+	}
+	neb_co_close(sp[0]);
+	sp[0] = -1;
+
+	int64_t start = neb_time_get_msec();
+	if (neb_co_sleep(SLEEP_MSEC) == 0 && neb_time_get_msec() - start >= SLEEP_MSEC)
+		slept = 1;
+	thread_events |= T_E_QUIT;
+}
+
+static void sleeper_co(void *arg _nattr_unused)
+{
+	if (neb_co_sleep(1) == 0)
+		sleepers_done++;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int lfd = -1;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd == -1) {
+		perror("socket");
+		return -1;
+	}
+	memset(&laddr, 0, sizeof(laddr));
+	laddr.sin_family = AF_INET;
+	laddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(laddr);
+	if (bind(lfd, (struct sockaddr *)&laddr, len) == -1 || getsockname(lfd, (struct sockaddr *)&laddr, &len) == -1 ||
+	    listen(lfd, 1) == -1) {
+		perror("listen");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == -1 ||
+	    fcntl(sp[0], F_SETFL, O_NONBLOCK) == -1 || fcntl(sp[1], F_SETFL, O_NONBLOCK) == -1) {
+		perror("socketpair");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	t = neb_evdp_timer_create(16, 256);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_co_spawn(dq, server_co, NULL, 0) != 0 || neb_co_spawn(dq, client_co, NULL, 0) != 0) {
+		fprintf(stderr, "failed to spawn coroutines\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < SLEEPER_NUM; i++) {
+		if (neb_co_spawn(dq, sleeper_co, NULL, 0) != 0) {
+			fprintf(stderr, "failed to spawn sleeper\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "connected %d, rounds %d/%d, sleepers %d, slept %d\n",
+	        connected, server_rounds, client_rounds, sleepers_done, slept);
+	if (timeout || !connected || server_rounds != ROUND_NUM || client_rounds != ROUND_NUM ||
+	    sleepers_done != SLEEPER_NUM || !slept)
+		ret = -1;
+	if (sp[0] != -1 || sp[1] != -1)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	neb_co_stack_pool_clear();
+	if (sp[0] >= 0)
+		close(sp[0]);
+	if (sp[1] >= 0)
+		close(sp[1]);
+	if (lfd >= 0)
+		close(lfd);
+	return ret;
+}
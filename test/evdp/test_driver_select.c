@@ -0,0 +1,130 @@
+
+/*
+ * Select the driver given in argv, or the default one, and check that a
+ * pipe read event can be delivered by it.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+static int read_ok = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char c;
+	if (read(fd, &c, 1) == 1 && c == 'x')
+		read_ok = 1;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && neb_evdp_driver_select(argv[1]) != 0) {
+		fprintf(stderr, "failed to select driver %s\n", argv[1]);
+		return -1;
+	}
+	const char *name = neb_evdp_driver_name();
+	if (!name) {
+		fprintf(stderr, "no driver is available\n");
+		return -1;
+	}
+	fprintf(stdout, "driver in use: %s\n", name);
+	if (argc > 1 && strcmp(name, argv[1]) != 0) {
+		fprintf(stderr, "driver mismatch\n");
+		return -1;
+	}
+	if (neb_evdp_driver_select("no_such_driver") == 0) {
+		fprintf(stderr, "unknown driver should not be selected\n");
+		return -1;
+	}
+
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return -1;
+	}
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t ds = NULL, dst = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	ds = neb_evdp_source_new_ro_fd(fds[0], read_handler, hup_handler);
+	if (!ds) {
+		fprintf(stderr, "failed to create ro_fd evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ds) != 0) {
+		fprintf(stderr, "failed to add ro_fd source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (write(fds[1], "x", 1) != 1) {
+		perror("write");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (timeout || !read_ok)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (ds) {
+		if (neb_evdp_source_get_queue(ds) && neb_evdp_queue_detach(dq, ds, 0) != 0)
+			fprintf(stderr, "failed to detach ds\n");
+		neb_evdp_source_del(ds);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	close(fds[0]);
+	close(fds[1]);
+	return ret;
+}
@@ -0,0 +1,173 @@
+
+/*
+ * Chain async openat -> write -> fsync -> stat -> read on a temp file,
+ * every op should be done in the evdp queue with the right result.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/fileio.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static const char wbuf[] = "nebase async file io";
+static char rbuf[sizeof(wbuf)];
+static struct stat st;
+
+static neb_evdp_fileio_t f = NULL;
+static int fd = -1;
+static int all_ok = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static void on_fail(const char *op, ssize_t res)
+{
+	fprintf(stderr, "%s failed: %s\n", op, res < 0 ? strerror(-res) : "unexpected result");
+	thread_events |= T_E_QUIT;
+}
+
+static void on_read(ssize_t res, void *udata _nattr_unused)
+{
+	if (res != sizeof(wbuf) || memcmp(rbuf, wbuf, sizeof(wbuf)) != 0) {
+		on_fail("read", res);
+		return;
+	}
+	fprintf(stdout, "read ok\n");
+	all_ok = 1;
+	thread_events |= T_E_QUIT;
+}
+
+static void on_stat(ssize_t res, void *udata _nattr_unused)
+{
+	if (res != 0 || st.st_size != sizeof(wbuf) || !S_ISREG(st.st_mode)) {
+		on_fail("stat", res);
+		return;
+	}
+	fprintf(stdout, "stat ok\n");
+	if (neb_evdp_fileio_read(f, fd, rbuf, sizeof(rbuf), 0, on_read, NULL) != 0) {
+		on_fail("submit read", 0);
+	}
+}
+
+static void on_fsync(ssize_t res, void *udata)
+{
+	if (res != 0) {
+		on_fail("fsync", res);
+		return;
+	}
+	fprintf(stdout, "fsync ok\n");
+	if (neb_evdp_fileio_stat(f, AT_FDCWD, udata, 0, &st, on_stat, NULL) != 0) {
+		on_fail("submit stat", 0);
+	}
+}
+
+static void on_write(ssize_t res, void *udata)
+{
+	if (res != sizeof(wbuf)) {
+		on_fail("write", res);
+		return;
+	}
+	fprintf(stdout, "write ok\n");
+	if (neb_evdp_fileio_fsync(f, fd, 1, on_fsync, udata) != 0) {
+		on_fail("submit fsync", 0);
+	}
+}
+
+static void on_open(ssize_t res, void *udata)
+{
+	if (res < 0) {
+		on_fail("openat", res);
+		return;
+	}
+	fd = res;
+	fprintf(stdout, "openat ok, fd %d\n", fd);
+	if (neb_evdp_fileio_write(f, fd, wbuf, sizeof(wbuf), 0, on_write, udata) != 0) {
+		on_fail("submit write", 0);
+	}
+}
+
+int main(void)
+{
+	char tmp_file[] = "/tmp/.nebase.test.fileio-XXXXXX";
+	int tmp_fd = mkstemp(tmp_file);
+	if (tmp_fd == -1) {
+		perror("mkstemp");
+		return -1;
+	}
+	close(tmp_fd);
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	f = neb_evdp_fileio_create(2);
+	if (!f) {
+		fprintf(stderr, "failed to create fileio\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_fileio_attach(f, dq) != 0) {
+		fprintf(stderr, "failed to attach fileio\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_s(1, 2, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_s evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_s source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_fileio_openat(f, AT_FDCWD, tmp_file, O_RDWR | O_TRUNC, 0, on_open, tmp_file) != 0) {
+		fprintf(stderr, "failed to submit openat\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+	}
+
+	if (timeout || !all_ok)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (f)
+		neb_evdp_fileio_destroy(f);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (fd >= 0)
+		close(fd);
+	unlink(tmp_file);
+	return ret;
+}
@@ -0,0 +1,147 @@
+
+/*
+ * Destroy a fileio with io_uring ops still in flight, it should wait for them
+ * to be done without calling their callbacks, so all the submitted writes
+ * should be in the file after destroy. Skipped if io_uring is not available.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/fileio.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define CHUNK_SIZE 4096
+#define CHUNK_NUM 64
+
+static char wbufs[CHUNK_NUM][CHUNK_SIZE];
+static char rbuf[CHUNK_SIZE];
+
+static int first_ok = 0, late_count = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static void on_first_write(ssize_t res, void *udata _nattr_unused)
+{
+	if (res == CHUNK_SIZE)
+		first_ok = 1;
+	else
+		fprintf(stderr, "first write failed with %zd\n", res);
+	thread_events |= T_E_QUIT;
+}
+
+static void on_late_done(ssize_t res _nattr_unused, void *udata _nattr_unused)
+{
+	late_count++;
+}
+
+int main(void)
+{
+	if (neb_evdp_driver_select("io_uring") != 0) {
+		fprintf(stdout, "io_uring is not available, skip\n");
+		return 0;
+	}
+
+	char tmp_file[] = "/tmp/.nebase.test.fileio-XXXXXX";
+	int fd = mkstemp(tmp_file);
+	if (fd == -1) {
+		perror("mkstemp");
+		return -1;
+	}
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t dst = NULL;
+	neb_evdp_fileio_t f = NULL;
+
+	for (int i = 0; i < CHUNK_NUM; i++)
+		memset(wbufs[i], 'a' + i % 26, CHUNK_SIZE);
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	dst = neb_evdp_source_new_itimer_s(1, 2, wakeup_handler);
+	if (!dst || neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_s source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	f = neb_evdp_fileio_create(0);
+	if (!f) {
+		fprintf(stderr, "failed to create fileio\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_fileio_attach(f, dq) != 0) {
+		fprintf(stderr, "failed to attach fileio\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	// make sure the ring works before going on
+	if (neb_evdp_fileio_write(f, fd, wbufs[0], CHUNK_SIZE, 0, on_first_write, NULL) != 0) {
+		fprintf(stderr, "failed to submit the first write\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_run(dq) != 0 || timeout || !first_ok) {
+		fprintf(stderr, "failed to run the first write\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	// fsync goes to the async workers, so some of them are surely in flight
+	for (int i = 1; i < CHUNK_NUM; i++) {
+		if (neb_evdp_fileio_write(f, fd, wbufs[i], CHUNK_SIZE, (off_t)i * CHUNK_SIZE, on_late_done, NULL) != 0 ||
+		    neb_evdp_fileio_fsync(f, fd, 0, on_late_done, NULL) != 0) {
+			fprintf(stderr, "failed to submit write and fsync %d\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+	neb_evdp_fileio_destroy(f);
+	f = NULL;
+
+	if (late_count) {
+		fprintf(stderr, "%d callbacks called for unfinished ops\n", late_count);
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < CHUNK_NUM; i++) {
+		if (pread(fd, rbuf, CHUNK_SIZE, (off_t)i * CHUNK_SIZE) != CHUNK_SIZE ||
+		    memcmp(rbuf, wbufs[i], CHUNK_SIZE) != 0) {
+			fprintf(stderr, "write %d is not done after destroy\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+	fprintf(stdout, "all %d writes are done after destroy\n", CHUNK_NUM);
+
+exit_clean:
+	if (f)
+		neb_evdp_fileio_destroy(f);
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	close(fd);
+	unlink(tmp_file);
+	return ret;
+}
@@ -0,0 +1,141 @@
+
+/*
+ * A burst of writes to a file in the watched dir should be coalesced
+ * into one event, and delivered after the dedup window.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/fswatch.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define WRITE_COUNT 5
+#define FILE_NAME "test.conf"
+
+static int cb_count = 0, event_ok = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static void fswatch_handler(const neb_evdp_fswatch_event_t *evs, int count, void *udata _nattr_unused)
+{
+	cb_count++;
+	for (int i = 0; i < count; i++)
+		fprintf(stdout, "fswatch event: id %d path %s name %s events 0x%x\n",
+		        evs[i].id, evs[i].path, evs[i].name ? evs[i].name : "", evs[i].events);
+	if (count == 1 && evs[0].name && strcmp(evs[0].name, FILE_NAME) == 0 &&
+	    (evs[0].events & NEB_FSWATCH_CREATE) && (evs[0].events & NEB_FSWATCH_MODIFY))
+		event_ok = 1;
+	thread_events |= T_E_QUIT;
+}
+
+int main(void)
+{
+	char tmp_dir[] = "/tmp/.nebase.test.fswatch-XXXXXX";
+	if (!mkdtemp(tmp_dir)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	char file_path[sizeof(tmp_dir) + sizeof(FILE_NAME) + 1];
+	snprintf(file_path, sizeof(file_path), "%s/%s", tmp_dir, FILE_NAME);
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_fswatch_t w = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	t = neb_evdp_timer_create(1, 1);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	w = neb_evdp_fswatch_create(50, fswatch_handler, NULL);
+	if (!w) {
+		fprintf(stderr, "failed to create fswatch\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_fswatch_add(w, tmp_dir) < 0) {
+		fprintf(stderr, "failed to watch dir %s\n", tmp_dir);
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_fswatch_attach(w, dq) != 0) {
+		fprintf(stderr, "failed to attach fswatch\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_s(1, 2, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_s evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_s source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	int fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1) {
+		perror("open");
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < WRITE_COUNT; i++) {
+		if (write(fd, "x\n", 2) == -1) {
+			perror("write");
+			ret = -1;
+			break;
+		}
+	}
+	close(fd);
+	if (ret != 0)
+		goto exit_clean;
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+	}
+
+	if (timeout || !event_ok || cb_count != 1)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (w)
+		neb_evdp_fswatch_destroy(w);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	unlink(file_path);
+	rmdir(tmp_dir);
+	return ret;
+}
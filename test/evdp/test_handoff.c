@@ -0,0 +1,375 @@
+
+/*
+ * The listening socket and the established connections should be handed to
+ * the new process with their states, and the clients should be served by the
+ * new process after the old one acknowledged and closed them.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/handoff.h>
+#include <nebase/sock/common.h>
+#include <nebase/sock/tcp.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CONN_NUM 4
+#define UTYPE_LISTENER 1
+#define UTYPE_CONN 2
+#define TIMEOUT_MSEC 2000
+
+struct conn_state {
+	int id;
+	int seq;
+};
+
+static struct sockaddr_in laddr;
+static int hfd[2] = {-1, -1};
+static int lfd = -1;
+static int sfds[CONN_NUM], cfds[CONN_NUM];
+static struct conn_state states[CONN_NUM];
+static neb_evdp_source_t ss[CONN_NUM + 1];
+static int handed = 0, collected = 0, timeout = 0;
+
+/*
+ * the new process
+ */
+
+static int new_lfd = -1;
+static int new_fds[CONN_NUM];
+static struct conn_state new_states[CONN_NUM];
+static int new_count = 0;
+
+static int restore_handler(int fd, int utype, const void *state, size_t len, void *udata _nattr_unused)
+{
+	switch (utype) {
+	case UTYPE_LISTENER:
+		if (new_lfd != -1 || len)
+			break;
+		new_lfd = fd;
+		return 0;
+	case UTYPE_CONN:
+		if (new_count == CONN_NUM || len != sizeof(struct conn_state))
+			break;
+		memcpy(&new_states[new_count], state, len);
+		new_fds[new_count++] = fd;
+		return 0;
+	default:
+		break;
+	}
+	fprintf(stderr, "unexpected fd with utype %d, state len %zu\n", utype, len);
+	close(fd);
+	return -1;
+}
+
+static int serve_one(int fd, const struct conn_state *st)
+{
+	char buf[16];
+	int hup = 0;
+	if (!neb_sock_timed_read_ready(fd, TIMEOUT_MSEC, &hup) || read(fd, buf, 4) != 4 || memcmp(buf, "ping", 4) != 0) {
+		fprintf(stderr, "failed to read from conn %d\n", st->id);
+		return -1;
+	}
+	int len = snprintf(buf, sizeof(buf), "%d:%d", st->id, st->seq + 1);
+	if (write(fd, buf, len) != len) {
+		perror("write");
+		return -1;
+	}
+	return 0;
+}
+
+static int new_process_run(void)
+{
+	// only use the handed ones
+	close(lfd);
+	for (int i = 0; i < CONN_NUM; i++) {
+		close(sfds[i]);
+		close(cfds[i]);
+	}
+	close(hfd[0]);
+
+	int n = neb_evdp_handoff_recv(hfd[1], TIMEOUT_MSEC, restore_handler, NULL);
+	if (n != CONN_NUM + 1 || new_lfd == -1 || new_count != CONN_NUM) {
+		fprintf(stderr, "handoff recv got %d fds\n", n);
+		return 1;
+	}
+
+	for (int i = 0; i < CONN_NUM; i++) {
+		if (serve_one(new_fds[i], &new_states[i]) != 0)
+			return 1;
+	}
+
+	int hup = 0;
+	if (!neb_sock_timed_read_ready(new_lfd, TIMEOUT_MSEC, &hup)) {
+		fprintf(stderr, "no new connection\n");
+		return 1;
+	}
+	int fd = accept(new_lfd, NULL, NULL);
+	if (fd == -1 || write(fd, "new", 3) != 3) {
+		perror("accept");
+		return 1;
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+ * the old process
+ */
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR; // nothing should be read by the old process
+}
+
+static int collect_handler(neb_evdp_handoff_t h, neb_evdp_source_t s, int utype, void *udata)
+{
+	collected++;
+	int fd = neb_evdp_source_get_fd(s);
+	if (utype == UTYPE_LISTENER)
+		return neb_evdp_handoff_add(h, fd, utype, NULL, 0);
+	return neb_evdp_handoff_add(h, fd, utype, udata, sizeof(struct conn_state));
+}
+
+static neb_evdp_cb_ret_t restart_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	neb_evdp_queue_t q = neb_evdp_source_get_queue(ss[0]);
+	neb_evdp_handoff_t h = neb_evdp_handoff_create();
+	if (!h)
+		return NEB_EVDP_CB_BREAK_ERR;
+	if (neb_evdp_handoff_collect(h, q, collect_handler) != 0 || neb_evdp_handoff_get_count(h) != CONN_NUM + 1) {
+		fprintf(stderr, "failed to collect fds\n");
+		neb_evdp_handoff_destroy(h);
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	if (neb_evdp_handoff_send(h, hfd[0], TIMEOUT_MSEC) == 0)
+		handed = 1;
+	neb_evdp_handoff_destroy(h);
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static int check_served(void)
+{
+	for (int i = 0; i < CONN_NUM; i++) {
+		if (write(cfds[i], "ping", 4) != 4) {
+			perror("write");
+			return -1;
+		}
+	}
+	for (int i = 0; i < CONN_NUM; i++) {
+		char buf[16], exp[16];
+		int hup = 0;
+		int len = snprintf(exp, sizeof(exp), "%d:%d", states[i].id, states[i].seq + 1);
+		if (!neb_sock_timed_read_ready(cfds[i], TIMEOUT_MSEC, &hup) || read(cfds[i], buf, sizeof(buf)) != len ||
+		    memcmp(buf, exp, len) != 0) {
+			fprintf(stderr, "conn %d is not served by the new process\n", i);
+			return -1;
+		}
+	}
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+	char buf[4];
+	int hup = 0;
+	if (connect(fd, (struct sockaddr *)&laddr, sizeof(laddr)) == -1 ||
+	    !neb_sock_timed_read_ready(fd, TIMEOUT_MSEC, &hup) || read(fd, buf, sizeof(buf)) != 3) {
+		fprintf(stderr, "new connection is not served by the new process\n");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+int main(void)
+{
+	int ret = 0;
+	pid_t cpid = -1;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t rst = NULL, dst = NULL;
+
+	signal(SIGPIPE, SIG_IGN);
+	for (int i = 0; i < CONN_NUM; i++) {
+		sfds[i] = -1;
+		cfds[i] = -1;
+		states[i].id = i + 1;
+		states[i].seq = (i + 1) * 10;
+	}
+	memset(ss, 0, sizeof(ss));
+
+	memset(&laddr, 0, sizeof(laddr));
+	laddr.sin_family = AF_INET;
+	laddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	lfd = neb_sock_tcp_listen((struct sockaddr *)&laddr, sizeof(laddr), NULL, NULL);
+	socklen_t len = sizeof(laddr);
+	if (lfd == -1 || getsockname(lfd, (struct sockaddr *)&laddr, &len) == -1) {
+		fprintf(stderr, "failed to listen\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < CONN_NUM; i++) {
+		cfds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (cfds[i] == -1 || connect(cfds[i], (struct sockaddr *)&laddr, len) == -1) {
+			perror("connect");
+			ret = -1;
+			goto exit_clean;
+		}
+		int hup = 0;
+		if (!neb_sock_timed_read_ready(lfd, TIMEOUT_MSEC, &hup) || (sfds[i] = accept(lfd, NULL, NULL)) == -1) {
+			perror("accept");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, hfd) == -1) {
+		perror("socketpair");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	ss[0] = neb_evdp_source_new_ro_fd(lfd, read_handler, hup_handler);
+	if (!ss[0]) {
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_source_set_utype(ss[0], UTYPE_LISTENER);
+	if (neb_evdp_queue_attach(dq, ss[0]) != 0) {
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < CONN_NUM; i++) {
+		neb_evdp_source_t s = neb_evdp_source_new_os_fd(sfds[i], hup_handler);
+		if (!s) {
+			ret = -1;
+			goto exit_clean;
+		}
+		ss[i + 1] = s;
+		neb_evdp_source_set_utype(s, UTYPE_CONN);
+		neb_evdp_source_set_udata(s, &states[i]);
+		if (neb_evdp_source_os_fd_next_read(s, read_handler) != 0 || neb_evdp_queue_attach(dq, s) != 0) {
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	cpid = fork();
+	if (cpid == -1) {
+		perror("fork");
+		ret = -1;
+		goto exit_clean;
+	} else if (cpid == 0) {
+		_exit(new_process_run());
+	}
+	close(hfd[1]);
+	hfd[1] = -1;
+
+	rst = neb_evdp_source_new_itimer_ms(1, 20, restart_handler);
+	dst = neb_evdp_source_new_itimer_ms(2, 500, wakeup_handler);
+	if (!rst || !dst || neb_evdp_queue_attach(dq, rst) != 0 || neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms sources to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	fprintf(stdout, "collected %d, handed %d\n", collected, handed);
+	if (timeout || !handed || collected != CONN_NUM + 1) {
+		ret = -1;
+		goto exit_clean;
+	}
+
+	// the old process exits
+	for (int i = 0; i < CONN_NUM + 1; i++) {
+		if (neb_evdp_queue_detach(dq, ss[i], 0) != 0)
+			fprintf(stderr, "failed to detach source %d\n", i);
+		neb_evdp_source_del(ss[i]);
+		ss[i] = NULL;
+	}
+	close(lfd);
+	lfd = -1;
+	for (int i = 0; i < CONN_NUM; i++) {
+		close(sfds[i]);
+		sfds[i] = -1;
+	}
+
+	if (check_served() != 0)
+		ret = -1;
+
+exit_clean:
+	if (cpid > 0) {
+		int wstatus = 0;
+		if (ret != 0)
+			kill(cpid, SIGKILL);
+		if (waitpid(cpid, &wstatus, 0) == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+			fprintf(stderr, "the new process failed\n");
+			ret = -1;
+		}
+	}
+	for (int i = 0; i < 2; i++) {
+		neb_evdp_source_t s = i ? dst : rst;
+		if (!s)
+			continue;
+		if (neb_evdp_source_get_queue(s) && neb_evdp_queue_detach(dq, s, 0) != 0)
+			fprintf(stderr, "failed to detach timer source\n");
+		neb_evdp_source_del(s);
+	}
+	for (int i = 0; i < CONN_NUM + 1; i++) {
+		if (!ss[i])
+			continue;
+		if (neb_evdp_source_get_queue(ss[i]) && neb_evdp_queue_detach(dq, ss[i], 0) != 0)
+			fprintf(stderr, "failed to detach source %d\n", i);
+		neb_evdp_source_del(ss[i]);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	for (int i = 0; i < CONN_NUM; i++) {
+		if (sfds[i] >= 0)
+			close(sfds[i]);
+		if (cfds[i] >= 0)
+			close(cfds[i]);
+	}
+	if (lfd >= 0)
+		close(lfd);
+	for (int i = 0; i < 2; i++) {
+		if (hfd[i] >= 0)
+			close(hfd[i]);
+	}
+	return ret;
+}
@@ -0,0 +1,107 @@
+
+/*
+ * Collecting should work again and the queue should be destroyed cleanly,
+ * even if the last running source of the queue has utype set.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/handoff.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define COLLECT_TIMES 3
+
+static int collected = 0, failed = 0;
+
+static int collect_handler(neb_evdp_handoff_t h, neb_evdp_source_t s, int utype, void *udata _nattr_unused)
+{
+	collected++;
+	return neb_evdp_handoff_add(h, neb_evdp_source_get_fd(s), utype, NULL, 0);
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	neb_evdp_queue_t q = udata;
+	for (int i = 0; i < COLLECT_TIMES; i++) {
+		neb_evdp_handoff_t h = neb_evdp_handoff_create();
+		if (!h) {
+			failed = 1;
+			break;
+		}
+		if (neb_evdp_handoff_collect(h, q, collect_handler) != 0 || neb_evdp_handoff_get_count(h) != 1) {
+			fprintf(stderr, "failed to collect at round %d\n", i);
+			failed = 1;
+		}
+		neb_evdp_handoff_destroy(h);
+		if (failed)
+			break;
+	}
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int fds[2] = {-1, -1};
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t s = NULL;
+
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return -1;
+	}
+	if (write(fds[1], "x", 1) != 1) {
+		perror("write");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	// the only running source, so it's also the last one
+	s = neb_evdp_source_new_ro_fd(fds[0], read_handler, hup_handler);
+	if (!s) {
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_source_set_utype(s, 1);
+	neb_evdp_source_set_udata(s, dq);
+	if (neb_evdp_queue_attach(dq, s) != 0) {
+		fprintf(stderr, "failed to attach ro_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	fprintf(stdout, "collected %d\n", collected);
+	if (failed || collected != COLLECT_TIMES)
+		ret = -1;
+
+exit_clean:
+	if (dq) // with the source still attached
+		neb_evdp_queue_destroy(dq);
+	if (s)
+		neb_evdp_source_del(s);
+	for (int i = 0; i < 2; i++) {
+		if (fds[i] >= 0)
+			close(fds[i]);
+	}
+	return ret;
+}
@@ -0,0 +1,76 @@
+
+/*
+ * An itimer_ms source with interval no less than 1000 msec should be able to
+ * be attached, and wake up at every interval.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define INTERVAL_MSEC 1050
+#define WAKEUP_COUNT 2
+#define MAX_DELAY_MSEC 100
+
+static int64_t start_msec = 0;
+static int wakeup_count = 0, bad_time = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	wakeup_count++;
+	int64_t elapsed = neb_time_get_msec() - start_msec;
+	int64_t expected = (int64_t)INTERVAL_MSEC * wakeup_count;
+	fprintf(stdout, "wakeup %d at %lldms\n", wakeup_count, (long long)elapsed);
+	if (elapsed < expected - MAX_DELAY_MSEC || elapsed > expected + MAX_DELAY_MSEC)
+		bad_time = 1;
+	if (wakeup_count < WAKEUP_COUNT)
+		return NEB_EVDP_CB_CONTINUE;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_source_t ds = NULL;
+	neb_evdp_queue_t dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+
+	ds = neb_evdp_source_new_itimer_ms(1, INTERVAL_MSEC, wakeup_handler);
+	if (!ds) {
+		fprintf(stderr, "failed to create itimer evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	start_msec = neb_time_get_msec();
+	if (neb_evdp_queue_attach(dq, ds) != 0) {
+		fprintf(stderr, "failed to attach itimer evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "error occured while running evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (wakeup_count != WAKEUP_COUNT || bad_time) {
+		fprintf(stderr, "should wakeup %d times at every %dms\n", WAKEUP_COUNT, INTERVAL_MSEC);
+		ret = -1;
+	}
+
+exit_clean:
+	if (ds) {
+		if (neb_evdp_source_get_queue(ds) && neb_evdp_queue_detach(dq, ds, 0) != 0)
+			fprintf(stderr, "failed to detach ds\n");
+		neb_evdp_source_del(ds);
+	}
+	neb_evdp_queue_destroy(dq);
+	return ret;
+}
@@ -0,0 +1,163 @@
+
+/*
+ * Connections in the accept queue should be accepted in batches no larger
+ * than the limit, and the auto created sources should be attached after the
+ * handler returns.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/listener.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CONN_NUM 10
+#define BATCH_SIZE 4
+
+static int accept_count = 0, round_count = 0, read_count = 0, bad_batch = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t conn_hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_CLOSE;
+}
+
+static neb_evdp_cb_ret_t conn_read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char c;
+	if (read(fd, &c, 1) == 1 && c == 'x')
+		read_count++;
+	if (read_count == CONN_NUM)
+		thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CLOSE;
+}
+
+static neb_evdp_cb_ret_t accept_handler(neb_evdp_listener_t l _nattr_unused, neb_evdp_listener_conn_t *conns,
+                                        int count, void *udata _nattr_unused)
+{
+	round_count++;
+	if (count > BATCH_SIZE)
+		bad_batch = 1;
+	for (int i = 0; i < count; i++) {
+		if (!conns[i].s || conns[i].addrlen != sizeof(struct sockaddr_in)) {
+			bad_batch = 1;
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		if (neb_evdp_source_os_fd_next_read(conns[i].s, conn_read_handler) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+	}
+	accept_count += count;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int lfd = -1;
+	int cfds[CONN_NUM];
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_listener_t l = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	for (int i = 0; i < CONN_NUM; i++)
+		cfds[i] = -1;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd == -1) {
+		perror("socket");
+		return -1;
+	}
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(lfd, (struct sockaddr *)&addr, len) == -1 || getsockname(lfd, (struct sockaddr *)&addr, &len) == -1 ||
+	    listen(lfd, CONN_NUM) == -1 || fcntl(lfd, F_SETFL, O_NONBLOCK) == -1) {
+		perror("listen");
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < CONN_NUM; i++) {
+		cfds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (cfds[i] == -1 || connect(cfds[i], (struct sockaddr *)&addr, len) == -1 || write(cfds[i], "x", 1) != 1) {
+			perror("connect");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	l = neb_evdp_listener_create(lfd, BATCH_SIZE, accept_handler, NULL);
+	if (!l) {
+		fprintf(stderr, "failed to create listener\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_listener_set_auto_source(l, conn_hup_handler);
+	if (neb_evdp_listener_attach(l, dq) != 0) {
+		fprintf(stderr, "failed to attach listener\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "accepted %d in %d rounds, read %d\n", accept_count, round_count, read_count);
+	if (timeout || bad_batch || accept_count != CONN_NUM || round_count < CONN_NUM / BATCH_SIZE || read_count != CONN_NUM)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (l)
+		neb_evdp_listener_destroy(l);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	for (int i = 0; i < CONN_NUM; i++) {
+		if (cfds[i] >= 0)
+			close(cfds[i]);
+	}
+	if (lfd >= 0)
+		close(lfd);
+	return ret;
+}
@@ -0,0 +1,230 @@
+
+/*
+ * Connections to a listener group should all be accepted by the worker
+ * queues, both with one reuseport socket per worker and with one shared
+ * socket in exclusive mode.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/listener.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define WORKER_NUM 2
+#define CONN_NUM 32
+#define TICK_MSEC 20
+#define TICK_MAX 250
+
+struct worker {
+	int idx;
+	pthread_t tid;
+	volatile int accepted;
+	int ticks;
+	int failed;
+};
+
+static neb_evdp_listener_group_t g = NULL;
+static struct worker workers[WORKER_NUM];
+
+static int get_accepted(void)
+{
+	int sum = 0;
+	for (int i = 0; i < WORKER_NUM; i++)
+		sum += workers[i].accepted;
+	return sum;
+}
+
+static neb_evdp_cb_ret_t tick_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata)
+{
+	struct worker *w = udata;
+	if (get_accepted() >= CONN_NUM) {
+		thread_events |= T_E_QUIT;
+		return NEB_EVDP_CB_CONTINUE;
+	}
+	if (++w->ticks > TICK_MAX) {
+		fprintf(stdout, "worker %d timeout occured\n", w->idx);
+		w->failed = 1;
+		return NEB_EVDP_CB_BREAK_EXP;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t accept_handler(neb_evdp_listener_t l _nattr_unused, neb_evdp_listener_conn_t *conns,
+                                        int count, void *udata)
+{
+	struct worker *w = udata;
+	for (int i = 0; i < count; i++)
+		close(conns[i].fd);
+	w->accepted += count;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	neb_evdp_queue_t q = NULL;
+	neb_evdp_listener_t l = NULL;
+	neb_evdp_source_t ts = NULL;
+
+	q = neb_evdp_queue_create(0);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		w->failed = 1;
+		return NULL;
+	}
+
+	l = neb_evdp_listener_group_new_listener(g, w->idx, 0, accept_handler, w);
+	if (!l) {
+		fprintf(stderr, "failed to create listener for worker %d\n", w->idx);
+		w->failed = 1;
+		goto exit_clean;
+	}
+	if (neb_evdp_listener_attach(l, q) != 0) {
+		fprintf(stderr, "failed to attach listener for worker %d\n", w->idx);
+		w->failed = 1;
+		goto exit_clean;
+	}
+
+	ts = neb_evdp_source_new_itimer_ms(1, TICK_MSEC, tick_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		w->failed = 1;
+		goto exit_clean;
+	}
+	neb_evdp_source_set_udata(ts, w);
+	if (neb_evdp_queue_attach(q, ts) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		w->failed = 1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		w->failed = 1;
+	}
+
+exit_clean:
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(q, ts, 0) != 0)
+			fprintf(stderr, "failed to detach ts\n");
+		neb_evdp_source_del(ts);
+	}
+	if (l)
+		neb_evdp_listener_destroy(l);
+	neb_evdp_queue_destroy(q);
+	return NULL;
+}
+
+static int test_mode(int mode)
+{
+	int ret = 0;
+	int started = 0;
+	int cfds[CONN_NUM];
+	for (int i = 0; i < CONN_NUM; i++)
+		cfds[i] = -1;
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	g = neb_evdp_listener_group_create((struct sockaddr *)&addr, sizeof(addr), WORKER_NUM, mode, NULL);
+	if (!g) {
+		fprintf(stderr, "failed to create listener group\n");
+		return -1;
+	}
+
+	int amode = neb_evdp_listener_group_get_mode(g);
+	fprintf(stdout, "mode %d, actual mode %d\n", mode, amode);
+	if (mode == NEB_EVDP_LISTENER_GROUP_EXCLUSIVE && amode != NEB_EVDP_LISTENER_GROUP_EXCLUSIVE) {
+		ret = -1;
+		goto exit_clean;
+	}
+	if (amode != NEB_EVDP_LISTENER_GROUP_EXCLUSIVE &&
+	    neb_evdp_listener_group_get_fd(g, 0) == neb_evdp_listener_group_get_fd(g, 1)) {
+		fprintf(stderr, "reuseport workers should not share the socket\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_listener_group_get_fd(g, WORKER_NUM) != -1) {
+		fprintf(stderr, "out of range index should be rejected\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	socklen_t len = sizeof(addr);
+	if (getsockname(neb_evdp_listener_group_get_fd(g, 0), (struct sockaddr *)&addr, &len) == -1) {
+		perror("getsockname");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	for (int i = 0; i < WORKER_NUM; i++) {
+		memset(&workers[i], 0, sizeof(workers[i]));
+		workers[i].idx = i;
+	}
+	for (; started < WORKER_NUM; started++) {
+		if (pthread_create(&workers[started].tid, NULL, worker_run, &workers[started]) != 0) {
+			fprintf(stderr, "failed to create worker thread\n");
+			ret = -1;
+			goto exit_join;
+		}
+	}
+
+	for (int i = 0; i < CONN_NUM; i++) {
+		cfds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (cfds[i] == -1) {
+			perror("socket");
+			ret = -1;
+			goto exit_join;
+		}
+		if (connect(cfds[i], (struct sockaddr *)&addr, len) == -1) {
+			perror("connect");
+			ret = -1;
+			goto exit_join;
+		}
+	}
+
+exit_join:
+	// the workers quit after all accepted, or by timeout
+	for (int i = 0; i < started; i++)
+		pthread_join(workers[i].tid, NULL);
+
+	for (int i = 0; i < started; i++) {
+		fprintf(stdout, "worker %d accepted %d\n", i, workers[i].accepted);
+		if (workers[i].failed)
+			ret = -1;
+	}
+	if (ret == 0 && get_accepted() != CONN_NUM)
+		ret = -1;
+
+	for (int i = 0; i < CONN_NUM; i++) {
+		if (cfds[i] >= 0)
+			close(cfds[i]);
+	}
+exit_clean:
+	neb_evdp_listener_group_destroy(g);
+	g = NULL;
+	return ret;
+}
+
+int main(void)
+{
+	if (test_mode(NEB_EVDP_LISTENER_GROUP_REUSEPORT_CPU) != 0) {
+		fprintf(stderr, "reuseport cpu mode failed\n");
+		return -1;
+	}
+	if (test_mode(NEB_EVDP_LISTENER_GROUP_EXCLUSIVE) != 0) {
+		fprintf(stderr, "exclusive mode failed\n");
+		return -1;
+	}
+	return 0;
+}
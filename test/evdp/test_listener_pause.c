@@ -0,0 +1,239 @@
+
+/*
+ * The listener should pause accepting instead of busy looping when there is
+ * no fd left, and resume after fds are released. The conns claimed by the
+ * accept handler should not be touched by the listener.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/listener.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CONN_NUM 2
+#define FILL_MAX 128
+#define RELEASE_MSEC 50
+#define PAUSE_MSEC 100
+
+static int fill_fds[FILL_MAX];
+static int fill_num = 0;
+static int64_t start_msec = 0, accept_msec = 0;
+static int accept_count = 0, read_count = 0, bad_conn = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t release_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	for (int i = 0; i < fill_num; i++)
+		close(fill_fds[i]);
+	fill_num = 0;
+	return NEB_EVDP_CB_REMOVE;
+}
+
+static neb_evdp_cb_ret_t conn_hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_CLOSE;
+}
+
+static neb_evdp_cb_ret_t conn_read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char c;
+	if (read(fd, &c, 1) == 1 && c == 'x')
+		read_count++;
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CLOSE;
+}
+
+static neb_evdp_cb_ret_t accept_handler(neb_evdp_listener_t l _nattr_unused, neb_evdp_listener_conn_t *conns,
+                                        int count, void *udata _nattr_unused)
+{
+	if (!accept_msec)
+		accept_msec = neb_time_get_msec();
+	for (int i = 0; i < count; i++) {
+		neb_evdp_listener_conn_t *c = conns + i;
+		if (!c->s) {
+			bad_conn = 1;
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		if (accept_count + i == 0) { // claim the first one
+			neb_evdp_source_del(c->s);
+			close(c->fd);
+			c->s = NULL;
+			continue;
+		}
+		if (neb_evdp_source_os_fd_next_read(c->s, conn_read_handler) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+	}
+	accept_count += count;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static int64_t get_cpu_msec(void)
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == -1)
+		return 0;
+	return (int64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000 +
+	       (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int lfd = -1;
+	int cfds[CONN_NUM];
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_listener_t l = NULL;
+	neb_evdp_source_t dst = NULL, rst = NULL;
+
+	for (int i = 0; i < CONN_NUM; i++)
+		cfds[i] = -1;
+
+	// keep the fds to fill small
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+		perror("getrlimit");
+		return -1;
+	}
+	if (rl.rlim_cur > FILL_MAX) {
+		rl.rlim_cur = FILL_MAX;
+		if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+			perror("setrlimit");
+			return -1;
+		}
+	}
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd == -1) {
+		perror("socket");
+		return -1;
+	}
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(lfd, (struct sockaddr *)&addr, len) == -1 || getsockname(lfd, (struct sockaddr *)&addr, &len) == -1 ||
+	    listen(lfd, CONN_NUM) == -1 || fcntl(lfd, F_SETFL, O_NONBLOCK) == -1) {
+		perror("listen");
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < CONN_NUM; i++) {
+		cfds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (cfds[i] == -1 || connect(cfds[i], (struct sockaddr *)&addr, len) == -1 || write(cfds[i], "x", 1) != 1) {
+			perror("connect");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	l = neb_evdp_listener_create(lfd, CONN_NUM * 2, accept_handler, NULL);
+	if (!l) {
+		fprintf(stderr, "failed to create listener\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_listener_set_auto_source(l, conn_hup_handler);
+	if (neb_evdp_listener_attach(l, dq) != 0) {
+		fprintf(stderr, "failed to attach listener\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 1000, wakeup_handler);
+	if (!dst || neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	rst = neb_evdp_source_new_itimer_ms(2, RELEASE_MSEC, release_handler);
+	if (!rst || neb_evdp_queue_attach(dq, rst) != 0) {
+		fprintf(stderr, "failed to add release source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	// use up all fds
+	while (fill_num < FILL_MAX) {
+		int fd = dup(lfd);
+		if (fd == -1)
+			break;
+		fill_fds[fill_num++] = fd;
+	}
+	if (fill_num == FILL_MAX) {
+		fprintf(stderr, "failed to use up all fds\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	start_msec = neb_time_get_msec();
+	int64_t start_cpu = get_cpu_msec();
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	int64_t wall = neb_time_get_msec() - start_msec;
+	int64_t cpu = get_cpu_msec() - start_cpu;
+
+	fprintf(stdout, "accept %d after %dms, read %d, wall %dms, cpu %dms\n", accept_count,
+	        (int)(accept_msec - start_msec), read_count, (int)wall, (int)cpu);
+	if (timeout || bad_conn || accept_count != CONN_NUM || read_count != 1)
+		ret = -1;
+	else if (accept_msec - start_msec < PAUSE_MSEC - 10)
+		ret = -1;
+	else if (cpu * 2 > wall) // busy looping
+		ret = -1;
+
+exit_clean:
+	for (int i = 0; i < fill_num; i++)
+		close(fill_fds[i]);
+	if (rst) {
+		if (neb_evdp_source_get_queue(rst) && neb_evdp_queue_detach(dq, rst, 0) != 0)
+			fprintf(stderr, "failed to detach rst\n");
+		neb_evdp_source_del(rst);
+	}
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (l)
+		neb_evdp_listener_destroy(l);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	for (int i = 0; i < CONN_NUM; i++) {
+		if (cfds[i] >= 0)
+			close(cfds[i]);
+	}
+	if (lfd >= 0)
+		close(lfd);
+	return ret;
+}
@@ -0,0 +1,155 @@
+
+/*
+ * A read wait with deadline should time out if no data comes, and the rearmed
+ * one should get data written by the timeout handler before the new deadline.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define DEADLINE_MSEC 50
+
+static int sp[2] = {-1, -1};
+static int64_t armed_msec = 0;
+static int timeout_count = 0, read_count = 0, early = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char c;
+	if (read(fd, &c, 1) != 1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	read_count++;
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t deadline_handler(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_source_t s = udata;
+	timeout_count++;
+	if (neb_time_get_msec() - armed_msec < DEADLINE_MSEC)
+		early = 1;
+
+	if (write(sp[1], "x", 1) != 1) {
+		perror("write");
+		return NEB_EVDP_CB_REMOVE;
+	}
+	if (neb_evdp_source_os_fd_set_deadline(s, DEADLINE_MSEC * 2, deadline_handler) != 0 ||
+	    neb_evdp_source_os_fd_next_read(s, read_handler) != 0) {
+		fprintf(stderr, "failed to rearm read\n");
+		return NEB_EVDP_CB_REMOVE;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_source_t dst = NULL, s = NULL;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	t = neb_evdp_timer_create(16, 256);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	s = neb_evdp_source_new_os_fd(sp[0], hup_handler);
+	if (!s) {
+		fprintf(stderr, "failed to create os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_source_set_udata(s, s);
+	if (neb_evdp_source_os_fd_set_deadline(s, DEADLINE_MSEC, deadline_handler) != 0 ||
+	    neb_evdp_source_os_fd_next_read(s, read_handler) != 0) {
+		fprintf(stderr, "failed to set os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	armed_msec = neb_time_get_msec();
+	if (neb_evdp_queue_attach(dq, s) != 0) {
+		fprintf(stderr, "failed to attach os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "timeout %d, read %d, early %d\n", timeout_count, read_count, early);
+	if (timeout || early || timeout_count != 1 || read_count != 1)
+		ret = -1;
+
+exit_clean:
+	if (s) {
+		if (neb_evdp_source_get_queue(s) && neb_evdp_queue_detach(dq, s, 0) != 0)
+			fprintf(stderr, "failed to detach os_fd source\n");
+		neb_evdp_source_del(s);
+	}
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	if (sp[0] >= 0)
+		close(sp[0]);
+	if (sp[1] >= 0)
+		close(sp[1]);
+	return ret;
+}
@@ -0,0 +1,176 @@
+
+/*
+ * Error events on a read-armed fd should not cancel the deadline of the read
+ * wait, and the source should not be detached in the timeout handler.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+#include <nebase/sock/inet.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEADLINE_MSEC 100
+
+static neb_evdp_queue_t dq = NULL;
+static int64_t armed_msec = 0;
+static int error_count = 0, timeout_count = 0, early = 0, detached = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "no data should be read\n");
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t error_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	for (;;) {
+		struct neb_sock_tx_tstamp t;
+		int ret = neb_sock_inet_recv_tx_timestamp(fd, &t);
+		if (ret < 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		if (ret == 0)
+			break;
+		error_count++;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t deadline_handler(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_source_t s = udata;
+	timeout_count++;
+	if (neb_time_get_msec() - armed_msec < DEADLINE_MSEC)
+		early = 1;
+	if (neb_evdp_queue_detach(dq, s, 0) == 0)
+		detached = 1;
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_REMOVE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int rfd = -1, fd = -1;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_source_t dst = NULL, s = NULL;
+
+	struct sockaddr_in addr = NEB_STRUCT_INITIALIZER;
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	rfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	fd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	if (rfd == -1 || fd == -1 || bind(rfd, (struct sockaddr *)&addr, len) == -1 ||
+	    getsockname(rfd, (struct sockaddr *)&addr, &len) == -1 || connect(fd, (struct sockaddr *)&addr, len) == -1) {
+		perror("failed to setup udp sockets");
+		ret = -1;
+		goto exit_clean;
+	}
+	// tx timestamps make error events
+	if (neb_sock_inet_enable_timestamping(fd, NEB_SOCK_TSTAMP_TX_SOFTWARE) != 0) {
+		if (errno == ENOTSUP) {
+			fprintf(stdout, "timestamping is not supported, skip\n");
+			goto exit_clean;
+		}
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	t = neb_evdp_timer_create(16, 256);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst || neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	s = neb_evdp_source_new_os_fd(fd, hup_handler);
+	if (!s) {
+		fprintf(stderr, "failed to create os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_source_set_udata(s, s);
+	neb_evdp_source_os_fd_set_error(s, error_handler);
+	if (neb_evdp_source_os_fd_set_deadline(s, DEADLINE_MSEC, deadline_handler) != 0 ||
+	    neb_evdp_source_os_fd_next_read(s, read_handler) != 0) {
+		fprintf(stderr, "failed to set os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	armed_msec = neb_time_get_msec();
+	if (neb_evdp_queue_attach(dq, s) != 0) {
+		fprintf(stderr, "failed to attach os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (send(fd, "x", 1, 0) != 1) {
+		perror("send");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "error %d, timeout %d, early %d, detached %d\n", error_count, timeout_count, early, detached);
+	if (timeout || early || detached || error_count != 1 || timeout_count != 1 || neb_evdp_source_get_queue(s))
+		ret = -1;
+
+exit_clean:
+	if (s) {
+		if (neb_evdp_source_get_queue(s) && neb_evdp_queue_detach(dq, s, 0) != 0)
+			fprintf(stderr, "failed to detach os_fd source\n");
+		neb_evdp_source_del(s);
+	}
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	if (fd >= 0)
+		close(fd);
+	if (rfd >= 0)
+		close(rfd);
+	return ret;
+}
@@ -0,0 +1,124 @@
+
+/*
+ * An os_fd source detached after its oneshot read event fired should be able
+ * to be attached again, and get the next read event.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define ROUNDS 3
+
+static int read_count = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char c;
+	if (read(fd, &c, 1) != 1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	read_count++;
+	// not armed again, so it's disabled in the driver
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int fds[2] = {-1, -1};
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t s = NULL, dst = NULL;
+
+	// the bug was in the epoll driver
+	if (neb_evdp_driver_select("epoll") != 0)
+		fprintf(stdout, "epoll driver is not available, use %s\n", neb_evdp_driver_name());
+
+	if (pipe(fds) == -1 || fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1) {
+		perror("pipe");
+		return -1;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst || neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	s = neb_evdp_source_new_os_fd(fds[0], hup_handler);
+	if (!s) {
+		fprintf(stderr, "failed to create os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	for (int i = 0; i < ROUNDS; i++) {
+		if (neb_evdp_source_os_fd_next_read(s, read_handler) != 0 || neb_evdp_queue_attach(dq, s) != 0) {
+			fprintf(stderr, "failed to attach os_fd source at round %d\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+		if (write(fds[1], "x", 1) != 1) {
+			perror("write");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (neb_evdp_queue_run(dq) != 0) {
+			fprintf(stderr, "failed to run evdp queue at round %d\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+		if (timeout || read_count != i + 1) {
+			fprintf(stderr, "no read event at round %d\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+		if (neb_evdp_queue_detach(dq, s, 0) != 0) {
+			fprintf(stderr, "failed to detach os_fd source at round %d\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+	fprintf(stdout, "read %d times\n", read_count);
+
+exit_clean:
+	if (s) {
+		if (neb_evdp_source_get_queue(s) && neb_evdp_queue_detach(dq, s, 0) != 0)
+			fprintf(stderr, "failed to detach os_fd source\n");
+		neb_evdp_source_del(s);
+	}
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	for (int i = 0; i < 2; i++) {
+		if (fds[i] >= 0)
+			close(fds[i]);
+	}
+	return ret;
+}
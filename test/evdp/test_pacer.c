@@ -0,0 +1,150 @@
+
+/*
+ * Many pacers sharing the queue timer should never exceed burst plus rate, and
+ * should wake up at most once per token. A pacer not using all of its budget
+ * should go idle until started again.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/pacer.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PACER_NUM 1000
+#define RATE 100
+#define BURST 5
+
+static neb_evdp_pacer_t pacers[PACER_NUM];
+static unsigned int tokens[PACER_NUM];
+static int wakeups[PACER_NUM];
+static int idle_calls = 0, restarted = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static int pacer_handler(neb_evdp_pacer_t p _nattr_unused, unsigned int budget, void *udata)
+{
+	int idx = (int)(intptr_t)udata;
+	tokens[idx] += budget;
+	wakeups[idx]++;
+	return budget;
+}
+
+static int idle_handler(neb_evdp_pacer_t p _nattr_unused, unsigned int budget _nattr_unused, void *udata _nattr_unused)
+{
+	idle_calls++;
+	return 0; // nothing to send, so no wakeup until started again
+}
+
+static neb_evdp_timeout_ret_t restart_idle(void *udata)
+{
+	neb_evdp_pacer_t p = udata;
+	restarted = 1;
+	if (neb_evdp_pacer_start(p) != 0)
+		fprintf(stderr, "failed to restart idle pacer\n");
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_source_t dst = NULL;
+	neb_evdp_pacer_t idle_p = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+	t = neb_evdp_timer_create(64, 2048);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	dst = neb_evdp_source_new_itimer_ms(1, 300, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	neb_evdp_queue_update_cur_msec(dq);
+	int64_t start_msec = neb_time_get_msec();
+	for (int i = 0; i < PACER_NUM; i++) {
+		pacers[i] = neb_evdp_pacer_create(dq, RATE, BURST, pacer_handler, (void *)(intptr_t)i);
+		if (!pacers[i] || neb_evdp_pacer_start(pacers[i]) != 0) {
+			fprintf(stderr, "failed to start pacer %d\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+	idle_p = neb_evdp_pacer_create(dq, RATE, BURST, idle_handler, NULL);
+	if (!idle_p || neb_evdp_pacer_start(idle_p) != 0) {
+		fprintf(stderr, "failed to start idle pacer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (!neb_evdp_timer_new_point(t, neb_evdp_queue_get_abs_timeout(dq, 100), restart_idle, idle_p)) {
+		fprintf(stderr, "failed to add timer point\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	int64_t elapsed = neb_time_get_msec() - start_msec;
+
+	unsigned int max_tokens = BURST + (RATE * (elapsed + 1)) / 1000 + 1;
+	unsigned int min_tokens = BURST + (RATE * elapsed) / 2000;
+	unsigned int min = UINT32_MAX, max = 0;
+	for (int i = 0; i < PACER_NUM; i++) {
+		if (tokens[i] < min)
+			min = tokens[i];
+		if (tokens[i] > max)
+			max = tokens[i];
+		if (wakeups[i] > (int)tokens[i] - BURST + 1)
+			ret = -1;
+	}
+	fprintf(stdout, "elapsed %lldms, tokens %u-%u, expected %u-%u, idle calls %d\n",
+	        (long long)elapsed, min, max, min_tokens, max_tokens, idle_calls);
+	if (!timeout || min < min_tokens || max > max_tokens)
+		ret = -1;
+	if (idle_calls != 2 || !restarted)
+		ret = -1;
+
+exit_clean:
+	for (int i = 0; i < PACER_NUM; i++) {
+		if (pacers[i])
+			neb_evdp_pacer_destroy(pacers[i]);
+	}
+	if (idle_p)
+		neb_evdp_pacer_destroy(idle_p);
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	return ret;
+}
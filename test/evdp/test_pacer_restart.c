@@ -0,0 +1,105 @@
+/*
+ * A pacer started again in its own handler should keep waking up with the
+ * unused tokens, and never use more than burst plus rate.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/pacer.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define RATE 200
+#define BURST 10
+#define RUN_MSEC 200
+
+static unsigned int used_tokens = 0;
+static int calls = 0, failed = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static int pacer_handler(neb_evdp_pacer_t p, unsigned int budget _nattr_unused, void *udata _nattr_unused)
+{
+	calls++;
+	used_tokens++;
+	// one token per call, and more data is queued in the handler
+	if (neb_evdp_pacer_start(p) != 0)
+		failed = 1;
+	return 1;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_source_t dst = NULL;
+	neb_evdp_pacer_t p = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+	t = neb_evdp_timer_create(16, 64);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	dst = neb_evdp_source_new_itimer_ms(1, RUN_MSEC, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	neb_evdp_queue_update_cur_msec(dq);
+	int64_t start_msec = neb_time_get_msec();
+	p = neb_evdp_pacer_create(dq, RATE, BURST, pacer_handler, NULL);
+	if (!p || neb_evdp_pacer_start(p) != 0) {
+		fprintf(stderr, "failed to start pacer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	int64_t elapsed = neb_time_get_msec() - start_msec;
+
+	unsigned int max_tokens = BURST + (RATE * (elapsed + 1)) / 1000 + 1;
+	unsigned int min_tokens = BURST + (RATE * elapsed) / 2000;
+	fprintf(stdout, "elapsed %lldms, calls %d, tokens %u, expected %u-%u\n",
+	        (long long)elapsed, calls, used_tokens, min_tokens, max_tokens);
+	if (!timeout || failed || used_tokens < min_tokens || used_tokens > max_tokens)
+		ret = -1;
+
+exit_clean:
+	if (p)
+		neb_evdp_pacer_destroy(p);
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	return ret;
+}
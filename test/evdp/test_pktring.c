@@ -0,0 +1,166 @@
+
+/*
+ * Udp packets sent over loopback should be captured by the packet ring, with
+ * kernel timestamps, and be read in place block by block.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/pktring.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define PKT_NUM 32
+
+static const char magic[] = "nebase-pktring";
+static uint16_t dst_port = 0;
+static int captured = 0, blocks = 0, bad_pkt = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t block_handler(neb_evdp_pktblock_t *blk, void *udata _nattr_unused)
+{
+	blocks++;
+	neb_evdp_pkt_t pkt;
+	while (neb_evdp_pktblock_next(blk, &pkt)) {
+		if (pkt.protocol != ETH_P_IP || pkt.len < sizeof(struct ip))
+			continue;
+		const struct ip *iph = (const struct ip *)pkt.data;
+		if (iph->ip_p != IPPROTO_UDP)
+			continue;
+		size_t hlen = iph->ip_hl << 2;
+		if (pkt.len < hlen + sizeof(struct udphdr) + sizeof(magic))
+			continue;
+		const struct udphdr *uh = (const struct udphdr *)(pkt.data + hlen);
+		if (uh->uh_dport != dst_port)
+			continue;
+		if (memcmp(pkt.data + hlen + sizeof(struct udphdr), magic, sizeof(magic)) != 0 ||
+		    pkt.ts.tv_sec == 0 || pkt.orig_len < pkt.len) {
+			bad_pkt = 1;
+			continue;
+		}
+		captured++;
+	}
+	if (captured >= PKT_NUM)
+		thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int fd = -1;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t dst = NULL;
+	neb_evdp_pktring_t r = NULL;
+
+	struct neb_evdp_pktring_conf conf = {
+		.protocol = ETH_P_IP,
+		.ifindex = if_nametoindex("lo"),
+		.cooked = 1,
+		.block_size = 1 << 16,
+		.block_num = 4,
+	};
+	r = neb_evdp_pktring_create(&conf, block_handler, NULL);
+	if (!r) {
+		if (errno == EPERM || errno == ENOTSUP) {
+			fprintf(stdout, "packet ring is not available, skip\n");
+			return 0;
+		}
+		fprintf(stderr, "failed to create pktring\n");
+		return -1;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_pktring_attach(r, dq) != 0) {
+		fprintf(stderr, "failed to attach pktring\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		ret = -1;
+		goto exit_clean;
+	}
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	if (bind(fd, (struct sockaddr *)&addr, len) == -1 || getsockname(fd, (struct sockaddr *)&addr, &len) == -1) {
+		perror("bind");
+		ret = -1;
+		goto exit_clean;
+	}
+	dst_port = addr.sin_port;
+	for (int i = 0; i < PKT_NUM; i++) {
+		if (sendto(fd, magic, sizeof(magic), 0, (struct sockaddr *)&addr, len) != sizeof(magic)) {
+			perror("sendto");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	unsigned int packets = 0, drops = 0;
+	if (neb_evdp_pktring_get_stats(r, &packets, &drops) != 0) {
+		fprintf(stderr, "failed to get pktring stats\n");
+		ret = -1;
+	}
+	fprintf(stdout, "captured %d in %d blocks, kernel packets %u drops %u\n", captured, blocks, packets, drops);
+	if (timeout || bad_pkt || captured < PKT_NUM || blocks >= captured)
+		ret = -1;
+
+exit_clean:
+	if (fd >= 0)
+		close(fd);
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	neb_evdp_pktring_destroy(r);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	return ret;
+}
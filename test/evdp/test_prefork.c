@@ -0,0 +1,365 @@
+
+/*
+ * Prefork workers should get the listening socket and serve on their own
+ * queues, be restarted after crashed or blocked by the worker lock, with
+ * backoff for the locked ones, get the reload signal, be replaced on respawn
+ * reload, and all quit after stopped.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/listener.h>
+#include <nebase/evdp/prefork.h>
+#include <nebase/sock/common.h>
+#include <nebase/sock/tcp.h>
+#include <nebase/pidfile.h>
+#include <nebase/time.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define WORKER_NUM 2
+#define TICK_MSEC 50
+#define TICK_MAX 200
+#define LOCK_NAME "worker."
+#define LOCKED_EXITS 3
+#define BACKOFF_MIN_MSEC 100
+
+static struct sockaddr_in laddr;
+static char lock_dir[] = "/tmp/.nebase.test.preforkXXXXXX";
+static int lock_fd = -1, pid_fd = -1;
+static neb_evdp_prefork_t pf = NULL;
+static int step = 0, ticks = 0, failed = 0, timeout = 0;
+static int locked_exits = 0, killed_exits = 0, stopped_exits = 0;
+static pid_t old_pids[WORKER_NUM];
+static int64_t locked_msec[LOCKED_EXITS];
+static int backoff_short = 0;
+
+static volatile sig_atomic_t reloaded = 0;
+
+static void reload_handler(int sig _nattr_unused)
+{
+	reloaded = 1;
+}
+
+static neb_evdp_cb_ret_t accept_handler(neb_evdp_listener_t l _nattr_unused, neb_evdp_listener_conn_t *conns,
+                                        int count, void *udata _nattr_unused)
+{
+	for (int i = 0; i < count; i++) {
+		if (write(conns[i].fd, reloaded ? "r" : "w", 1) != 1)
+			perror("write");
+		close(conns[i].fd);
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t ctl_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_EXP; // the supervisor is gone
+}
+
+static int worker_main(int idx _nattr_unused, int ctl_fd, const int *fds, int fd_num, void *udata _nattr_unused)
+{
+	int ret = 0;
+	neb_evdp_queue_t q = NULL;
+	neb_evdp_listener_t l = NULL;
+	neb_evdp_source_t cs = NULL;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = reload_handler;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGHUP, &sa, NULL) == -1) {
+		perror("sigaction");
+		return 2;
+	}
+	if (fd_num != 1) {
+		fprintf(stderr, "worker got %d fds\n", fd_num);
+		return 2;
+	}
+
+	q = neb_evdp_queue_create(0);
+	if (!q)
+		return 2;
+	l = neb_evdp_listener_create(fds[0], 0, accept_handler, NULL);
+	if (!l || neb_evdp_listener_attach(l, q) != 0) {
+		ret = 2;
+		goto exit_clean;
+	}
+	cs = neb_evdp_source_new_ro_fd(ctl_fd, ctl_handler, ctl_handler);
+	if (!cs || neb_evdp_queue_attach(q, cs) != 0) {
+		ret = 2;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(q) != 0)
+		ret = 2;
+
+exit_clean:
+	if (cs) {
+		if (neb_evdp_source_get_queue(cs) && neb_evdp_queue_detach(q, cs, 0) != 0)
+			fprintf(stderr, "failed to detach ctl source\n");
+		neb_evdp_source_del(cs);
+	}
+	if (l)
+		neb_evdp_listener_destroy(l);
+	neb_evdp_queue_destroy(q);
+	return ret;
+}
+
+static void exit_handler(int idx, pid_t pid, int wstatus, void *udata _nattr_unused)
+{
+	fprintf(stdout, "worker %d (pid %d) exited with status %d\n", idx, pid, wstatus);
+	if (wstatus == -1)
+		failed = 1;
+	else if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == NEB_EVDP_PREFORK_EXIT_LOCKED) {
+		if (locked_exits < LOCKED_EXITS) {
+			locked_msec[locked_exits] = neb_time_get_msec();
+			// the worker ran a little before exited, so allow some msec
+			if (locked_exits && locked_msec[locked_exits] - locked_msec[locked_exits - 1] <
+			                    (BACKOFF_MIN_MSEC << (locked_exits - 1)) - 10)
+				backoff_short = 1;
+		}
+		locked_exits++;
+	}
+	else if (WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGKILL)
+		killed_exits++;
+	else if (WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGTERM && step == 5)
+		stopped_exits++;
+}
+
+/**
+ * \return the reply byte, or 0 if failed
+ */
+static char request(void)
+{
+	char c = 0;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		return 0;
+	}
+	if (connect(fd, (struct sockaddr *)&laddr, sizeof(laddr)) == -1) {
+		perror("connect");
+		close(fd);
+		return 0;
+	}
+	int hup = 0;
+	if (!neb_sock_timed_read_ready(fd, 2000, &hup) || read(fd, &c, 1) != 1)
+		c = 0;
+	close(fd);
+	return c;
+}
+
+static int all_replaced(void)
+{
+	for (int i = 0; i < WORKER_NUM; i++) {
+		pid_t pid = neb_evdp_prefork_get_pid(pf, i);
+		if (!pid || pid == old_pids[i])
+			return 0;
+	}
+	return 1;
+}
+
+static neb_evdp_cb_ret_t tick_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	if (++ticks > TICK_MAX) {
+		timeout = 1;
+		fprintf(stdout, "timeout occured at step %d\n", step);
+		return NEB_EVDP_CB_BREAK_EXP;
+	}
+
+	switch (step) {
+	case 0: // worker 1 is blocked by the lock, and restarted with backoff
+		if (locked_exits < LOCKED_EXITS)
+			break;
+		close(lock_fd);
+		lock_fd = -1;
+		step++;
+		break;
+	case 1: // crash worker 0
+		if (request() != 'w')
+			break;
+		old_pids[0] = neb_evdp_prefork_get_pid(pf, 0);
+		kill(old_pids[0], SIGKILL);
+		step++;
+		break;
+	case 2: // reload in place
+		if (!killed_exits || !neb_evdp_prefork_get_pid(pf, 0) || neb_evdp_prefork_get_pid(pf, 0) == old_pids[0])
+			break;
+		if (neb_evdp_prefork_reload(pf, 0) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		step++;
+		break;
+	case 3: // respawn reload
+		if (request() != 'r') {
+			fprintf(stderr, "workers are not reloaded\n");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		for (int i = 0; i < WORKER_NUM; i++)
+			old_pids[i] = neb_evdp_prefork_get_pid(pf, i);
+		if (neb_evdp_prefork_reload(pf, 1) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		step++;
+		break;
+	case 4: // stop
+		if (!all_replaced() || neb_evdp_prefork_get_running(pf) != WORKER_NUM || request() != 'w')
+			break;
+		step++;
+		if (neb_evdp_prefork_stop(pf, 0) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		break;
+	default:
+		if (!neb_evdp_prefork_get_running(pf))
+			thread_events |= T_E_QUIT;
+		break;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int fd = -1, dirfd = -1;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!mkdtemp(lock_dir)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	dirfd = open(lock_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd == -1) {
+		perror("open");
+		ret = -1;
+		goto exit_clean;
+	}
+	pid_t locker = 0;
+	pid_fd = neb_pidlock(dirfd, "supervisor.pid", &locker);
+	if (pid_fd == -1) {
+		fprintf(stderr, "failed to lock supervisor pidfile, locker %d\n", locker);
+		ret = -1;
+		goto exit_clean;
+	}
+	lock_fd = neb_pidlock(dirfd, LOCK_NAME "1", &locker);
+	if (lock_fd == -1) {
+		fprintf(stderr, "failed to lock worker 1, locker %d\n", locker);
+		ret = -1;
+		goto exit_clean;
+	}
+
+	memset(&laddr, 0, sizeof(laddr));
+	laddr.sin_family = AF_INET;
+	laddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	fd = neb_sock_tcp_listen((struct sockaddr *)&laddr, sizeof(laddr), NULL, NULL);
+	socklen_t len = sizeof(laddr);
+	if (fd == -1 || getsockname(fd, (struct sockaddr *)&laddr, &len) == -1) {
+		fprintf(stderr, "failed to listen\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	t = neb_evdp_timer_create(16, 64);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	struct neb_evdp_prefork_conf conf = {
+		.worker_num = WORKER_NUM,
+		.worker = worker_main,
+		.on_exit = exit_handler,
+		.udata = NULL,
+		.close_fd = pid_fd,
+		.lock_dirfd = dirfd,
+		.lock_name = LOCK_NAME,
+		.restart_delay_msec = TICK_MSEC,
+		.reload_signo = 0,
+	};
+	pf = neb_evdp_prefork_create(&conf);
+	if (!pf) {
+		fprintf(stderr, "failed to create prefork\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_prefork_set_fds(pf, &fd, 1) != 0 || neb_evdp_prefork_start(pf, dq) != 0) {
+		fprintf(stderr, "failed to start prefork\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, TICK_MSEC, tick_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "step %d, locked %d, killed %d, stopped %d, backoff short %d\n",
+	        step, locked_exits, killed_exits, stopped_exits, backoff_short);
+	if (timeout || failed || step != 5 || locked_exits < LOCKED_EXITS || backoff_short ||
+	    killed_exits != 1 || stopped_exits != WORKER_NUM)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (pf)
+		neb_evdp_prefork_destroy(pf);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	if (fd >= 0)
+		close(fd);
+	if (lock_fd >= 0)
+		close(lock_fd);
+	if (pid_fd >= 0)
+		neb_pidfile_close(pid_fd);
+	if (dirfd >= 0) {
+		unlinkat(dirfd, "supervisor.pid", 0);
+		for (int i = 0; i < WORKER_NUM; i++) {
+			char name[16];
+			snprintf(name, sizeof(name), LOCK_NAME "%d", i);
+			unlinkat(dirfd, name, 0);
+		}
+		close(dirfd);
+	}
+	rmdir(lock_dir);
+	return ret;
+}
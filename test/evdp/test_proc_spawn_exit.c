@@ -0,0 +1,147 @@
+
+/*
+ * Spawn some children with different exit codes, the proc source should
+ * be triggered for every child with the right exit status.
+ */
+
+#include <nebase/evdp/base.h>
+#include <nebase/proc.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define CHILD_NUM 3
+
+struct child {
+	pid_t pid;
+	int pidfd;
+	int code;
+	int exited;
+	neb_evdp_source_t s;
+};
+
+static struct child children[CHILD_NUM];
+static int exit_count = 0, status_ok = 1, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t exit_handler(pid_t pid, int wstatus, void *udata)
+{
+	struct child *c = udata;
+	fprintf(stdout, "child %d exited with status %d\n", pid, wstatus);
+	if (c->pid != pid || wstatus == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != c->code) {
+		fprintf(stderr, "child %d: unexpected exit status %d, expect code %d\n", pid, wstatus, c->code);
+		status_ok = 0;
+	}
+	c->exited = 1;
+	close(c->pidfd);
+	c->pidfd = -1;
+
+	exit_count++;
+	if (exit_count == CHILD_NUM)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CLOSE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	char *const bad_argv[] = {"/nonexistent", NULL};
+	int bad_pidfd = -1;
+	if (neb_proc_spawn(bad_argv[0], bad_argv, NULL, NULL, &bad_pidfd) != -1) {
+		fprintf(stderr, "spawn of nonexistent file should fail\n");
+		return -1;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+
+	for (int i = 0; i < CHILD_NUM; i++) {
+		struct child *c = children + i;
+		c->pidfd = -1;
+		c->code = i + 1;
+
+		char cmd[16];
+		snprintf(cmd, sizeof(cmd), "exit %d", c->code);
+		char *const argv[] = {"sh", "-c", cmd, NULL};
+
+		neb_proc_spawn_attr_t attr;
+		neb_proc_spawn_attr_init(&attr);
+		if (i % 2)
+			attr.stdout_fd = -1;
+
+		c->pid = neb_proc_spawn("/bin/sh", argv, NULL, &attr, &c->pidfd);
+		if (c->pid == -1) {
+			fprintf(stderr, "failed to spawn child %d\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+
+		c->s = neb_evdp_source_new_proc(c->pid, c->pidfd, exit_handler);
+		if (!c->s) {
+			fprintf(stderr, "failed to create proc evdp source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(c->s, c);
+		if (neb_evdp_queue_attach(dq, c->s) != 0) {
+			fprintf(stderr, "failed to attach proc source to queue\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	dst = neb_evdp_source_new_itimer_s(1, 2, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_s evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_s source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+	}
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	for (int i = 0; i < CHILD_NUM; i++) {
+		struct child *c = children + i;
+		if (c->s) {
+			if (neb_evdp_source_get_queue(c->s) && neb_evdp_queue_detach(dq, c->s, c->exited) != 0)
+				fprintf(stderr, "failed to detach proc source\n");
+			neb_evdp_source_del(c->s);
+		}
+		if (c->pidfd >= 0)
+			close(c->pidfd);
+		if (c->pid > 0 && !c->exited)
+			waitpid(c->pid, NULL, 0);
+	}
+	neb_evdp_queue_destroy(dq);
+
+	if (timeout || !status_ok || exit_count != CHILD_NUM)
+		ret = -1;
+	return ret;
+}
@@ -0,0 +1,189 @@
+
+/*
+ * Relay data between two socketpairs with a small buffer, peer a sends data
+ * and then closes the socket, the relay should still forward all the data
+ * buffered before the hup, and report done with no error after peer b
+ * shutdown its write side.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/relay.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define A2B_LEN 100000
+
+static int recv_len = 0, recv_eof = 0, bad_byte = 0;
+static int done_count = 0, done_err = -1, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t done_handler(neb_evdp_relay_t r _nattr_unused, int err, void *udata _nattr_unused)
+{
+	done_count++;
+	done_err = err;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t peer_read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char buf[4096];
+	for (;;) {
+		ssize_t nr = read(fd, buf, sizeof(buf));
+		if (nr == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			perror("read");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		if (nr == 0) {
+			recv_eof = 1;
+			if (shutdown(fd, SHUT_WR) == -1) {
+				perror("shutdown");
+				return NEB_EVDP_CB_BREAK_ERR;
+			}
+			return NEB_EVDP_CB_REMOVE;
+		}
+		for (ssize_t i = 0; i < nr; i++) {
+			if (buf[i] != 'a')
+				bad_byte = 1;
+		}
+		recv_len += nr;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t peer_hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_REMOVE;
+}
+
+static void peer_a_send(int fd)
+{
+	char buf[1000];
+	memset(buf, 'a', sizeof(buf));
+	for (int left = A2B_LEN; left > 0; left -= sizeof(buf)) {
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror("write");
+			_exit(1);
+		}
+	}
+	close(fd);
+	_exit(0);
+}
+
+int main(void)
+{
+	int sa[2], sb[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sa) == -1 || socketpair(AF_UNIX, SOCK_STREAM, 0, sb) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+	if (fcntl(sa[1], F_SETFL, O_NONBLOCK) == -1 || fcntl(sb[0], F_SETFL, O_NONBLOCK) == -1 ||
+	    fcntl(sb[1], F_SETFL, O_NONBLOCK) == -1) {
+		perror("fcntl");
+		return -1;
+	}
+
+	pid_t cpid = fork();
+	if (cpid == -1) {
+		perror("fork");
+		return -1;
+	}
+	if (cpid == 0) {
+		close(sa[1]);
+		close(sb[0]);
+		close(sb[1]);
+		peer_a_send(sa[0]);
+	}
+	close(sa[0]); // so the child is the only peer a
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_relay_t r = NULL;
+	neb_evdp_source_t dst = NULL, ps = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	r = neb_evdp_relay_create(sa[1], sb[0], 4096, done_handler, NULL);
+	if (!r) {
+		fprintf(stderr, "failed to create relay\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_relay_attach(r, dq) != 0) {
+		fprintf(stderr, "failed to attach relay\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	ps = neb_evdp_source_new_ro_fd(sb[1], peer_read_handler, peer_hup_handler);
+	if (!ps || neb_evdp_queue_attach(dq, ps) != 0) {
+		fprintf(stderr, "failed to add peer b source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 1000, wakeup_handler);
+	if (!dst || neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	unsigned long long a2b = neb_evdp_relay_get_bytes(r, NEB_EVDP_RELAY_A2B);
+	fprintf(stdout, "done %d times with err %d, a2b %llu bytes, peer b got %d bytes, eof %d\n",
+	        done_count, done_err, a2b, recv_len, recv_eof);
+	if (timeout || done_count != 1 || done_err != 0 || a2b != A2B_LEN ||
+	    recv_len != A2B_LEN || !recv_eof || bad_byte)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (ps) {
+		if (neb_evdp_source_get_queue(ps) && neb_evdp_queue_detach(dq, ps, 0) != 0)
+			fprintf(stderr, "failed to detach ps\n");
+		neb_evdp_source_del(ps);
+	}
+	if (r)
+		neb_evdp_relay_destroy(r);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	close(sa[1]);
+	close(sb[0]);
+	close(sb[1]);
+
+	int wstatus = 0;
+	if (waitpid(cpid, &wstatus, 0) == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+		fprintf(stderr, "peer a failed to send\n");
+		ret = -1;
+	}
+	return ret;
+}
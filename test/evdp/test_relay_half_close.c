@@ -0,0 +1,167 @@
+
+/*
+ * Relay data between two socketpairs with a small buffer, both peers shutdown
+ * their write side after sending, the relay should forward all data, shutdown
+ * the write side of the other end, and then report done with no error.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/relay.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define A2B_LEN (32 * 1024)
+#define B2A_LEN (16 * 1024)
+
+static int done_count = 0, done_err = -1, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t done_handler(neb_evdp_relay_t r _nattr_unused, int err, void *udata _nattr_unused)
+{
+	done_count++;
+	done_err = err;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static int send_all(int fd, char c, int len)
+{
+	char buf[1024];
+	memset(buf, c, sizeof(buf));
+	for (int left = len; left > 0; left -= sizeof(buf)) {
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror("write");
+			return -1;
+		}
+	}
+	if (shutdown(fd, SHUT_WR) == -1) {
+		perror("shutdown");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * \return -1 if the data is not the same, or not end with EOF
+ */
+static int recv_all(int fd, char c, int len)
+{
+	char buf[1024];
+	int total = 0;
+	for (;;) {
+		ssize_t nr = read(fd, buf, sizeof(buf));
+		if (nr == -1) {
+			perror("read");
+			return -1;
+		}
+		if (nr == 0)
+			break;
+		for (ssize_t i = 0; i < nr; i++) {
+			if (buf[i] != c) {
+				fprintf(stderr, "bad byte at %d\n", total + (int)i);
+				return -1;
+			}
+		}
+		total += nr;
+	}
+	if (total != len) {
+		fprintf(stderr, "got %d bytes, expect %d\n", total, len);
+		return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int sa[2], sb[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sa) == -1 || socketpair(AF_UNIX, SOCK_STREAM, 0, sb) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+	if (fcntl(sa[1], F_SETFL, O_NONBLOCK) == -1 || fcntl(sb[0], F_SETFL, O_NONBLOCK) == -1) {
+		perror("fcntl");
+		return -1;
+	}
+
+	if (send_all(sa[0], 'a', A2B_LEN) != 0 || send_all(sb[1], 'b', B2A_LEN) != 0)
+		return -1;
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_relay_t r = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	r = neb_evdp_relay_create(sa[1], sb[0], 4096, done_handler, NULL);
+	if (!r) {
+		fprintf(stderr, "failed to create relay\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_relay_attach(r, dq) != 0) {
+		fprintf(stderr, "failed to attach relay\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	unsigned long long a2b = neb_evdp_relay_get_bytes(r, NEB_EVDP_RELAY_A2B);
+	unsigned long long b2a = neb_evdp_relay_get_bytes(r, NEB_EVDP_RELAY_B2A);
+	fprintf(stdout, "done %d times with err %d, a2b %llu bytes, b2a %llu bytes\n", done_count, done_err, a2b, b2a);
+	if (timeout || done_count != 1 || done_err != 0 || a2b != A2B_LEN || b2a != B2A_LEN) {
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (recv_all(sb[1], 'a', A2B_LEN) != 0 || recv_all(sa[0], 'b', B2A_LEN) != 0)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (r)
+		neb_evdp_relay_destroy(r);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	for (int i = 0; i < 2; i++) {
+		close(sa[i]);
+		close(sb[i]);
+	}
+	return ret;
+}
@@ -0,0 +1,178 @@
+
+/*
+ * Sources detached by another handler in the same batch should not get their
+ * already harvested events, even if the slot is reused by a new source, and
+ * find_fd should follow attach and detach.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define PAIR_NUM 8
+
+static int fds[PAIR_NUM][2];
+static neb_evdp_source_t ss[PAIR_NUM];
+static neb_evdp_queue_t dq = NULL;
+static int first_count = 0, stale_count = 0, new_count = 0, bad_find = 0, timeout = 0;
+static neb_evdp_source_t new_s = NULL;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t new_read_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	new_count++;
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_REMOVE;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	int idx = (int)(intptr_t)udata;
+	if (first_count) {
+		stale_count++;
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	first_count++;
+
+	// remove all others, whose events are already fetched
+	for (int i = 0; i < PAIR_NUM; i++) {
+		if (i == idx)
+			continue;
+		if (neb_evdp_queue_detach(dq, ss[i], 0) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		neb_evdp_source_del(ss[i]);
+		ss[i] = NULL;
+		if (neb_evdp_queue_find_fd(dq, fds[i][0]))
+			bad_find = 1;
+	}
+
+	// reuse one slot, the new source should only get new events
+	int ridx = (idx + 1) % PAIR_NUM;
+	new_s = neb_evdp_source_new_os_fd(fds[ridx][0], hup_handler);
+	if (!new_s)
+		return NEB_EVDP_CB_BREAK_ERR;
+	if (neb_evdp_source_os_fd_next_read(new_s, new_read_handler) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	if (neb_evdp_queue_attach(dq, new_s) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	if (neb_evdp_queue_find_fd(dq, fds[ridx][0]) != new_s)
+		bad_find = 1;
+
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_source_t dst = NULL;
+
+	for (int i = 0; i < PAIR_NUM; i++) {
+		fds[i][0] = -1;
+		fds[i][1] = -1;
+		ss[i] = NULL;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+
+	for (int i = 0; i < PAIR_NUM; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]) == -1) {
+			perror("socketpair");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (write(fds[i][1], "x", 1) != 1) {
+			perror("write");
+			ret = -1;
+			goto exit_clean;
+		}
+		ss[i] = neb_evdp_source_new_os_fd(fds[i][0], hup_handler);
+		if (!ss[i]) {
+			fprintf(stderr, "failed to create os_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(ss[i], (void *)(intptr_t)i);
+		if (neb_evdp_source_os_fd_next_read(ss[i], read_handler) != 0 || neb_evdp_queue_attach(dq, ss[i]) != 0) {
+			fprintf(stderr, "failed to attach os_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (neb_evdp_queue_find_fd(dq, fds[i][0]) != ss[i]) {
+			fprintf(stderr, "failed to find source by fd\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "first %d, stale %d, new %d\n", first_count, stale_count, new_count);
+	if (timeout || bad_find || first_count != 1 || stale_count != 0 || new_count != 1)
+		ret = -1;
+	if (neb_evdp_queue_find_fd(dq, -1) || neb_evdp_queue_find_fd(dq, 65536))
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (new_s) {
+		if (neb_evdp_source_get_queue(new_s) && neb_evdp_queue_detach(dq, new_s, 0) != 0)
+			fprintf(stderr, "failed to detach new source\n");
+		neb_evdp_source_del(new_s);
+	}
+	for (int i = 0; i < PAIR_NUM; i++) {
+		if (ss[i]) {
+			if (neb_evdp_source_get_queue(ss[i]) && neb_evdp_queue_detach(dq, ss[i], 0) != 0)
+				fprintf(stderr, "failed to detach source %d\n", i);
+			neb_evdp_source_del(ss[i]);
+		}
+	}
+	neb_evdp_queue_destroy(dq);
+	for (int i = 0; i < PAIR_NUM; i++) {
+		if (fds[i][0] >= 0)
+			close(fds[i][0]);
+		if (fds[i][1] >= 0)
+			close(fds[i][1]);
+	}
+	return ret;
+}
@@ -0,0 +1,160 @@
+
+/*
+ * The peer sends a lot of small messages, the stream should parse them with
+ * partial messages kept in read buffer, and the replies should be coalesced
+ * with read paused when the write queue is above the high watermark.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/stream.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define MSG_NUM 100
+#define MSG_LEN 5
+static const char ping_msg[MSG_LEN] = "ping\n";
+static const char pong_msg[MSG_LEN] = "pong\n";
+
+static int msg_count = 0, wq_low_count = 0, bad_msg = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t read_handler(neb_evdp_stream_t st, const char *data, size_t len, size_t *consumed, void *udata _nattr_unused)
+{
+	size_t off = 0;
+	for (; off + MSG_LEN <= len; off += MSG_LEN) {
+		if (memcmp(data + off, ping_msg, MSG_LEN) != 0) {
+			bad_msg = 1;
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		msg_count++;
+		if (neb_evdp_stream_write(st, pong_msg, MSG_LEN) < 0) {
+			fprintf(stderr, "failed to write to stream\n");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+	}
+	*consumed = off;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t event_handler(neb_evdp_stream_t st _nattr_unused, int event, int err, void *udata _nattr_unused)
+{
+	switch (event) {
+	case NEB_EVDP_STREAM_EV_WQ_LOW:
+		wq_low_count++;
+		return NEB_EVDP_CB_CONTINUE;
+	default:
+		fprintf(stderr, "unexpected stream event %d, err %d\n", event, err);
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+}
+
+int main(void)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		if (fcntl(sv[i], F_SETFL, O_NONBLOCK) == -1) {
+			perror("fcntl");
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < MSG_NUM; i++) {
+		if (write(sv[1], ping_msg, MSG_LEN) != MSG_LEN) {
+			perror("write");
+			return -1;
+		}
+	}
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_stream_t st = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	neb_evdp_stream_conf_t conf;
+	neb_evdp_stream_conf_init(&conf);
+	conf.rbuf_size = 64; // not a multiple of MSG_LEN
+	conf.rbuf_max_size = 128;
+	conf.chunk_size = 32;
+	conf.wq_high = 64;
+	conf.wq_low = 16;
+	st = neb_evdp_stream_create(sv[0], &conf, read_handler, event_handler, NULL);
+	if (!st) {
+		fprintf(stderr, "failed to create stream\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_stream_attach(st, dq) != 0) {
+		fprintf(stderr, "failed to attach stream\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 200, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	char rbuf[MSG_NUM * MSG_LEN + 1];
+	ssize_t nr = read(sv[1], rbuf, sizeof(rbuf));
+	fprintf(stdout, "got %d msgs, %d wq_low events, %lld bytes replied\n", msg_count, wq_low_count, (long long)nr);
+	if (bad_msg || msg_count != MSG_NUM || !wq_low_count || nr != MSG_NUM * MSG_LEN) {
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < MSG_NUM; i++) {
+		if (memcmp(rbuf + i * MSG_LEN, pong_msg, MSG_LEN) != 0) {
+			fprintf(stderr, "bad reply msg %d\n", i);
+			ret = -1;
+			break;
+		}
+	}
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (st)
+		neb_evdp_stream_destroy(st);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	close(sv[0]);
+	close(sv[1]);
+	return ret;
+}
@@ -0,0 +1,251 @@
+
+/*
+ * Large buffers written by write_zc, mixed with small copied writes, should
+ * arrive in order over tcp, and each buffer should be released exactly once,
+ * whether the kernel sends it by zerocopy or falls back to copy.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/stream.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BUF_NUM 4
+#define BUF_SIZE (256 * 1024)
+#define HDR_SIZE 4
+#define TOTAL_SIZE (BUF_NUM * (HDR_SIZE + BUF_SIZE))
+
+static char *bufs[BUF_NUM];
+static char *expected = NULL;
+static size_t received = 0;
+static int done_count[BUF_NUM];
+static int done_total = 0, bad_done = 0, bad_data = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static void check_finished(void)
+{
+	if (received == TOTAL_SIZE && done_total == BUF_NUM)
+		thread_events |= T_E_QUIT;
+}
+
+static void zc_done(neb_evdp_stream_t st _nattr_unused, const void *data, size_t len, void *udata)
+{
+	int idx = (int)(intptr_t)udata;
+	if (data != bufs[idx] || len != BUF_SIZE || done_count[idx])
+		bad_done = 1;
+	done_count[idx]++;
+	done_total++;
+	check_finished();
+}
+
+static neb_evdp_cb_ret_t stream_read_handler(neb_evdp_stream_t st _nattr_unused, const char *data _nattr_unused, size_t len,
+                                             size_t *consumed, void *udata _nattr_unused)
+{
+	*consumed = len;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t stream_event_handler(neb_evdp_stream_t st _nattr_unused, int event, int err, void *udata _nattr_unused)
+{
+	if (event == NEB_EVDP_STREAM_EV_WQ_LOW)
+		return NEB_EVDP_CB_CONTINUE;
+	fprintf(stderr, "unexpected stream event %d, err %d\n", event, err);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t peer_read_handler(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_source_t s = udata;
+	char buf[65536];
+	ssize_t nr = read(fd, buf, sizeof(buf));
+	if (nr <= 0) {
+		if (nr == -1 && errno == EAGAIN)
+			goto rearm;
+		fprintf(stderr, "failed to read from peer\n");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	if (received + nr > TOTAL_SIZE || memcmp(buf, expected + received, nr) != 0) {
+		bad_data = 1;
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	received += nr;
+	check_finished();
+	if (received == TOTAL_SIZE)
+		return NEB_EVDP_CB_CONTINUE;
+rearm:
+	if (neb_evdp_source_os_fd_next_read(s, peer_read_handler) != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int lfd = -1, cfd = -1, afd = -1;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_stream_t st = NULL;
+	neb_evdp_source_t dst = NULL, ps = NULL;
+
+	expected = malloc(TOTAL_SIZE);
+	if (!expected) {
+		perror("malloc");
+		return -1;
+	}
+	for (int i = 0; i < BUF_NUM; i++) {
+		bufs[i] = malloc(BUF_SIZE);
+		if (!bufs[i]) {
+			perror("malloc");
+			ret = -1;
+			goto exit_clean;
+		}
+		for (int j = 0; j < BUF_SIZE; j++)
+			bufs[i][j] = (char)((i + j) % 251);
+		char *p = expected + i * (HDR_SIZE + BUF_SIZE);
+		snprintf(p, HDR_SIZE, "zc%d", i);
+		p[HDR_SIZE - 1] = '\n';
+		memcpy(p + HDR_SIZE, bufs[i], BUF_SIZE);
+	}
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd == -1 || bind(lfd, (struct sockaddr *)&addr, len) == -1 ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len) == -1 || listen(lfd, 1) == -1) {
+		perror("listen");
+		ret = -1;
+		goto exit_clean;
+	}
+	cfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (cfd == -1 || connect(cfd, (struct sockaddr *)&addr, len) == -1) {
+		perror("connect");
+		ret = -1;
+		goto exit_clean;
+	}
+	afd = accept(lfd, NULL, NULL);
+	if (afd == -1) {
+		perror("accept");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (fcntl(afd, F_SETFL, O_NONBLOCK) == -1 || fcntl(cfd, F_SETFL, O_NONBLOCK) == -1) {
+		perror("fcntl");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	st = neb_evdp_stream_create(afd, NULL, stream_read_handler, stream_event_handler, NULL);
+	if (!st) {
+		fprintf(stderr, "failed to create stream\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_stream_enable_zerocopy(st) != 0)
+		fprintf(stdout, "zerocopy is not supported, test with copy\n");
+	if (neb_evdp_stream_attach(st, dq) != 0) {
+		fprintf(stderr, "failed to attach stream\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < BUF_NUM; i++) {
+		if (neb_evdp_stream_write(st, expected + i * (HDR_SIZE + BUF_SIZE), HDR_SIZE) < 0 ||
+		    neb_evdp_stream_write_zc(st, bufs[i], BUF_SIZE, zc_done, (void *)(intptr_t)i) < 0) {
+			fprintf(stderr, "failed to write to stream\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	ps = neb_evdp_source_new_os_fd(cfd, hup_handler);
+	if (!ps) {
+		fprintf(stderr, "failed to create os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_source_set_udata(ps, ps);
+	if (neb_evdp_source_os_fd_next_read(ps, peer_read_handler) != 0 || neb_evdp_queue_attach(dq, ps) != 0) {
+		fprintf(stderr, "failed to attach os_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "received %zu/%d bytes, %d buffers released\n", received, TOTAL_SIZE, done_total);
+	if (timeout || bad_done || bad_data || received != TOTAL_SIZE || done_total != BUF_NUM)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (ps) {
+		if (neb_evdp_source_get_queue(ps) && neb_evdp_queue_detach(dq, ps, 0) != 0)
+			fprintf(stderr, "failed to detach os_fd source\n");
+		neb_evdp_source_del(ps);
+	}
+	if (st)
+		neb_evdp_stream_destroy(st);
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (afd >= 0)
+		close(afd);
+	if (cfd >= 0)
+		close(cfd);
+	if (lfd >= 0)
+		close(lfd);
+	for (int i = 0; i < BUF_NUM; i++)
+		free(bufs[i]);
+	free(expected);
+	return ret;
+}
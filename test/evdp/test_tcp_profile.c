@@ -0,0 +1,206 @@
+
+/*
+ * Listeners and connectors created with tcp profiles should report the
+ * accepted options, and connect and transfer data with evdp, even with
+ * fastopen and defer accept enabled.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/evdp/listener.h>
+#include <nebase/evdp/connect.h>
+#include <nebase/sock/tcp.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static int cfd = -1;
+static int connected = 0, accepted = 0, got_data = 0, nodelay_inherited = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+static neb_evdp_cb_ret_t conn_hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_CLOSE;
+}
+
+static neb_evdp_cb_ret_t conn_read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char buf[8];
+	if (read(fd, buf, sizeof(buf)) == 5 && memcmp(buf, "hello", 5) == 0)
+		got_data = 1;
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CLOSE;
+}
+
+static neb_evdp_cb_ret_t accept_handler(neb_evdp_listener_t l _nattr_unused, neb_evdp_listener_conn_t *conns,
+                                        int count, void *udata _nattr_unused)
+{
+	for (int i = 0; i < count; i++) {
+		int val = 0;
+		socklen_t len = sizeof(val);
+		if (getsockopt(conns[i].fd, IPPROTO_TCP, TCP_NODELAY, &val, &len) == 0 && val)
+			nodelay_inherited = 1;
+		if (neb_evdp_source_os_fd_next_read(conns[i].s, conn_read_handler) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+	}
+	accepted += count;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static void connect_handler(int fd, int err, void *udata _nattr_unused)
+{
+	if (fd < 0) {
+		fprintf(stderr, "connect failed: %s\n", strerror(err));
+		thread_events |= T_E_QUIT;
+		return;
+	}
+	connected = 1;
+	cfd = fd;
+	if (write(fd, "hello", 5) != 5) {
+		perror("write");
+		thread_events |= T_E_QUIT;
+	}
+}
+
+int main(void)
+{
+	int ret = 0;
+	int lfd = -1;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_listener_t l = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	struct neb_sock_tcp_profile p;
+	neb_sock_tcp_profile_init(&p, NEB_SOCK_TCP_PROFILE_LATENCY);
+	p.opts &= ~NEB_SOCK_TCP_OPT_BUSY_POLL; // may need privilege
+
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	unsigned int applied = 0;
+	lfd = neb_sock_tcp_listen((struct sockaddr *)&addr, sizeof(addr), &p, &applied);
+	if (lfd == -1) {
+		fprintf(stderr, "failed to listen\n");
+		return -1;
+	}
+	fprintf(stdout, "listener options: %#x/%#x\n", applied, p.opts);
+	unsigned int required = NEB_SOCK_TCP_OPT_REUSEADDR | NEB_SOCK_TCP_OPT_NODELAY;
+	if ((applied & required) != required || (applied & ~p.opts)) {
+		fprintf(stderr, "unexpected listener options\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	socklen_t len = sizeof(addr);
+	if (getsockname(lfd, (struct sockaddr *)&addr, &len) == -1) {
+		perror("getsockname");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	t = neb_evdp_timer_create(16, 64);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	l = neb_evdp_listener_create(lfd, 0, accept_handler, NULL);
+	if (!l) {
+		fprintf(stderr, "failed to create listener\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_listener_set_auto_source(l, conn_hup_handler);
+	if (neb_evdp_listener_attach(l, dq) != 0) {
+		fprintf(stderr, "failed to attach listener\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst) {
+		fprintf(stderr, "failed to create itimer_ms evdp source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	int fd = neb_sock_tcp_new_connector(AF_INET, &p, &applied);
+	if (fd == -1) {
+		fprintf(stderr, "failed to create connector\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	fprintf(stdout, "connector options: %#x/%#x\n", applied, p.opts);
+	if (!(applied & NEB_SOCK_TCP_OPT_NODELAY) || (applied & (NEB_SOCK_TCP_OPT_DEFER_ACCEPT | NEB_SOCK_TCP_OPT_REUSEADDR))) {
+		fprintf(stderr, "unexpected connector options\n");
+		close(fd);
+		ret = -1;
+		goto exit_clean;
+	}
+	if (!neb_evdp_connect_fd(dq, fd, (struct sockaddr *)&addr, sizeof(addr), 1000, connect_handler, NULL)) {
+		fprintf(stderr, "failed to start connect\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "connected %d, accepted %d, data %d, nodelay inherited %d\n",
+	        connected, accepted, got_data, nodelay_inherited);
+	if (timeout || !connected || accepted != 1 || !got_data)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (l) {
+		neb_evdp_listener_detach(l);
+		neb_evdp_listener_destroy(l);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	if (cfd >= 0)
+		close(cfd);
+	if (lfd >= 0)
+		close(lfd);
+	return ret;
+}
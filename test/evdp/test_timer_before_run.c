@@ -0,0 +1,94 @@
+
+/*
+ * A timer point armed with the queue abs timeout before the first run should
+ * fire after the timeout, neither at once nor much later.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/time.h>
+#include <nebase/evdp/base.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define TIMEOUT_MSEC 200
+
+static int64_t fired_msec = 0;
+
+static neb_evdp_timeout_ret_t timer_cb(void *udata _nattr_unused)
+{
+	fired_msec = neb_time_get_msec();
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_timer_t t = NULL;
+	neb_evdp_source_t dst = NULL;
+
+	// the msec time is counted from the first call, so let it pass for a while
+	neb_time_get_msec();
+	usleep(TIMEOUT_MSEC * 2 * 1000);
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+	t = neb_evdp_timer_create(1, 1);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(dq, t);
+
+	dst = neb_evdp_source_new_itimer_ms(1, TIMEOUT_MSEC * 5, wakeup_handler);
+	if (!dst || neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	int64_t abs_msec = neb_evdp_queue_get_abs_timeout(dq, TIMEOUT_MSEC);
+	int64_t armed_msec = neb_time_get_msec();
+	neb_evdp_timer_point tp = neb_evdp_timer_new_point(t, abs_msec, timer_cb, NULL);
+	if (!tp) {
+		fprintf(stderr, "failed to add timer point\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "armed at %lldms for %lldms, fired at %lldms\n",
+	        (long long)armed_msec, (long long)abs_msec, (long long)fired_msec);
+	if (abs_msec <= armed_msec || !fired_msec || fired_msec < abs_msec || fired_msec - abs_msec > TIMEOUT_MSEC)
+		ret = -1;
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	neb_evdp_queue_destroy(dq);
+	if (t)
+		neb_evdp_timer_destroy(t);
+	return ret;
+}
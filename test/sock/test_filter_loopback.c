@@ -0,0 +1,244 @@
+
+/*
+ * Socket filters should drop the unwanted udp datagrams and icmp packets in
+ * the kernel, i.e. from other ports, or echo replies for other identifiers.
+ */
+
+#include <nebase/sock/filter.h>
+#include <nebase/sock/inet.h>
+#include <nebase/sock/raw.h>
+#include <nebase/sock/csum.h>
+#include <nebase/endian.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <arpa/inet.h>
+
+#define MSG_NUM 8
+#define ICMP_ID_WANTED 0x1234
+#define ICMP_ID_OTHER 0x4321
+
+static struct in_addr loopback_addr = {.s_addr = neb_const_htobe32(INADDR_LOOPBACK)};
+
+static int udp_bind_loopback(int fd, struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr = loopback_addr;
+	if (bind(fd, (struct sockaddr *)addr, len) == -1 || getsockname(fd, (struct sockaddr *)addr, &len) == -1) {
+		perror("bind");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * \return number of packets received until idle
+ */
+static int drain(int fd, u_char *buf, size_t len, int (*check)(const u_char *, ssize_t))
+{
+	int count = 0;
+	for (;;) {
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+		if (poll(&pfd, 1, 100) != 1)
+			break;
+		ssize_t nr = recv(fd, buf, len, MSG_DONTWAIT);
+		if (nr == -1) {
+			if (errno == EAGAIN)
+				continue;
+			perror("recv");
+			return -1;
+		}
+		if (check(buf, nr) != 0)
+			return -1;
+		count++;
+	}
+	return count;
+}
+
+static int check_udp(const u_char *buf, ssize_t len)
+{
+	if (len != 1 || buf[0] != 'a') {
+		fprintf(stderr, "unexpected udp datagram\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int test_udp(void)
+{
+	int ret = 0;
+	int sfd = -1, afd = -1, bfd = -1;
+	neb_sock_filter_t f = NULL;
+
+	sfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	afd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	bfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	if (sfd == -1 || afd == -1 || bfd == -1) {
+		fprintf(stderr, "failed to create udp sockets\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	struct sockaddr_in saddr, aaddr, baddr;
+	if (udp_bind_loopback(sfd, &saddr) != 0 || udp_bind_loopback(afd, &aaddr) != 0 || udp_bind_loopback(bfd, &baddr) != 0) {
+		ret = -1;
+		goto exit_clean;
+	}
+
+	f = neb_sock_filter_create(AF_INET);
+	if (!f) {
+		fprintf(stderr, "failed to create filter\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_sock_filter_ip_proto(f, IPPROTO_UDP) != 0 || neb_sock_filter_ip4_src(f, &loopback_addr) != 0 ||
+	    neb_sock_filter_src_port(f, ntohs(aaddr.sin_port)) != 0 ||
+	    neb_sock_filter_dst_port(f, ntohs(saddr.sin_port)) != 0) {
+		fprintf(stderr, "failed to build filter\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_sock_filter_attach(f, sfd) != 0) {
+		fprintf(stderr, "failed to attach filter\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	for (int i = 0; i < MSG_NUM; i++) {
+		if (sendto(afd, "a", 1, 0, (struct sockaddr *)&saddr, sizeof(saddr)) != 1 ||
+		    sendto(bfd, "b", 1, 0, (struct sockaddr *)&saddr, sizeof(saddr)) != 1) {
+			perror("sendto");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	u_char buf[16];
+	int count = drain(sfd, buf, sizeof(buf), check_udp);
+	fprintf(stdout, "udp: received %d\n", count);
+	if (count != MSG_NUM)
+		ret = -1;
+
+	// all should be received after detached
+	if (neb_sock_filter_detach(sfd) != 0) {
+		fprintf(stderr, "failed to detach filter\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (sendto(bfd, "a", 1, 0, (struct sockaddr *)&saddr, sizeof(saddr)) != 1) {
+		perror("sendto");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (drain(sfd, buf, sizeof(buf), check_udp) != 1)
+		ret = -1;
+
+exit_clean:
+	if (f)
+		neb_sock_filter_destroy(f);
+	if (sfd >= 0)
+		close(sfd);
+	if (afd >= 0)
+		close(afd);
+	if (bfd >= 0)
+		close(bfd);
+	return ret;
+}
+
+static int check_icmp(const u_char *buf, ssize_t len)
+{
+	const struct ip *iph = (const struct ip *)buf;
+	size_t hlen = iph->ip_hl << 2;
+	if ((size_t)len < hlen + ICMP_MINLEN) {
+		fprintf(stderr, "invalid icmp packet\n");
+		return -1;
+	}
+	const struct icmp *ih = (const struct icmp *)(buf + hlen);
+	if (ih->icmp_type != ICMP_ECHOREPLY || ih->icmp_id != htons(ICMP_ID_WANTED)) {
+		fprintf(stderr, "unexpected icmp packet, type %u id %u\n", ih->icmp_type, ntohs(ih->icmp_id));
+		return -1;
+	}
+	return 0;
+}
+
+static int test_icmp(void)
+{
+	int ret = 0;
+	neb_sock_filter_t f = NULL;
+
+	int fd = neb_sock_raw_icmp4_new();
+	if (fd == -1) {
+		if (errno == EPERM) {
+			fprintf(stdout, "icmp: no permission, skip\n");
+			return 0;
+		}
+		fprintf(stderr, "failed to create icmp socket\n");
+		return -1;
+	}
+
+	f = neb_sock_filter_create(AF_INET);
+	if (!f) {
+		fprintf(stderr, "failed to create filter\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_sock_filter_ip_proto(f, IPPROTO_ICMP) != 0 || neb_sock_filter_icmp_type(f, ICMP_ECHOREPLY) != 0 ||
+	    neb_sock_filter_icmp_id(f, htons(ICMP_ID_WANTED)) != 0) {
+		fprintf(stderr, "failed to build filter\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_sock_filter_attach(f, fd) != 0) {
+		fprintf(stderr, "failed to attach filter\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	for (int i = 0; i < MSG_NUM; i++) {
+		u_char pkt[64] = NEB_STRUCT_INITIALIZER;
+		struct icmp *ih = (struct icmp *)pkt;
+		ih->icmp_type = ICMP_ECHO;
+		ih->icmp_code = 0;
+		ih->icmp_id = htons(i % 2 ? ICMP_ID_OTHER : ICMP_ID_WANTED);
+		ih->icmp_seq = htons(i);
+		neb_sock_csum_icmp4_fill(ih, sizeof(pkt));
+		if (neb_sock_raw_icmp4_send(fd, pkt, sizeof(pkt), &loopback_addr, NULL) != sizeof(pkt)) {
+			fprintf(stderr, "failed to send icmp echo\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	u_char buf[256];
+	int count = drain(fd, buf, sizeof(buf), check_icmp);
+	fprintf(stdout, "icmp: received %d\n", count);
+	if (count != MSG_NUM / 2)
+		ret = -1;
+
+exit_clean:
+	if (f)
+		neb_sock_filter_destroy(f);
+	close(fd);
+	return ret;
+}
+
+int main(void)
+{
+	int ret = 0;
+	if (test_udp() != 0) {
+		fprintf(stderr, "udp test failed\n");
+		ret = -1;
+	}
+	if (test_icmp() != 0) {
+		fprintf(stderr, "icmp test failed\n");
+		ret = -1;
+	}
+	return ret;
+}
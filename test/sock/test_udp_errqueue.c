@@ -0,0 +1,115 @@
+
+/*
+ * With both tx timestamping and zerocopy enabled, all the messages in the
+ * error queue should be got by the shared reader, so none of the zerocopy
+ * notifications are lost to the tx timestamp reader, and vice versa.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/sock/inet.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_NUM 8
+
+#if !defined(MSG_ZEROCOPY)
+# define MSG_ZEROCOPY 0 // not used, as zerocopy can not be enabled
+#endif
+
+int main(void)
+{
+	int ret = 0;
+	int sfd = -1, cfd = -1;
+	int tstamp_count = 0, zc_count = 0, other_count = 0;
+	uint32_t zc_next = 0;
+
+	struct sockaddr_in addr = NEB_STRUCT_INITIALIZER;
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	sfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	cfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	if (sfd == -1 || cfd == -1 || bind(sfd, (struct sockaddr *)&addr, len) == -1 ||
+	    getsockname(sfd, (struct sockaddr *)&addr, &len) == -1 || connect(cfd, (struct sockaddr *)&addr, len) == -1) {
+		perror("failed to setup udp sockets");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_sock_inet_enable_timestamping(cfd, NEB_SOCK_TSTAMP_TX_SOFTWARE) != 0 ||
+	    neb_sock_inet_enable_zerocopy(cfd) != 0) {
+		if (errno == ENOTSUP || errno == ENOPROTOOPT) {
+			fprintf(stdout, "timestamping or zerocopy is not supported, skip\n");
+			goto exit_clean;
+		}
+		fprintf(stderr, "failed to enable timestamping and zerocopy\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	static const char data[MSG_NUM] = "01234567";
+	for (int i = 0; i < MSG_NUM; i++) {
+		if (send(cfd, data + i, 1, MSG_ZEROCOPY) != 1) {
+			perror("send");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	while (tstamp_count < MSG_NUM || zc_next < MSG_NUM) {
+		struct pollfd pfd = {.fd = cfd, .events = 0};
+		if (poll(&pfd, 1, 500) != 1) {
+			fprintf(stderr, "timeout to wait error events\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		for (;;) {
+			struct neb_sock_errqueue_msg m;
+			int nr = neb_sock_inet_recv_errqueue(cfd, &m);
+			if (nr < 0) {
+				ret = -1;
+				goto exit_clean;
+			}
+			if (nr == 0)
+				break;
+			switch (m.type) {
+			case NEB_SOCK_ERRQUEUE_TSTAMP:
+				if (m.tstamp.type != NEB_SOCK_TSTAMP_TYPE_SND || m.tstamp.id != (uint32_t)tstamp_count ||
+				    !(m.tstamp.flags & NEB_SOCK_TSTAMP_TX_SOFTWARE)) {
+					fprintf(stderr, "invalid tx timestamp: id %u, flags %#x\n", m.tstamp.id, m.tstamp.flags);
+					ret = -1;
+					goto exit_clean;
+				}
+				tstamp_count++;
+				break;
+			case NEB_SOCK_ERRQUEUE_ZEROCOPY:
+				if (m.zc.lo != zc_next || m.zc.hi < m.zc.lo) {
+					fprintf(stderr, "invalid zerocopy range [%u, %u]\n", m.zc.lo, m.zc.hi);
+					ret = -1;
+					goto exit_clean;
+				}
+				zc_next = m.zc.hi + 1;
+				zc_count++;
+				break;
+			default:
+				other_count++;
+				break;
+			}
+		}
+	}
+
+	fprintf(stdout, "tstamp %d, zerocopy %d covering %u, other %d\n", tstamp_count, zc_count, zc_next, other_count);
+	if (other_count)
+		ret = -1;
+
+exit_clean:
+	if (cfd >= 0)
+		close(cfd);
+	if (sfd >= 0)
+		close(sfd);
+	return ret;
+}
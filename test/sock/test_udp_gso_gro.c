@@ -0,0 +1,161 @@
+
+/*
+ * Datagrams sent by udp gso should be received in order after splitting the
+ * gro coalesced buffers, in fewer recv calls than datagrams if gro works.
+ */
+
+#include <nebase/sock/inet.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SEG_SIZE 1000
+#define SEG_PER_SEND 40
+#define SEND_NUM 4
+#define SEG_NUM (SEG_PER_SEND * SEND_NUM)
+
+struct recv_ctx {
+	unsigned int segsize;
+	uint32_t next;
+	int bad;
+};
+
+static int cmsg_cb(int level, int type, const u_char *data, size_t len, void *udata)
+{
+	struct recv_ctx *ctx = udata;
+	if (level == NEB_CMSG_LEVEL_COMPAT && type == NEB_CMSG_TYPE_UDP_GRO_SEGSIZE && len == sizeof(unsigned int))
+		memcpy(&ctx->segsize, data, sizeof(unsigned int));
+	return 0;
+}
+
+static int seg_cb(const u_char *data, size_t len, void *udata)
+{
+	struct recv_ctx *ctx = udata;
+	uint32_t idx;
+	if (len != SEG_SIZE) {
+		ctx->bad = 1;
+		return -1;
+	}
+	memcpy(&idx, data, sizeof(idx));
+	if (idx != ctx->next) {
+		ctx->bad = 1;
+		return -1;
+	}
+	ctx->next++;
+	return 0;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int sfd = -1, cfd = -1;
+
+	struct sockaddr_in saddr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(saddr);
+
+	sfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	cfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	if (sfd == -1 || cfd == -1) {
+		fprintf(stderr, "failed to create sockets\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (bind(sfd, (struct sockaddr *)&saddr, len) == -1 || getsockname(sfd, (struct sockaddr *)&saddr, &len) == -1) {
+		perror("bind");
+		ret = -1;
+		goto exit_clean;
+	}
+	int rcvbuf = 4 * 1024 * 1024;
+	if (setsockopt(sfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == -1) {
+		perror("setsockopt(SO_RCVBUF)");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_sock_inet_set_udp_gso(cfd, SEG_SIZE) != 0 || neb_sock_inet_enable_udp_gro(sfd) != 0) {
+		if (errno == ENOTSUP) {
+			fprintf(stdout, "udp gso/gro is not supported, skip\n");
+			goto exit_clean;
+		}
+		fprintf(stderr, "failed to enable udp gso/gro\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	static u_char wbuf[SEND_NUM][SEG_SIZE * SEG_PER_SEND];
+	struct iovec wiov[SEND_NUM];
+	struct neb_sock_mmsghdr wmsgs[SEND_NUM];
+	for (int i = 0; i < SEND_NUM; i++) {
+		for (int j = 0; j < SEG_PER_SEND; j++) {
+			uint32_t idx = i * SEG_PER_SEND + j;
+			memset(wbuf[i] + j * SEG_SIZE, 0, SEG_SIZE);
+			memcpy(wbuf[i] + j * SEG_SIZE, &idx, sizeof(idx));
+		}
+		wiov[i].iov_base = wbuf[i];
+		wiov[i].iov_len = sizeof(wbuf[i]);
+		memset(&wmsgs[i], 0, sizeof(wmsgs[i]));
+		wmsgs[i].msg_hdr.msg_peer = (struct sockaddr *)&saddr;
+		wmsgs[i].msg_hdr.msg_iov = &wiov[i];
+		wmsgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int nw = neb_sock_inet_sendmmsg(cfd, wmsgs, SEND_NUM);
+	if (nw != SEND_NUM) {
+		fprintf(stderr, "sendmmsg: sent %d/%d\n", nw, SEND_NUM);
+		ret = -1;
+		goto exit_clean;
+	}
+
+	static u_char rbuf[65536];
+	struct recv_ctx ctx = {.segsize = 0, .next = 0, .bad = 0};
+	int calls = 0, coalesced = 0;
+	while (ctx.next < SEG_NUM) {
+		struct pollfd pfd = {.fd = sfd, .events = POLLIN};
+		if (poll(&pfd, 1, 500) != 1) {
+			fprintf(stderr, "timeout after %u segments\n", ctx.next);
+			ret = -1;
+			goto exit_clean;
+		}
+
+		struct sockaddr_in peer = {.sin_family = AF_INET};
+		struct iovec riov = {.iov_base = rbuf, .iov_len = sizeof(rbuf)};
+		struct neb_sock_msghdr rmsg = {
+			.msg_peer = (struct sockaddr *)&peer,
+			.msg_iov = &riov,
+			.msg_iovlen = 1,
+			.msg_control_cb = cmsg_cb,
+			.msg_udata = &ctx,
+		};
+		ctx.segsize = 0;
+		ssize_t nr = neb_sock_inet_recvmsg(sfd, &rmsg);
+		if (nr <= 0) {
+			fprintf(stderr, "failed to recvmsg\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		calls++;
+		if (ctx.segsize && (size_t)nr > ctx.segsize)
+			coalesced++;
+		if (neb_sock_inet_udp_gro_split(rbuf, nr, ctx.segsize, seg_cb, &ctx) != 0 || ctx.bad) {
+			fprintf(stderr, "invalid segment %u\n", ctx.next);
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	fprintf(stdout, "received %u segments in %d calls, %d coalesced\n", ctx.next, calls, coalesced);
+
+exit_clean:
+	if (sfd >= 0)
+		close(sfd);
+	if (cfd >= 0)
+		close(cfd);
+	return ret;
+}
@@ -0,0 +1,160 @@
+
+/*
+ * A batch of udp datagrams sent by sendmmsg should be received by recvmmsg,
+ * with the right peer, data and timestamp of each message.
+ */
+
+#include <nebase/sock/inet.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_NUM 48
+#define RECV_BATCH 16
+
+struct msg_info {
+	int has_ts;
+	int ended;
+};
+
+static int cmsg_cb(int level, int type, const u_char *data _nattr_unused, size_t len, void *udata)
+{
+	struct msg_info *info = udata;
+	if (level != NEB_CMSG_LEVEL_COMPAT)
+		return 0;
+	switch (type) {
+	case NEB_CMSG_TYPE_TIMESTAMP:
+		if (len == sizeof(struct timespec))
+			info->has_ts = 1;
+		break;
+	case NEB_CMSG_TYPE_LOOP_END:
+		info->ended = 1;
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int sfd = -1, cfd = -1;
+
+	struct sockaddr_in saddr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(saddr);
+
+	sfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	cfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	if (sfd == -1 || cfd == -1) {
+		fprintf(stderr, "failed to create sockets\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (bind(sfd, (struct sockaddr *)&saddr, len) == -1 || getsockname(sfd, (struct sockaddr *)&saddr, &len) == -1) {
+		perror("bind");
+		ret = -1;
+		goto exit_clean;
+	}
+	struct sockaddr_in caddr = saddr;
+	caddr.sin_port = 0;
+	len = sizeof(caddr);
+	if (bind(cfd, (struct sockaddr *)&caddr, len) == -1 || getsockname(cfd, (struct sockaddr *)&caddr, &len) == -1) {
+		perror("bind");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_sock_inet_enable_recv_time(sfd) != 0) {
+		fprintf(stderr, "failed to enable recv time\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	uint32_t wdata[MSG_NUM];
+	struct iovec wiov[MSG_NUM];
+	struct neb_sock_mmsghdr wmsgs[MSG_NUM];
+	for (int i = 0; i < MSG_NUM; i++) {
+		wdata[i] = i;
+		wiov[i].iov_base = &wdata[i];
+		wiov[i].iov_len = sizeof(wdata[i]);
+		memset(&wmsgs[i], 0, sizeof(wmsgs[i]));
+		wmsgs[i].msg_hdr.msg_peer = (struct sockaddr *)&saddr;
+		wmsgs[i].msg_hdr.msg_iov = &wiov[i];
+		wmsgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int nw = neb_sock_inet_sendmmsg(cfd, wmsgs, MSG_NUM);
+	if (nw != MSG_NUM) {
+		fprintf(stderr, "sendmmsg: sent %d/%d\n", nw, MSG_NUM);
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < MSG_NUM; i++) {
+		if (wmsgs[i].msg_len != sizeof(uint32_t)) {
+			fprintf(stderr, "invalid sent len %zu for msg %d\n", wmsgs[i].msg_len, i);
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	int received = 0, calls = 0;
+	while (received < MSG_NUM) {
+		struct pollfd pfd = {.fd = sfd, .events = POLLIN};
+		if (poll(&pfd, 1, 500) != 1) {
+			fprintf(stderr, "timeout after %d messages\n", received);
+			ret = -1;
+			goto exit_clean;
+		}
+
+		uint32_t rdata[RECV_BATCH];
+		struct iovec riov[RECV_BATCH];
+		struct sockaddr_in peers[RECV_BATCH];
+		struct msg_info infos[RECV_BATCH];
+		struct neb_sock_mmsghdr rmsgs[RECV_BATCH];
+		for (int i = 0; i < RECV_BATCH; i++) {
+			riov[i].iov_base = &rdata[i];
+			riov[i].iov_len = sizeof(rdata[i]);
+			peers[i].sin_family = AF_INET;
+			memset(&infos[i], 0, sizeof(infos[i]));
+			rmsgs[i].msg_hdr.msg_peer = (struct sockaddr *)&peers[i];
+			rmsgs[i].msg_hdr.msg_iov = &riov[i];
+			rmsgs[i].msg_hdr.msg_iovlen = 1;
+			rmsgs[i].msg_hdr.msg_control_cb = cmsg_cb;
+			rmsgs[i].msg_hdr.msg_udata = &infos[i];
+			rmsgs[i].msg_len = 0;
+		}
+		int nr = neb_sock_inet_recvmmsg(sfd, rmsgs, RECV_BATCH);
+		if (nr < 0) {
+			fprintf(stderr, "failed to recvmmsg\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		calls++;
+		for (int i = 0; i < nr; i++) {
+			if (rmsgs[i].msg_len != sizeof(uint32_t) || rdata[i] != (uint32_t)(received + i) ||
+			    peers[i].sin_port != caddr.sin_port || !infos[i].has_ts || !infos[i].ended) {
+				fprintf(stderr, "invalid message %d\n", received + i);
+				ret = -1;
+				goto exit_clean;
+			}
+		}
+		received += nr;
+	}
+
+	fprintf(stdout, "received %d messages in %d calls\n", received, calls);
+	if (calls < MSG_NUM / RECV_BATCH)
+		ret = -1;
+
+exit_clean:
+	if (sfd >= 0)
+		close(sfd);
+	if (cfd >= 0)
+		close(cfd);
+	return ret;
+}
@@ -0,0 +1,163 @@
+
+/*
+ * With more ancillary data enabled than the recvmmsg cmsg buffer could hold,
+ * every message should still be received, with the truncation reported by
+ * the cmsg callback instead of failing the whole batch.
+ */
+
+#include <nebase/sock/inet.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_NUM 8
+
+struct msg_info {
+	int ctrunc;
+	int ended;
+};
+
+static int cmsg_cb(int level, int type, const u_char *data _nattr_unused, size_t len _nattr_unused, void *udata)
+{
+	struct msg_info *info = udata;
+	if (level != NEB_CMSG_LEVEL_COMPAT)
+		return 0;
+	switch (type) {
+	case NEB_CMSG_TYPE_CTRUNC:
+		info->ctrunc = 1;
+		break;
+	case NEB_CMSG_TYPE_LOOP_END:
+		info->ended = 1;
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static int enable_more_cmsg(int fd)
+{
+	static const int opts[][2] = {
+		{IPPROTO_IPV6, IPV6_RECVPKTINFO},
+		{IPPROTO_IPV6, IPV6_RECVHOPLIMIT},
+		{IPPROTO_IPV6, IPV6_RECVTCLASS},
+#ifdef IPV6_2292PKTINFO
+		{IPPROTO_IPV6, IPV6_2292PKTINFO},
+#endif
+#ifdef IPV6_2292HOPLIMIT
+		{IPPROTO_IPV6, IPV6_2292HOPLIMIT},
+#endif
+#ifdef IPV6_RECVORIGDSTADDR
+		{IPPROTO_IPV6, IPV6_RECVORIGDSTADDR},
+#endif
+	};
+	int on = 1;
+	for (size_t i = 0; i < sizeof(opts) / sizeof(opts[0]); i++) {
+		if (setsockopt(fd, opts[i][0], opts[i][1], &on, sizeof(on)) == -1) {
+			perror("setsockopt");
+			return -1;
+		}
+	}
+	return neb_sock_inet_enable_timestamping(fd, NEB_SOCK_TSTAMP_RX_SOFTWARE);
+}
+
+int main(void)
+{
+	int ret = 0;
+	int sfd = -1, cfd = -1;
+
+	struct sockaddr_in6 saddr = {
+		.sin6_family = AF_INET6,
+		.sin6_addr = IN6ADDR_LOOPBACK_INIT,
+	};
+	socklen_t len = sizeof(saddr);
+
+	sfd = neb_sock_inet_new(AF_INET6, SOCK_DGRAM, 0);
+	cfd = neb_sock_inet_new(AF_INET6, SOCK_DGRAM, 0);
+	if (sfd == -1 || cfd == -1) {
+		fprintf(stdout, "ipv6 is not available, skip\n");
+		goto exit_clean;
+	}
+	if (bind(sfd, (struct sockaddr *)&saddr, len) == -1 || getsockname(sfd, (struct sockaddr *)&saddr, &len) == -1) {
+		if (errno == EADDRNOTAVAIL) {
+			fprintf(stdout, "ipv6 loopback is not available, skip\n");
+			goto exit_clean;
+		}
+		perror("bind");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (enable_more_cmsg(sfd) != 0) {
+		fprintf(stderr, "failed to enable cmsg options\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	for (uint32_t i = 0; i < MSG_NUM; i++) {
+		if (sendto(cfd, &i, sizeof(i), 0, (struct sockaddr *)&saddr, len) != sizeof(i)) {
+			perror("sendto");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	int received = 0, ctrunc_count = 0;
+	while (received < MSG_NUM) {
+		struct pollfd pfd = {.fd = sfd, .events = POLLIN};
+		if (poll(&pfd, 1, 500) != 1) {
+			fprintf(stderr, "timeout after %d messages\n", received);
+			ret = -1;
+			goto exit_clean;
+		}
+
+		uint32_t rdata[MSG_NUM];
+		struct iovec riov[MSG_NUM];
+		struct sockaddr_in6 peers[MSG_NUM];
+		struct msg_info infos[MSG_NUM];
+		struct neb_sock_mmsghdr rmsgs[MSG_NUM];
+		for (int i = 0; i < MSG_NUM; i++) {
+			riov[i].iov_base = &rdata[i];
+			riov[i].iov_len = sizeof(rdata[i]);
+			peers[i].sin6_family = AF_INET6;
+			memset(&infos[i], 0, sizeof(infos[i]));
+			rmsgs[i].msg_hdr.msg_peer = (struct sockaddr *)&peers[i];
+			rmsgs[i].msg_hdr.msg_iov = &riov[i];
+			rmsgs[i].msg_hdr.msg_iovlen = 1;
+			rmsgs[i].msg_hdr.msg_control_cb = cmsg_cb;
+			rmsgs[i].msg_hdr.msg_udata = &infos[i];
+			rmsgs[i].msg_len = 0;
+		}
+		int nr = neb_sock_inet_recvmmsg(sfd, rmsgs, MSG_NUM - received);
+		if (nr <= 0) {
+			fprintf(stderr, "failed to recvmmsg after %d messages\n", received);
+			ret = -1;
+			goto exit_clean;
+		}
+		for (int i = 0; i < nr; i++) {
+			if (rmsgs[i].msg_len != sizeof(uint32_t) || rdata[i] != (uint32_t)(received + i) || !infos[i].ended) {
+				fprintf(stderr, "invalid message %d\n", received + i);
+				ret = -1;
+				goto exit_clean;
+			}
+			if (infos[i].ctrunc)
+				ctrunc_count++;
+		}
+		received += nr;
+	}
+
+	fprintf(stdout, "received %d messages, %d with cmsg truncated\n", received, ctrunc_count);
+	if (!ctrunc_count)
+		fprintf(stdout, "cmsg is not truncated by this kernel, skip\n");
+
+exit_clean:
+	if (sfd >= 0)
+		close(sfd);
+	if (cfd >= 0)
+		close(cfd);
+	return ret;
+}
@@ -0,0 +1,236 @@
+
+/*
+ * The fixed layout receive should decode timestamp, ifindex, destination
+ * address, ttl and gro segment size, for both single and batch receive.
+ */
+
+#include <nebase/sock/inet.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_NUM 8
+#define SEND_TTL 33
+#define SEG_SIZE 100
+
+static const unsigned int info_flags = NEB_SOCK_PKTINFO_TIMESTAMP | NEB_SOCK_PKTINFO_IFINDEX |
+                                       NEB_SOCK_PKTINFO_DSTADDR | NEB_SOCK_PKTINFO_TTL;
+
+static int wait_readable(int fd)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	if (poll(&pfd, 1, 500) != 1) {
+		fprintf(stderr, "timeout\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int check_info(int family, const struct neb_sock_pktinfo *info, unsigned int lo_index)
+{
+	if ((info->flags & info_flags) != info_flags) {
+		fprintf(stderr, "missing fields, flags %#x\n", info->flags);
+		return -1;
+	}
+	if (info->ts.tv_sec == 0 || info->ifindex != lo_index || info->ttl != SEND_TTL) {
+		fprintf(stderr, "invalid ts %lld, ifindex %u, ttl %d\n", (long long)info->ts.tv_sec, info->ifindex, info->ttl);
+		return -1;
+	}
+	if (family == AF_INET) {
+		if (info->dst_addr.v4.s_addr != htonl(INADDR_LOOPBACK)) {
+			fprintf(stderr, "invalid dst addr\n");
+			return -1;
+		}
+	} else {
+		if (memcmp(&info->dst_addr.v6, &in6addr_loopback, sizeof(struct in6_addr)) != 0) {
+			fprintf(stderr, "invalid dst addr\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int test_family(int family)
+{
+	int ret = 0;
+	int sfd = -1, cfd = -1;
+	unsigned int lo_index = if_nametoindex("lo");
+
+	struct sockaddr_storage saddr = NEB_STRUCT_INITIALIZER;
+	socklen_t len;
+	if (family == AF_INET) {
+		struct sockaddr_in *a = (struct sockaddr_in *)&saddr;
+		a->sin_family = AF_INET;
+		a->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		len = sizeof(struct sockaddr_in);
+	} else {
+		struct sockaddr_in6 *a = (struct sockaddr_in6 *)&saddr;
+		a->sin6_family = AF_INET6;
+		a->sin6_addr = in6addr_loopback;
+		len = sizeof(struct sockaddr_in6);
+	}
+
+	sfd = neb_sock_inet_new(family, SOCK_DGRAM, 0);
+	cfd = neb_sock_inet_new(family, SOCK_DGRAM, 0);
+	if (sfd == -1 || cfd == -1) {
+		if (family == AF_INET6 && errno == EAFNOSUPPORT) {
+			fprintf(stdout, "ipv6 is not supported, skip\n");
+			goto exit_clean;
+		}
+		fprintf(stderr, "failed to create sockets\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (bind(sfd, (struct sockaddr *)&saddr, len) == -1 || getsockname(sfd, (struct sockaddr *)&saddr, &len) == -1) {
+		perror("bind");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_sock_inet_enable_pktinfo(sfd, family, info_flags) != 0) {
+		fprintf(stderr, "failed to enable pktinfo\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	int ttl = SEND_TTL;
+	if (family == AF_INET) {
+		if (setsockopt(cfd, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl)) == -1) {
+			perror("setsockopt(IP_TTL)");
+			ret = -1;
+			goto exit_clean;
+		}
+	} else {
+		if (setsockopt(cfd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl)) == -1) {
+			perror("setsockopt(IPV6_UNICAST_HOPS)");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	for (int i = 0; i < MSG_NUM + 1; i++) {
+		if (sendto(cfd, &i, sizeof(i), 0, (struct sockaddr *)&saddr, len) != sizeof(i)) {
+			perror("sendto");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	// single
+	struct sockaddr_storage peer;
+	int data;
+	struct iovec iov = {.iov_base = &data, .iov_len = sizeof(data)};
+	struct neb_sock_msghdr msg = {
+		.msg_peer = (struct sockaddr *)&peer,
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+	peer.ss_family = family;
+	struct neb_sock_pktinfo info;
+	if (wait_readable(sfd) != 0 || neb_sock_inet_recvmsg_pktinfo(sfd, &msg, info_flags, &info) != sizeof(data) ||
+	    data != 0 || check_info(family, &info, lo_index) != 0) {
+		fprintf(stderr, "failed to recv single message\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	// batch
+	int received = 1;
+	while (received < MSG_NUM + 1) {
+		int datas[MSG_NUM];
+		struct iovec iovs[MSG_NUM];
+		struct sockaddr_storage peers[MSG_NUM];
+		struct neb_sock_mmsghdr msgs[MSG_NUM];
+		struct neb_sock_pktinfo infos[MSG_NUM];
+		for (int i = 0; i < MSG_NUM; i++) {
+			iovs[i].iov_base = &datas[i];
+			iovs[i].iov_len = sizeof(datas[i]);
+			peers[i].ss_family = family;
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_peer = (struct sockaddr *)&peers[i];
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		if (wait_readable(sfd) != 0) {
+			ret = -1;
+			goto exit_clean;
+		}
+		int n = neb_sock_inet_recvmmsg_pktinfo(sfd, msgs, MSG_NUM, info_flags, infos);
+		if (n < 0) {
+			fprintf(stderr, "failed to recv batch messages\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		for (int i = 0; i < n; i++) {
+			if (msgs[i].msg_len != sizeof(int) || datas[i] != received + i || check_info(family, &infos[i], lo_index) != 0) {
+				fprintf(stderr, "invalid batch message %d\n", received + i);
+				ret = -1;
+				goto exit_clean;
+			}
+		}
+		received += n;
+	}
+
+	// gro
+	if (family == AF_INET) {
+		if (neb_sock_inet_enable_pktinfo(sfd, family, NEB_SOCK_PKTINFO_GRO) != 0 ||
+		    neb_sock_inet_set_udp_gso(cfd, SEG_SIZE) != 0) {
+			if (errno == ENOTSUP) {
+				fprintf(stdout, "udp gro is not supported, skip\n");
+				goto exit_clean;
+			}
+			fprintf(stderr, "failed to enable gso/gro\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		char wbuf[SEG_SIZE * 4] = NEB_STRUCT_INITIALIZER;
+		if (sendto(cfd, wbuf, sizeof(wbuf), 0, (struct sockaddr *)&saddr, len) != sizeof(wbuf)) {
+			perror("sendto");
+			ret = -1;
+			goto exit_clean;
+		}
+		char rbuf[sizeof(wbuf)];
+		iov.iov_base = rbuf;
+		iov.iov_len = sizeof(rbuf);
+		ssize_t nr;
+		if (wait_readable(sfd) != 0 ||
+		    (nr = neb_sock_inet_recvmsg_pktinfo(sfd, &msg, info_flags | NEB_SOCK_PKTINFO_GRO, &info)) <= 0) {
+			fprintf(stderr, "failed to recv gro message\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (nr > SEG_SIZE && (!(info.flags & NEB_SOCK_PKTINFO_GRO) || info.gro_segsize != SEG_SIZE)) {
+			fprintf(stderr, "invalid gro segsize\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		fprintf(stdout, "gro: received %zd with segsize %u\n", nr, info.gro_segsize);
+	}
+
+	fprintf(stdout, "family %d: received %d messages\n", family, received);
+
+exit_clean:
+	if (sfd >= 0)
+		close(sfd);
+	if (cfd >= 0)
+		close(cfd);
+	return ret;
+}
+
+int main(void)
+{
+	int ret = 0;
+	if (test_family(AF_INET) != 0) {
+		fprintf(stderr, "ipv4 test failed\n");
+		ret = -1;
+	}
+	if (test_family(AF_INET6) != 0) {
+		fprintf(stderr, "ipv6 test failed\n");
+		ret = -1;
+	}
+	return ret;
+}
@@ -0,0 +1,250 @@
+
+/*
+ * The tx software timestamps should be read from the error queue in the evdp
+ * error handler, be matched to the sent datagrams by id, and be earlier than
+ * the rx software timestamps got through cmsg by the receiver.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/base.h>
+#include <nebase/sock/inet.h>
+#include <nebase/events.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MSG_NUM 8
+
+static int sfd = -1, cfd = -1;
+static struct timespec rx_ts[MSG_NUM];
+static struct timespec tx_ts[MSG_NUM];
+static int rx_count = 0, tx_count = 0, echo_count = 0;
+static int failed = 0, timeout = 0;
+
+static int ts_before(const struct timespec *a, const struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec)
+		return a->tv_sec < b->tv_sec;
+	return a->tv_nsec <= b->tv_nsec;
+}
+
+struct rx_data {
+	struct timespec ts;
+	int got;
+};
+
+static int parse_cmsg(int level, int type, const u_char *data, size_t len _nattr_unused, void *udata)
+{
+	struct rx_data *d = udata;
+	if (level == NEB_CMSG_LEVEL_COMPAT && type == NEB_CMSG_TYPE_TIMESTAMP) {
+		memcpy(&d->ts, data, sizeof(struct timespec));
+		d->got = 1;
+	}
+	return 0;
+}
+
+static int server_echo(void)
+{
+	for (int i = 0; i < MSG_NUM; i++) {
+		struct pollfd pfd = {.fd = sfd, .events = POLLIN};
+		if (poll(&pfd, 1, 500) != 1) {
+			fprintf(stderr, "timeout to recv msg %d\n", i);
+			return -1;
+		}
+
+		char buf[16];
+		struct sockaddr_in peer = {.sin_family = AF_INET};
+		struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf)};
+		struct rx_data d = NEB_STRUCT_INITIALIZER;
+		struct neb_sock_msghdr m = {
+			.msg_peer = (struct sockaddr *)&peer,
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control_cb = parse_cmsg,
+			.msg_udata = &d,
+		};
+		ssize_t nr = neb_sock_inet_recvmsg(sfd, &m);
+		if (nr != 1 || buf[0] != i || !d.got) {
+			fprintf(stderr, "invalid msg %d: nr %zd, rx timestamp %d\n", i, nr, d.got);
+			return -1;
+		}
+		rx_ts[i] = d.ts;
+		rx_count++;
+		if (sendto(sfd, buf, 1, 0, (struct sockaddr *)&peer, sizeof(peer)) != 1) {
+			perror("sendto");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static neb_evdp_cb_ret_t error_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	for (;;) {
+		struct neb_sock_tx_tstamp t;
+		int ret = neb_sock_inet_recv_tx_timestamp(fd, &t);
+		if (ret < 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		if (ret == 0)
+			break;
+		if (t.type != NEB_SOCK_TSTAMP_TYPE_SND)
+			continue;
+		if (t.id >= MSG_NUM || !(t.flags & NEB_SOCK_TSTAMP_TX_SOFTWARE) || tx_ts[t.id].tv_sec) {
+			fprintf(stderr, "invalid tx timestamp: id %u, flags %#x\n", t.id, t.flags);
+			failed = 1;
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		tx_ts[t.id] = t.sw;
+		tx_count++;
+	}
+	if (tx_count == MSG_NUM && echo_count == MSG_NUM)
+		thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char buf[16];
+	for (;;) {
+		ssize_t nr = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (nr == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			perror("recv");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		echo_count++;
+	}
+	if (tx_count == MSG_NUM && echo_count == MSG_NUM)
+		thread_events |= T_E_QUIT;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t wakeup_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	fprintf(stdout, "timeout occured\n");
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t cs = NULL, dst = NULL;
+
+	struct sockaddr_in saddr = NEB_STRUCT_INITIALIZER;
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(saddr);
+
+	sfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	cfd = neb_sock_inet_new(AF_INET, SOCK_DGRAM, 0);
+	if (sfd == -1 || cfd == -1) {
+		fprintf(stderr, "failed to create sockets\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (bind(sfd, (struct sockaddr *)&saddr, len) == -1 || getsockname(sfd, (struct sockaddr *)&saddr, &len) == -1 ||
+	    connect(cfd, (struct sockaddr *)&saddr, len) == -1) {
+		perror("bind/connect");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_sock_inet_enable_timestamping(sfd, NEB_SOCK_TSTAMP_RX_SOFTWARE) != 0 ||
+	    neb_sock_inet_enable_timestamping(cfd, NEB_SOCK_TSTAMP_TX_SOFTWARE | NEB_SOCK_TSTAMP_TX_HARDWARE) != 0) {
+		if (errno == ENOTSUP) {
+			fprintf(stdout, "timestamping is not supported, skip\n");
+			goto exit_clean;
+		}
+		fprintf(stderr, "failed to enable timestamping\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	cs = neb_evdp_source_new_os_fd(cfd, hup_handler);
+	if (!cs) {
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_source_os_fd_set_error(cs, error_handler);
+	if (neb_evdp_source_os_fd_next_read(cs, read_handler) != 0 || neb_evdp_queue_attach(dq, cs) != 0) {
+		fprintf(stderr, "failed to add os_fd source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	dst = neb_evdp_source_new_itimer_ms(1, 500, wakeup_handler);
+	if (!dst || neb_evdp_queue_attach(dq, dst) != 0) {
+		fprintf(stderr, "failed to add itimer_ms source to queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	for (char i = 0; i < MSG_NUM; i++) {
+		if (send(cfd, &i, 1, 0) != 1) {
+			perror("send");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+	if (server_echo() != 0) {
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run evdp queue\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	fprintf(stdout, "rx %d, tx %d, echo %d\n", rx_count, tx_count, echo_count);
+	if (timeout || failed || tx_count != MSG_NUM || echo_count != MSG_NUM) {
+		ret = -1;
+		goto exit_clean;
+	}
+	for (int i = 0; i < MSG_NUM; i++) {
+		if (!ts_before(&tx_ts[i], &rx_ts[i])) {
+			fprintf(stderr, "tx timestamp of msg %d is later than rx\n", i);
+			ret = -1;
+			goto exit_clean;
+		}
+		fprintf(stdout, "msg %d: tx -> rx %ldns\n", i,
+		        (long)((rx_ts[i].tv_sec - tx_ts[i].tv_sec) * 1000000000L + rx_ts[i].tv_nsec - tx_ts[i].tv_nsec));
+	}
+
+exit_clean:
+	if (dst) {
+		if (neb_evdp_source_get_queue(dst) && neb_evdp_queue_detach(dq, dst, 0) != 0)
+			fprintf(stderr, "failed to detach dst\n");
+		neb_evdp_source_del(dst);
+	}
+	if (cs) {
+		if (neb_evdp_source_get_queue(cs) && neb_evdp_queue_detach(dq, cs, 0) != 0)
+			fprintf(stderr, "failed to detach cs\n");
+		neb_evdp_source_del(cs);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+	if (cfd >= 0)
+		close(cfd);
+	if (sfd >= 0)
+		close(sfd);
+	return ret;
+}
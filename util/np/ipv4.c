@@ -3,6 +3,7 @@
 #include <nebase/evdp/helper.h>
 #include <nebase/sock/raw.h>
 #include <nebase/sock/inet.h>
+#include <nebase/sock/filter.h>
 #include <nebase/time.h>
 
 #include "ipv4.h"
@@ -138,6 +139,13 @@ int np_ipv4_init(neb_evdp_queue_t q)
 		close(ipv4_raw_fd);
 		return -1;
 	}
+	neb_sock_filter_t filter = neb_sock_filter_create(AF_INET);
+	if (filter) { // drop other icmp packets in kernel if supported
+		if (neb_sock_filter_icmp_type(filter, ICMP_ECHOREPLY) != 0 ||
+		    neb_sock_filter_attach(filter, ipv4_raw_fd) != 0)
+			fprintf(stderr, "failed to attach icmp filter, filter in userspace\n");
+		neb_sock_filter_destroy(filter);
+	}
 
 	neb_evdp_source_t s = neb_evdp_source_new_ro_fd(ipv4_raw_fd, on_recv, neb_evdp_sock_log_on_hup);
 	if (!s) {